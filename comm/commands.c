@@ -52,6 +52,7 @@
 #include "bms.h"
 #include "qmlui.h"
 #include "crc.h"
+#include "delta_patch.h"
 #ifdef USE_LISPBM
 #include "lispif.h"
 #endif
@@ -65,12 +66,17 @@
 
 // Settings
 #define PRINT_BUFFER_SIZE	400
+#define LZO_REPLY_MIN_LEN	64
 
 // Threads
 static THD_FUNCTION(blocking_thread, arg);
 static THD_WORKING_AREA(blocking_thread_wa, 3000);
 static thread_t *blocking_tp;
 
+// Private functions
+static void mcconf_prepare_new(mc_configuration *mcconf, volatile const mc_configuration *mcconf_old);
+static bool apply_conf_diff(uint8_t *buffer, int32_t buffer_len, uint8_t *diff, int32_t diff_len);
+
 // Private variables
 static char print_buffer[PRINT_BUFFER_SIZE];
 static uint8_t blocking_thread_cmd_buffer[PACKET_MAX_PL_LEN];
@@ -81,6 +87,7 @@ static void(* volatile send_func)(unsigned char *data, unsigned int len) = 0;
 static void(* volatile send_func_blocking)(unsigned char *data, unsigned int len) = 0;
 static void(* volatile send_func_nrf)(unsigned char *data, unsigned int len) = 0;
 static void(* volatile send_func_can_fwd)(unsigned char *data, unsigned int len) = 0;
+static void(* volatile send_func_lzo)(unsigned char *data, unsigned int len) = 0;
 static void(* volatile appdata_func)(unsigned char *data, unsigned int len) = 0;
 static void(* volatile hwdata_func)(unsigned char *data, unsigned int len) = 0;
 static disp_pos_mode display_position_mode;
@@ -179,6 +186,54 @@ void commands_unregister_reply_func(void(*reply_func)(unsigned char *data, unsig
 	if (send_func_can_fwd == reply_func) {
 		send_func_can_fwd = NULL;
 	}
+	if (send_func_lzo == reply_func) {
+		send_func_lzo = NULL;
+	}
+}
+
+/**
+ * Send a reply that can be large. If the client has enabled compressed replies
+ * on this interface with COMM_SET_LZO_REPLIES, the packet is compressed with
+ * LZO and wrapped in a COMM_LZO_PACKET when that makes it smaller.
+ *
+ * @param data
+ * The packet data.
+ *
+ * @param len
+ * The data length.
+ *
+ * @param reply_func
+ * The function to send the packet with.
+ */
+void commands_send_packet_lzo(unsigned char *data, unsigned int len,
+		void(*reply_func)(unsigned char *data, unsigned int len)) {
+	if (!reply_func) {
+		return;
+	}
+
+	if (reply_func != send_func_lzo || len < LZO_REPLY_MIN_LEN) {
+		reply_func(data, len);
+		return;
+	}
+
+	uint8_t *out;
+	unsigned int out_size;
+	void *wrkmem = mempools_get_lzo_work_mem(&out, &out_size);
+
+	int32_t ind = 0;
+	out[ind++] = COMM_LZO_PACKET;
+	buffer_append_uint16(out, len, &ind);
+
+	lzo_uint out_len = out_size - ind;
+	int res = lzo1x_1_compress(data, len, out + ind, &out_len, wrkmem);
+
+	if (res == LZO_E_OK && (out_len + ind) < len) {
+		reply_func(out, out_len + ind);
+	} else {
+		reply_func(data, len);
+	}
+
+	mempools_free_lzo_work_mem(wrkmem);
 }
 
 static void send_func_dummy(unsigned char *data, unsigned int len) {
@@ -381,6 +436,137 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		reply_func(send_buffer, ind);
 	} break;
 
+	case COMM_FW_STAGE_BEGIN_ALL_CAN:
+		if (nrf_driver_ext_nrf_running()) {
+			nrf_driver_pause(6000);
+		}
+
+		data[-1] = COMM_FW_STAGE_BEGIN;
+		comm_can_send_buffer(255, data - 1, len + 1, 2);
+		chThdSleepMilliseconds(1500);
+		/* Falls through. */
+		/* no break */
+	case COMM_FW_STAGE_BEGIN: {
+		int32_t ind = 0;
+		uint32_t size = buffer_get_uint32(data, &ind);
+		uint32_t chunk_size = buffer_get_uint16(data, &ind);
+		bool resume = data[ind++];
+
+		if (nrf_driver_ext_nrf_running()) {
+			nrf_driver_pause(6000);
+		}
+		uint16_t flash_res = flash_helper_stage_begin(size, chunk_size, resume);
+
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = COMM_FW_STAGE_BEGIN;
+		send_buffer[ind++] = flash_res == FLASH_COMPLETE ? 1 : 0;
+		buffer_append_uint16(send_buffer, flash_helper_stage_chunk_num(), &ind);
+		buffer_append_uint16(send_buffer, flash_helper_stage_chunks_done(), &ind);
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_FW_STAGE_STATUS: {
+		// Reply with the chunk completion bitmap, starting at the requested
+		// byte so that large bitmaps can be read in several packets.
+		int32_t ind = 0;
+		uint32_t first_byte = buffer_get_uint16(data, &ind);
+
+		ind = 0;
+		uint8_t send_buffer[80];
+		send_buffer[ind++] = COMM_FW_STAGE_STATUS;
+		send_buffer[ind++] = flash_helper_stage_active();
+		buffer_append_uint16(send_buffer, flash_helper_stage_chunk_num(), &ind);
+		buffer_append_uint16(send_buffer, flash_helper_stage_chunks_done(), &ind);
+		buffer_append_uint16(send_buffer, first_byte, &ind);
+		ind += flash_helper_stage_get_bitmap(first_byte, send_buffer + ind, sizeof(send_buffer) - ind);
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_FW_STAGE_VERIFY: {
+		int32_t ind = 0;
+		uint32_t crc_expected = buffer_get_uint32(data, &ind);
+		uint32_t crc = flash_helper_stage_crc();
+		uint32_t missing = flash_helper_stage_chunk_num() - flash_helper_stage_chunks_done();
+
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = COMM_FW_STAGE_VERIFY;
+		send_buffer[ind++] = flash_helper_stage_active() && missing == 0 && crc == crc_expected;
+		buffer_append_uint16(send_buffer, missing, &ind);
+		buffer_append_uint32(send_buffer, crc, &ind);
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_FW_DELTA_BEGIN: {
+		int32_t ind = 0;
+		uint32_t base_crc = buffer_get_uint32(data, &ind);
+		uint32_t out_size = buffer_get_uint32(data, &ind);
+
+		if (nrf_driver_ext_nrf_running()) {
+			nrf_driver_pause(6000);
+		}
+		uint16_t flash_res = flash_helper_delta_begin(base_crc, out_size);
+
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = COMM_FW_DELTA_BEGIN;
+		send_buffer[ind++] = flash_res == FLASH_COMPLETE ? 1 : 0;
+		buffer_append_uint32(send_buffer, flash_helper_app_crc(), &ind);
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_FW_DELTA_DATA_LZO:
+	case COMM_FW_DELTA_DATA: {
+		if (packet_id == COMM_FW_DELTA_DATA_LZO) {
+			uint8_t *send_buffer_global = mempools_get_packet_buffer();
+			memcpy(send_buffer_global, data + 6, len - 6);
+			int32_t ind = 4;
+			lzo_uint decompressed_len = buffer_get_uint16(data, &ind);
+			lzo1x_decompress_safe(send_buffer_global, len - 6, data + 4, &decompressed_len, NULL);
+			mempools_free_packet_buffer(send_buffer_global);
+			len = decompressed_len + 4;
+		}
+
+		int32_t ind = 0;
+		uint32_t out_pos = buffer_get_uint32(data, &ind);
+
+		if (nrf_driver_ext_nrf_running()) {
+			nrf_driver_pause(2000);
+		}
+		int res = flash_helper_delta_apply(out_pos, data + ind, len - ind);
+
+		SHUTDOWN_RESET();
+
+		// Reply with the current output position, so that the client knows
+		// where to continue in case packets were lost.
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = COMM_FW_DELTA_DATA;
+		send_buffer[ind++] = res == DELTA_PATCH_OK ? 1 : 0;
+		buffer_append_int16(send_buffer, res, &ind);
+		buffer_append_uint32(send_buffer, flash_helper_delta_pos(), &ind);
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_SET_LZO_REPLIES: {
+		// The client advertises that it can decode COMM_LZO_PACKET on the
+		// interface this command came in on.
+		bool enable = len > 0 && data[0];
+
+		if (enable) {
+			send_func_lzo = reply_func;
+		} else if (send_func_lzo == reply_func) {
+			send_func_lzo = NULL;
+		}
+
+		int32_t ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = COMM_SET_LZO_REPLIES;
+		send_buffer[ind++] = enable;
+		reply_func(send_buffer, ind);
+	} break;
+
 	case COMM_GET_VALUES:
 	case COMM_GET_VALUES_SELECTIVE: {
 		int32_t ind = 0;
@@ -544,33 +730,7 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		*mcconf = *mcconf_old;
 
 		if (confgenerator_deserialize_mcconf(data, mcconf)) {
-			utils_truncate_number(&mcconf->l_current_max_scale , 0.0, 1.0);
-			utils_truncate_number(&mcconf->l_current_min_scale , 0.0, 1.0);
-
-#if defined(HW_HAS_DUAL_MOTORS) & !defined(HW_SET_SINGLE_MOTOR)
-			mcconf->motor_type = MOTOR_TYPE_FOC;
-#endif
-
-			mcconf->lo_current_max = mcconf->l_current_max * mcconf->l_current_max_scale;
-			mcconf->lo_current_min = mcconf->l_current_min * mcconf->l_current_min_scale;
-			mcconf->lo_in_current_max = mcconf->l_in_current_max;
-			mcconf->lo_in_current_min = mcconf->l_in_current_min;
-
-			// Keep old offsets if writing offsets is disabled
-			if (!(mcconf->foc_offsets_cal_mode & (1 << 1))) {
-				mcconf->foc_offsets_current[0] = mcconf_old->foc_offsets_current[0];
-				mcconf->foc_offsets_current[1] = mcconf_old->foc_offsets_current[1];
-				mcconf->foc_offsets_current[2] = mcconf_old->foc_offsets_current[2];
-
-				mcconf->foc_offsets_voltage[0] = mcconf_old->foc_offsets_voltage[0];
-				mcconf->foc_offsets_voltage[1] = mcconf_old->foc_offsets_voltage[1];
-				mcconf->foc_offsets_voltage[2] = mcconf_old->foc_offsets_voltage[2];
-
-				mcconf->foc_offsets_voltage_undriven[0] = mcconf_old->foc_offsets_voltage_undriven[0];
-				mcconf->foc_offsets_voltage_undriven[1] = mcconf_old->foc_offsets_voltage_undriven[1];
-				mcconf->foc_offsets_voltage_undriven[2] = mcconf_old->foc_offsets_voltage_undriven[2];
-			}
-
+			mcconf_prepare_new(mcconf, mcconf_old);
 			commands_apply_mcconf_hw_limits(mcconf);
 			conf_general_store_mc_configuration(mcconf, mc_interface_get_motor_thread() == 2);
 			mc_interface_set_configuration(mcconf);
@@ -588,6 +748,121 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 #endif
 	} break;
 
+	case COMM_SET_MCCONF_DIFF: {
+#ifndef	HW_MCCONF_READ_ONLY
+		// Only the changed parameters are sent as (offset, length, bytes) into
+		// the serialized configuration. The new configuration is applied as
+		// with COMM_SET_MCCONF.
+		int32_t ind = 0;
+		uint32_t signature = buffer_get_uint32(data, &ind);
+		bool store = data[ind++];
+		bool forward_can = data[ind++];
+
+		bool ok = false;
+
+		if (signature == MCCONF_SIGNATURE) {
+			mc_configuration *mcconf = mempools_alloc_mcconf();
+			volatile const mc_configuration *mcconf_old = mc_interface_get_configuration();
+			*mcconf = *mcconf_old;
+
+			uint8_t *buffer = mempools_get_packet_buffer();
+			int32_t conf_len = confgenerator_serialize_mcconf(buffer, mcconf);
+
+			if (apply_conf_diff(buffer, conf_len, data + ind, len - ind) &&
+					confgenerator_deserialize_mcconf(buffer, mcconf)) {
+				mcconf_prepare_new(mcconf, mcconf_old);
+				ok = true;
+			}
+
+			mempools_free_packet_buffer(buffer);
+
+			if (ok) {
+				commands_apply_mcconf_hw_limits(mcconf);
+
+				if (store) {
+					conf_general_store_mc_configuration(mcconf, mc_interface_get_motor_thread() == 2);
+				}
+
+				mc_interface_set_configuration(mcconf);
+
+				if (store) {
+					chThdSleepMilliseconds(200);
+				}
+			}
+
+			mempools_free_mcconf(mcconf);
+		}
+
+		if (ok && forward_can) {
+			data[-1] = COMM_SET_MCCONF_DIFF;
+			data[5] = 0; // No more forward
+			comm_can_send_buffer(255, data - 1, len + 1, 2);
+		}
+
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = packet_id;
+		send_buffer[ind++] = ok;
+		reply_func(send_buffer, ind);
+#endif
+	} break;
+
+	case COMM_SET_APPCONF_DIFF: {
+#ifndef	HW_APPCONF_READ_ONLY
+		int32_t ind = 0;
+		uint32_t signature = buffer_get_uint32(data, &ind);
+		bool store = data[ind++];
+		bool forward_can = data[ind++];
+
+		bool ok = false;
+
+		if (signature == APPCONF_SIGNATURE) {
+			app_configuration *appconf = mempools_alloc_appconf();
+			*appconf = *app_get_configuration();
+
+			uint8_t *buffer = mempools_get_packet_buffer();
+			int32_t conf_len = confgenerator_serialize_appconf(buffer, appconf);
+
+			if (apply_conf_diff(buffer, conf_len, data + ind, len - ind) &&
+					confgenerator_deserialize_appconf(buffer, appconf)) {
+				ok = true;
+			}
+
+			mempools_free_packet_buffer(buffer);
+
+			if (ok) {
+#ifdef HW_HAS_DUAL_MOTORS
+				// Ignore ID when setting second motor config
+				if (mc_interface_get_motor_thread() == 2) {
+					appconf->controller_id = app_get_configuration()->controller_id;
+				}
+#endif
+
+				if (store) {
+					conf_general_store_app_configuration(appconf);
+				}
+
+				app_set_configuration(appconf);
+				timeout_configure(appconf->timeout_msec, appconf->timeout_brake_current, appconf->kill_sw_mode);
+			}
+
+			mempools_free_appconf(appconf);
+		}
+
+		if (ok && forward_can) {
+			data[-1] = COMM_SET_APPCONF_DIFF;
+			data[5] = 0; // No more forward
+			comm_can_send_buffer(255, data - 1, len + 1, 2);
+		}
+
+		ind = 0;
+		uint8_t send_buffer[50];
+		send_buffer[ind++] = packet_id;
+		send_buffer[ind++] = ok;
+		reply_func(send_buffer, ind);
+#endif
+	} break;
+
 	case COMM_GET_MCCONF:
 	case COMM_GET_MCCONF_DEFAULT: {
 		mc_configuration *mcconf = mempools_alloc_mcconf();
@@ -1348,7 +1623,7 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		buffer_append_int32(send_buffer_global, ofs_qml, &ind);
 		memcpy(send_buffer_global + ind, data_qml_hw + ofs_qml, len_qml);
 		ind += len_qml;
-		reply_func(send_buffer_global, ind);
+		commands_send_packet_lzo(send_buffer_global, ind, reply_func);
 
 		mempools_free_packet_buffer(send_buffer_global);
 #endif
@@ -1395,7 +1670,7 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		buffer_append_int32(send_buffer_global, ofs_qml, &ind);
 		memcpy(send_buffer_global + ind, qmlui_data + ofs_qml, len_qml);
 		ind += len_qml;
-		reply_func(send_buffer_global, ind);
+		commands_send_packet_lzo(send_buffer_global, ind, reply_func);
 		mempools_free_packet_buffer(send_buffer_global);
 	} break;
 
@@ -1571,6 +1846,7 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 
 	case COMM_LISP_SET_RUNNING:
 	case COMM_LISP_GET_STATS:
+	case COMM_LISP_GET_PROF:
 	case COMM_LISP_REPL_CMD:
 	case COMM_LISP_STREAM_CODE:
 	case COMM_LISP_RMSG: {
@@ -1853,11 +2129,7 @@ void commands_send_mcconf(COMM_PACKET_ID packet_id, mc_configuration* mcconf, vo
 	uint8_t *send_buffer_global = mempools_get_packet_buffer();
 	send_buffer_global[0] = packet_id;
 	int32_t len = confgenerator_serialize_mcconf(send_buffer_global + 1, mcconf);
-	if (reply_func) {
-		reply_func(send_buffer_global, len + 1);
-	} else {
-		commands_send_packet(send_buffer_global, len + 1);
-	}
+	commands_send_packet_lzo(send_buffer_global, len + 1, reply_func ? reply_func : send_func);
 	mempools_free_packet_buffer(send_buffer_global);
 }
 
@@ -1865,14 +2137,66 @@ void commands_send_appconf(COMM_PACKET_ID packet_id, app_configuration *appconf,
 	uint8_t *send_buffer_global = mempools_get_packet_buffer();
 	send_buffer_global[0] = packet_id;
 	int32_t len = confgenerator_serialize_appconf(send_buffer_global + 1, appconf);
-	if (reply_func) {
-		reply_func(send_buffer_global, len + 1);
-	} else {
-		commands_send_packet(send_buffer_global, len + 1);
-	}
+	commands_send_packet_lzo(send_buffer_global, len + 1, reply_func ? reply_func : send_func);
 	mempools_free_packet_buffer(send_buffer_global);
 }
 
+static void mcconf_prepare_new(mc_configuration *mcconf, volatile const mc_configuration *mcconf_old) {
+	utils_truncate_number(&mcconf->l_current_max_scale , 0.0, 1.0);
+	utils_truncate_number(&mcconf->l_current_min_scale , 0.0, 1.0);
+
+#if defined(HW_HAS_DUAL_MOTORS) & !defined(HW_SET_SINGLE_MOTOR)
+	mcconf->motor_type = MOTOR_TYPE_FOC;
+#endif
+
+	mcconf->lo_current_max = mcconf->l_current_max * mcconf->l_current_max_scale;
+	mcconf->lo_current_min = mcconf->l_current_min * mcconf->l_current_min_scale;
+	mcconf->lo_in_current_max = mcconf->l_in_current_max;
+	mcconf->lo_in_current_min = mcconf->l_in_current_min;
+
+	// Keep old offsets if writing offsets is disabled
+	if (!(mcconf->foc_offsets_cal_mode & (1 << 1))) {
+		mcconf->foc_offsets_current[0] = mcconf_old->foc_offsets_current[0];
+		mcconf->foc_offsets_current[1] = mcconf_old->foc_offsets_current[1];
+		mcconf->foc_offsets_current[2] = mcconf_old->foc_offsets_current[2];
+
+		mcconf->foc_offsets_voltage[0] = mcconf_old->foc_offsets_voltage[0];
+		mcconf->foc_offsets_voltage[1] = mcconf_old->foc_offsets_voltage[1];
+		mcconf->foc_offsets_voltage[2] = mcconf_old->foc_offsets_voltage[2];
+
+		mcconf->foc_offsets_voltage_undriven[0] = mcconf_old->foc_offsets_voltage_undriven[0];
+		mcconf->foc_offsets_voltage_undriven[1] = mcconf_old->foc_offsets_voltage_undriven[1];
+		mcconf->foc_offsets_voltage_undriven[2] = mcconf_old->foc_offsets_voltage_undriven[2];
+	}
+}
+
+/*
+ * Apply a configuration diff to a serialized configuration. The diff consists
+ * of entries with an offset (u16), a length (u8) and that many bytes.
+ */
+static bool apply_conf_diff(uint8_t *buffer, int32_t buffer_len, uint8_t *diff, int32_t diff_len) {
+	int32_t ind = 0;
+
+	while (ind < diff_len) {
+		if ((ind + 3) > diff_len) {
+			return false;
+		}
+
+		int32_t offset = buffer_get_uint16(diff, &ind);
+		int32_t len = diff[ind++];
+
+		// The signature cannot be changed
+		if (offset < 4 || (offset + len) > buffer_len || (ind + len) > diff_len) {
+			return false;
+		}
+
+		memcpy(buffer + offset, diff + ind, len);
+		ind += len;
+	}
+
+	return true;
+}
+
 inline static float hw_lim_upper(float l, float h) {(void)l; return h;}
 
 void commands_apply_mcconf_hw_limits(mc_configuration *mcconf) {
@@ -54,6 +54,8 @@
 #define EEPROM_BASE_CUSTOM		4000
 #define EEPROM_BASE_MCCONF_2	5000
 #define EEPROM_BASE_BACKUP		6000
+#define EEPROM_BASE_MC_LOCAL	7000
+#define EEPROM_BASE_MC_LOCAL_2	8000
 
 // Global variables
 uint16_t VirtAddVarTab[NB_OF_VAR];
@@ -63,6 +65,10 @@ __attribute__((section(".ram4"))) volatile backup_data g_backup;
 // Private functions
 static bool read_eeprom_var(eeprom_var *v, int address, uint16_t base);
 static bool store_eeprom_var(eeprom_var *v, int address, uint16_t base);
+static bool release_motors(int motor_old);
+static void unlock_motors(int motor_old);
+static bool write_eeprom_block(uint8_t *data, unsigned int len, unsigned int base);
+static unsigned mc_local_calc_crc(mc_local_configuration *conf);
 
 void conf_general_init(void) {
 	// First, make sure that all relevant virtual addresses are assigned for page swapping.
@@ -89,6 +95,14 @@ void conf_general_init(void) {
 		VirtAddVarTab[ind++] = EEPROM_BASE_BACKUP + i;
 	}
 
+	for (unsigned int i = 0;i < (sizeof(mc_local_configuration) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_MC_LOCAL + i;
+	}
+
+	for (unsigned int i = 0;i < (sizeof(mc_local_configuration) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_MC_LOCAL_2 + i;
+	}
+
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
@@ -172,6 +186,84 @@ bool conf_general_store_backup_data(void) {
 	return is_ok;
 }
 
+/*
+ * Release both motors and lock them while flash is written. Returns false,
+ * with the motors unlocked again, if they could not be released in time.
+ */
+static bool release_motors(int motor_old) {
+	mc_interface_select_motor_thread(1);
+	mc_interface_unlock();
+	mc_interface_release_motor();
+	mc_interface_lock();
+
+	if (!mc_interface_wait_for_motor_release(2.0)) {
+		mc_interface_unlock();
+		mc_interface_select_motor_thread(motor_old);
+		return false;
+	}
+
+	mc_interface_select_motor_thread(2);
+	mc_interface_unlock();
+	mc_interface_release_motor();
+	mc_interface_lock();
+
+	if (!mc_interface_wait_for_motor_release(2.0)) {
+		mc_interface_unlock();
+		mc_interface_select_motor_thread(motor_old);
+		return false;
+	}
+
+	utils_sys_lock_cnt();
+
+	return true;
+}
+
+static void unlock_motors(int motor_old) {
+	chThdSleepMilliseconds(100);
+
+	mc_interface_select_motor_thread(1);
+	mc_interface_unlock();
+	mc_interface_select_motor_thread(2);
+	mc_interface_unlock();
+
+	utils_sys_unlock_cnt();
+
+	mc_interface_select_motor_thread(motor_old);
+}
+
+static bool write_eeprom_block(uint8_t *data, unsigned int len, unsigned int base) {
+	timeout_configure_IWDT_slowest();
+
+	bool is_ok = true;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
+			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+	for (unsigned int i = 0;i < (len / 2);i++) {
+		uint16_t var = (data[2 * i] << 8) & 0xFF00;
+		var |= data[2 * i + 1] & 0xFF;
+
+		if (EE_WriteVariable(base + i, var) != FLASH_COMPLETE) {
+			is_ok = false;
+			break;
+		}
+	}
+	FLASH_Lock();
+
+	timeout_configure_IWDT();
+
+	return is_ok;
+}
+
+static unsigned mc_local_calc_crc(mc_local_configuration *conf) {
+	uint16_t crc_old = conf->crc;
+	conf->crc = 0;
+	unsigned crc_new = crc16((uint8_t*)conf, sizeof(mc_local_configuration));
+	conf->crc = crc_old;
+	return crc_new;
+}
+
 /**
  * Read hw-specific variable from emulated EEPROM.
  *
@@ -452,65 +544,91 @@ void conf_general_read_mc_configuration(mc_configuration *conf, bool is_motor_2)
 bool conf_general_store_mc_configuration(mc_configuration *conf, bool is_motor_2) {
 	int motor_old = mc_interface_get_motor_thread();
 
-	mc_interface_select_motor_thread(1);
-	mc_interface_unlock();
-	mc_interface_release_motor();
-	mc_interface_lock();
-
-	if (!mc_interface_wait_for_motor_release(2.0)) {
-		mc_interface_unlock();
-		mc_interface_select_motor_thread(motor_old);
+	if (!release_motors(motor_old)) {
 		return false;
 	}
 
-	mc_interface_select_motor_thread(2);
-	mc_interface_unlock();
-	mc_interface_release_motor();
-	mc_interface_lock();
+	conf->crc = mc_interface_calc_crc(conf, is_motor_2);
 
-	if (!mc_interface_wait_for_motor_release(2.0)) {
-		mc_interface_unlock();
-		mc_interface_select_motor_thread(motor_old);
-		return false;
-	}
+	bool is_ok = write_eeprom_block((uint8_t*)conf, sizeof(mc_configuration),
+			is_motor_2 ? EEPROM_BASE_MCCONF_2 : EEPROM_BASE_MCCONF);
 
-	utils_sys_lock_cnt();
+	unlock_motors(motor_old);
 
-	timeout_configure_IWDT_slowest();
+	return is_ok;
+}
 
+/**
+ * Read mc_local_configuration from EEPROM. If this fails, default values will be used.
+ *
+ * @param conf
+ * A pointer to a mc_local_configuration struct to write the read configuration to.
+ *
+ * @param is_motor_2
+ * true to read the configuration of motor 2.
+ */
+void conf_general_read_mc_local_configuration(mc_local_configuration *conf, bool is_motor_2) {
 	bool is_ok = true;
 	uint8_t *conf_addr = (uint8_t*)conf;
-	unsigned int base = is_motor_2 ? EEPROM_BASE_MCCONF_2 : EEPROM_BASE_MCCONF;
-
-	conf->crc = mc_interface_calc_crc(conf, is_motor_2);
-
-	FLASH_Unlock();
-	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
-			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
-
-	for (unsigned int i = 0;i < (sizeof(mc_configuration) / 2);i++) {
-		uint16_t var = (conf_addr[2 * i] << 8) & 0xFF00;
-		var |= conf_addr[2 * i + 1] & 0xFF;
+	uint16_t var;
+	unsigned int base = is_motor_2 ? EEPROM_BASE_MC_LOCAL_2 : EEPROM_BASE_MC_LOCAL;
 
-		if (EE_WriteVariable(base + i, var) != FLASH_COMPLETE) {
+	for (unsigned int i = 0;i < (sizeof(mc_local_configuration) / 2);i++) {
+		if (EE_ReadVariable(base + i, &var) == 0) {
+			conf_addr[2 * i] = (var >> 8) & 0xFF;
+			conf_addr[2 * i + 1] = var & 0xFF;
+		} else {
 			is_ok = false;
 			break;
 		}
 	}
-	FLASH_Lock();
 
-	timeout_configure_IWDT();
+	// Missing data is expected until the first calibration, so this is not
+	// reported as a fault.
+	if (!is_ok || conf->crc != mc_local_calc_crc(conf)) {
+		conf_general_set_defaults_mc_local(conf);
+	}
+}
 
-	chThdSleepMilliseconds(100);
+/**
+ * Set mc_local_configuration to its default values, which disables all
+ * calibration data.
+ *
+ * @param conf
+ * A pointer to the configuration to update.
+ */
+void conf_general_set_defaults_mc_local(mc_local_configuration *conf) {
+	memset(conf, 0, sizeof(mc_local_configuration));
+	conf->sp_pid_loop_in_isr = MCCONF_SP_PID_LOOP_IN_ISR;
+	conf->p_pid_traj_vel_max = MCCONF_P_PID_TRAJ_VEL_MAX;
+	conf->p_pid_traj_acc_max = MCCONF_P_PID_TRAJ_ACC_MAX;
+	conf->p_pid_traj_jerk_max = MCCONF_P_PID_TRAJ_JERK_MAX;
+	conf->p_pid_traj_ff_vel = MCCONF_P_PID_TRAJ_FF_VEL;
+	conf->p_pid_traj_ff_acc = MCCONF_P_PID_TRAJ_FF_ACC;
+}
 
-	mc_interface_select_motor_thread(1);
-	mc_interface_unlock();
-	mc_interface_select_motor_thread(2);
-	mc_interface_unlock();
+/**
+ * Write mc_local_configuration to EEPROM.
+ *
+ * @param conf
+ * A pointer to the configuration that should be stored.
+ *
+ * @param is_motor_2
+ * true to store the configuration of motor 2.
+ */
+bool conf_general_store_mc_local_configuration(mc_local_configuration *conf, bool is_motor_2) {
+	int motor_old = mc_interface_get_motor_thread();
 
-	utils_sys_unlock_cnt();
+	if (!release_motors(motor_old)) {
+		return false;
+	}
 
-	mc_interface_select_motor_thread(motor_old);
+	conf->crc = mc_local_calc_crc(conf);
+
+	bool is_ok = write_eeprom_block((uint8_t*)conf, sizeof(mc_local_configuration),
+			is_motor_2 ? EEPROM_BASE_MC_LOCAL_2 : EEPROM_BASE_MC_LOCAL);
+
+	unlock_motors(motor_old);
 
 	return is_ok;
 }
@@ -292,6 +292,17 @@ typedef struct {
 	BMS_FWD_CAN_MODE fwd_can_mode;
 } bms_config;
 
+// Entries per electrical revolution in the cogging compensation table
+#define FOC_COGGING_TABLE_SIZE	128
+
+// Entries per revolution in the encoder correction table
+#define ENCODER_CORR_TABLE_SIZE	64
+
+// Points along id (0 to -i_max) and iq (0 to i_max) in the saturation map
+#define FOC_SAT_MAP_ID_N		5
+#define FOC_SAT_MAP_IQ_N		6
+#define FOC_SAT_MAP_SIZE		(FOC_SAT_MAP_ID_N * FOC_SAT_MAP_IQ_N)
+
 #define BMS_MAX_CELLS	50
 #define BMS_MAX_TEMPS	50
 #define BMS_STATUS_LEN	41
@@ -582,6 +593,37 @@ typedef struct {
 	uint16_t crc;
 } mc_configuration;
 
+// Per motor calibration data and settings that are not part of the serialized
+// configuration. It is stored in its own EEPROM area, so that
+// mc_configuration and all copies of it stay small.
+typedef struct {
+	// Cogging compensation. Set by foc_cogging_cal. A scale of 0 disables the
+	// compensation.
+	float foc_cogging_comp_scale;
+	int8_t foc_cogging_comp_table[FOC_COGGING_TABLE_SIZE];
+	// Encoder nonlinearity correction. Set by foc_encoder_corr_cal.
+	bool m_encoder_corr_enable;
+	int16_t m_encoder_corr_table[ENCODER_CORR_TABLE_SIZE];
+	// Ld, Lq and flux linkage over id and iq. Set by foc_sat_map_measure. A
+	// current of 0 disables the map.
+	float foc_sat_map_i_max;
+	float foc_sat_map_ld[FOC_SAT_MAP_SIZE];
+	float foc_sat_map_lq[FOC_SAT_MAP_SIZE];
+	float foc_sat_map_lambda[FOC_SAT_MAP_SIZE];
+	// Run the speed and position PIDs from the ADC interrupt. Set with conf-set.
+	bool sp_pid_loop_in_isr;
+	// S-curve trajectory for position control. Set with conf-set. A max
+	// velocity of 0 disables the trajectory.
+	float p_pid_traj_vel_max;
+	float p_pid_traj_acc_max;
+	float p_pid_traj_jerk_max;
+	float p_pid_traj_ff_vel;
+	float p_pid_traj_ff_acc;
+
+	// Protect from flash corruption.
+	uint16_t crc;
+} mc_local_configuration;
+
 // Applications to use
 typedef enum {
 	APP_NONE = 0,
@@ -1123,6 +1165,19 @@ typedef enum {
 	COMM_FW_INFO							= 157,
 
 	COMM_CAN_UPDATE_BAUD_ALL				= 158,
+
+	COMM_FW_STAGE_BEGIN						= 159,
+	COMM_FW_STAGE_BEGIN_ALL_CAN				= 160,
+	COMM_FW_STAGE_STATUS					= 161,
+	COMM_FW_STAGE_VERIFY					= 162,
+	COMM_FW_DELTA_BEGIN						= 163,
+	COMM_FW_DELTA_DATA						= 164,
+	COMM_FW_DELTA_DATA_LZO					= 165,
+	COMM_SET_LZO_REPLIES					= 166,
+	COMM_LZO_PACKET							= 167,
+	COMM_SET_MCCONF_DIFF					= 168,
+	COMM_SET_APPCONF_DIFF					= 169,
+	COMM_LISP_GET_PROF						= 170,
 } COMM_PACKET_ID;
 
 // CAN commands
@@ -1399,6 +1454,25 @@ typedef union {
 #define EEPROM_VARS_HW			32
 #define EEPROM_VARS_CUSTOM		256
 
+// Motor state passed to control hooks that run in the FOC interrupt
+typedef struct {
+	int motor; // 1 or 2
+	float dt; // Time since the previous call in seconds
+	float phase; // Electrical angle in radians
+	float speed; // Electrical speed in rad/s
+	float pos; // PID position in degrees
+	float id;
+	float iq;
+	float vd;
+	float vq;
+	float v_in;
+	bool engaged; // True when the motor is running in current control mode
+	float id_set; // Current targets. Written back to the current controller when engaged.
+	float iq_set;
+} foc_hook_state;
+
+typedef void (*foc_hook_fun)(foc_hook_state *state, void *arg);
+
 typedef struct {
 	float ah_tot;
 	float ah_charge_tot;
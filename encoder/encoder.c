@@ -21,6 +21,7 @@
 #include "encoder.h"
 #include "encoder_datatype.h"
 #include "encoder_cfg.h"
+#include "encoder_corr.h"
 
 #include "utils.h"
 #include "utils_math.h"
@@ -44,6 +45,8 @@ typedef enum {
 volatile routine_rate_t m_routine_rate = routine_rate_1k;
 static encoder_type_t m_encoder_type_now = ENCODER_TYPE_NONE;
 static float m_enc_custom_pos = 0.0;
+static volatile bool m_corr_enable = false;
+static int16_t m_corr_table[ENCODER_CORR_TABLE_SIZE];
 
 static THD_WORKING_AREA(routine_thread_wa, 256);
 static THD_FUNCTION(routine_thread, arg);
@@ -305,6 +308,23 @@ void encoder_update_config(volatile mc_configuration *conf) {
 	}
 }
 
+/**
+ * Set the nonlinearity correction table that is applied to the encoder angle.
+ *
+ * @param conf
+ * The local motor configuration to take the table from.
+ */
+void encoder_set_corr(const volatile mc_local_configuration *conf) {
+	// Disable while copying so that the ISR never sees a partially updated table
+	m_corr_enable = false;
+
+	for (int i = 0;i < ENCODER_CORR_TABLE_SIZE;i++) {
+		m_corr_table[i] = conf->m_encoder_corr_table[i];
+	}
+
+	m_corr_enable = conf->m_encoder_corr_enable;
+}
+
 void encoder_deinit(void) {
 	nvicDisableVector(HW_ENC_EXTI_CH);
 	nvicDisableVector(HW_ENC_TIM_ISR_CH);
@@ -357,7 +377,30 @@ void encoder_set_custom_callbacks (
 	}
 }
 
+/**
+ * Read the encoder angle with the nonlinearity correction applied.
+ *
+ * @return
+ * The angle in degrees.
+ */
 float encoder_read_deg(void) {
+	float angle = encoder_read_deg_raw();
+
+	if (m_corr_enable) {
+		angle = encoder_corr_apply(m_corr_table, ENCODER_CORR_TABLE_SIZE, angle);
+	}
+
+	return angle;
+}
+
+/**
+ * Read the encoder angle without the nonlinearity correction. Used when
+ * calibrating the correction.
+ *
+ * @return
+ * The angle in degrees.
+ */
+float encoder_read_deg_raw(void) {
 	if (m_encoder_type_now == ENCODER_TYPE_AS504x) {
 		return AS504x_LAST_ANGLE(&encoder_cfg_as504x);
 	} else if (m_encoder_type_now == ENCODER_TYPE_MT6816) {
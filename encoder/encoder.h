@@ -37,6 +37,7 @@
 // Functions
 bool encoder_init(volatile mc_configuration *conf);
 void encoder_update_config(volatile mc_configuration *conf);
+void encoder_set_corr(const volatile mc_local_configuration *conf);
 void encoder_deinit(void);
 
 void encoder_set_custom_callbacks (
@@ -45,6 +46,7 @@ void encoder_set_custom_callbacks (
 		char* (*print_info)(void));
 
 float encoder_read_deg(void);
+float encoder_read_deg_raw(void);
 float encoder_read_deg_multiturn(void);
 void encoder_set_deg(float deg);
 encoder_type_t encoder_is_configured(void);
@@ -1,5 +1,6 @@
 ENCSRC =	encoder/encoder.c \
 			encoder/encoder_cfg.c \
+			encoder/encoder_corr.c \
 			encoder/enc_abi.c \
 			encoder/enc_ad2s1205.c \
 			encoder/enc_as5x47u.c \
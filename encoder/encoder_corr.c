@@ -0,0 +1,111 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "encoder_corr.h"
+#include <math.h>
+
+/**
+ * Apply the correction table to an encoder angle. Uses linear interpolation
+ * and is cheap enough to run on every encoder read.
+ *
+ * @param table
+ * The correction table.
+ *
+ * @param len
+ * Number of entries in the table.
+ *
+ * @param angle
+ * Raw angle in degrees, 0 to 360.
+ *
+ * @return
+ * The corrected angle in degrees, 0 to 360.
+ */
+float encoder_corr_apply(const int16_t *table, int len, float angle) {
+	float pos = angle * ((float)len / 360.0);
+
+	while (pos < 0.0) {
+		pos += (float)len;
+	}
+
+	while (pos >= (float)len) {
+		pos -= (float)len;
+	}
+
+	int i0 = (int)pos;
+	if (i0 >= len) {
+		i0 = len - 1;
+	}
+
+	int i1 = i0 + 1;
+	if (i1 >= len) {
+		i1 = 0;
+	}
+
+	float frac = pos - (float)i0;
+	angle += ((float)table[i0] + frac * (float)(table[i1] - table[i0])) * ENCODER_CORR_SCALE;
+
+	if (angle < 0.0) {
+		angle += 360.0;
+	} else if (angle >= 360.0) {
+		angle -= 360.0;
+	}
+
+	return angle;
+}
+
+/**
+ * Remove the average from a set of angle errors and quantize them to a
+ * correction table. The average is an offset that the encoder offset
+ * calibration takes care of.
+ *
+ * @param values
+ * Angle errors in degrees.
+ *
+ * @param len
+ * Number of values and table entries.
+ *
+ * @param table
+ * The resulting table.
+ *
+ * @return
+ * false if an error is too large for the table.
+ */
+bool encoder_corr_quantize(const float *values, int len, int16_t *table) {
+	float mean = 0.0;
+	for (int i = 0;i < len;i++) {
+		mean += values[i];
+	}
+	mean /= (float)len;
+
+	bool res = true;
+	for (int i = 0;i < len;i++) {
+		float v = roundf((values[i] - mean) / ENCODER_CORR_SCALE);
+		if (v > (float)INT16_MAX) {
+			v = (float)INT16_MAX;
+			res = false;
+		} else if (v < (float)-INT16_MAX) {
+			v = (float)-INT16_MAX;
+			res = false;
+		}
+		table[i] = (int16_t)v;
+	}
+
+	return res;
+}
@@ -0,0 +1,38 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef ENCODER_ENCODER_CORR_H_
+#define ENCODER_ENCODER_CORR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Correction table for encoder nonlinearity such as eccentricity and
+ * harmonic errors of magnetic encoders. Entry i holds the correction to add
+ * at the raw angle i * 360 / len, in units of ENCODER_CORR_SCALE degrees.
+ */
+#define ENCODER_CORR_SCALE		0.01
+
+// Functions
+float encoder_corr_apply(const int16_t *table, int len, float angle);
+bool encoder_corr_quantize(const float *values, int len, int16_t *table);
+
+#endif /* ENCODER_ENCODER_CORR_H_ */
@@ -30,6 +30,7 @@
 #include "hw.h"
 #include "crc.h"
 #include "buffer.h"
+#include "delta_patch.h"
 #include <string.h>
 
 #ifdef USE_LISPBM
@@ -50,6 +51,9 @@
 #define LISP_CONST_BASE							8
 #define QMLUI_MAX_SIZE							(1024 * 128 - 8)
 #define LISP_MAX_SIZE							(1024 * 128 - 8)
+#define NEW_APP_MAX_SIZE						(1024 * 128 * NEW_APP_SECTORS)
+#define STAGE_MAX_CHUNKS						2048
+#define DELTA_CHUNK_SIZE						1024
 
 // Base address of the Flash sectors
 #define ADDR_FLASH_SECTOR_0    					((uint32_t)0x08000000) // Base @ of Sector 0, 16 Kbytes
@@ -86,10 +90,17 @@ typedef struct {
 // Make sure the app image has the CRC bits set to '1' to later write the flag and CRC.
 const crc_info_t __attribute__((section (".crcinfo"))) crc_info = {0xFFFFFFFF, 0xFFFFFFFF};
 
+// From the linker script. The initial values of .data are stored right after
+// the code, so the running image ends at _textdata + (_edata - _data).
+extern uint32_t _textdata;
+extern uint32_t _data;
+extern uint32_t _edata;
+
 // Private functions
 static uint16_t erase_sector(uint32_t sector);
 static uint16_t write_data(uint32_t base, uint8_t *data, uint32_t len);
 static void qmlui_check(int ind);
+static void stage_mark_written(uint32_t offset, uint8_t *data, uint32_t len);
 
 // Private variables
 typedef struct {
@@ -97,6 +108,21 @@ typedef struct {
 	bool ok;
 } _code_checks;
 
+// Tracks which chunks of the new app image have been written and read back
+// correctly, so that an interrupted upload can be resumed.
+typedef struct {
+	bool active;
+	uint32_t size;
+	uint32_t chunk_size;
+	uint32_t chunk_num;
+	uint32_t chunks_done;
+	uint8_t done_bitmap[STAGE_MAX_CHUNKS / 8];
+} _stage_state;
+
+static _stage_state stage = {0};
+static delta_patch_state delta_state;
+static bool delta_active = false;
+
 static _code_checks code_checks[3] = {0};
 static int code_sectors[3] = {QMLUI_BASE, LISP_BASE, LISP_CONST_BASE};
 
@@ -131,6 +157,10 @@ static const uint16_t flash_sector[FLASH_SECTORS] = {
 };
 
 uint16_t flash_helper_erase_new_app(uint32_t new_app_size) {
+	// The staged chunks are gone after erasing
+	stage.active = false;
+	delta_active = false;
+
 #ifdef USE_LISPBM
 	lispif_restart(false, false, false);
 #endif
@@ -179,7 +209,235 @@ uint16_t flash_helper_erase_bootloader(void) {
 }
 
 uint16_t flash_helper_write_new_app_data(uint32_t offset, uint8_t *data, uint32_t len) {
-	return write_data(flash_addr[NEW_APP_BASE] + offset, data, len);
+	uint16_t res = write_data(flash_addr[NEW_APP_BASE] + offset, data, len);
+
+	if (res == FLASH_COMPLETE) {
+		stage_mark_written(offset, data, len);
+	}
+
+	return res;
+}
+
+/**
+ * Start or resume a staged upload of a new app image. While a stage is active,
+ * each chunk that is written completely by flash_helper_write_new_app_data and
+ * reads back correctly is marked as done.
+ *
+ * @param size
+ * Total size of the image in bytes, including the header.
+ *
+ * @param chunk_size
+ * Size of each chunk in bytes. The number of chunks cannot exceed
+ * STAGE_MAX_CHUNKS.
+ *
+ * @param resume
+ * If true and a stage with the same size and chunk size is active, it is kept
+ * and only the missing chunks have to be written. Otherwise the new app area is
+ * erased and all chunks start as missing.
+ *
+ * @return
+ * FLASH_COMPLETE on success, 101 for invalid arguments or an error from erasing.
+ */
+uint16_t flash_helper_stage_begin(uint32_t size, uint32_t chunk_size, bool resume) {
+	if (size == 0 || size > NEW_APP_MAX_SIZE || chunk_size == 0) {
+		return 101;
+	}
+
+	uint32_t chunk_num = (size + chunk_size - 1) / chunk_size;
+	if (chunk_num > STAGE_MAX_CHUNKS) {
+		return 101;
+	}
+
+	if (resume && stage.active && stage.size == size && stage.chunk_size == chunk_size) {
+		return FLASH_COMPLETE;
+	}
+
+	uint16_t res = flash_helper_erase_new_app(size);
+	if (res != FLASH_COMPLETE) {
+		return res;
+	}
+
+	memset(stage.done_bitmap, 0, sizeof(stage.done_bitmap));
+	stage.size = size;
+	stage.chunk_size = chunk_size;
+	stage.chunk_num = chunk_num;
+	stage.chunks_done = 0;
+	stage.active = true;
+
+	return FLASH_COMPLETE;
+}
+
+bool flash_helper_stage_active(void) {
+	return stage.active;
+}
+
+uint32_t flash_helper_stage_chunk_num(void) {
+	return stage.active ? stage.chunk_num : 0;
+}
+
+uint32_t flash_helper_stage_chunks_done(void) {
+	return stage.active ? stage.chunks_done : 0;
+}
+
+/**
+ * Copy part of the chunk completion bitmap. Bit n of byte m is set when chunk
+ * m * 8 + n is done.
+ *
+ * @param first_byte
+ * First bitmap byte to copy.
+ *
+ * @param dst
+ * Where to copy the bitmap to.
+ *
+ * @param max_len
+ * Maximum number of bytes to copy.
+ *
+ * @return
+ * The number of bytes copied.
+ */
+uint32_t flash_helper_stage_get_bitmap(uint32_t first_byte, uint8_t *dst, uint32_t max_len) {
+	uint32_t bytes = (stage.chunk_num + 7) / 8;
+
+	if (!stage.active || first_byte >= bytes) {
+		return 0;
+	}
+
+	uint32_t len = bytes - first_byte;
+	if (len > max_len) {
+		len = max_len;
+	}
+
+	memcpy(dst, stage.done_bitmap + first_byte, len);
+	return len;
+}
+
+/**
+ * Calculate the CRC32 (same as crc32_with_init) over the staged image.
+ *
+ * @return
+ * The CRC, or 0 if no stage is active.
+ */
+uint32_t flash_helper_stage_crc(void) {
+	if (!stage.active) {
+		return 0;
+	}
+
+	return crc32_with_init((uint8_t*)flash_addr[NEW_APP_BASE], stage.size, 0);
+}
+
+/**
+ * The CRC of the running app, as stored by flash_helper_verify_flash_memory.
+ * Used to identify which image a delta patch is based on.
+ */
+uint32_t flash_helper_app_crc(void) {
+	return APP_CRC_ADDRESS[0];
+}
+
+/**
+ * Start applying a delta patch against the running app. The result is written
+ * to the new app area through a staged upload with DELTA_CHUNK_SIZE chunks, so
+ * it can be checked with the stage functions afterwards. Copy operations can
+ * read the vector table and the app code and data, but not the emulated
+ * EEPROM or the unused flash after the image.
+ *
+ * @param base_crc
+ * CRC of the app the patch was made against. Must match flash_helper_app_crc.
+ *
+ * @param out_size
+ * Size of the resulting image, including the header.
+ *
+ * @return
+ * FLASH_COMPLETE on success, 102 if the base does not match or an error from
+ * flash_helper_stage_begin.
+ */
+uint16_t flash_helper_delta_begin(uint32_t base_crc, uint32_t out_size) {
+	delta_active = false;
+
+	if (base_crc != flash_helper_app_crc()) {
+		return 102;
+	}
+
+	uint32_t chunk_size = DELTA_CHUNK_SIZE;
+	while (((out_size + chunk_size - 1) / chunk_size) > STAGE_MAX_CHUNKS) {
+		chunk_size *= 2;
+	}
+
+	uint16_t res = flash_helper_stage_begin(out_size, chunk_size, false);
+	if (res != FLASH_COMPLETE) {
+		return res;
+	}
+
+	// The source is the running image up to the end of its code and data.
+	// The emulated EEPROM in between holds this unit's settings and is not
+	// part of any image, so the patch may not copy from it.
+	uint32_t app_len = (uint32_t)&_textdata + ((uint32_t)&_edata - (uint32_t)&_data) -
+			flash_addr[APP_BASE];
+	delta_patch_init(&delta_state, (uint8_t*)flash_addr[APP_BASE], app_len, out_size);
+	delta_patch_exclude(&delta_state, VECTOR_TABLE_SIZE, EEPROM_EMULATION_SIZE);
+	delta_active = true;
+
+	return FLASH_COMPLETE;
+}
+
+static bool delta_write(uint32_t offset, uint8_t *data, uint32_t len) {
+	uint8_t *addr = (uint8_t*)flash_addr[NEW_APP_BASE] + offset;
+
+	if (write_data((uint32_t)addr, data, len) != FLASH_COMPLETE) {
+		return false;
+	}
+
+	return memcmp(addr, data, len) == 0;
+}
+
+/**
+ * Apply delta patch operations to the new app area.
+ *
+ * @param out_pos
+ * Output position the operations start at. If it is behind the current position
+ * the operations were applied already, e.g. when a reply got lost, and they
+ * are ignored.
+ *
+ * @param ops
+ * The operations.
+ *
+ * @param len
+ * Length of the operations in bytes.
+ *
+ * @return
+ * DELTA_PATCH_OK on success, DELTA_PATCH_ERR_OUT_RANGE if no patch is active
+ * or out_pos is ahead of the current position, or another DELTA_PATCH_ERR code.
+ */
+int flash_helper_delta_apply(uint32_t out_pos, uint8_t *ops, uint32_t len) {
+	if (!delta_active || out_pos > delta_state.out_pos) {
+		return DELTA_PATCH_ERR_OUT_RANGE;
+	}
+
+	if (out_pos < delta_state.out_pos) {
+		return DELTA_PATCH_OK;
+	}
+
+	int res = delta_patch_apply(&delta_state, ops, len, delta_write);
+
+	// The output is written in order and every write is read back, so all
+	// chunks before the current position are done.
+	if (res == DELTA_PATCH_OK && stage.active) {
+		uint32_t done = delta_state.out_pos / stage.chunk_size;
+		if (delta_state.out_pos == stage.size) {
+			done = stage.chunk_num;
+		}
+
+		for (uint32_t c = stage.chunks_done;c < done;c++) {
+			stage.done_bitmap[c / 8] |= 1 << (c % 8);
+		}
+
+		stage.chunks_done = done;
+	}
+
+	return res;
+}
+
+uint32_t flash_helper_delta_pos(void) {
+	return delta_active ? delta_state.out_pos : 0;
 }
 
 uint16_t flash_helper_erase_code(int ind) {
@@ -466,6 +724,39 @@ static uint16_t write_data(uint32_t base, uint8_t *data, uint32_t len) {
 	return FLASH_COMPLETE;
 }
 
+static void stage_mark_written(uint32_t offset, uint8_t *data, uint32_t len) {
+	if (!stage.active || len == 0) {
+		return;
+	}
+
+	uint32_t first = (offset + stage.chunk_size - 1) / stage.chunk_size;
+	uint32_t end = offset + len;
+
+	for (uint32_t c = first;c < stage.chunk_num;c++) {
+		uint32_t c_start = c * stage.chunk_size;
+		uint32_t c_len = stage.chunk_size;
+		if ((c_start + c_len) > stage.size) {
+			c_len = stage.size - c_start;
+		}
+
+		if ((c_start + c_len) > end) {
+			break;
+		}
+
+		bool ok = memcmp((uint8_t*)flash_addr[NEW_APP_BASE] + c_start,
+				data + (c_start - offset), c_len) == 0;
+		bool was_done = stage.done_bitmap[c / 8] & (1 << (c % 8));
+
+		if (ok && !was_done) {
+			stage.done_bitmap[c / 8] |= 1 << (c % 8);
+			stage.chunks_done++;
+		} else if (!ok && was_done) {
+			stage.done_bitmap[c / 8] &= ~(1 << (c % 8));
+			stage.chunks_done--;
+		}
+	}
+}
+
 static void qmlui_check(int ind) {
 	if (code_checks[ind].check_done) {
 		return;
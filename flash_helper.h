@@ -30,6 +30,16 @@
 uint16_t flash_helper_erase_new_app(uint32_t new_app_size);
 uint16_t flash_helper_erase_bootloader(void);
 uint16_t flash_helper_write_new_app_data(uint32_t offset, uint8_t *data, uint32_t len);
+uint16_t flash_helper_stage_begin(uint32_t size, uint32_t chunk_size, bool resume);
+bool flash_helper_stage_active(void);
+uint32_t flash_helper_stage_chunk_num(void);
+uint32_t flash_helper_stage_chunks_done(void);
+uint32_t flash_helper_stage_get_bitmap(uint32_t first_byte, uint8_t *dst, uint32_t max_len);
+uint32_t flash_helper_stage_crc(void);
+uint32_t flash_helper_app_crc(void);
+uint16_t flash_helper_delta_begin(uint32_t base_crc, uint32_t out_size);
+int flash_helper_delta_apply(uint32_t out_pos, uint8_t *ops, uint32_t len);
+uint32_t flash_helper_delta_pos(void);
 
 uint16_t flash_helper_erase_code(int ind);
 uint16_t flash_helper_write_code(int ind, uint32_t offset, uint8_t *data, uint32_t len);
@@ -201,6 +201,24 @@ typedef struct {
 	float ki;
 	float beta;
 } ATTITUDE_INFO;
+
+typedef struct {
+	int motor; // 1 or 2
+	float dt; // Time since the previous call in seconds
+	float phase; // Electrical angle in radians
+	float speed; // Electrical speed in rad/s
+	float pos; // PID position in degrees
+	float id;
+	float iq;
+	float vd;
+	float vq;
+	float v_in;
+	bool engaged; // True when the motor is running in current control mode
+	float id_set; // Current targets. Written back to the current controller when engaged.
+	float iq_set;
+} foc_hook_state;
+
+typedef void (*foc_hook_fun)(foc_hook_state *state, void *arg);
 #endif
 
 typedef bool (*load_extension_fptr)(char*,extension_fptr);
@@ -656,6 +674,20 @@ typedef struct {
 	void (*sem_signal)(lib_semaphore);
 	bool (*sem_wait_to)(lib_semaphore, systime_t); // Returns false on timeout
 	void (*sem_reset)(lib_semaphore);
+
+	// Functions below were added in firmware 6.06
+
+	// FOC control hook. The hook runs in the FOC interrupt every div control
+	// loop iterations, for each motor, with a snapshot of the motor state. When
+	// the motor is engaged in current control mode, e.g. with mc_set_current
+	// from a thread, the id_set and iq_set it leaves in the state become the new
+	// current targets. Keep resetting the timeout from a thread while the hook
+	// is in control. The hook is removed if a call takes longer than budget_us,
+	// after which the current targets are set to 0. Only one hook can be active,
+	// pass NULL to remove it. The hook is removed when the library is unloaded.
+	bool (*foc_set_control_hook)(foc_hook_fun hook, void *arg, int div, float budget_us);
+	bool (*foc_control_hook_overrun)(void); // True if the hook was removed on overrun
+	float (*foc_control_hook_max_time_us)(bool reset);
 } vesc_c_if;
 
 typedef struct {
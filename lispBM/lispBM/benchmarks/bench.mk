@@ -0,0 +1,28 @@
+# Shared build rules for the host benchmarks. Each bench_* Makefile sets
+# BENCH to the name of the program and includes this file.
+
+LISPBM := ../../
+
+include $(LISPBM)/lispbm.mk
+
+PLATFORM_INCLUDE = -I$(LISPBM)/platform/linux/include
+PLATFORM_SRC     = $(LISPBM)/platform/linux/src/platform_mutex.c
+
+BENCH_SRC = ../bench_common.c main.c
+BENCH_H   = ../bench_common.h
+
+LBMFLAGS = -DFULL_RTS_LIB -DLBM_USE_DYN_FUNS -DLBM_USE_DYN_MACROS -DLBM_USE_DYN_LOOPS -DLBM_USE_DYN_ARRAYS
+
+CCFLAGS = -O2 -Wall -Wconversion -pedantic -std=c11 $(LBMFLAGS)
+
+all: CCFLAGS += -DLBM64
+all: $(BENCH)
+
+bench32: CCFLAGS += -m32
+bench32: $(BENCH)
+
+$(BENCH): $(LISPBM_SRC) $(PLATFORM_SRC) $(LISPBM_H) $(BENCH_SRC) $(BENCH_H)
+	$(CC) $(CCFLAGS) $(LISPBM_SRC) $(PLATFORM_SRC) $(LISPBM_FLAGS) $(BENCH_SRC) -o $(BENCH) -I.. -I$(LISPBM)include $(PLATFORM_INCLUDE) -lpthread -lm
+
+clean:
+	rm -f $(BENCH)
@@ -0,0 +1,96 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs the function based programs in benchmarks/ interpreted and after
+// compiling the functions with compile. The program is loaded, the function
+// is optionally compiled and then the same call is timed, from bench-start
+// to the end of the context.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_common.h"
+
+#define HEAP_SIZE               8192
+#define SOURCE_SIZE             (16 * 1024)
+#define NUM_RUNS                10
+
+static const bench_conf_t conf = {HEAP_SIZE, NULL, NULL};
+
+static char source[SOURCE_SIZE];
+
+typedef struct {
+  const char *file;
+  const char *fun;
+  const char *call;
+} bench_t;
+
+static const bench_t benchmarks[] = {
+  {"../dec_cnt1.lisp",      "dec-cnt",  "(dec-cnt 100000)"},
+  {"../dec_cnt3.lisp",      "dec-cnt3", "(dec-cnt3 100000)"},
+  {"../tail_call_200k.lisp", "f",       "(f 200000)"},
+  {"../tak.lisp",           "tak",      "(tak 18 12 6)"},
+  {"../q2.lisp",            "q2",       "(q2 6 7)"},
+};
+
+static int load_file(const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (!fp) return -1;
+  size_t n = fread(source, 1, SOURCE_SIZE - 1, fp);
+  fclose(fp);
+  source[n] = 0;
+  return (int)n;
+}
+
+static uint32_t time_call(const bench_t *b, int src_len, bool compiled, char *res, size_t res_size) {
+  int n = src_len;
+  if (compiled) {
+    n += snprintf(source + n, SOURCE_SIZE - (size_t)n, "\n(compile '%s)", b->fun);
+  }
+  snprintf(source + n, SOURCE_SIZE - (size_t)n, "\n(bench-start)\n%s\n", b->call);
+
+  uint32_t t = bench_time_source(&conf, source, NUM_RUNS);
+  source[src_len] = 0;
+  snprintf(res, res_size, "%s", bench_res);
+  return t;
+}
+
+int main(void) {
+  bool ok = true;
+
+  printf("%-22s %12s %12s %8s\n", "Benchmark", "Interp [us]", "Compiled [us]", "Speedup");
+  for (size_t i = 0;i < sizeof(benchmarks) / sizeof(bench_t);i++) {
+    const bench_t *b = &benchmarks[i];
+    int src_len = load_file(b->file);
+    if (src_len < 0) {
+      printf("Could not open %s\n", b->file);
+      return 1;
+    }
+
+    char res_i[256], res_c[256];
+    uint32_t t_i = time_call(b, src_len, false, res_i, sizeof(res_i));
+    uint32_t t_c = time_call(b, src_len, true, res_c, sizeof(res_c));
+
+    bool same = strcmp(res_i, res_c) == 0;
+    ok = ok && same;
+    printf("%-22s %12u %12u %7.1fx %s\n", b->file + 3, t_i, t_c,
+           (double)t_i / (double)t_c, same ? "" : "RESULT DIFFERS");
+  }
+
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
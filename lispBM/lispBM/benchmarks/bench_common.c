@@ -0,0 +1,180 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "bench_common.h"
+#include "extensions/array_extensions.h"
+#include "extensions/math_extensions.h"
+#include "extensions/string_extensions.h"
+#include "extensions/runtime_extensions.h"
+#include "extensions/lbm_dyn_lib.h"
+
+#define GC_STACK_SIZE           160
+#define PRINT_STACK_SIZE        128
+#define EXTENSION_STORAGE_SIZE  200
+
+static lbm_cons_t heap[BENCH_HEAP_SIZE_MAX];
+static lbm_uint memory[LBM_MEMORY_SIZE_1M];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_1M];
+static lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+
+static lbm_string_channel_state_t string_tok_state;
+static lbm_char_channel_t string_tok;
+
+static const bench_conf_t *run_conf = NULL;
+static lbm_cid run_cid = -1;
+static uint32_t run_start = 0;
+static uint32_t run_end = 0;
+
+char bench_res[BENCH_RES_SIZE];
+
+uint32_t bench_timestamp(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint32_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+static void sleep_callback(uint32_t us) {
+  struct timespec s;
+  s.tv_sec = 0;
+  s.tv_nsec = (long)us * 1000;
+  nanosleep(&s, NULL);
+}
+
+static void done_callback(eval_context_t *ctx) {
+  if (ctx->id == run_cid) {
+    run_end = bench_timestamp();
+    lbm_print_value(bench_res, sizeof(bench_res), ctx->r);
+    if (run_conf && run_conf->result) {
+      run_conf->result(ctx->r);
+    }
+    lbm_kill_eval();
+  }
+}
+
+static lbm_value ext_bench_start(lbm_value *args, lbm_uint argn) {
+  (void)args;
+  (void)argn;
+  run_start = bench_timestamp();
+  return ENC_SYM_TRUE;
+}
+
+static void critical_error(void) {
+  printf("Critical error\n");
+  exit(EXIT_FAILURE);
+}
+
+static bool dyn_load(const char *str, const char **code) {
+  return lbm_dyn_lib_find(str, code);
+}
+
+/**
+ * Initialize lbm from scratch with the common extensions and callbacks.
+ *
+ * @param conf The heap size and hooks of the benchmark.
+ * @return true on success.
+ */
+bool bench_start_lbm(const bench_conf_t *conf) {
+  if (conf->heap_size > BENCH_HEAP_SIZE_MAX) {
+    return false;
+  }
+
+  run_conf = conf;
+
+  if (!lbm_init(heap, conf->heap_size,
+                memory, LBM_MEMORY_SIZE_1M,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_1M,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSION_STORAGE_SIZE)) {
+    return false;
+  }
+
+  if (!lbm_eval_init_events(20)) return false;
+
+  lbm_array_extensions_init();
+  lbm_math_extensions_init();
+  lbm_string_extensions_init();
+  lbm_runtime_extensions_init();
+  lbm_dyn_lib_init();
+  lbm_add_extension("bench-start", ext_bench_start);
+
+  lbm_set_dynamic_load_callback(dyn_load);
+  lbm_set_timestamp_us_callback(bench_timestamp);
+  lbm_set_usleep_callback(sleep_callback);
+  lbm_set_printf_callback(printf);
+  lbm_set_critical_error_callback(critical_error);
+  lbm_set_ctx_done_callback(done_callback);
+
+  if (conf->init && !conf->init()) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Run the evaluator until the context cid is done.
+ *
+ * @param cid The context to wait for.
+ * @param start Start time, replaced if the program calls bench-start.
+ * @return Microseconds from the start to the end of the context.
+ */
+uint32_t bench_run(lbm_cid cid, uint32_t start) {
+  run_cid = cid;
+  run_start = start;
+  lbm_run_eval();
+  return run_end - run_start;
+}
+
+/**
+ * Load source incrementally and run it once on the current lbm instance.
+ *
+ * @return The time from the start of loading, or from bench-start, to the
+ * end of the program. 0 if it could not be loaded.
+ */
+uint32_t bench_run_source(const char *source) {
+  uint32_t start = bench_timestamp();
+  lbm_create_string_char_channel(&string_tok_state, &string_tok, (char*)source);
+  lbm_cid cid = lbm_load_and_eval_program_incremental(&string_tok, NULL);
+  if (cid < 0) return 0;
+  return bench_run(cid, start);
+}
+
+/**
+ * Run source runs times, restarting lbm before every run.
+ *
+ * @return The shortest time of all runs. 0 if lbm could not be started or
+ * the program could not be loaded.
+ */
+uint32_t bench_time_source(const bench_conf_t *conf, const char *source, int runs) {
+  uint32_t t_min = UINT32_MAX;
+  for (int i = 0;i < runs;i++) {
+    if (!bench_start_lbm(conf)) return 0;
+    uint32_t t = bench_run_source(source);
+    if (t == 0) return 0;
+    if (t < t_min) t_min = t;
+  }
+  return t_min;
+}
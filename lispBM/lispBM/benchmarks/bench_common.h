@@ -0,0 +1,54 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host harness shared by the benchmarks in the bench_* directories. It
+// owns the lbm memories, sets up the evaluator with the common extensions
+// and times programs from a start point to the end of their context.
+// Programs mark the start with (bench-start).
+
+#ifndef BENCH_COMMON_H_
+#define BENCH_COMMON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lispbm.h"
+
+#define BENCH_HEAP_SIZE_MAX     32768
+#define BENCH_RES_SIZE          256
+
+typedef struct {
+  // Heap size in cells, at most BENCH_HEAP_SIZE_MAX.
+  lbm_uint heap_size;
+  // Called after the common extensions have been added, to add the ones
+  // the benchmark needs. Can be NULL.
+  bool (*init)(void);
+  // Called with the result of the timed context. Can be NULL.
+  void (*result)(lbm_value r);
+} bench_conf_t;
+
+// The printed result of the last timed context
+extern char bench_res[BENCH_RES_SIZE];
+
+uint32_t bench_timestamp(void);
+bool bench_start_lbm(const bench_conf_t *conf);
+uint32_t bench_run(lbm_cid cid, uint32_t start);
+uint32_t bench_run_source(const char *source);
+uint32_t bench_time_source(const bench_conf_t *conf, const char *source, int runs);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Rendering with the display extensions into image buffers of every
+// colour format, as done by the repl without SDL. The same scene of
+// clears, filled and outlined rectangles, circles, arcs, lines and blits is
+// drawn a number of times and a checksum of the final image is printed, so
+// that changes to the rasteriser can be checked for identical output.
+//
+// A second run updates a small gauge in a full screen image and renders
+// it with disp-render and disp-render-dirty. The render callback draws
+// into a shadow screen that is compared to the image at the end, and the
+// number of pixels sent to the "display" is printed. The gauge needle is
+// blitted from a sprite that must not become dirty by being read.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "extensions/display_extensions.h"
+
+#define HEAP_SIZE               8192
+#define SOURCE_SIZE             4096
+#define NUM_FRAMES              20
+#define NUM_RUNS                5
+
+#define SCREEN_W                320
+#define SCREEN_H                240
+
+static char source[SOURCE_SIZE];
+
+static uint32_t run_crc = 0;
+static uint32_t run_mismatch = 0;
+
+static uint32_t screen[SCREEN_W * SCREEN_H];
+static uint32_t pixels_sent = 0;
+
+typedef struct {
+  const char *fmt;
+  uint32_t c1;
+  uint32_t c2;
+} format_t;
+
+static const format_t formats[] = {
+  {"indexed2",  1,        0},
+  {"indexed4",  2,        1},
+  {"indexed16", 11,       5},
+  {"rgb332",    0x12AB34, 0xFF8000},
+  {"rgb565",    0x12AB34, 0xFF8000},
+  {"rgb888",    0x12AB34, 0xFF8000},
+};
+
+static void image_result(lbm_value r) {
+  run_crc = 0;
+  run_mismatch = 0;
+  lbm_array_header_t *arr = lbm_dec_array_r(r);
+  if (arr) {
+    image_buffer_t img;
+    image_buffer_from_array(&img, arr);
+
+    // FNV-1a over the header and the pixels of the image buffer
+    lbm_uint size = IMAGE_BUFFER_HEADER_SIZE + image_dims_to_size_bytes(img.fmt, img.width, img.height);
+    run_crc = 2166136261u;
+    for (lbm_uint i = 0;i < size;i++) {
+      run_crc = (run_crc ^ ((uint8_t*)arr->data)[i]) * 16777619u;
+    }
+
+    for (int y = 0;y < img.height && y < SCREEN_H;y++) {
+      for (int x = 0;x < img.width && x < SCREEN_W;x++) {
+        if (getpixel(&img, x, y) != screen[y * SCREEN_W + x]) {
+          run_mismatch++;
+        }
+      }
+    }
+  }
+}
+
+static bool render_image(image_buffer_t *img, uint16_t x, uint16_t y, color_t *colors) {
+  (void)colors;
+  for (int j = 0;j < img->height;j++) {
+    for (int i = 0;i < img->width;i++) {
+      if (x + i < SCREEN_W && y + j < SCREEN_H) {
+        screen[(y + j) * SCREEN_W + x + i] = getpixel(img, i, j);
+      }
+    }
+  }
+  pixels_sent += (uint32_t)img->width * img->height;
+  return true;
+}
+
+static void clear_screen(uint32_t color) {
+  for (int i = 0;i < SCREEN_W * SCREEN_H;i++) {
+    screen[i] = color;
+  }
+}
+
+static void reset_screen(void) {
+}
+
+static bool init_display(void) {
+  pixels_sent = 0;
+  lbm_display_extensions_init();
+  lbm_display_extensions_set_callbacks(render_image, clear_screen, reset_screen);
+  return true;
+}
+
+static const bench_conf_t conf = {HEAP_SIZE, init_display, image_result};
+
+static uint32_t time_source(uint32_t *crc) {
+  uint32_t t = bench_time_source(&conf, source, NUM_RUNS);
+  *crc = run_crc;
+  return t;
+}
+
+static uint32_t time_format(const format_t *f, uint32_t *crc) {
+
+  snprintf(source, SOURCE_SIZE,
+           "(define img (img-buffer '%s 320 240))\n"
+           "(define src (img-buffer '%s 64 64))\n"
+           "(define c1 %u)\n"
+           "(define c2 %u)\n"
+           "(img-clear src c2)\n"
+           "(img-circle src 32 32 20 c1 '(filled))\n"
+           "(bench-start)\n"
+           "(looprange i 0 %d {\n"
+           "  (img-clear img c2)\n"
+           "  (img-rectangle img 10 10 300 220 c1 '(filled))\n"
+           "  (img-rectangle img -20 -20 100 100 c2 '(filled))\n"
+           "  (img-rectangle img 5 5 310 230 c2)\n"
+           "  (img-circle img 160 120 100 c2 '(filled))\n"
+           "  (img-circle img 160 120 60 c1 '(thickness 10))\n"
+           "  (img-circle img 300 20 40 c1)\n"
+           "  (img-arc img 160 120 110 30 300 c1 '(thickness 8))\n"
+           "  (img-arc img 80 180 40 0 270 c2 '(filled))\n"
+           "  (img-triangle img 20 200 60 150 100 230 c2 '(filled))\n"
+           "  (img-line img 0 (mod i 240) 319 (mod i 240) c2)\n"
+           "  (img-line img (mod i 320) 0 (mod i 320) 239 c1 '(thickness 2))\n"
+           "  (img-blit img src (- (mod (* i 7) 300) 10) 100 -1)\n"
+           "  (img-blit img src 280 -10 c2)\n"
+           "  })\n"
+           "img\n",
+           f->fmt, f->fmt, f->c1, f->c2, NUM_FRAMES);
+
+  return time_source(crc);
+}
+
+static uint32_t time_gauge(const format_t *f, const char *render, uint32_t *sent, uint32_t *crc) {
+  snprintf(source, SOURCE_SIZE,
+           "(define img (img-buffer '%s 320 240))\n"
+           "(define spr (img-buffer '%s 8 8))\n"
+           "(define c1 %u)\n"
+           "(define c2 %u)\n"
+           "(img-clear img c2)\n"
+           "(img-circle img 160 120 100 c1 '(filled))\n"
+           "(img-clear spr c1)\n"
+           "(img-clear-dirty spr)\n"
+           "(disp-render img 0 0)\n"
+           "(bench-start)\n"
+           "(looprange i 0 %d {\n"
+           "  (img-rectangle img 200 20 80 30 c2 '(filled))\n"
+           "  (img-rectangle img 200 20 (+ 1 (mod (* i 7) 80)) 30 c1 '(filled))\n"
+           "  (img-blit img spr (+ 200 (mod (* i 7) 80)) 20 -1)\n"
+           "  (%s img 0 0)\n"
+           "  })\n"
+           "(if (img-dirty spr) 'sprite-dirty img)\n",
+           f->fmt, f->fmt, f->c1, f->c2, NUM_FRAMES, render);
+
+  uint32_t t = time_source(crc);
+  *sent = pixels_sent;
+  return t;
+}
+
+// Blit a buffer onto itself, moved down and right and then back up and
+// left, and compare it to a buffer where the result is drawn pixel by pixel.
+static bool check_self_blit(void) {
+  snprintf(source, SOURCE_SIZE,
+           "(define s (img-buffer 'rgb565 16 16))\n"
+           "(define e (img-buffer 'rgb565 16 16))\n"
+           "(defun col (i j) (+ (shl (* j 8) 16) (shl (* i 4) 8)))\n"
+           "(looprange j 0 16 (looprange i 0 16 {\n"
+           "  (img-setpix s i j (col i j))\n"
+           "  (img-setpix e i j (col i j)) }))\n"
+           "(bench-start)\n"
+           "(img-blit s s 3 2 -1)\n"
+           "(looprange j 2 16 (looprange i 3 16 (img-setpix e i j (col (- i 3) (- j 2)))))\n"
+           "(define ok1 (eq s e))\n"
+           "(img-blit s s -3 -2 -1)\n"
+           "(looprange j 0 14 (looprange i 0 13 (img-setpix e i j (col i j))))\n"
+           "(define ok2 (eq s e))\n"
+           "(if (and ok1 ok2) s 'self-blit-wrong)\n");
+
+  uint32_t crc = 0;
+  time_source(&crc);
+  return crc != 0;
+}
+
+int main(void) {
+  bool ok = true;
+  printf("%-10s %12s %12s %10s\n", "Format", "Time [us]", "us/frame", "Checksum");
+  for (size_t i = 0;i < sizeof(formats) / sizeof(format_t);i++) {
+    uint32_t crc = 0;
+    uint32_t t = time_format(&formats[i], &crc);
+    ok = ok && crc != 0;
+    printf("%-10s %12u %12.1f   %08x\n", formats[i].fmt, t,
+           (double)t / (double)NUM_FRAMES, crc);
+  }
+
+  printf("\n%-10s %12s %12s %12s %12s\n", "Format", "Full [us]", "Full [px]", "Dirty [us]", "Dirty [px]");
+  for (size_t i = 0;i < sizeof(formats) / sizeof(format_t);i++) {
+    uint32_t sent_full = 0, sent_dirty = 0;
+    uint32_t crc_full = 0, crc_dirty = 0;
+    uint32_t t_full = time_gauge(&formats[i], "disp-render", &sent_full, &crc_full);
+    bool full_ok = run_mismatch == 0 && crc_full != 0;
+    uint32_t t_dirty = time_gauge(&formats[i], "disp-render-dirty", &sent_dirty, &crc_dirty);
+    bool dirty_ok = run_mismatch == 0 && crc_dirty != 0;
+    ok = ok && full_ok && dirty_ok;
+    printf("%-10s %12u %12u %12u %12u %s\n", formats[i].fmt, t_full, sent_full,
+           t_dirty, sent_dirty, full_ok && dirty_ok ? "" : "SCREEN DIFFERS");
+  }
+
+  bool self_ok = check_self_blit();
+  ok = ok && self_ok;
+  printf("\nSelf blit: %s\n", self_ok ? "OK" : "WRONG");
+
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Table lookups with association lists and with hash maps. A table with
+// n integer keys is built and then every key is looked up and updated
+// repeatedly. The assoc list time grows with n while the hash map time
+// should stay flat.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "extensions/hashmap_extensions.h"
+
+#define HEAP_SIZE               32768
+#define SOURCE_SIZE             2048
+#define NUM_OPS                 20000
+#define NUM_RUNS                5
+
+static bool init_hashmap(void) {
+  lbm_hashmap_extensions_init();
+  return true;
+}
+
+static const bench_conf_t conf = {HEAP_SIZE, init_hashmap, NULL};
+
+static char source[SOURCE_SIZE];
+
+static const int num_keys[] = {4, 16, 64, 256, 1024};
+
+static const char *prog_assoc =
+  "(define tab nil)\n"
+  "(looprange i 0 %d (setq tab (acons i 0 tab)))\n"
+  "(bench-start)\n"
+  "(define sum 0)\n"
+  "(looprange i 0 %d {\n"
+  "  (var k (mod (* i 7) %d))\n"
+  "  (var v (assoc tab k))\n"
+  "  (setassoc tab k (+ v 1))\n"
+  "  (setq sum (+ sum v))\n"
+  "  })\n"
+  "sum\n";
+
+static const char *prog_hashmap =
+  "(define tab (mkhashmap))\n"
+  "(looprange i 0 %d (hashmap-set tab i 0))\n"
+  "(bench-start)\n"
+  "(define sum 0)\n"
+  "(looprange i 0 %d {\n"
+  "  (var k (mod (* i 7) %d))\n"
+  "  (var v (hashmap-get tab k))\n"
+  "  (hashmap-set tab k (+ v 1))\n"
+  "  (setq sum (+ sum v))\n"
+  "  })\n"
+  "sum\n";
+
+static uint32_t time_prog(const char *prog, int n_keys, char *res, size_t res_size) {
+  snprintf(source, SOURCE_SIZE, prog, n_keys, NUM_OPS, n_keys);
+
+  uint32_t t = bench_time_source(&conf, source, NUM_RUNS);
+  snprintf(res, res_size, "%s", bench_res);
+  return t;
+}
+
+int main(void) {
+  bool ok = true;
+  printf("%-10s %12s %12s %8s\n", "Keys", "Assoc [us]", "Hashmap [us]", "Speedup");
+  for (size_t i = 0;i < sizeof(num_keys) / sizeof(int);i++) {
+    char res_a[256], res_h[256];
+    uint32_t t_a = time_prog(prog_assoc, num_keys[i], res_a, sizeof(res_a));
+    uint32_t t_h = time_prog(prog_hashmap, num_keys[i], res_h, sizeof(res_h));
+    bool same = strcmp(res_a, res_h) == 0;
+    ok = ok && same;
+    printf("%-10d %12u %12u %7.1fx %s\n", num_keys[i], t_a, t_h,
+           (double)t_a / (double)t_h, same ? "" : "RESULT DIFFERS");
+  }
+
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
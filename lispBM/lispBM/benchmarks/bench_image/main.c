@@ -0,0 +1,164 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares loading a program from source with loading the same program
+// from an image made by read-image. The heap is about the size of the one
+// on the VESC, so that GC pressure during parsing is comparable.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "lbm_image.h"
+
+#define HEAP_SIZE               4096
+#define CONST_HEAP_SIZE         (256 * 128)
+#define SOURCE_SIZE             (128 * 1024)
+#define IMAGE_BUF_SIZE          (256 * 1024)
+#ifndef NUM_FUNS
+#define NUM_FUNS                120
+#endif
+#define NUM_RUNS                20
+
+static lbm_uint const_heap_mem[CONST_HEAP_SIZE];
+static lbm_const_heap_t const_heap;
+
+static char source[SOURCE_SIZE];
+static uint8_t image[IMAGE_BUF_SIZE];
+
+static bool const_heap_write(lbm_uint ix, lbm_uint w) {
+  if (ix >= CONST_HEAP_SIZE) return false;
+  if (const_heap_mem[ix] != (lbm_uint)-1) return false;
+  const_heap_mem[ix] = w;
+  return true;
+}
+
+static bool init_const_heap(void) {
+  memset(const_heap_mem, 0xFF, sizeof(const_heap_mem));
+  return lbm_const_heap_init(const_heap_write, &const_heap,
+                             const_heap_mem, CONST_HEAP_SIZE);
+}
+
+static const bench_conf_t conf = {HEAP_SIZE, init_const_heap, NULL};
+
+static int make_source(void) {
+  int n = 0;
+  n += snprintf(source + n, SOURCE_SIZE - (size_t)n, "@const-start\n");
+  for (int i = 0;i < NUM_FUNS;i++) {
+    n += snprintf(source + n, SOURCE_SIZE - (size_t)n,
+                  "(defun f%d (x)\n"
+                  "  (let ((a (+ x %d))\n"
+                  "        (b (list %d \"name-%d\" 'sym-%d 1.5)))\n"
+                  "    (cond ((> a 100) (- a 100))\n"
+                  "          ((< a -100) (+ a 100))\n"
+                  "          (t (+ a (length b))))))\n"
+                  "(def tab%d '(%d 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15))\n",
+                  i, i, i, i, i, i, i);
+  }
+  n += snprintf(source + n, SOURCE_SIZE - (size_t)n, "@const-end\n(def chk 0)\n");
+  for (int i = 0;i < NUM_FUNS;i++) {
+    n += snprintf(source + n, SOURCE_SIZE - (size_t)n,
+                  "(setq chk (+ chk (f%d %d) (length tab%d)))\n", i, i, i);
+  }
+  n += snprintf(source + n, SOURCE_SIZE - (size_t)n, "chk\n");
+  return n;
+}
+
+static lbm_uint make_image(int src_len) {
+  if (!bench_start_lbm(&conf)) return 0;
+
+  lbm_value src, buf;
+  if (!lbm_share_array(&src, source, (lbm_uint)src_len + 1) ||
+      !lbm_share_array(&buf, (char*)image, IMAGE_BUF_SIZE)) {
+    return 0;
+  }
+
+  lbm_value exp = lbm_cons(ENC_SYM_READ_IMAGE, lbm_cons(src, lbm_cons(buf, ENC_SYM_NIL)));
+  lbm_value prg = lbm_cons(exp, ENC_SYM_NIL);
+  bench_run(lbm_create_ctx(prg, ENC_SYM_NIL, 256, NULL), bench_timestamp());
+  return lbm_image_size(image, IMAGE_BUF_SIZE);
+}
+
+typedef struct {
+  uint32_t t_min;
+  uint32_t t_sum;
+  lbm_uint gc_num;
+  lbm_uint const_words;
+  char res[256];
+} bench_res_t;
+
+static bool run_bench(bool use_image, lbm_uint img_size, bench_res_t *r) {
+  memset(r, 0, sizeof(bench_res_t));
+  r->t_min = UINT32_MAX;
+
+  for (int i = 0;i < NUM_RUNS;i++) {
+    if (!bench_start_lbm(&conf)) return false;
+
+    uint32_t t;
+    if (use_image) {
+      uint32_t start = bench_timestamp();
+      lbm_cid cid = lbm_load_and_eval_image((char*)image, img_size, NULL);
+      if (cid < 0) return false;
+      t = bench_run(cid, start);
+    } else {
+      t = bench_run_source(source);
+      if (t == 0) return false;
+    }
+
+    r->t_sum += t;
+    if (t < r->t_min) r->t_min = t;
+
+    lbm_heap_state_t hs;
+    lbm_get_heap_state(&hs);
+    r->gc_num = hs.gc_num;
+    r->const_words = lbm_flash_memory_usage();
+    strcpy(r->res, bench_res);
+  }
+  return true;
+}
+
+static void print_res(const char *name, bench_res_t *r) {
+  printf("%-8s min %7u us, mean %7u us, GCs %4u, const heap %6u words, result %s\n",
+         name, r->t_min, r->t_sum / NUM_RUNS,
+         (unsigned int)r->gc_num, (unsigned int)r->const_words, r->res);
+}
+
+int main(void) {
+  int src_len = make_source();
+  printf("Source: %d bytes, %d functions\n", src_len, NUM_FUNS);
+
+  lbm_uint img_size = make_image(src_len);
+  if (img_size == 0) {
+    printf("Could not make image: %s\n", bench_res);
+    return 1;
+  }
+  printf("Image:  %u bytes\n", (unsigned int)img_size);
+
+  bench_res_t parse, img;
+  if (!run_bench(false, 0, &parse) || !run_bench(true, img_size, &img)) {
+    printf("Could not start program\n");
+    return 1;
+  }
+
+  print_res("Parse", &parse);
+  print_res("Image", &img);
+  printf("Speedup: %.1fx\n", (double)parse.t_min / (double)img.t_min);
+
+  bool ok = strcmp(parse.res, img.res) == 0;
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Message passing between many contexts. A counter is passed around a
+// ring of contexts that block in recv, so every send has to find its
+// receiver among all the others. The time per message should not depend
+// on the number of contexts.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_common.h"
+
+#define HEAP_SIZE               32768
+#define SOURCE_SIZE             2048
+#define NUM_MSGS                50000
+#define NUM_RUNS                5
+
+static const bench_conf_t conf = {HEAP_SIZE, NULL, NULL};
+
+static char source[SOURCE_SIZE];
+
+static const int num_ctxs[] = {4, 32, 128, 256, 512};
+
+static uint32_t time_ring(int n_ctx, char *res, size_t res_size) {
+  snprintf(source, SOURCE_SIZE,
+           "(defun relay (next)\n"
+           "  (loopwhile t (recv ((? n) (send next (+ n 1))))))\n"
+           "(define next (self))\n"
+           "(looprange i 0 %d (setq next (spawn 64 relay next)))\n"
+           "(define r 0)\n"
+           "(bench-start)\n"
+           "(send next 0)\n"
+           "(loopwhile (< r %d) (recv ((? n) { (setq r n) (send next (+ n 1)) })))\n"
+           "r\n",
+           n_ctx - 1, NUM_MSGS);
+
+  uint32_t t = bench_time_source(&conf, source, NUM_RUNS);
+  snprintf(res, res_size, "%s", bench_res);
+  return t;
+}
+
+int main(void) {
+  bool ok = true;
+  printf("%-10s %12s %12s\n", "Contexts", "Time [us]", "ns/msg");
+  for (size_t i = 0;i < sizeof(num_ctxs) / sizeof(int);i++) {
+    char res[256];
+    uint32_t t = time_ring(num_ctxs[i], res, sizeof(res));
+    bool same = atoi(res) >= NUM_MSGS;
+    ok = ok && same;
+    printf("%-10d %12u %12.1f %s\n", num_ctxs[i], t,
+           (double)t * 1000.0 / (double)NUM_MSGS, same ? "" : res);
+  }
+
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
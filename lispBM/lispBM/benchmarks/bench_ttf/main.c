@@ -0,0 +1,213 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Text rendering with ttf-text from a font prepared with ttf-prepare for a
+// large set of characters. The same text is drawn with the prepared font
+// and with a copy where the glyph and kerning index tables have been
+// removed, as in bins created before the tables were added. Both must
+// give the same image.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "buffer.h"
+#include "extensions/display_extensions.h"
+#include "extensions/ttf_extensions.h"
+
+#define HEAP_SIZE               8192
+#define SOURCE_SIZE             (16 * 1024)
+#define NUM_REPS                20
+#define NUM_RUNS                3
+#define FONT_FILE               "../../doc/Ubuntu-Regular.ttf"
+
+static char source[SOURCE_SIZE];
+
+static uint8_t *font_data = NULL;
+static long font_size = 0;
+static char chars[4096];
+
+static uint32_t run_crc = 0;
+static lbm_uint run_bin_size = 0;
+
+static void image_result(lbm_value r) {
+  run_crc = 0;
+  lbm_array_header_t *arr = lbm_dec_array_r(r);
+  if (arr) {
+    // FNV-1a over the image buffer
+    run_crc = 2166136261u;
+    for (lbm_uint i = 0;i < arr->size;i++) {
+      run_crc = (run_crc ^ ((uint8_t*)arr->data)[i]) * 16777619u;
+    }
+  }
+}
+
+static lbm_value ext_font_data(lbm_value *args, lbm_uint argn) {
+  (void)args;
+  (void)argn;
+  lbm_value res;
+  if (!lbm_create_array(&res, (lbm_uint)font_size)) {
+    return ENC_SYM_MERROR;
+  }
+  lbm_array_header_t *arr = lbm_dec_array_r(res);
+  memcpy(arr->data, font_data, (size_t)font_size);
+  return res;
+}
+
+static lbm_value ext_chars(lbm_value *args, lbm_uint argn) {
+  (void)args;
+  (void)argn;
+  lbm_value res;
+  if (!lbm_create_array(&res, strlen(chars) + 1)) {
+    return ENC_SYM_MERROR;
+  }
+  lbm_array_header_t *arr = lbm_dec_array_r(res);
+  memcpy(arr->data, chars, strlen(chars) + 1);
+  return res;
+}
+
+// Copy a prepared font without the "gindex" and "kindex" sections.
+static lbm_value ext_strip_index(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *bin;
+  if (argn != 1 || !(bin = lbm_dec_array_r(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+  run_bin_size = bin->size;
+
+  lbm_value res;
+  if (!lbm_create_array(&res, bin->size)) {
+    return ENC_SYM_MERROR;
+  }
+  lbm_array_header_t *arr = lbm_dec_array_r(res);
+  uint8_t *src = (uint8_t*)bin->data;
+  uint8_t *dst = (uint8_t*)arr->data;
+
+  int32_t preamble = 4 + (int32_t)sizeof("font");
+  memcpy(dst, src, (size_t)preamble);
+  int32_t i = preamble;
+  int32_t n = preamble;
+  while (i < (int32_t)bin->size) {
+    int32_t start = i;
+    char *name = (char*)&src[i];
+    i += (int32_t)strlen(name) + 1;
+    i += (int32_t)buffer_get_uint32(src, &i);
+    if (strcmp(name, "gindex") != 0 && strcmp(name, "kindex") != 0) {
+      memcpy(dst + n, src + start, (size_t)(i - start));
+      n += i - start;
+    }
+  }
+  arr->size = (lbm_uint)n;
+  return res;
+}
+
+static bool init_ttf(void) {
+  lbm_display_extensions_init();
+  lbm_ttf_extensions_init();
+  lbm_add_extension("font-data", ext_font_data);
+  lbm_add_extension("chars", ext_chars);
+  lbm_add_extension("strip-index", ext_strip_index);
+  return true;
+}
+
+static const bench_conf_t conf = {HEAP_SIZE, init_ttf, image_result};
+
+static int append_utf8(char *buf, uint32_t c) {
+  if (c < 0x80) {
+    buf[0] = (char)c;
+    return 1;
+  } else if (c < 0x800) {
+    buf[0] = (char)(0xC0 | (c >> 6));
+    buf[1] = (char)(0x80 | (c & 0x3F));
+    return 2;
+  }
+  buf[0] = (char)(0xE0 | (c >> 12));
+  buf[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+  buf[2] = (char)(0x80 | (c & 0x3F));
+  return 3;
+}
+
+// Printable ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic
+static int make_chars(char *buf) {
+  static const uint32_t ranges[][2] = {
+    {0x20, 0x7E}, {0xA1, 0x17F}, {0x391, 0x3C9}, {0x400, 0x45F},
+  };
+  int n = 0;
+  int num = 0;
+  for (size_t r = 0;r < sizeof(ranges) / sizeof(ranges[0]);r++) {
+    for (uint32_t c = ranges[r][0];c <= ranges[r][1];c++) {
+      if (c == '"' || c == '\\') continue;
+      n += append_utf8(buf + n, c);
+      num++;
+    }
+  }
+  buf[n] = 0;
+  return num;
+}
+
+static uint32_t time_text(bool strip, uint32_t *crc) {
+  snprintf(source, SOURCE_SIZE,
+           "(define char-set (chars))\n"
+           "(define bin (ttf-prepare (font-data) 14 'indexed4 char-set))\n"
+           "(if %s (setq bin (strip-index bin)) (strip-index bin))\n"
+           "(define text (str-merge \"Hello World. To the AVAV water!\\n\" char-set))\n"
+           "(define img (img-buffer 'indexed4 320 240))\n"
+           "(bench-start)\n"
+           "(looprange i 0 %d\n"
+           "  (ttf-text img -2000 16 '(0 1 2 3) bin text))\n"
+           "img\n",
+           strip ? "t" : "nil", NUM_REPS);
+
+  uint32_t t = bench_time_source(&conf, source, NUM_RUNS);
+  *crc = run_crc;
+  return t;
+}
+
+int main(void) {
+  FILE *fp = fopen(FONT_FILE, "rb");
+  if (!fp) {
+    printf("Could not open %s\n", FONT_FILE);
+    return 1;
+  }
+  fseek(fp, 0, SEEK_END);
+  font_size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  font_data = malloc((size_t)font_size);
+  if (!font_data || fread(font_data, 1, (size_t)font_size, fp) != (size_t)font_size) {
+    printf("Could not read %s\n", FONT_FILE);
+    return 1;
+  }
+  fclose(fp);
+
+  int num_chars = make_chars(chars);
+
+  uint32_t crc_idx = 0;
+  uint32_t crc_old = 0;
+  uint32_t t_idx = time_text(false, &crc_idx);
+  uint32_t t_old = time_text(true, &crc_old);
+
+  bool ok = crc_idx != 0 && crc_idx == crc_old;
+  printf("%d glyphs, bin size %u bytes\n", num_chars, (unsigned int)run_bin_size);
+  printf("%-10s %12s %10s\n", "Bin", "Time [us]", "Checksum");
+  printf("%-10s %12u   %08x\n", "indexed", t_idx, crc_idx);
+  printf("%-10s %12u   %08x\n", "linear", t_old, crc_old);
+  printf("Speedup: %.1fx\n", (double)t_old / (double)t_idx);
+
+  free(font_data);
+  printf("Result: %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
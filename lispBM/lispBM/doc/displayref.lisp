@@ -54,6 +54,61 @@
                       ))
               end)))
 
+(define dirty-regions
+  (ref-entry "img-dirty"
+             (list
+              (para (list "Image buffers created with `img-buffer` keep track of the rectangle that"
+                          "has been drawn to since the image was last rendered to the display."
+                          "All drawing functions grow this dirty rectangle and `disp-render` and"
+                          "`disp-render-dirty` clear it. `img-dirty` returns the dirty rectangle"
+                          "as a list `(x y width height)`, or nil if nothing has changed."
+                          "A new image buffer is completely dirty."
+                          "Image buffers that do not track changes, such as images loaded from files,"
+                          "are always reported as completely dirty."
+                          ))
+              (code '((define dirty-img (img-buffer 'indexed2 100 50))
+                      (img-dirty dirty-img)
+                      (img-clear-dirty dirty-img)
+                      (img-dirty dirty-img)
+                      (img-rectangle dirty-img 10 20 30 5 1 '(filled))
+                      (img-setpix dirty-img 60 10 1)
+                      (img-dirty dirty-img)
+                      ))
+              (para (list "`img-mark-dirty` adds a rectangle to the dirty region, or the whole image"
+                          "if no rectangle is given, and `img-clear-dirty` marks the image as clean."
+                          "These are useful when the image is modified by other means than the drawing"
+                          "functions, for example with `bufset-u8`."
+                          ))
+              (code '((img-clear-dirty dirty-img)
+                      (img-mark-dirty dirty-img 90 40 20 20)
+                      (img-dirty dirty-img)
+                      (img-mark-dirty dirty-img)
+                      (img-dirty dirty-img)
+                      ))
+              end)))
+
+(define render-dirty
+  (ref-entry "disp-render-dirty"
+             (list
+              (para (list "`disp-render-dirty` takes the same arguments as `disp-render`, but only"
+                          "sends the dirty rectangle of the image to the display and then clears it."
+                          "The result is t if something was rendered and nil if the image has not"
+                          "changed since it was last rendered. When only a small part of a large image"
+                          "changes between frames, such as a gauge or a number, this saves most of"
+                          "the time spent transferring pixels to the display."
+                          "The dirty rectangle is copied to a temporary image buffer before it is"
+                          "rendered. If there is not enough memory for that the whole image is rendered."
+                          ))
+              (code '((define gauge (img-buffer 'indexed2 200 100))
+                      (disp-render-dirty gauge 0 0 '(0x000000 0xFFFFFF))
+                      (disp-render-dirty gauge 0 0 '(0x000000 0xFFFFFF))
+                      (img-rectangle gauge 20 40 80 20 1 '(filled))
+                      (img-dirty gauge)
+                      (disp-render-dirty gauge 0 0 '(0x000000 0xFFFFFF))
+                      (img-dirty gauge)
+                      ))
+              end)))
+
 (define arcs
     (ref-entry "img-arc"
 	       (list
@@ -311,6 +366,8 @@
    (section 1 "Reference"
             (list create_image1
                   image-from-bin
+                  dirty-regions
+                  render-dirty
                   blitting
 		  arcs
                   circles
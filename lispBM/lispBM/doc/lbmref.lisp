@@ -1534,6 +1534,44 @@
                       ))
               end)))
 
+(define special-form-read-image
+  (ref-entry "read-image"
+             (list
+              (para (list "Reads a program and stores it as an image in a byte array. The form of a read-image"
+                          "expression is `(read-image string buffer)`. The top-level expressions are read one at"
+                          "a time and stored as flat values together with the `@const-start` and `@const-end` state."
+                          "The result is the size of the image in bytes. An image can only be used on a platform"
+                          "with the same word size as the one that created it."
+                          ))
+              end)))
+
+(define special-form-eval-image
+  (ref-entry "eval-image"
+             (list
+              (para (list "Evaluates a program image created by read-image. The form of an eval-image expression"
+                          "is `(eval-image image)`. The result is the same as read-eval-program on the source"
+                          "of the image, but nothing is parsed. Expressions that were read between `@const-start`"
+                          "and `@const-end` are placed directly in constant memory."
+                          ))
+              end)))
+
+(define special-form-compile
+  (ref-entry "compile"
+             (list
+              (para (list "Compiles a function to bytecode. The form of a compile expression is `(compile 'f)`"
+                          "or `(compile closure)`. Compiling a symbol replaces its global binding with the"
+                          "compiled closure, which is also the result. A compiled closure is called in the same way"
+                          "as any other closure but runs faster, as parameters and local variables are kept in"
+                          "slots instead of in the environment, fundamental operations are called directly and"
+                          "recursive calls in tail position become jumps."
+                          ))
+              (para (list "The body may use if, cond, and, or, progn, var, let, loop, setq, define, quote,"
+                          "loopwhile, looprange, loopfor, loopforeach and break together with calls to any functions."
+                          "Other special forms and macros result in an eval_error. Local variables of a compiled"
+                          "function are not visible to eval."
+                          ))
+              end)))
+
 (define special-form-trap
   (ref-entry "trap"
              (list
@@ -1578,6 +1616,9 @@
                   special-form-read
                   special-form-read-program
                   special-form-read-eval-program
+                  special-form-read-image
+                  special-form-eval-image
+                  special-form-compile
                   special-form-trap
                   )
             )))
@@ -1960,6 +2001,163 @@
             assoc-cossa
             assoc-setassoc
             )))
+;; Hash maps
+
+(define hm-mkhashmap
+  (ref-entry "mkhashmap"
+             (list
+              (para (list "Create an empty hash map. The form of a `mkhashmap` expression is `(mkhashmap opt-num-buckets)`."
+                          "The number of buckets defaults to 16 and grows automatically as keys are added, so the"
+                          "argument is only a hint for maps that are known to become large."
+                          ))
+              (code '((define m (mkhashmap))
+                      (hashmap? m)
+                      ))
+              end)))
+
+(define hm-hashmap-set
+  (ref-entry "hashmap-set"
+             (list
+              (para (list "Add or update the value of a key in a hash map. The form of a `hashmap-set`"
+                          "expression is `(hashmap-set map-expr key-expr value-expr)`. The map is updated"
+                          "destructively and returned."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 'speed 10)
+                          (hashmap-set m "name" 'motor)
+                          (hashmap-count m)
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-get
+  (ref-entry "hashmap-get"
+             (list
+              (para (list "Look up a key in a hash map. The form of a `hashmap-get` expression is"
+                          "`(hashmap-get map-expr key-expr opt-default-expr)`. If the key is not"
+                          "in the map the default value is returned, or nil if no default is given."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 'speed 10)
+                          (hashmap-get m 'speed)
+                          )
+                         ((define m (mkhashmap))
+                          (hashmap-get m 'speed 'none)
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-remove
+  (ref-entry "hashmap-remove"
+             (list
+              (para (list "Remove a key from a hash map. The form of a `hashmap-remove` expression is"
+                          "`(hashmap-remove map-expr key-expr)`. Removing a key that is not in the map"
+                          "does nothing."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 'speed 10)
+                          (hashmap-remove m 'speed)
+                          (hashmap-count m)
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-count
+  (ref-entry "hashmap-count"
+             (list
+              (para (list "Number of keys in a hash map. The form of a `hashmap-count` expression is"
+                          "`(hashmap-count map-expr)`."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 1 'a)
+                          (hashmap-set m 2 'b)
+                          (hashmap-count m)
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-keys
+  (ref-entry "hashmap-keys"
+             (list
+              (para (list "List of all keys in a hash map. The form of a `hashmap-keys` expression is"
+                          "`(hashmap-keys map-expr)`. The order of the keys is not specified."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 1 'a)
+                          (hashmap-set m 2 'b)
+                          (sort < (hashmap-keys m))
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-to-list
+  (ref-entry "hashmap-to-list"
+             (list
+              (para (list "Convert a hash map to an alist. The form of a `hashmap-to-list` expression is"
+                          "`(hashmap-to-list map-expr)`. The pairs in the alist are copies, so changing"
+                          "them does not change the map. This is the way to iterate over all entries in a map."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 1 10)
+                          (hashmap-set m 2 20)
+                          (define sum 0)
+                          (loopforeach p (hashmap-to-list m) (setq sum (+ sum (cdr p))))
+                          sum
+                          )
+                         ))
+              end)))
+
+(define hm-hashmap-p
+  (ref-entry "hashmap?"
+             (list
+              (para (list "Check if a value is a hash map. The form of a `hashmap?` expression is"
+                          "`(hashmap? expr)`."
+                          ))
+              (code '((hashmap? (mkhashmap))
+                      (hashmap? (list '(1 . 2)))
+                      ))
+              end)))
+
+(define hm-hashmap-rehash
+  (ref-entry "hashmap-rehash"
+             (list
+              (para (list "Recompute the bucket of every key in a hash map. The form of a `hashmap-rehash`"
+                          "expression is `(hashmap-rehash map-expr)`. Symbols are numbered differently in"
+                          "different runtimes, so a map that was flattened in one runtime and unflattened in"
+                          "another has to be rehashed before it is used. This is not needed when the map stays"
+                          "in the same runtime, for example when it is sent between processes."
+                          ))
+              (program '(((define m (mkhashmap))
+                          (hashmap-set m 'speed 10)
+                          (define m2 (hashmap-rehash (unflatten (flatten m))))
+                          (hashmap-get m2 'speed)
+                          )
+                         ))
+              end)))
+
+(define hash-maps
+  (section 2 "Hash maps"
+           (list
+            (para (list "A hash map is a key-value lookup structure, just like an alist, but looking up"
+                        "a key does not have to walk through all the other keys. For tables with more than"
+                        "a handful of keys that are looked up often, hash maps are much faster than alists."
+                        ))
+            (para (list "Keys are compared in the same way as with `assoc`, so numbers, symbols, strings,"
+                        "lists and arrays can all be used as keys. A key must not be modified after"
+                        "it has been added to a map."
+                        "A hash map is stored in a lisp array, so it is handled by the GC and can be flattened,"
+                        "sent in messages and stored in flash like any other value. Maps in flash are read-only."
+                        ))
+            hm-mkhashmap
+            hm-hashmap-set
+            hm-hashmap-get
+            hm-hashmap-remove
+            hm-hashmap-count
+            hm-hashmap-keys
+            hm-hashmap-to-list
+            hm-hashmap-p
+            hm-hashmap-rehash
+            )))
 
 ;; Byte buffers
 
@@ -2059,6 +2257,35 @@
                       ))
               end)))
 
+(define bb-f32-kernels
+  (ref-entry "buf-f32 kernels"
+             (list
+              (para (list "A family of functions operate on whole byte arrays of 32-bit floats, encoded"
+                          "in the same way as by `bufset-f32`. This is much faster than looping over the"
+                          "elements with `bufget-f32` and `bufset-f32` and no boxed floats are allocated."
+                          "All of them take the optional symbol `'little-endian` as the last argument."
+                          "When two arrays are given the shorter one decides the number of elements and"
+                          "results are written back to the first array."
+                          ))
+              (bullet '("`(buf-f32-axpy y a x)` - y = a * x + y"
+                        "`(buf-f32-dot x y)` - Dot product of x and y"
+                        "`(buf-f32-scale x a optB)` - x = a * x + b"
+                        "`(buf-f32-add y x)` - y = y + x"
+                        "`(buf-f32-mul y x)` - y = y * x"
+                        "`(buf-f32-stats x)` - The list (min max mean rms) of x"
+                        "`(buf-f32-fir x taps optState)` - FIR filter x in place. The optional state array holds the last num-taps - 1 inputs between calls."
+                        "`(buf-f32-biquad x coeffs)` - Biquad filter x in place. coeffs holds a0 a1 a2 b1 b2 z1 z2 and the state z1 z2 is updated."
+                        ))
+              (program '(((define x (bufcreate 12))
+                          (bufset-f32 x 0 1.0)
+                          (bufset-f32 x 4 2.0)
+                          (bufset-f32 x 8 3.0)
+                          (buf-f32-scale x 2.0 1.0)
+                          (buf-f32-stats x)
+                          )
+                         ))
+              end)))
+
 (define bb-literal
   (ref-entry "Byte buffer literal syntax"
              (list
@@ -2081,6 +2308,7 @@
                  bb-bufget
                  bb-bufset
                  bb-bufclear
+                 bb-f32-kernels
                  bb-literal
                  )))
 
@@ -3087,6 +3315,7 @@
                                  special-forms
                                  lists
                                  assoc-lists
+                                 hash-maps
                                  bytebuffers
                                  arrays
 				 defrag-mem
@@ -285,6 +285,66 @@
                  word
                  )))
 
+(define profiling-ctx-stats
+  (ref-entry "prof-ctx-stats"
+             (list
+              (para (list "`prof-ctx-stats` returns a list with statistics for each thread."
+                          "Each element is a list `(cid name steps run-us blocked-us cells gc-num mail-max)`"
+                          "where `steps` is the number of evaluation steps, `run-us` and `blocked-us`"
+                          "are the time spent running and blocked or sleeping in microseconds, `cells` is the"
+                          "number of cons cells allocated, `gc-num` is the number of garbage collections that"
+                          "happened while the thread was running and `mail-max` is the largest number of messages"
+                          "that has been in the mailbox. Time that has not yet been completed, such as the time"
+                          "slice of the thread asking, is not included."
+                          "Profiling statistics are only available when LBM is compiled with `-DLBM_USE_PROF_STATS`."
+                          ))
+              (code '((prof-ctx-stats)
+                      ))
+              end)))
+
+(define profiling-ext-stats
+  (ref-entry "prof-ext-stats"
+             (list
+              (para (list "`prof-ext-stats` returns a list `(extension calls time-us)` for each extension"
+                          "that has been called. Extension statistics are only collected when the platform"
+                          "has provided storage for them with `lbm_prof_ext_init`."
+                          ))
+              (code '((prof-reset)
+                      (prof-ext-stats)
+                      ))
+              end)))
+
+(define profiling-reset
+  (ref-entry "prof-reset"
+             (list
+              (para (list "`prof-reset` clears the statistics of all threads and extensions."
+                          ))
+              (code '((prof-reset)
+                      ))
+              end)))
+
+(define profiling-event-queues
+  (ref-entry "event-queue-stats"
+             (list
+              (para (list "`event-queue-stats` returns a list `(name size dropped max-used)` for each event queue."
+                          "The first element is the shared event queue and the rest are the queues that the"
+                          "platform has added for producers that send many events, such as a CAN bus."
+                          "`dropped` is the number of events that were lost because the queue was full and"
+                          "`max-used` is the largest number of events that have been waiting in the queue at once."
+                          "The event queue statistics do not require `-DLBM_USE_PROF_STATS`."
+                          ))
+              (code '((event-queue-stats)
+                      ))
+              end)))
+
+(define chapter-profiling
+  (section 2 "Profiling"
+           (list profiling-ctx-stats
+                 profiling-ext-stats
+                 profiling-reset
+                 profiling-event-queues
+                 )))
+
 (define hide-em
   (ref-entry "hide-trapped-error"
              (list
@@ -327,6 +387,7 @@
              chapter-environments
              chapter-gc
              chapter-memory
+             chapter-profiling
              chapter-scheduling
              chapter-symboltable
              chapter-threads
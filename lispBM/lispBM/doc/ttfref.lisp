@@ -191,8 +191,15 @@
                          ))
              (bullet '("Line metrics table - \"lmtx\"" 
                        "Kerning table - \"kern\""
+                       "Kerning index - \"kindex\""
                        "Glyph table - \"glyphs\""
+                       "Glyph index - \"gindex\""
                        ))
+             (para (list "Tables of unknown kinds can be skipped using the size field."
+                         "The index tables were added in version 1 of the format and are"
+                         "optional. Without them glyphs and kerning pairs are found by"
+                         "searching the tables from the start."
+                         ))
              (para (list "**Line metrics**"
                          ))
              (bullet '("\"lmtx\" - zero terminated string"
@@ -238,6 +245,24 @@
                        "height : int32"
                        "data : uint8[]"
                        ))
+             (para (list "**Index tables**"
+                         ))
+             (para (list "The kerning index has one entry per kerning table row and the glyph index"
+                         "one entry per glyph. The entries are sorted by utf32 code and the offset is"
+                         "the position of the kerning row or glyph from the start of the binary blob."
+                         "The pairs in a kerning row are also sorted by utf32 code, so that both glyphs"
+                         "and kerning pairs can be found with a binary search."
+                         ))
+             (bullet '("\"kindex\" or \"gindex\" - zero terminated string"
+                       "size - uint32"
+                       "num_entries - uint32"
+                       "entries - index_entry[]"
+                       ))
+             (para (list "index_entry:"
+                         ))
+             (bullet '("utf32 : uint32"
+                       "offset : uint32"
+                       ))
              )
             )        
    (section 1 "Reference"
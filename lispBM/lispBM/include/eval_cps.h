@@ -36,6 +36,13 @@ extern "C" {
 
 #define EVAL_CPS_DEFAULT_MAILBOX_SIZE 10
 
+/** Number of buckets in the context-id to context index as a power of 2.
+ *  Sends, unblocks and kills look up their target context in the index.
+ */
+#ifndef EVAL_CPS_CTX_INDEX_BITS
+#define EVAL_CPS_CTX_INDEX_BITS 6
+#endif
+
 // Make sure the flags fit in an u28. (do not go beyond 27 flags)
 #define EVAL_CPS_CONTEXT_FLAG_NOTHING               (uint32_t)0x00
 #define EVAL_CPS_CONTEXT_FLAG_TRAP                  (uint32_t)0x01
@@ -60,6 +67,24 @@ extern "C" {
 #define LBM_IS_STATE_WAKE_UP_WAKABLE(X) (X & (LBM_THREAD_STATE_SLEEPING | LBM_IS_STATE_TIMEOUT(X)))
 #define LBM_IS_STATE_UNBLOCKABLE(X) (X & (LBM_THREAD_STATE_BLOCKED | LBM_THREAD_STATE_TIMEOUT))
 #define LBM_IS_STATE_RECV(X) (X & (LBM_THREAD_STATE_RECV_BL | LBM_THREAD_STATE_RECV_TO))
+
+#ifdef LBM_USE_PROF_STATS
+/** Per context statistics collected by the evaluator when
+ *  LBM_USE_PROF_STATS is defined. Times are measured with the
+ *  timestamp callback and have its resolution.
+ */
+typedef struct {
+  lbm_uint steps;        /* Evaluation steps performed */
+  uint64_t run_us;       /* Time spent running */
+  uint64_t blocked_us;   /* Time spent blocked or sleeping */
+  lbm_uint cells;        /* Cons cells allocated */
+  lbm_uint gc_num;       /* Garbage collections performed while running */
+  uint32_t mail_max;     /* Mailbox high water mark */
+  /* Bookkeeping */
+  uint32_t t_start;      /* When the context started running or got blocked */
+  lbm_uint cells_start;  /* Allocation count when the context started running */
+} lbm_ctx_stats_t;
+#endif
 typedef struct eval_context_s{
   lbm_value program;
   lbm_value curr_exp;
@@ -84,6 +109,11 @@ typedef struct eval_context_s{
   /* List structure */
   struct eval_context_s *prev;
   struct eval_context_s *next;
+  struct eval_context_queue_s *queue; /* Queue the context is in, NULL while running */
+  struct eval_context_s *index_next;  /* Next context in the same index bucket */
+#ifdef LBM_USE_PROF_STATS
+  lbm_ctx_stats_t stats;
+#endif
 } eval_context_t;
 
 typedef enum {
@@ -91,6 +121,7 @@ typedef enum {
   LBM_EVENT_UNBLOCK_CTX,
   LBM_EVENT_DEFINE,
   LBM_EVENT_RUN_USER_CALLBACK,
+  LBM_EVENT_BUILD,
 } lbm_event_type_t;
 
 typedef struct {
@@ -100,6 +131,32 @@ typedef struct {
   lbm_uint buf_len;
 } lbm_event_t;
 
+/** Function that creates the value of an LBM_EVENT_BUILD event. It is
+ *  called by the evaluator between evaluation steps and may allocate on
+ *  the heap. If it returns ENC_SYM_MERROR the GC is run and it is called
+ *  again with retry set. If that also fails the event is dropped and the
+ *  function is responsible for releasing whatever arg refers to.
+ */
+typedef lbm_value (*lbm_event_build_fun)(lbm_uint arg, bool retry);
+
+/** Single producer event queue.
+ *  One producer thread pushes events and the evaluator drains them
+ *  without taking any lock. head is only written by the producer and
+ *  tail only by the evaluator. Both are free running counters and the
+ *  size of the queue must be a power of two.
+ */
+typedef struct lbm_event_queue_s {
+  const char *name;
+  lbm_event_t *events;
+  uint32_t size;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;   /* Events rejected because the queue was full */
+  volatile uint32_t max_used;  /* High-water mark of queued events */
+  volatile bool active;
+  struct lbm_event_queue_s *next;
+} lbm_event_queue_t;
+
 /** Fundamental operation type */
 typedef lbm_value (*fundamental_fun)(lbm_value *, lbm_uint, eval_context_t*);
 
@@ -182,10 +239,65 @@ bool lbm_event(lbm_flat_value_t *fv);
  * \return true on success.
  */
 bool lbm_event_unboxed(lbm_value unboxed);
-/** Check if the event queue is empty.
+/** Check if the event queue and all registered producer queues are empty.
  * \return true if event queue is empty, otherwise false.
  */
 bool lbm_event_queue_is_empty(void);
+/** Get statistics for the shared event queue.
+ * \param dropped Number of events that did not fit in the queue.
+ * \param max_used High-water mark of the queue.
+ * \return The size of the queue.
+ */
+uint32_t lbm_event_stats(uint32_t *dropped, uint32_t *max_used);
+/** Initialize a single producer event queue.
+ * \param q Queue to initialize.
+ * \param name Name used when reporting statistics.
+ * \param storage Storage for size events. Must outlive the queue.
+ * \param size Number of events, must be a power of two.
+ * \return true on success, false if size is not a power of two.
+ */
+bool lbm_event_queue_init(lbm_event_queue_t *q, const char *name, lbm_event_t *storage, uint32_t size);
+/** Register a queue to be drained by the evaluator. Queues are
+ *  unregistered by lbm_eval_init_events and have to be added again
+ *  after that. Pending events are discarded when the queue is added.
+ * \param q Queue to register.
+ */
+void lbm_event_queue_add(lbm_event_queue_t *q);
+/** Get the first registered queue. Follow next to iterate.
+ * \return First registered queue or NULL.
+ */
+lbm_event_queue_t *lbm_event_queue_first(void);
+/** Send an event to the registered event handler through a producer queue.
+ *  Works like lbm_event but must only be called from the single producer
+ *  of q. If false is returned the caller is still responsible for fv.
+ * \param q Producer queue.
+ * \param fv Flat value to send.
+ * \return true if the event was added to the queue.
+ */
+bool lbm_event_queue_event(lbm_event_queue_t *q, lbm_flat_value_t *fv);
+/** Send an unboxed value to the event handler through a producer queue.
+ * \param q Producer queue.
+ * \param unboxed A symbol, int, uint or character.
+ * \return true if the event was added to the queue.
+ */
+bool lbm_event_queue_unboxed(lbm_event_queue_t *q, lbm_value unboxed);
+/** Unblock a context through a producer queue. Works like lbm_unblock_ctx.
+ * \param q Producer queue.
+ * \param cid Context to unblock.
+ * \param fv Flat value to unblock with.
+ * \return true if the event was added to the queue.
+ */
+bool lbm_event_queue_unblock_ctx(lbm_event_queue_t *q, lbm_cid cid, lbm_flat_value_t *fv);
+/** Send an event whose value is created by the evaluator. This avoids
+ *  flattening into lbm_memory, for example when the value refers to
+ *  platform owned buffers through borrowed arrays.
+ * \param q Producer queue.
+ * \param cid Context to unblock or -1 to send the value to the event handler.
+ * \param fun Function that creates the value.
+ * \param arg Argument passed to fun.
+ * \return true if the event was added to the queue.
+ */
+bool lbm_event_queue_build(lbm_event_queue_t *q, lbm_cid cid, lbm_event_build_fun fun, lbm_uint arg);
 /** Remove a context that has finished executing and free up its associated memory.
  *
  * \param cid Context id of context to free.
@@ -50,6 +50,7 @@ typedef struct {
   uint16_t height;
   uint8_t  *data;
   uint8_t  *mem_base;
+  uint8_t  *dirty; // Dirty rectangle of the buffer, NULL if not tracked
 } image_buffer_t;
 
 
@@ -70,6 +71,11 @@ typedef struct {
 
 #define IMAGE_BUFFER_HEADER_SIZE (lbm_uint)5
 
+// Image buffers created with img-buffer have a trailer after the pixel
+// data with a magic and the dirty rectangle as x0, y0, x1, y1 (BE16, end
+// exclusive). The rectangle is empty when x0 >= x1.
+#define IMAGE_BUFFER_DIRTY_SIZE (lbm_uint)12
+
 static inline uint8_t color_format_to_byte(color_format_t fmt) {
   return (uint8_t)fmt;
 }
@@ -182,8 +188,20 @@ uint32_t getpixel(image_buffer_t* img, int x_i, int y_i);
 bool lbm_display_is_color(lbm_value v);
 uint32_t lbm_display_rgb888_from_color(color_t color, int x, int y);
 void image_buffer_clear(image_buffer_t *img, uint32_t cc);
+void image_buffer_from_array(image_buffer_t *img, lbm_array_header_t *arr);
+
+// Read up to len bytes of a jpg into buf, or skip len bytes if buf is
+// NULL. Returns the number of bytes read or skipped.
+typedef size_t (*disp_jpg_read_t)(void *arg, uint8_t *buf, size_t len);
+
+// Decode a jpg from read and render it block by block at x, y.
+lbm_value lbm_display_render_jpg(disp_jpg_read_t read, void *arg, int x, int y);
 
 void lbm_display_extensions_init(void);
+// Lets disp-render-jpg read from other values than byte arrays, such as
+// file handles. source returns true and sets read and arg if it can read
+// from v.
+void lbm_display_extensions_set_jpg_source(bool(* volatile source)(lbm_value v, disp_jpg_read_t *read, void **arg));
 void lbm_display_extensions_set_callbacks(
                                           bool(* volatile render_image)(image_buffer_t *img, uint16_t x, uint16_t y, color_t *colors),
                                           void(* volatile clear)(uint32_t color),
@@ -0,0 +1,39 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* The hashmap extensions add a hash map datatype based upon lisp arrays.
+   A map is an array [| hashmap count bucket0 bucket1 ... |] where every
+   bucket is an association list. As it is an ordinary lisp array it is
+   handled by the GC, flatten/unflatten and the constant heap without any
+   special cases. Keys are compared in the same way as with assoc. */
+
+#ifndef HASHMAP_EXTENSIONS_H_
+#define HASHMAP_EXTENSIONS_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lbm_hashmap_extensions_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -635,6 +635,20 @@ int lbm_heap_allocate_lisp_array(lbm_value *res, lbm_uint size);
  * \return 1 for success and 0 for failure.
  */
 int lbm_lift_array(lbm_value *value, char *data, lbm_uint num_elt);
+/** Create a byte array that borrows a header and data owned by the platform.
+ *  The header and data must be outside of lbm_memory. The array is read-only
+ *  from LBM and the header is handed to the array release callback when the
+ *  array is freed explicitly or by the GC.
+ * \param value Result array.
+ * \param header Header describing the borrowed data.
+ * \return 1 for success and 0 for failure.
+ */
+int lbm_heap_borrow_array(lbm_value *value, lbm_array_header_t *header);
+/** Set the function that is called when a borrowed array is released.
+ *  The callback runs in the evaluator, during GC or explicit free.
+ * \param fptr Callback or NULL.
+ */
+void lbm_heap_set_array_release_callback(void (*fptr)(lbm_array_header_t *));
 /** Get the size of an array value.
  * \param arr lbm_value array to get size of.
  * \return -1 for failure or length of array.
@@ -880,10 +894,27 @@ static inline bool lbm_is_array_r(lbm_value x) {
   return (((t & LBM_PTR_TO_CONSTANT_MASK) == LBM_TYPE_ARRAY) && lbm_heap_array_valid(x)) ;
 }
 
+/** Check if value is an array that can be READ and WRITTEN.
+ * Borrowed arrays are read-only.
+ * \param x Value to check.
+ * \return true if x represents a writable array and false otherwise.
+ */
 static inline bool lbm_is_array_rw(lbm_value x) {
   return ((lbm_type_of(x) == LBM_TYPE_ARRAY) &&
           !(x & LBM_PTR_TO_CONSTANT_BIT) &&
-          lbm_heap_array_valid(x));
+          lbm_heap_array_valid(x) &&
+          lbm_memory_ptr_inside((lbm_uint*)lbm_car(x)));
+}
+
+/** Check if value is a borrowed array, see lbm_heap_borrow_array.
+ * \param x Value to check.
+ * \return true if x is a borrowed array and false otherwise.
+ */
+static inline bool lbm_is_array_borrowed(lbm_value x) {
+  return ((lbm_type_of(x) == LBM_TYPE_ARRAY) &&
+          !(x & LBM_PTR_TO_CONSTANT_BIT) &&
+          lbm_heap_array_valid(x) &&
+          !lbm_memory_ptr_inside((lbm_uint*)lbm_car(x)));
 }
 
 static inline bool lbm_is_lisp_array_r(lbm_value x) {
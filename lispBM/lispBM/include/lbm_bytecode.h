@@ -0,0 +1,88 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file lbm_bytecode.h
+ *  Compiler from closures to a stack bytecode that is run by the evaluator.
+ *
+ *  A compiled closure has the form (closure params (bytecode code consts) env)
+ *  where code is a byte array and consts is a lisp array. Parameters and
+ *  let/var bindings live in numbered local slots instead of in the
+ *  environment, calls to fundamentals are made directly by index and self
+ *  tail calls become jumps. Everything else, such as globals and calls to
+ *  other functions, behaves as in the interpreter. As the local variables
+ *  are not in the environment they are not visible to eval.
+ *
+ *  Code layout:
+ *    [0] u8 number of parameters
+ *    [1] u8 number of local slots, parameters included
+ *    [2] u8 maximum operand stack depth
+ *    [3] u8 reserved, 0
+ *    [4] instructions, followed by two zero bytes so that operands
+ *        never are read past the end of the array.
+ *
+ *  The first consts are the parameter symbols, in order. Instruction
+ *  operands are u8, or u16 big endian for const indices and jump targets.
+ */
+
+#ifndef LBM_BYTECODE_H_
+#define LBM_BYTECODE_H_
+
+#include "lbm_types.h"
+
+#define LBM_BC_HEADER_SIZE      4
+
+#define LBM_BC_NIL              0  // push nil
+#define LBM_BC_TRUE             1  // push t
+#define LBM_BC_CONST            2  // u16 ix: push consts[ix]
+#define LBM_BC_LOAD             3  // u8 slot: push local
+#define LBM_BC_STORE            4  // u8 slot: pop into local
+#define LBM_BC_LOAD_VAR         5  // u16 ix: push value of variable consts[ix]
+#define LBM_BC_SET_VAR          6  // u16 ix: setq variable consts[ix] to top, no pop
+#define LBM_BC_DEFINE           7  // u16 ix: define global consts[ix] to top, no pop
+#define LBM_BC_POP              8
+#define LBM_BC_POPN             9  // u8 n
+#define LBM_BC_DUP              10
+#define LBM_BC_JMP              11 // u16 target
+#define LBM_BC_JMP_NIL          12 // u16 target: pop, jump if nil
+#define LBM_BC_JMP_NOT_NIL      13 // u16 target: pop, jump if not nil
+#define LBM_BC_CALL_FUND        14 // u8 fundamental, u8 argn: args on stack
+#define LBM_BC_CALL             15 // u8 argn: function and args on stack
+#define LBM_BC_TAIL_CALL        16 // u8 argn: as call, but replaces this frame
+#define LBM_BC_SELF_TAIL_CALL   17 // u8 argn: args to parameter slots, jump to start
+#define LBM_BC_RET              18 // return top of stack
+
+#define LBM_BC_COMPILE_OK           0
+#define LBM_BC_COMPILE_UNSUPPORTED  -1
+#define LBM_BC_COMPILE_TOO_LARGE    -2
+#define LBM_BC_COMPILE_MERROR       -3
+
+/** Compile a closure to bytecode.
+ *
+ * \param name Symbol the closure is defined as, used to turn self tail calls
+ *             into jumps. nil if unknown.
+ * \param closure Closure to compile.
+ * \param res The compiled closure on success.
+ * \return LBM_BC_COMPILE_OK or one of the LBM_BC_COMPILE error codes.
+ */
+int lbm_bytecode_compile(lbm_value name, lbm_value closure, lbm_value *res);
+/** Get a description of what made the last compilation fail.
+ *
+ * \return Error description string.
+ */
+const char *lbm_bytecode_error_str(void);
+
+#endif
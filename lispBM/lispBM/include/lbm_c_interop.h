@@ -48,6 +48,15 @@ extern "C" {
  * \return A context id on success or 0 on failure.
  */
   lbm_cid lbm_load_and_eval_program_incremental(lbm_char_channel_t *tokenizer, char *name);
+/** Evaluate a program image created with read-image, see lbm_image.h. The image
+ *  data is shared, not copied, so it has to stay valid while the program runs.
+ *
+ * \param data Image data, for example in flash.
+ * \param size Size of the image in bytes.
+ * \param name Name of the thread (or NULL) that evaluates the image.
+ * \return A context id on success or -1 on failure.
+ */
+  lbm_cid lbm_load_and_eval_image(char *data, lbm_uint size, char *name);
 /** Load and schedule an expression for execution.
  *
  * \param tokenizer The tokenizer to read the expression from.
@@ -255,7 +255,8 @@
 #define SYM_TRAP                0x116
 #define SYM_CALL_CC_UNSAFE      0x117
 #define SYM_CONT_SP             0x118
-#define SPECIAL_FORMS_END       0x118
+#define SYM_BYTECODE            0x119
+#define SPECIAL_FORMS_END       0x119
 
 #ifndef LBM64
 #define SPECIAL_FORMS_MASK        0xFFFFFF00
@@ -372,7 +373,10 @@
 #define SYM_SORT                  0x30014
 #define SYM_REST_ARGS             0x30015
 #define SYM_ROTATE                0x30016
-#define SYM_POPRET                0x30017
+#define SYM_READ_IMAGE            0x30017
+#define SYM_EVAL_IMAGE            0x30018
+#define SYM_COMPILE               0x30019
+#define SYM_POPRET                0x3001A
 
 #define SYMBOL_KIND(X)          ((X) >> 16)
 #define SYMBOL_KIND_SPECIAL     0
@@ -518,9 +522,13 @@
 #define ENC_SYM_SORT                  ENC_SYM(SYM_SORT)
 #define ENC_SYM_REST_ARGS             ENC_SYM(SYM_REST_ARGS)
 #define ENC_SYM_ROTATE                ENC_SYM(SYM_ROTATE)
+#define ENC_SYM_READ_IMAGE            ENC_SYM(SYM_READ_IMAGE)
+#define ENC_SYM_EVAL_IMAGE            ENC_SYM(SYM_EVAL_IMAGE)
 #define ENC_SYM_TRAP                  ENC_SYM(SYM_TRAP)
 #define ENC_SYM_CALL_CC_UNSAFE        ENC_SYM(SYM_CALL_CC_UNSAFE)
 #define ENC_SYM_CONT_SP               ENC_SYM(SYM_CONT_SP)
+#define ENC_SYM_BYTECODE              ENC_SYM(SYM_BYTECODE)
+#define ENC_SYM_COMPILE               ENC_SYM(SYM_COMPILE)
 
 #define ENC_SYM_ADD           ENC_SYM(SYM_ADD)
 #define ENC_SYM_SUB           ENC_SYM(SYM_SUB)
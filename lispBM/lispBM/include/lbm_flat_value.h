@@ -57,6 +57,8 @@ typedef struct {
 #define FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY   -6
 #define FLATTEN_VALUE_ERROR_FATAL               -7
 
+#define UNFLATTEN_FLASH_ERROR   -4
+#define UNFLATTEN_FLASH_FULL    -3
 #define UNFLATTEN_MALFORMED     -2
 #define UNFLATTEN_GC_RETRY      -1
 #define UNFLATTEN_OK             0
@@ -89,4 +91,13 @@ void lbm_set_max_flatten_depth(int depth);
  *  \return True on success and false otherwise.
  */
 bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res);
+/** Unflatten a flat value into the constant heap. Symbols that do not exist
+ *  are added with their names in flash. The heap may be garbage collected
+ *  while unflattening.
+ *
+ *  \param v Flat value to unflatten.
+ *  \param res Pointer to where the result lbm_value should be stored.
+ *  \return UNFLATTEN_OK on success or one of the UNFLATTEN error codes.
+ */
+int lbm_unflatten_value_const(lbm_flat_value_t *v, lbm_value *res);
 #endif
@@ -0,0 +1,93 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file lbm_image.h
+ *  Program images are programs that have already been read. They store
+ *  the top level expressions of a program as flat values, in the order
+ *  they appear in the source, together with the @const-start/@const-end
+ *  state of the reader. Evaluating an image gives the same result as
+ *  read-eval-program on the source, but without tokenizing and parsing.
+ *  Expressions that were read inside a @const-start/@const-end block are
+ *  unflattened directly into the constant heap.
+ *
+ *  All multi-byte fields are big endian, as in flat values.
+ *
+ *  Header:
+ *    [0]  u32 magic. The first byte is 0 so that an image never is
+ *             mistaken for source code.
+ *    [4]  u8  version
+ *    [5]  u8  sizeof(lbm_uint) of the platform that built the image.
+ *             Integers are flattened with the platform word size.
+ *    [6]  u16 reserved, 0
+ *    [8]  u32 number of expressions
+ *    [12] u32 image size in bytes, header included
+ *
+ *  Expression:
+ *    [0]  u8  LBM_IMAGE_EXP_RAM or LBM_IMAGE_EXP_CONST
+ *    [1]  u32 flat value size in bytes
+ *    [5]  flat value
+ */
+
+#ifndef LBM_IMAGE_H_
+#define LBM_IMAGE_H_
+
+#include "lbm_types.h"
+#include "lbm_flat_value.h"
+
+#define LBM_IMAGE_MAGIC         0x004C4249 // "\0LBI"
+#define LBM_IMAGE_VERSION       1
+#define LBM_IMAGE_HEADER_SIZE   16
+#define LBM_IMAGE_EXP_HEADER    5
+
+#define LBM_IMAGE_EXP_RAM       0
+#define LBM_IMAGE_EXP_CONST     1
+
+/** Start a new, empty image in a buffer.
+ *
+ * \param buf Buffer to build the image in.
+ * \param buf_size Size of buffer in bytes.
+ * \return true on success, false if the buffer cannot hold the header.
+ */
+bool lbm_image_start(uint8_t *buf, lbm_uint buf_size);
+/** Flatten an expression and append it to an image. The header is updated so
+ *  that the image is valid after every added expression.
+ *
+ * \param buf Buffer with an image started by lbm_image_start.
+ * \param buf_size Size of buffer in bytes.
+ * \param exp Expression to add.
+ * \param constant Whether exp should be placed in the constant heap when loaded.
+ * \return FLATTEN_VALUE_OK on success or one of the FLATTEN_VALUE_ERROR codes.
+ */
+int lbm_image_add_exp(uint8_t *buf, lbm_uint buf_size, lbm_value exp, bool constant);
+/** Check if data starts with a valid image for this platform.
+ *
+ * \param data Data to check.
+ * \param size Number of bytes available in data.
+ * \return Size of the image in bytes, or 0 if data is not a valid image.
+ */
+lbm_uint lbm_image_size(const uint8_t *data, lbm_uint size);
+/** Get an expression from an image.
+ *
+ * \param data Image that has passed lbm_image_size.
+ * \param pos Offset of the expression in the image. Updated to the offset of the next expression.
+ * \param fv Flat value that is set up to point into the image.
+ * \param constant Set to whether the expression goes into the constant heap.
+ * \return true on success, false if there are no more expressions or if the image is malformed.
+ */
+bool lbm_image_get_exp(const uint8_t *data, lbm_uint *pos, lbm_flat_value_t *fv, bool *constant);
+
+#endif
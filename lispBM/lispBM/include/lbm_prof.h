@@ -39,4 +39,30 @@ lbm_uint lbm_prof_get_num_sleep_samples(void);
 lbm_uint lbm_prof_stop(void);
 void lbm_prof_sample(void);
 
+#ifdef LBM_USE_PROF_STATS
+/** Call statistics for one extension, indexed in the same way as the
+ *  extension table.
+ */
+typedef struct {
+  lbm_uint calls;
+  uint64_t time_us;
+} lbm_prof_ext_t;
+
+extern lbm_prof_ext_t *lbm_prof_ext_data;
+extern lbm_uint        lbm_prof_ext_num;
+
+/** Set the storage used for extension call statistics and clear it.
+ *  Extension calls are only counted when storage has been set.
+ *
+ * \param prof_ext_buf Array with one entry per extension or NULL to stop
+ *                     collecting extension statistics.
+ * \param prof_ext_buf_num Number of entries in prof_ext_buf.
+ */
+void lbm_prof_ext_init(lbm_prof_ext_t *prof_ext_buf,
+                       lbm_uint        prof_ext_buf_num);
+/** Clear the statistics of all contexts and extensions.
+ */
+void lbm_prof_stats_reset(void);
+#endif
+
 #endif
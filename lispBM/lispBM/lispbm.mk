@@ -15,6 +15,8 @@ LISPBM_SRC = $(LISPBM)/src/env.c \
              $(LISPBM)/src/lbm_custom_type.c \
              $(LISPBM)/src/lbm_channel.c \
              $(LISPBM)/src/lbm_flat_value.c\
+             $(LISPBM)/src/lbm_image.c \
+             $(LISPBM)/src/lbm_bytecode.c \
              $(LISPBM)/src/lbm_flags.c\
              $(LISPBM)/src/lbm_prof.c\
              $(LISPBM)/src/lbm_defrag_mem.c\
@@ -25,6 +27,7 @@ LISPBM_SRC = $(LISPBM)/src/env.c \
              $(LISPBM)/src/extensions/runtime_extensions.c \
              $(LISPBM)/src/extensions/random_extensions.c \
 	     $(LISPBM)/src/extensions/set_extensions.c \
+             $(LISPBM)/src/extensions/hashmap_extensions.c \
              $(LISPBM)/src/extensions/display_extensions.c \
              $(LISPBM)/src/extensions/tjpgd.c \
              $(LISPBM)/src/extensions/mutex_extensions.c \
@@ -46,6 +49,8 @@ LISPBM_H = $(LISPBM)/include/env.h \
            $(LISPBM)/include/lbm_defrag_mem.h \
            $(LISPBM)/include/lbm_flags.h \
            $(LISPBM)/include/lbm_flat_value.h \
+           $(LISPBM)/include/lbm_image.h \
+           $(LISPBM)/include/lbm_bytecode.h \
            $(LISPBM)/include/lbm_llama_ascii.h \
            $(LISPBM)/include/lbm_memory.h \
            $(LISPBM)/include/lbm_prof.h \
@@ -60,6 +65,7 @@ LISPBM_H = $(LISPBM)/include/env.h \
            $(LISPBM)/include/buffer.h \
            $(LISPBM)/include/extensions/array_extensions.h \
            $(LISPBM)/include/extensions/display_extensions.h \
+           $(LISPBM)/include/extensions/hashmap_extensions.h \
            $(LISPBM)/include/extensions/lbm_dyn_lib.h \
            $(LISPBM)/include/extensions/math_extensions.h \
            $(LISPBM)/include/extensions/random_extensions.h \
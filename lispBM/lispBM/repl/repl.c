@@ -93,6 +93,9 @@ static lbm_char_channel_t buffered_string_tok;
 
 lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
 lbm_prof_t prof_data[100];
+#ifdef LBM_USE_PROF_STATS
+lbm_prof_ext_t prof_ext_data[EXTENSION_STORAGE_SIZE];
+#endif
 
 static char *env_input_file = NULL;
 static char *env_output_file = NULL;
@@ -762,6 +765,9 @@ int init_repl() {
                 EXTENSION_STORAGE_SIZE)) {
     return 0;
   }
+#ifdef LBM_USE_PROF_STATS
+  lbm_prof_ext_init(prof_ext_data, EXTENSION_STORAGE_SIZE);
+#endif
 
   if (!lbm_eval_init_events(20)) {
     return 0;
@@ -1268,6 +1274,9 @@ bool vescif_restart(bool print, bool load_code, bool load_imports) {
                 EXTENSION_STORAGE_SIZE)) {
     return 0;
   }
+#ifdef LBM_USE_PROF_STATS
+  lbm_prof_ext_init(prof_ext_data, EXTENSION_STORAGE_SIZE);
+#endif
 
 
   if (!lbm_eval_init_events(20)) {
@@ -28,6 +28,7 @@
 #include "extensions/math_extensions.h"
 #include "extensions/runtime_extensions.h"
 #include "extensions/set_extensions.h"
+#include "extensions/hashmap_extensions.h"
 #include "extensions/display_extensions.h"
 #include "extensions/mutex_extensions.h"
 #include "extensions/lbm_dyn_lib.h"
@@ -196,6 +197,26 @@ static bool is_file_handle(lbm_value arg) {
   return false;
 }
 
+// disp-render-jpg streams from file handles in chunks instead of
+// requiring the whole file to be loaded into an array.
+static size_t jpg_file_read(void *arg, uint8_t *buf, size_t len) {
+  FILE *fp = (FILE*)arg;
+  if (buf) {
+    return fread(buf, 1, len, fp);
+  }
+  return fseek(fp, (long)len, SEEK_CUR) == 0 ? len : 0;
+}
+
+static bool jpg_file_source(lbm_value v, disp_jpg_read_t *read, void **arg) {
+  if (is_file_handle(v)) {
+    lbm_file_handle_t *h = (lbm_file_handle_t*)lbm_get_custom_value(v);
+    *read = jpg_file_read;
+    *arg = h->fp;
+    return true;
+  }
+  return false;
+}
+
 static lbm_value ext_fclose(lbm_value *args, lbm_uint argn) {
   lbm_value res = ENC_SYM_TERROR;
   if (argn == 1 &&
@@ -666,6 +687,7 @@ static void image_renderer_clear(uint32_t color) {
     img.width = image_buffer_width((uint8_t*)arr->data);
     img.height = image_buffer_height((uint8_t*)arr->data);
     img.data = image_buffer_data((uint8_t*)arr->data);
+    img.dirty = NULL;
     image_buffer_clear(&img, color);
   }
 }
@@ -699,7 +721,9 @@ int init_exts(void) {
   lbm_math_extensions_init();
   lbm_runtime_extensions_init();
   lbm_set_extensions_init();
+  lbm_hashmap_extensions_init();
   lbm_display_extensions_init();
+  lbm_display_extensions_set_jpg_source(jpg_file_source);
   lbm_mutex_extensions_init();
   lbm_dyn_lib_init();
   lbm_ttf_extensions_init();
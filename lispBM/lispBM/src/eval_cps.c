@@ -30,6 +30,9 @@
 #include "platform_mutex.h"
 #include "lbm_flat_value.h"
 #include "lbm_flags.h"
+#include "lbm_image.h"
+#include "lbm_bytecode.h"
+#include "lbm_prof.h"
 
 #ifdef VISUALIZE_HEAP
 #include "heap_vis.h"
@@ -98,7 +101,11 @@ static jmp_buf critical_error_jmp_buf;
 #define RECV_TO_RETRY              CONTINUATION(48)
 #define READ_START_ARRAY           CONTINUATION(49)
 #define READ_APPEND_ARRAY          CONTINUATION(50)
-#define NUM_CONTINUATIONS          51
+#define READ_IMAGE_CONTINUE        CONTINUATION(51)
+#define EVAL_IMAGE_CONTINUE        CONTINUATION(52)
+#define BYTECODE_RETURN            CONTINUATION(53)
+#define BYTECODE_CONTINUE          CONTINUATION(54)
+#define NUM_CONTINUATIONS          55
 
 #define FM_NEED_GC       -1
 #define FM_NO_MATCH      -2
@@ -163,6 +170,10 @@ const char* lbm_error_str_flash_full = "Flash memory is full.";
 const char* lbm_error_str_variable_not_bound = "Variable not bound.";
 const char* lbm_error_str_read_no_mem = "Out of memory while reading.";
 const char* lbm_error_str_qq_expand = "Quasiquotation expansion error.";
+const char* lbm_error_str_image_buffer = "Image does not fit in buffer.";
+const char* lbm_error_str_image_malformed = "Malformed image.";
+const char* lbm_error_str_bytecode_malformed = "Malformed bytecode.";
+const char* lbm_error_str_bytecode_apply = "Value cannot be applied from compiled code.";
 
 static lbm_value lbm_error_suspect;
 static bool lbm_error_has_suspect = false;
@@ -218,7 +229,7 @@ static bool lbm_error_has_suspect = false;
 
 /**************************************************************/
 /* */
-typedef struct {
+typedef struct eval_context_queue_s {
   eval_context_t *first;
   eval_context_t *last;
 } eval_context_queue_t;
@@ -345,6 +356,61 @@ void lbm_set_timestamp_us_callback(uint32_t (*fptr)(void)) {
   else timestamp_us_callback = fptr;
 }
 
+#ifdef LBM_USE_PROF_STATS
+// Cells recovered by all garbage collections. Added to the number of
+// allocated cells it gives a count that only grows with allocation.
+static lbm_uint prof_cells_recovered = 0;
+
+static inline lbm_uint prof_cells_allocated(void) {
+  return lbm_heap_state.num_alloc + prof_cells_recovered;
+}
+
+static void prof_run_start(eval_context_t *ctx) {
+  if (ctx) {
+    ctx->stats.t_start = timestamp_us_callback();
+    ctx->stats.cells_start = prof_cells_allocated();
+  }
+}
+
+// Also marks the point in time from which a blocked context
+// counts as blocked.
+static void prof_run_stop(eval_context_t *ctx) {
+  uint32_t t_now = timestamp_us_callback();
+  ctx->stats.run_us += (uint32_t)(t_now - ctx->stats.t_start);
+  ctx->stats.cells += prof_cells_allocated() - ctx->stats.cells_start;
+  ctx->stats.t_start = t_now;
+}
+
+static void prof_unblocked(eval_context_t *ctx) {
+  ctx->stats.blocked_us += (uint32_t)(timestamp_us_callback() - ctx->stats.t_start);
+}
+
+// The storage can be replaced from another thread, so read the
+// pointer once.
+static void prof_ext_call(lbm_uint ix, uint32_t t_start) {
+  lbm_prof_ext_t *data = lbm_prof_ext_data;
+  if (data && ix < lbm_prof_ext_num) {
+    data[ix].calls ++;
+    data[ix].time_us += (uint32_t)(timestamp_us_callback() - t_start);
+  }
+}
+
+#define PROF_RUN_START(ctx)  prof_run_start(ctx)
+#define PROF_RUN_STOP(ctx)   prof_run_stop(ctx)
+#define PROF_UNBLOCKED(ctx)  prof_unblocked(ctx)
+#define PROF_STEP(ctx)       (ctx)->stats.steps ++
+#define PROF_MAIL(ctx)                                  \
+  if ((ctx)->num_mail > (ctx)->stats.mail_max) {        \
+    (ctx)->stats.mail_max = (ctx)->num_mail;            \
+  }
+#else
+#define PROF_RUN_START(ctx)
+#define PROF_RUN_STOP(ctx)
+#define PROF_UNBLOCKED(ctx)
+#define PROF_STEP(ctx)
+#define PROF_MAIL(ctx)
+#endif
+
 void lbm_set_ctx_done_callback(void (*fptr)(eval_context_t *)) {
   if (fptr == NULL) ctx_done_callback = ctx_done_nonsense;
   else ctx_done_callback = fptr;
@@ -365,6 +431,8 @@ static unsigned int lbm_events_head = 0;
 static unsigned int lbm_events_tail = 0;
 static unsigned int lbm_events_max  = 0;
 static bool         lbm_events_full = false;
+static uint32_t     lbm_events_dropped = 0;
+static uint32_t     lbm_events_max_used = 0;
 static mutex_t      lbm_events_mutex;
 static bool         lbm_events_mutex_initialized = false;
 static volatile lbm_cid  lbm_event_handler_pid = -1;
@@ -395,7 +463,12 @@ static bool event_internal(lbm_event_type_t event_type, lbm_uint parameter, lbm_
       lbm_events[lbm_events_head] = event;
       lbm_events_head = (lbm_events_head + 1) % lbm_events_max;
       lbm_events_full = lbm_events_head == lbm_events_tail;
+      uint32_t used = lbm_events_full ? lbm_events_max :
+        (lbm_events_head + lbm_events_max - lbm_events_tail) % lbm_events_max;
+      if (used > lbm_events_max_used) lbm_events_max_used = used;
       r = true;
+    } else {
+      lbm_events_dropped ++;
     }
     mutex_unlock(&lbm_events_mutex);
   }
@@ -443,6 +516,106 @@ static bool lbm_event_pop(lbm_event_t *event) {
   return true;
 }
 
+uint32_t lbm_event_stats(uint32_t *dropped, uint32_t *max_used) {
+  mutex_lock(&lbm_events_mutex);
+  *dropped = lbm_events_dropped;
+  *max_used = lbm_events_max_used;
+  uint32_t size = lbm_events_max;
+  mutex_unlock(&lbm_events_mutex);
+  return size;
+}
+
+// Single producer queues
+//
+// Every producer thread that sends a lot of events can have a queue of
+// its own. The producer only writes head and the evaluator only writes
+// tail, so no lock is needed as long as the stores are ordered with
+// respect to the event slots. Queues are only ever added to the list
+// and the list is cleared by lbm_eval_init_events.
+
+static lbm_event_queue_t *lbm_event_queues = NULL;
+
+bool lbm_event_queue_init(lbm_event_queue_t *q, const char *name, lbm_event_t *storage, uint32_t size) {
+  if (size == 0 || (size & (size - 1)) != 0) return false;
+  q->name = name;
+  q->events = storage;
+  q->size = size;
+  q->head = 0;
+  q->tail = 0;
+  q->dropped = 0;
+  q->max_used = 0;
+  q->active = false;
+  q->next = NULL;
+  return true;
+}
+
+void lbm_event_queue_add(lbm_event_queue_t *q) {
+  mutex_lock(&lbm_events_mutex);
+  lbm_event_queue_t *curr = lbm_event_queues;
+  while (curr && curr != q) curr = curr->next;
+  if (!curr) {
+    q->tail = q->head;
+    q->next = lbm_event_queues;
+    __atomic_store_n(&lbm_event_queues, q, __ATOMIC_RELEASE);
+  }
+  q->active = true;
+  mutex_unlock(&lbm_events_mutex);
+}
+
+lbm_event_queue_t *lbm_event_queue_first(void) {
+  return __atomic_load_n(&lbm_event_queues, __ATOMIC_ACQUIRE);
+}
+
+static bool event_queue_push(lbm_event_queue_t *q, lbm_event_type_t event_type, lbm_uint parameter, lbm_uint buf_ptr, lbm_uint buf_len) {
+  if (!q->active) return false;
+  uint32_t head = q->head;
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  uint32_t used = head - tail;
+  if (used >= q->size) {
+    q->dropped ++;
+    return false;
+  }
+  lbm_event_t *e = &q->events[head & (q->size - 1)];
+  e->type = event_type;
+  e->parameter = parameter;
+  e->buf_ptr = buf_ptr;
+  e->buf_len = buf_len;
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  if (used + 1 > q->max_used) q->max_used = used + 1;
+  return true;
+}
+
+bool lbm_event_queue_event(lbm_event_queue_t *q, lbm_flat_value_t *fv) {
+  if (lbm_event_handler_pid > 0) {
+    return event_queue_push(q, LBM_EVENT_FOR_HANDLER, 0, (lbm_uint)fv->buf, fv->buf_size);
+  }
+  return false;
+}
+
+bool lbm_event_queue_unboxed(lbm_event_queue_t *q, lbm_value unboxed) {
+  lbm_uint t = lbm_type_of(unboxed);
+  if (t == LBM_TYPE_SYMBOL ||
+      t == LBM_TYPE_I ||
+      t == LBM_TYPE_U ||
+      t == LBM_TYPE_CHAR) {
+    if (lbm_event_handler_pid > 0) {
+      return event_queue_push(q, LBM_EVENT_FOR_HANDLER, 0, (lbm_uint)unboxed, 0);
+    }
+  }
+  return false;
+}
+
+bool lbm_event_queue_unblock_ctx(lbm_event_queue_t *q, lbm_cid cid, lbm_flat_value_t *fv) {
+  return event_queue_push(q, LBM_EVENT_UNBLOCK_CTX, (lbm_uint)cid, (lbm_uint)fv->buf, fv->buf_size);
+}
+
+bool lbm_event_queue_build(lbm_event_queue_t *q, lbm_cid cid, lbm_event_build_fun fun, lbm_uint arg) {
+  if (cid < 0 && lbm_event_handler_pid <= 0) {
+    return false;
+  }
+  return event_queue_push(q, LBM_EVENT_BUILD, (lbm_uint)cid, (lbm_uint)fun, arg);
+}
+
 bool lbm_event_queue_is_empty(void) {
   mutex_lock(&lbm_events_mutex);
   bool empty = false;
@@ -450,6 +623,13 @@ bool lbm_event_queue_is_empty(void) {
     empty = true;
   }
   mutex_unlock(&lbm_events_mutex);
+  lbm_event_queue_t *q = lbm_event_queue_first();
+  while (empty && q) {
+    if (q->active && __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) != q->tail) {
+      empty = false;
+    }
+    q = q->next;
+  }
   return empty;
 }
 
@@ -466,6 +646,13 @@ static bool              is_atomic = false;
 static eval_context_queue_t blocked  = {NULL, NULL};
 static eval_context_queue_t queue    = {NULL, NULL};
 
+/* Context-id to context index. Holds every live context, including the
+   running one, chained through index_next. */
+#define CTX_INDEX_SIZE (1u << EVAL_CPS_CTX_INDEX_BITS)
+static eval_context_t *ctx_index[CTX_INDEX_SIZE];
+/* Number of contexts in blocked that wait for a timeout. */
+static lbm_uint num_wakeable = 0;
+
 /* one mutex for all queue operations */
 mutex_t qmutex;
 bool    qmutex_initialized = false;
@@ -740,6 +927,7 @@ static void atomic_error(void) {
 // Blocking while in an atomic block would have bad consequences.
 static void block_current_ctx(uint32_t state, lbm_uint sleep_us,  bool do_cont) {
   if (is_atomic) atomic_error();
+  PROF_RUN_STOP(ctx_running);
   ctx_running->timestamp = timestamp_us_callback();
   ctx_running->sleep_us = sleep_us;
   ctx_running->state  = state;
@@ -752,6 +940,7 @@ static void block_current_ctx(uint32_t state, lbm_uint sleep_us,  bool do_cont)
 // Same as block but sets no new timestamp or sleep_us.
 static void reblock_current_ctx(uint32_t state, bool do_cont) {
   if (is_atomic) atomic_error();
+  PROF_RUN_STOP(ctx_running);
   ctx_running->state  = state;
   ctx_running->app_cont = do_cont;
   enqueue_ctx(&blocked, ctx_running);
@@ -987,6 +1176,10 @@ void lbm_blocked_iterator(ctx_fun f, void *arg1, void *arg2){
 }
 
 static void enqueue_ctx_nm(eval_context_queue_t *q, eval_context_t *ctx) {
+  ctx->queue = q;
+  if (q == &blocked && LBM_IS_STATE_WAKE_UP_WAKABLE(ctx->state)) {
+    num_wakeable++;
+  }
   if (q->last == NULL) {
     ctx->prev = NULL;
     ctx->next = NULL;
@@ -1006,57 +1199,80 @@ static void enqueue_ctx(eval_context_queue_t *q, eval_context_t *ctx) {
   mutex_unlock(&qmutex);
 }
 
-static eval_context_t *lookup_ctx_nm(eval_context_queue_t *q, lbm_cid cid) {
-  eval_context_t *curr;
-  curr = q->first;
+// cids are lbm_memory indices of the contexts, which are spaced by at
+// least the size of a context. A multiplicative hash spreads them over
+// the buckets.
+static inline lbm_uint ctx_index_bucket(lbm_cid cid) {
+  return (lbm_uint)(((uint32_t)cid * 2654435761u) >> (32 - EVAL_CPS_CTX_INDEX_BITS));
+}
+
+static void ctx_index_add_nm(eval_context_t *ctx) {
+  lbm_uint b = ctx_index_bucket(ctx->id);
+  ctx->index_next = ctx_index[b];
+  ctx_index[b] = ctx;
+}
+
+static void ctx_index_remove_nm(eval_context_t *ctx) {
+  eval_context_t **curr = &ctx_index[ctx_index_bucket(ctx->id)];
+  while (*curr) {
+    if (*curr == ctx) {
+      *curr = ctx->index_next;
+      break;
+    }
+    curr = &(*curr)->index_next;
+  }
+  ctx->index_next = NULL;
+}
+
+static void ctx_index_clear_nm(void) {
+  memset(ctx_index, 0, sizeof(ctx_index));
+  num_wakeable = 0;
+}
+
+static eval_context_t *ctx_index_lookup_nm(lbm_cid cid) {
+  eval_context_t *curr = ctx_index[ctx_index_bucket(cid)];
   while (curr != NULL) {
     if (curr->id == cid) {
       return curr;
     }
-    curr = curr->next;
+    curr = curr->index_next;
   }
   return NULL;
 }
 
-static bool drop_ctx_nm(eval_context_queue_t *q, eval_context_t *ctx) {
+static eval_context_t *lookup_ctx_nm(eval_context_queue_t *q, lbm_cid cid) {
+  eval_context_t *ctx = ctx_index_lookup_nm(cid);
+  if (ctx && ctx->queue == q) {
+    return ctx;
+  }
+  return NULL;
+}
 
-  bool res = false;
-  if (q->first == NULL || q->last == NULL) {
-    if (!(q->last == NULL && q->first == NULL)) {
-      /* error state that should not happen */
-      return res;
+static bool drop_ctx_nm(eval_context_queue_t *q, eval_context_t *ctx) {
+  if (ctx->queue != q) {
+    return false;
+  }
+  if (q == &blocked) {
+    if (LBM_IS_STATE_WAKE_UP_WAKABLE(ctx->state)) {
+      num_wakeable--;
     }
-    /* Queue is empty */
-    return res;
+    PROF_UNBLOCKED(ctx);
   }
 
-  eval_context_t *curr = q->first;
-  while (curr) {
-    if (curr->id == ctx->id) {
-      res = true;
-      eval_context_t *tmp = curr->next;
-      if (curr->prev == NULL) {
-        if (curr->next == NULL) {
-          q->last = NULL;
-          q->first = NULL;
-        } else {
-          q->first = tmp;
-          tmp->prev = NULL;
-        }
-      } else { /* curr->prev != NULL */
-        if (curr->next == NULL) {
-          q->last = curr->prev;
-          q->last->next = NULL;
-        } else {
-          curr->prev->next = tmp;
-          tmp->prev = curr->prev;
-        }
-      }
-      break;
-    }
-    curr = curr->next;
+  if (ctx->prev == NULL) {
+    q->first = ctx->next;
+  } else {
+    ctx->prev->next = ctx->next;
   }
-  return res;
+  if (ctx->next == NULL) {
+    q->last = ctx->prev;
+  } else {
+    ctx->next->prev = ctx->prev;
+  }
+  ctx->prev = NULL;
+  ctx->next = NULL;
+  ctx->queue = NULL;
+  return true;
 }
 
 /* End execution of the running context. */
@@ -1065,6 +1281,10 @@ static void finish_ctx(void) {
   if (!ctx_running) {
     return;
   }
+  mutex_lock(&qmutex);
+  ctx_index_remove_nm(ctx_running);
+  mutex_unlock(&qmutex);
+
   /* Drop the continuation stack immediately to free up lbm_memory */
   lbm_stack_free(&ctx_running->K);
   ctx_done_callback(ctx_running);
@@ -1077,12 +1297,6 @@ static void finish_ctx(void) {
   ctx_running = NULL;
 }
 
-static void context_exists(eval_context_t *ctx, void *cid, void *b) {
-  if (ctx->id == *(lbm_cid*)cid) {
-    *(bool*)b = true;
-  }
-}
-
 void lbm_set_error_suspect(lbm_value suspect) {
   lbm_error_suspect = suspect;
   lbm_error_has_suspect = true;
@@ -1221,12 +1435,19 @@ static eval_context_t *dequeue_ctx_nm(eval_context_queue_t *q) {
   }
   res->prev = NULL;
   res->next = NULL;
+  res->queue = NULL;
   return res;
 }
 
 static void wake_up_ctxs_nm(void) {
   lbm_uint t_now;
 
+  // Only contexts that sleep or wait with a timeout can wake up here, so
+  // there is no need to look through blocked when there are none.
+  if (num_wakeable == 0) {
+    return;
+  }
+
   if (timestamp_us_callback) {
     t_now = timestamp_us_callback();
   } else {
@@ -1272,6 +1493,8 @@ static void wake_up_ctxs_nm(void) {
         }
         wake_ctx->next = NULL;
         wake_ctx->prev = NULL;
+        num_wakeable--;
+        PROF_UNBLOCKED(wake_ctx);
         if (LBM_IS_STATE_TIMEOUT(curr->state)) {
           mailbox_add_mail(wake_ctx, ENC_SYM_TIMEOUT);
           wake_ctx->r = ENC_SYM_TIMEOUT;
@@ -1286,6 +1509,7 @@ static void wake_up_ctxs_nm(void) {
 
 static void yield_ctx(lbm_uint sleep_us) {
   if (is_atomic) atomic_error();
+  PROF_RUN_STOP(ctx_running);
   if (timestamp_us_callback) {
     ctx_running->timestamp = timestamp_us_callback();
     ctx_running->sleep_us = sleep_us;
@@ -1404,6 +1628,11 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
   ctx->state = LBM_THREAD_STATE_READY;
   ctx->prev = NULL;
   ctx->next = NULL;
+  ctx->queue = NULL;
+  ctx->index_next = NULL;
+#ifdef LBM_USE_PROF_STATS
+  memset(&ctx->stats, 0, sizeof(lbm_ctx_stats_t));
+#endif
 
   ctx->row0 = -1;
   ctx->row1 = -1;
@@ -1418,7 +1647,10 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
     return -1;
   }
 
-  enqueue_ctx(&queue,ctx);
+  mutex_lock(&qmutex);
+  ctx_index_add_nm(ctx);
+  enqueue_ctx_nm(&queue,ctx);
+  mutex_unlock(&qmutex);
 
   return ctx->id;
 }
@@ -1473,6 +1705,7 @@ static void mailbox_add_mail(eval_context_t *ctx, lbm_value mail) {
 
   ctx->mailbox[ctx->num_mail] = mail;
   ctx->num_mail ++;
+  PROF_MAIL(ctx);
 }
 
 /**************************************************************
@@ -1575,30 +1808,18 @@ bool lbm_find_receiver_and_send(lbm_cid cid, lbm_value msg) {
   eval_context_t *found = NULL;
   int res = true;
 
-  found = lookup_ctx_nm(&blocked, cid);
+  found = ctx_index_lookup_nm(cid);
   if (found) {
-    if (LBM_IS_STATE_RECV(found->state)) { // only if unblock receivers here.
+    if (found->queue == &blocked &&
+        LBM_IS_STATE_RECV(found->state)) { // only if unblock receivers here.
       drop_ctx_nm(&blocked,found);
       found->state = LBM_THREAD_STATE_READY;
       enqueue_ctx_nm(&queue,found);
     }
     mailbox_add_mail(found, msg);
-    goto find_receiver_end;
-  }
-
-  found = lookup_ctx_nm(&queue, cid);
-  if (found) {
-    mailbox_add_mail(found, msg);
-    goto find_receiver_end;
-  }
-
-  /* check the current context */
-  if (ctx_running && ctx_running->id == cid) {
-    mailbox_add_mail(ctx_running, msg);
-    goto find_receiver_end;
+  } else {
+    res = false;
   }
-  res = false;
- find_receiver_end:
   mutex_unlock(&qmutex);
   return res;
 }
@@ -1709,6 +1930,9 @@ static void mark_context(eval_context_t *ctx, void *arg1, void *arg2) {
 static int gc(void) {
   if (ctx_running) {
     ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
+#ifdef LBM_USE_PROF_STATS
+    ctx_running->stats.gc_num ++;
+#endif
   }
 
   gc_requested = false;
@@ -1737,6 +1961,9 @@ static int gc(void) {
 #endif
 
   int r = lbm_gc_sweep_phase();
+#ifdef LBM_USE_PROF_STATS
+  prof_cells_recovered += lbm_heap_state.gc_recovered;
+#endif
   lbm_heap_new_freelist_length();
   lbm_memory_update_min_free();
 
@@ -2408,14 +2635,9 @@ static void cont_wait(eval_context_t *ctx) {
   lbm_pop(&ctx->K, &cid_val);
   lbm_cid cid = (lbm_cid)lbm_dec_i(cid_val);
 
-  bool exists = false;
-
-  lbm_blocked_iterator(context_exists, &cid, &exists);
-  lbm_running_iterator(context_exists, &cid, &exists);
-
-  if (ctx_running->id == cid) {
-    exists = true;
-  }
+  mutex_lock(&qmutex);
+  bool exists = ctx_index_lookup_nm(cid) != NULL;
+  mutex_unlock(&qmutex);
 
   if (exists) {
     lbm_value *sptr = stack_reserve(ctx, 2);
@@ -2469,39 +2691,46 @@ static void apply_setvar(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
 #define READING_EXPRESSION             ((0 << LBM_VAL_SHIFT) | LBM_TYPE_U)
 #define READING_PROGRAM                ((1 << LBM_VAL_SHIFT) | LBM_TYPE_U)
 #define READING_PROGRAM_INCREMENTALLY  ((2 << LBM_VAL_SHIFT) | LBM_TYPE_U)
-
-static void apply_read_base(lbm_value *args, lbm_uint nargs, eval_context_t *ctx, bool program, bool incremental) {
-  if (nargs == 1) {
-    lbm_value chan = ENC_SYM_NIL;
-    if (lbm_type_of_functional(args[0]) == LBM_TYPE_ARRAY) {
-      char *str = lbm_dec_str(args[0]);
-      if (str) {
+#define READING_IMAGE                  ((3 << LBM_VAL_SHIFT) | LBM_TYPE_U)
+
+// The source of a reader is either a string or a channel.
+static lbm_value read_source_channel(lbm_value src) {
+  lbm_value chan = ENC_SYM_NIL;
+  if (lbm_type_of_functional(src) == LBM_TYPE_ARRAY) {
+    char *str = lbm_dec_str(src);
+    if (str) {
 #ifdef LBM_ALWAYS_GC
-        gc();
+      gc();
 #endif
-        if (!create_string_channel(lbm_dec_str(args[0]), &chan, args[0])) {
-          gc();
-          if (!create_string_channel(lbm_dec_str(args[0]), &chan, args[0])) {
-            ERROR_CTX(ENC_SYM_MERROR);
-          }
+      if (!create_string_channel(lbm_dec_str(src), &chan, src)) {
+        gc();
+        if (!create_string_channel(lbm_dec_str(src), &chan, src)) {
+          ERROR_CTX(ENC_SYM_MERROR);
         }
-      } else {
-        ERROR_CTX(ENC_SYM_EERROR);
-      }
-    } else if (lbm_type_of(args[0]) == LBM_TYPE_CHANNEL) {
-      chan = args[0];
-      // Streaming transfers can freeze the evaluator if the stream is cut while
-      // the reader is reading inside of an atomic block.
-      // It is generally not advisable to read in an atomic block but now it is also
-      // enforced in the case where it can cause problems.
-      if (lbm_channel_may_block(lbm_dec_channel(chan)) && is_atomic) {
-       lbm_set_error_reason((char*)lbm_error_str_forbidden_in_atomic);
-       is_atomic = false;
-       ERROR_CTX(ENC_SYM_EERROR);
       }
     } else {
       ERROR_CTX(ENC_SYM_EERROR);
     }
+  } else if (lbm_type_of(src) == LBM_TYPE_CHANNEL) {
+    chan = src;
+    // Streaming transfers can freeze the evaluator if the stream is cut while
+    // the reader is reading inside of an atomic block.
+    // It is generally not advisable to read in an atomic block but now it is also
+    // enforced in the case where it can cause problems.
+    if (lbm_channel_may_block(lbm_dec_channel(chan)) && is_atomic) {
+      lbm_set_error_reason((char*)lbm_error_str_forbidden_in_atomic);
+      is_atomic = false;
+      ERROR_CTX(ENC_SYM_EERROR);
+    }
+  } else {
+    ERROR_CTX(ENC_SYM_EERROR);
+  }
+  return chan;
+}
+
+static void apply_read_base(lbm_value *args, lbm_uint nargs, eval_context_t *ctx, bool program, bool incremental) {
+  if (nargs == 1) {
+    lbm_value chan = read_source_channel(args[0]);
     lbm_value *sptr = get_stack_ptr(ctx, 2);
 
     // If we are inside a reader, its settings are stored.
@@ -2560,6 +2789,117 @@ static void apply_read(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
   apply_read_base(args,nargs,ctx,false,false);
 }
 
+// (read-image source buffer)
+// Reads a program into an image in buffer instead of evaluating it. The result
+// is the size of the image in bytes.
+static void apply_read_image(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  lbm_array_header_t *buf;
+  if (nargs != 2 || !(buf = lbm_dec_array_rw(args[1]))) {
+    lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+    ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_READ_IMAGE);
+  }
+  if (!lbm_image_start((uint8_t*)buf->data, buf->size)) {
+    lbm_set_error_reason((char*)lbm_error_str_image_buffer);
+    ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_READ_IMAGE);
+  }
+
+  lbm_value chan = read_source_channel(args[0]);
+  lbm_value *sptr = get_stack_ptr(ctx, 3);
+  lbm_value buf_val = sptr[2];
+  sptr[0] = lbm_enc_u(ctx->flags);
+  sptr[1] = chan;
+  sptr[2] = READING_IMAGE;
+
+  // Same as reading a program incrementally, but the expressions are added
+  // to the image in READ_IMAGE_CONTINUE instead of being evaluated.
+  ctx->flags &= ~EVAL_CPS_CONTEXT_READER_FLAGS_MASK;
+  ctx->r = ENC_SYM_NIL;
+
+  lbm_value *rptr = stack_reserve(ctx, 7);
+  rptr[0] = READ_DONE;
+  rptr[1] = chan;
+  rptr[2] = buf_val;
+  rptr[3] = READ_IMAGE_CONTINUE;
+  rptr[4] = chan;
+  rptr[5] = lbm_enc_u(1);
+  rptr[6] = READ_NEXT_TOKEN;
+  ctx->app_cont = true;
+}
+
+// (eval-image image)
+// Evaluates the expressions in an image in order, the same way as
+// read-eval-program evaluates the expressions in the source.
+static void apply_eval_image(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  lbm_array_header_t *img;
+  if (nargs != 1 || !(img = lbm_dec_array_r(args[0]))) {
+    lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+    ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_EVAL_IMAGE);
+  }
+  if (lbm_image_size((uint8_t*)img->data, img->size) == 0) {
+    lbm_set_error_reason((char*)lbm_error_str_image_malformed);
+    ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_EVAL_IMAGE);
+  }
+
+  lbm_value *sptr = get_stack_ptr(ctx, 2);
+  lbm_value img_val = sptr[1];
+  sptr[0] = lbm_enc_u(ctx->flags);
+  sptr[1] = POP_READER_FLAGS;
+
+  lbm_value *rptr = stack_reserve(ctx, 4);
+  rptr[0] = img_val;
+  rptr[1] = lbm_enc_u(LBM_IMAGE_HEADER_SIZE);
+  rptr[2] = ctx->curr_env;
+  rptr[3] = EVAL_IMAGE_CONTINUE;
+  ctx->r = ENC_SYM_NIL;
+  ctx->app_cont = true;
+}
+
+// (compile 'f) or (compile closure)
+// Compiling a symbol replaces its global binding with the compiled closure.
+static void apply_compile(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  if (nargs != 1) {
+    lbm_set_error_reason((char*)lbm_error_str_num_args);
+    ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_COMPILE);
+  }
+  lbm_value name = ENC_SYM_NIL;
+  lbm_value clo = args[0];
+  if (lbm_is_symbol(clo)) {
+    name = clo;
+    if (!lbm_global_env_lookup(&clo, name)) {
+      lbm_set_error_reason((char*)lbm_error_str_variable_not_bound);
+      ERROR_AT_CTX(ENC_SYM_NOT_FOUND, name);
+    }
+  }
+  if (!lbm_is_closure(clo)) {
+    lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+    ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_COMPILE);
+  }
+
+  lbm_value res;
+  int r = lbm_bytecode_compile(name, clo, &res);
+  if (r == LBM_BC_COMPILE_MERROR) {
+    gc();
+    r = lbm_bytecode_compile(name, clo, &res);
+  }
+  if (r == LBM_BC_COMPILE_MERROR) {
+    ERROR_CTX(ENC_SYM_MERROR);
+  } else if (r != LBM_BC_COMPILE_OK) {
+    lbm_set_error_reason((char*)lbm_bytecode_error_str());
+    ERROR_AT_CTX(ENC_SYM_EERROR, res);
+  }
+
+  if (name != ENC_SYM_NIL) {
+    lbm_uint ix_key  = lbm_dec_sym(name) & GLOBAL_ENV_MASK;
+    lbm_value *global_env = lbm_get_global_env();
+    lbm_value new_env;
+    WITH_GC_RMBR_1(new_env, lbm_env_set(global_env[ix_key], name, res), res);
+    global_env[ix_key] = new_env;
+  }
+  lbm_stack_drop(&ctx->K, nargs+1);
+  ctx->r = res;
+  ctx->app_cont = true;
+}
+
 static void apply_spawn_base(lbm_value *args, lbm_uint nargs, eval_context_t *ctx, uint32_t context_flags) {
 
   lbm_uint stack_size = EVAL_CPS_DEFAULT_STACK_SIZE;
@@ -3195,6 +3535,9 @@ static const apply_fun fun_table[] =
    apply_sort,
    apply_rest_args,
    apply_rotate,
+   apply_read_image,
+   apply_eval_image,
+   apply_compile,
   };
 
 /***************************************************/
@@ -3215,7 +3558,17 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
     extension_fptr f = extension_table[SYMBOL_IX(fun_val)].fptr;
 
     lbm_value ext_res;
+#ifdef LBM_USE_PROF_STATS
+    // Only time the call when there is storage for the statistics
+    bool prof_ext = lbm_prof_ext_data != NULL;
+    uint32_t t_ext = prof_ext ? timestamp_us_callback() : 0;
+#endif
     WITH_GC(ext_res, f(&fun_args[1], arg_count));
+#ifdef LBM_USE_PROF_STATS
+    if (prof_ext) {
+      prof_ext_call(SYMBOL_IX(fun_val), t_ext);
+    }
+#endif
     if (lbm_is_error(ext_res)) { //Error other than merror
       ERROR_AT_CTX(ext_res, fun);
     }
@@ -3342,6 +3695,428 @@ static void cont_closure_args_rest(eval_context_t *ctx) {
   }
 }
 
+/***************************************************/
+/* Bytecode                                        */
+
+/* A compiled closure runs in a frame on the continuation stack:
+ *   fb[0] code, fb[1] consts, fb[2] env, fb[3 ...] local slots
+ * followed by the operand stack. When the frame calls out to the
+ * interpreter, or gives the scheduler a chance to run, pc and fb
+ * are pushed under a BYTECODE_RETURN or BYTECODE_CONTINUE.
+ */
+#define BC_FRAME_ENV      2
+#define BC_FRAME_LOCALS   3
+// Number of jumps, calls and returns between yields to the scheduler.
+// Straight line code between them is bounded by the size of the function.
+#define BC_STEP_BUDGET    32
+
+static void bytecode_malformed(eval_context_t *ctx, lbm_uint sp) {
+  ctx->K.sp = sp;
+  lbm_set_error_reason((char*)lbm_error_str_bytecode_malformed);
+  ERROR_CTX(ENC_SYM_EERROR);
+}
+
+// Checks code and consts and that the frame fits on the stack together
+// with a continuation. Returns the code header.
+static uint8_t *bytecode_check_frame(eval_context_t *ctx, lbm_uint fb, lbm_value code, lbm_value consts) {
+  if (!lbm_is_array_r(code) || !lbm_is_lisp_array_r(consts)) {
+    bytecode_malformed(ctx, ctx->K.sp);
+  }
+  lbm_array_header_t *ch = assume_array(code);
+  lbm_array_header_t *kh = assume_array(consts);
+  uint8_t *hdr = (uint8_t*)ch->data;
+  if (ch->size < LBM_BC_HEADER_SIZE + 3 ||
+      hdr[0] > hdr[1] ||
+      kh->size / sizeof(lbm_value) < hdr[0]) {
+    bytecode_malformed(ctx, ctx->K.sp);
+  }
+  if (fb + BC_FRAME_LOCALS + hdr[1] + hdr[2] + 3 >= ctx->K.size) {
+    ERROR_CTX(ENC_SYM_STACK_ERROR);
+  }
+  return hdr;
+}
+
+static lbm_value bytecode_call_fundamental(eval_context_t *ctx, lbm_uint f, lbm_uint *args, lbm_uint argn) {
+  if (argn == 2 &&
+      lbm_type_of(args[0]) == LBM_TYPE_I &&
+      lbm_type_of(args[1]) == LBM_TYPE_I) {
+    lbm_int a = lbm_dec_i(args[0]);
+    lbm_int b = lbm_dec_i(args[1]);
+    switch (f) {
+    case SYMBOL_IX(SYM_ADD): return lbm_enc_i(a + b);
+    case SYMBOL_IX(SYM_SUB): return lbm_enc_i(a - b);
+    case SYMBOL_IX(SYM_NUMEQ): return a == b ? ENC_SYM_TRUE : ENC_SYM_NIL;
+    case SYMBOL_IX(SYM_LT): return a < b ? ENC_SYM_TRUE : ENC_SYM_NIL;
+    case SYMBOL_IX(SYM_GT): return a > b ? ENC_SYM_TRUE : ENC_SYM_NIL;
+    case SYMBOL_IX(SYM_LEQ): return a <= b ? ENC_SYM_TRUE : ENC_SYM_NIL;
+    case SYMBOL_IX(SYM_GEQ): return a >= b ? ENC_SYM_TRUE : ENC_SYM_NIL;
+    default: break;
+    }
+  }
+  if (f >= fundamental_table_size) {
+    bytecode_malformed(ctx, ctx->K.sp);
+  }
+#ifdef LBM_ALWAYS_GC
+  gc();
+#endif
+  lbm_value res = fundamental_table[f](args, argn, ctx);
+  if (lbm_is_error(res)) {
+    if (lbm_is_symbol_merror(res)) {
+      gc();
+      res = fundamental_table[f](args, argn, ctx);
+    }
+    if (lbm_is_error(res)) {
+      ERROR_AT_CTX(res, lbm_enc_sym(FUNDAMENTAL_SYMBOLS_START | f));
+    }
+  }
+  return res;
+}
+
+#define BC_LOAD_FRAME()                                                 \
+  do {                                                                  \
+    lbm_array_header_t *ch_ = assume_array(K[fb]);                      \
+    lbm_array_header_t *kh_ = assume_array(K[fb + 1]);                  \
+    code = (uint8_t*)ch_->data;                                         \
+    code_end = ch_->size - 2;                                           \
+    consts = (lbm_value*)kh_->data;                                     \
+    num_consts = kh_->size / sizeof(lbm_value);                         \
+    locals = &K[fb + BC_FRAME_LOCALS];                                  \
+    num_locals = code[1];                                               \
+    base = fb + BC_FRAME_LOCALS + num_locals;                           \
+    lim = base + code[2];                                               \
+  } while (0)
+
+#define BC_PUSH(v)  do { if (sp >= lim) goto malformed; K[sp++] = (v); } while (0)
+#define BC_NEED(n)  do { if (sp < base + (n)) goto malformed; } while (0)
+#define BC_U8()     (code[pc++])
+#define BC_U16()    (pc += 2, ((lbm_uint)code[pc - 2] << 8) | code[pc - 1])
+
+static void bytecode_run(eval_context_t *ctx, lbm_uint pc, lbm_uint fb) {
+  lbm_uint *K = ctx->K.data;
+  lbm_uint sp = ctx->K.sp;
+  uint8_t *code;
+  lbm_value *consts;
+  lbm_uint *locals;
+  lbm_uint code_end, num_consts, num_locals, base, lim;
+  int budget = BC_STEP_BUDGET;
+
+  BC_LOAD_FRAME();
+
+  while (true) {
+    if (pc >= code_end) goto malformed;
+    switch (BC_U8()) {
+    case LBM_BC_NIL:
+      BC_PUSH(ENC_SYM_NIL);
+      break;
+    case LBM_BC_TRUE:
+      BC_PUSH(ENC_SYM_TRUE);
+      break;
+    case LBM_BC_CONST: {
+      lbm_uint ix = BC_U16();
+      if (ix >= num_consts) goto malformed;
+      BC_PUSH(consts[ix]);
+    } break;
+    case LBM_BC_LOAD: {
+      lbm_uint slot = BC_U8();
+      if (slot >= num_locals) goto malformed;
+      BC_PUSH(locals[slot]);
+    } break;
+    case LBM_BC_STORE: {
+      lbm_uint slot = BC_U8();
+      if (slot >= num_locals) goto malformed;
+      BC_NEED(1);
+      locals[slot] = K[--sp];
+    } break;
+    case LBM_BC_LOAD_VAR: {
+      lbm_uint ix = BC_U16();
+      if (ix >= num_consts) goto malformed;
+      lbm_value v;
+      if (lbm_env_lookup_b(&v, consts[ix], K[fb + BC_FRAME_ENV]) ||
+          lbm_global_env_lookup(&v, consts[ix])) {
+        BC_PUSH(v);
+      } else {
+        // Let the interpreter evaluate the symbol, it knows about
+        // dynamic loading and how to report an unbound variable.
+        K[sp] = lbm_enc_u(pc);
+        K[sp + 1] = lbm_enc_u(fb);
+        K[sp + 2] = BYTECODE_RETURN;
+        ctx->K.sp = sp + 3;
+        ctx->curr_exp = consts[ix];
+        ctx->curr_env = K[fb + BC_FRAME_ENV];
+        return;
+      }
+    } break;
+    case LBM_BC_SET_VAR: {
+      lbm_uint ix = BC_U16();
+      if (ix >= num_consts || !lbm_is_symbol(consts[ix])) goto malformed;
+      BC_NEED(1);
+      ctx->K.sp = sp;
+      lbm_value res;
+      WITH_GC(res, perform_setvar(consts[ix], K[sp - 1], K[fb + BC_FRAME_ENV]));
+      (void)res;
+    } break;
+    case LBM_BC_DEFINE: {
+      lbm_uint ix = BC_U16();
+      if (ix >= num_consts || !lbm_is_symbol(consts[ix])) goto malformed;
+      BC_NEED(1);
+      ctx->K.sp = sp;
+      lbm_value key = consts[ix];
+      lbm_uint ix_key  = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
+      lbm_value *global_env = lbm_get_global_env();
+      lbm_value new_env;
+      WITH_GC(new_env, lbm_env_set(global_env[ix_key], key, K[sp - 1]));
+      global_env[ix_key] = new_env;
+    } break;
+    case LBM_BC_POP:
+      BC_NEED(1);
+      sp --;
+      break;
+    case LBM_BC_POPN: {
+      lbm_uint n = BC_U8();
+      BC_NEED(n);
+      sp -= n;
+    } break;
+    case LBM_BC_DUP: {
+      BC_NEED(1);
+      lbm_value v = K[sp - 1];
+      BC_PUSH(v);
+    } break;
+    case LBM_BC_JMP:
+      pc = BC_U16();
+      goto jumped;
+    case LBM_BC_JMP_NIL: {
+      lbm_uint target = BC_U16();
+      BC_NEED(1);
+      if (K[--sp] == ENC_SYM_NIL) {
+        pc = target;
+        goto jumped;
+      }
+    } break;
+    case LBM_BC_JMP_NOT_NIL: {
+      lbm_uint target = BC_U16();
+      BC_NEED(1);
+      if (K[--sp] != ENC_SYM_NIL) {
+        pc = target;
+        goto jumped;
+      }
+    } break;
+    case LBM_BC_CALL_FUND: {
+      lbm_uint f = BC_U8();
+      lbm_uint argn = BC_U8();
+      BC_NEED(argn);
+      ctx->K.sp = sp;
+      lbm_value res = bytecode_call_fundamental(ctx, f, &K[sp - argn], argn);
+      sp -= argn;
+      BC_PUSH(res);
+    } break;
+    case LBM_BC_SELF_TAIL_CALL: {
+      lbm_uint argn = BC_U8();
+      if (argn > num_locals) goto malformed;
+      BC_NEED(argn);
+      memmove(locals, &K[sp - argn], argn * sizeof(lbm_uint));
+      sp = base;
+      pc = LBM_BC_HEADER_SIZE;
+      goto jumped;
+    }
+    case LBM_BC_RET: {
+      BC_NEED(1);
+      lbm_value v = K[sp - 1];
+      sp = fb;
+      if (sp >= 3 && K[sp - 1] == BYTECODE_RETURN) {
+        // Returning to a compiled caller, continue in its frame.
+        pc = lbm_dec_u(K[sp - 3]);
+        fb = lbm_dec_u(K[sp - 2]);
+        sp -= 3;
+        BC_LOAD_FRAME();
+        BC_PUSH(v);
+        goto jumped;
+      }
+      ctx->K.sp = sp;
+      ctx->r = v;
+      ctx->app_cont = true;
+      return;
+    }
+    case LBM_BC_CALL:
+    case LBM_BC_TAIL_CALL: {
+      bool tail = code[pc - 1] == LBM_BC_TAIL_CALL;
+      lbm_uint argn = BC_U8();
+      BC_NEED(argn + 1);
+      lbm_uint fp = sp - argn - 1;
+      lbm_value fun = K[fp];
+      lbm_value env = K[fb + BC_FRAME_ENV];
+      ctx->K.sp = sp;
+
+      if (lbm_is_symbol(fun)) {
+        lbm_uint fun_val = lbm_dec_sym(fun);
+        if (SYMBOL_KIND(fun_val) == SYMBOL_KIND_FUNDAMENTAL) {
+          lbm_value res = bytecode_call_fundamental(ctx, SYMBOL_IX(fun_val), &K[fp + 1], argn);
+          sp = fp;
+          BC_PUSH(res);
+          break;
+        }
+        if (tail) {
+          memmove(&K[fb], &K[fp], (argn + 1) * sizeof(lbm_uint));
+          fp = fb;
+        } else {
+          memmove(&K[fp + 3], &K[fp], (argn + 1) * sizeof(lbm_uint));
+          K[fp] = lbm_enc_u(pc);
+          K[fp + 1] = lbm_enc_u(fb);
+          K[fp + 2] = BYTECODE_RETURN;
+          fp += 3;
+        }
+        ctx->K.sp = fp + argn + 1;
+        ctx->curr_env = env;
+        application(ctx, &K[fp], argn);
+        sp = ctx->K.sp;
+        if (ctx_running == ctx && ctx->app_cont &&
+            sp >= 3 && K[sp - 1] == BYTECODE_RETURN) {
+          ctx->app_cont = false;
+          pc = lbm_dec_u(K[sp - 3]);
+          fb = lbm_dec_u(K[sp - 2]);
+          sp -= 3;
+          BC_LOAD_FRAME();
+          BC_PUSH(ctx->r);
+          goto jumped;
+        }
+        return;
+      }
+
+      if (!lbm_is_cons(fun) || get_car(fun) != ENC_SYM_CLOSURE) {
+        lbm_set_error_reason((char*)lbm_error_str_bytecode_apply);
+        ERROR_AT_CTX(ENC_SYM_EERROR, fun);
+      }
+      lbm_value cl[3];
+      extract_n(get_cdr(fun), cl, 3);
+
+      if (lbm_is_cons(cl[CLO_BODY]) && get_car(cl[CLO_BODY]) == ENC_SYM_BYTECODE) {
+        // Compiled callee, new frame directly on the stack
+        lbm_value bc[2];
+        extract_n(get_cdr(cl[CLO_BODY]), bc, 2);
+        lbm_uint nfb = tail ? fb : fp + 3;
+        uint8_t *hdr = bytecode_check_frame(ctx, nfb, bc[0], bc[1]);
+        lbm_uint nparams = hdr[0];
+        if (argn < nparams) {
+          lbm_set_error_reason((char*)lbm_error_str_num_args);
+          ERROR_AT_CTX(ENC_SYM_EERROR, fun);
+        }
+        memmove(&K[nfb + BC_FRAME_LOCALS], &K[fp + 1], nparams * sizeof(lbm_uint));
+        if (!tail) {
+          K[fp] = lbm_enc_u(pc);
+          K[fp + 1] = lbm_enc_u(fb);
+          K[fp + 2] = BYTECODE_RETURN;
+        }
+        fb = nfb;
+        K[fb] = bc[0];
+        K[fb + 1] = bc[1];
+        K[fb + BC_FRAME_ENV] = cl[CLO_ENV];
+        for (lbm_uint i = nparams; i < hdr[1]; i ++) {
+          K[fb + BC_FRAME_LOCALS + i] = ENC_SYM_NIL;
+        }
+        BC_LOAD_FRAME();
+        sp = base;
+        pc = LBM_BC_HEADER_SIZE;
+        goto jumped;
+      }
+
+      // Interpreted callee, bind the arguments the same way as
+      // closure application does and continue in the interpreter.
+      lbm_value params = cl[CLO_PARAMS];
+      lbm_value clo_env = cl[CLO_ENV];
+      lbm_uint i = 0;
+      while (lbm_is_cons(params)) {
+        if (i >= argn) {
+          lbm_set_error_reason((char*)lbm_error_str_num_args);
+          ERROR_AT_CTX(ENC_SYM_EERROR, fun);
+        }
+        clo_env = allocate_binding(get_car(params), K[fp + 1 + i], clo_env);
+        params = get_cdr(params);
+        i ++;
+      }
+      if (i < argn) {
+        lbm_value rest = ENC_SYM_NIL;
+        for (lbm_uint j = argn; j > i; j --) {
+          rest = cons_with_gc(K[fp + j], rest, clo_env);
+        }
+        clo_env = allocate_binding(ENC_SYM_REST_ARGS, rest, clo_env);
+      }
+      if (tail) {
+        sp = fb;
+      } else {
+        K[fp] = lbm_enc_u(pc);
+        K[fp + 1] = lbm_enc_u(fb);
+        K[fp + 2] = BYTECODE_RETURN;
+        sp = fp + 3;
+      }
+      ctx->K.sp = sp;
+      ctx->curr_exp = cl[CLO_BODY];
+      ctx->curr_env = clo_env;
+      return;
+    }
+    default:
+      goto malformed;
+    }
+    continue;
+
+  jumped:
+    // Jumps, calls and returns are counted so that loops and
+    // recursion let other contexts run.
+    if (pc >= code_end) goto malformed;
+    if (--budget == 0) {
+      K[sp] = lbm_enc_u(pc);
+      K[sp + 1] = lbm_enc_u(fb);
+      K[sp + 2] = BYTECODE_CONTINUE;
+      ctx->K.sp = sp + 3;
+      ctx->app_cont = true;
+      return;
+    }
+  }
+
+ malformed:
+  bytecode_malformed(ctx, sp);
+}
+
+// (bytecode code consts)
+// Entered as the body of a compiled closure that was applied by the
+// interpreter. The arguments are bound in the environment.
+static void eval_bytecode(eval_context_t *ctx) {
+  lbm_value bc[2];
+  extract_n(get_cdr(ctx->curr_exp), bc, 2);
+  lbm_uint fb = ctx->K.sp;
+  uint8_t *hdr = bytecode_check_frame(ctx, fb, bc[0], bc[1]);
+  lbm_value *consts = (lbm_value*)assume_array(bc[1])->data;
+
+  lbm_value *frame = stack_reserve(ctx, BC_FRAME_LOCALS + hdr[1]);
+  frame[0] = bc[0];
+  frame[1] = bc[1];
+  frame[BC_FRAME_ENV] = ctx->curr_env;
+  for (lbm_uint i = 0; i < hdr[1]; i ++) {
+    lbm_value v = ENC_SYM_NIL;
+    if (i < hdr[0] && !lbm_env_lookup_b(&v, consts[i], ctx->curr_env)) {
+      lbm_set_error_reason((char*)lbm_error_str_num_args);
+      ERROR_CTX(ENC_SYM_EERROR);
+    }
+    frame[BC_FRAME_LOCALS + i] = v;
+  }
+  bytecode_run(ctx, LBM_BC_HEADER_SIZE, fb);
+}
+
+static void cont_bytecode_return(eval_context_t *ctx) {
+  lbm_uint *sptr = get_stack_ptr(ctx, 2);
+  lbm_uint pc = lbm_dec_u(sptr[0]);
+  lbm_uint fb = lbm_dec_u(sptr[1]);
+  sptr[0] = ctx->r;
+  ctx->K.sp --;
+  bytecode_run(ctx, pc, fb);
+}
+
+static void cont_bytecode_continue(eval_context_t *ctx) {
+  lbm_uint *sptr = get_stack_ptr(ctx, 2);
+  lbm_uint pc = lbm_dec_u(sptr[0]);
+  lbm_uint fb = lbm_dec_u(sptr[1]);
+  ctx->K.sp -= 2;
+  bytecode_run(ctx, pc, fb);
+}
+
 static void cont_application_args(eval_context_t *ctx) {
   lbm_uint *sptr = get_stack_ptr(ctx, 3);
 
@@ -3861,6 +4636,16 @@ static void read_finish(lbm_char_channel_t *str, eval_context_t *ctx) {
     lbm_pop_3(&ctx->K, &sym, &env, &s);
     ctx->curr_env = env;
     ctx->app_cont = true; // Program evaluated and result is in ctx->r.
+  } else if (ctx->K.sp > 4  && (ctx->K.data[ctx->K.sp - 4] == READ_DONE) &&
+             (ctx->K.data[ctx->K.sp - 5] == READING_IMAGE)) {
+    /* image is done, result is its size */
+    lbm_value buf;
+    lbm_value s;
+    lbm_value k;
+    lbm_pop_3(&ctx->K, &k, &buf, &s);
+    lbm_array_header_t *arr = assume_array(buf);
+    ctx->r = lbm_enc_u(lbm_image_size((uint8_t*)arr->data, arr->size));
+    ctx->app_cont = true;
   } else if (ctx->K.sp > 5 && (ctx->K.data[ctx->K.sp - 5] == READ_DONE) &&
              (ctx->K.data[ctx->K.sp - 6] == READING_PROGRAM)) {
     /* successfully finished reading a program  (CASE 2) */
@@ -4531,6 +5316,91 @@ static void cont_read_eval_continue(eval_context_t *ctx) {
   }
 }
 
+static void cont_read_image_continue(eval_context_t *ctx) {
+  lbm_value *sptr = get_stack_ptr(ctx, 2);
+  lbm_value stream = sptr[0];
+  lbm_char_channel_t *str = lbm_dec_channel(stream);
+  if (str && str->state) {
+    ctx->row1 = (lbm_int)str->row(str);
+    if (lbm_type_of(ctx->r) == LBM_TYPE_SYMBOL) {
+      switch(ctx->r) {
+      case ENC_SYM_CLOSEPAR:
+        lbm_stack_drop(&ctx->K, 2);
+        ctx->app_cont = true;
+        return;
+      case ENC_SYM_DOT:
+        lbm_set_error_reason((char*)lbm_error_str_parse_dot);
+        READ_ERROR_CTX(lbm_channel_row(str),lbm_channel_column(str));
+        return;
+      }
+    }
+    lbm_array_header_t *buf = assume_array(sptr[1]);
+    bool constant = (ctx->flags & EVAL_CPS_CONTEXT_FLAG_CONST) != 0;
+    if (lbm_image_add_exp((uint8_t*)buf->data, buf->size, ctx->r, constant) != FLATTEN_VALUE_OK) {
+      lbm_channel_reader_close(str);
+      lbm_set_error_reason((char*)lbm_error_str_image_buffer);
+      ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_READ_IMAGE);
+    }
+    lbm_value *rptr = stack_reserve(ctx, 4);
+    rptr[0] = READ_IMAGE_CONTINUE;
+    rptr[1] = stream;
+    rptr[2] = lbm_enc_u(1);
+    rptr[3] = READ_NEXT_TOKEN;
+    ctx->app_cont = true;
+  } else {
+    ERROR_CTX(ENC_SYM_FATAL_ERROR);
+  }
+}
+
+/* cont_eval_image_continue
+   sp-3 : Image
+   sp-2 : Offset of the next expression
+   sp-1 : Environment
+*/
+static void cont_eval_image_continue(eval_context_t *ctx) {
+  lbm_value *sptr = get_stack_ptr(ctx, 3);
+  lbm_array_header_t *img = assume_array(sptr[0]);
+  lbm_uint pos = lbm_dec_u(sptr[1]);
+
+  lbm_flat_value_t fv;
+  bool constant;
+  if (!lbm_image_get_exp((uint8_t*)img->data, &pos, &fv, &constant)) {
+    // Done, the result is the value of the last expression.
+    lbm_stack_drop(&ctx->K, 3);
+    ctx->app_cont = true;
+    return;
+  }
+
+  lbm_value exp;
+  if (constant) {
+    ctx->flags |= EVAL_CPS_CONTEXT_FLAG_CONST;
+    int r = lbm_unflatten_value_const(&fv, &exp);
+    if (r == UNFLATTEN_FLASH_FULL) {
+      lbm_set_error_reason((char*)lbm_error_str_flash_full);
+      ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_EVAL_IMAGE);
+    } else if (r == UNFLATTEN_FLASH_ERROR) {
+      lbm_set_error_reason((char*)lbm_error_str_flash_error);
+      ERROR_AT_CTX(ENC_SYM_FATAL_ERROR, ENC_SYM_EVAL_IMAGE);
+    } else if (r != UNFLATTEN_OK) {
+      lbm_set_error_reason((char*)lbm_error_str_image_malformed);
+      ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_EVAL_IMAGE);
+    }
+  } else {
+    ctx->flags &= ~EVAL_CPS_CONTEXT_FLAG_CONST;
+    if (!lbm_unflatten_value(&fv, &exp)) {
+      if (exp != ENC_SYM_MERROR) {
+        lbm_set_error_reason((char*)lbm_error_str_image_malformed);
+      }
+      ERROR_AT_CTX(exp, ENC_SYM_EVAL_IMAGE);
+    }
+  }
+
+  sptr[1] = lbm_enc_u(pos);
+  stack_reserve(ctx, 1)[0] = EVAL_IMAGE_CONTINUE;
+  ctx->curr_env = sptr[2];
+  ctx->curr_exp = exp;
+}
+
 static void cont_read_expect_closepar(eval_context_t *ctx) {
   lbm_value res;
   lbm_value stream;
@@ -4878,6 +5748,12 @@ static void cont_move_val_to_flash_dispatch(eval_context_t *ctx) {
 
   lbm_value val = ctx->r;
 
+  if (lbm_is_ptr(val) && (val & LBM_PTR_TO_CONSTANT_BIT)) { // constant pointer cons or not.
+    //ctx->r unchanged
+    ctx->app_cont = true;
+    return;
+  }
+
   if (lbm_is_cons(val)) { // non-constant cons-cell
     lbm_value *rptr = stack_reserve(ctx, 5);
     rptr[0] = ENC_SYM_NIL; // fst cell of list
@@ -4890,12 +5766,6 @@ static void cont_move_val_to_flash_dispatch(eval_context_t *ctx) {
     return;
   }
 
-  if (lbm_is_ptr(val) && (val & LBM_PTR_TO_CONSTANT_BIT)) { // constant pointer cons or not.
-    //ctx->r unchanged
-    ctx->app_cont = true;
-    return;
-  }
-
   if (lbm_is_ptr(val)) { // something that is not a cons but still a ptr type.
     lbm_cons_t *ref = lbm_ref_cell(val);
     if (lbm_type_of(ref->cdr) == LBM_TYPE_SYMBOL) {
@@ -5404,7 +6274,11 @@ static const cont_fun continuations[NUM_CONTINUATIONS] =
     cont_wrap_result,
     cont_recv_to_retry,
     cont_read_start_array,
-    cont_read_append_array
+    cont_read_append_array,
+    cont_read_image_continue,
+    cont_eval_image_continue,
+    cont_bytecode_return,
+    cont_bytecode_continue
   };
 
 /*********************************************************/
@@ -5438,6 +6312,7 @@ static const evaluator_fun evaluators[] =
    eval_trap,
    eval_call_cc_unsafe,
    eval_selfevaluating, // cont_sp
+   eval_bytecode,
   };
 
 
@@ -5579,6 +6454,52 @@ static lbm_value get_event_value(lbm_event_t *e) {
   return v;
 }
 
+static lbm_value build_event_value(lbm_event_t *e) {
+  lbm_event_build_fun fun = (lbm_event_build_fun)e->buf_ptr;
+  lbm_value v = fun(e->buf_len, false);
+  if (lbm_is_symbol_merror(v)) {
+    gc();
+    v = fun(e->buf_len, true);
+    if (lbm_is_symbol_merror(v)) {
+      lbm_set_flags(LBM_FLAG_HANDLER_EVENT_DELIVERY_FAILED);
+      v = ENC_SYM_EERROR;
+    }
+  }
+  return v;
+}
+
+static void process_event(lbm_event_t *e) {
+  lbm_value event_val;
+  if (e->type == LBM_EVENT_BUILD) {
+    event_val = build_event_value(e);
+  } else {
+    event_val = get_event_value(e);
+  }
+  switch(e->type) {
+  case LBM_EVENT_UNBLOCK_CTX:
+    handle_event_unblock_ctx((lbm_cid)e->parameter, event_val);
+    break;
+  case LBM_EVENT_DEFINE:
+    handle_event_define((lbm_value)e->parameter, event_val);
+    break;
+  case LBM_EVENT_FOR_HANDLER:
+    if (lbm_event_handler_pid >= 0) {
+      lbm_find_receiver_and_send(lbm_event_handler_pid, event_val);
+    }
+    break;
+  case LBM_EVENT_RUN_USER_CALLBACK:
+    user_callback((void*)e->parameter);
+    break;
+  case LBM_EVENT_BUILD:
+    if ((lbm_cid)e->parameter >= 0) {
+      handle_event_unblock_ctx((lbm_cid)e->parameter, event_val);
+    } else if (lbm_event_handler_pid >= 0) {
+      lbm_find_receiver_and_send(lbm_event_handler_pid, event_val);
+    }
+    break;
+  }
+}
+
 static void process_events(void) {
 
   if (!lbm_events) {
@@ -5587,23 +6508,26 @@ static void process_events(void) {
 
   lbm_event_t e;
   while (lbm_event_pop(&e)) {
-    lbm_value event_val = get_event_value(&e);
-    switch(e.type) {
-    case LBM_EVENT_UNBLOCK_CTX:
-      handle_event_unblock_ctx((lbm_cid)e.parameter, event_val);
-      break;
-    case LBM_EVENT_DEFINE:
-      handle_event_define((lbm_value)e.parameter, event_val);
-      break;
-    case LBM_EVENT_FOR_HANDLER:
-      if (lbm_event_handler_pid >= 0) {
-        lbm_find_receiver_and_send(lbm_event_handler_pid, event_val);
+    process_event(&e);
+  }
+
+  // Drain the producer queues in batches. Only the events that were
+  // present when head was read are processed, so a producer that keeps
+  // sending cannot starve the evaluator. The slot is released before
+  // the event is processed so that the producer can reuse it at once.
+  lbm_event_queue_t *q = lbm_event_queue_first();
+  while (q) {
+    if (q->active) {
+      uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+      uint32_t tail = q->tail;
+      while (tail != head) {
+        e = q->events[tail & (q->size - 1)];
+        tail ++;
+        __atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+        process_event(&e);
       }
-      break;
-    case LBM_EVENT_RUN_USER_CALLBACK:
-      user_callback((void*)e.parameter);
-      break;
     }
+    q = q->next;
   }
 }
 
@@ -5633,6 +6557,7 @@ void lbm_run_eval(void){
           blocked.last = NULL;
           queue.first = NULL;
           queue.last = NULL;
+          ctx_index_clear_nm();
           ctx_running = NULL;
 #ifdef LBM_USE_TIME_QUOTA
           eval_time_quota = 0; // maybe timestamp here ?
@@ -5670,6 +6595,7 @@ void lbm_run_eval(void){
 #ifdef LBM_USE_TIME_QUOTA
       // use a fast implementation of timestamp where possible.
       if (timestamp_us_callback() < eval_current_quota && ctx_running) {
+        PROF_STEP(ctx_running);
         evaluation_step();
       } else {
         if (eval_cps_state_changed) break;
@@ -5684,12 +6610,14 @@ void lbm_run_eval(void){
           process_events();
           mutex_lock(&qmutex);
           if (ctx_running) {
+            PROF_RUN_STOP(ctx_running);
             enqueue_ctx_nm(&queue, ctx_running);
             ctx_running = NULL;
           }
           wake_up_ctxs_nm();
           ctx_running = dequeue_ctx_nm(&queue);
           mutex_unlock(&qmutex);
+          PROF_RUN_START(ctx_running);
           if (!ctx_running) {
             lbm_system_sleeping = true;
             //Fixed sleep interval to poll events regularly.
@@ -5701,6 +6629,7 @@ void lbm_run_eval(void){
 #else
       if (eval_steps_quota && ctx_running) {
         eval_steps_quota--;
+        PROF_STEP(ctx_running);
         evaluation_step();
       } else {
         if (eval_cps_state_changed) break;
@@ -5712,12 +6641,14 @@ void lbm_run_eval(void){
           process_events();
           mutex_lock(&qmutex);
           if (ctx_running) {
+            PROF_RUN_STOP(ctx_running);
             enqueue_ctx_nm(&queue, ctx_running);
             ctx_running = NULL;
           }
           wake_up_ctxs_nm();
           ctx_running = dequeue_ctx_nm(&queue);
           mutex_unlock(&qmutex);
+          PROF_RUN_START(ctx_running);
           if (!ctx_running) {
             lbm_system_sleeping = true;
             //Fixed sleep interval to poll events regularly.
@@ -5760,6 +6691,7 @@ int lbm_eval_init() {
   blocked.last = NULL;
   queue.first = NULL;
   queue.last = NULL;
+  ctx_index_clear_nm();
   ctx_running = NULL;
 
   eval_cps_run_state = EVAL_CPS_STATE_RUNNING;
@@ -5784,9 +6716,21 @@ bool lbm_eval_init_events(unsigned int num_events) {
     lbm_events_head = 0;
     lbm_events_tail = 0;
     lbm_events_full = false;
+    lbm_events_dropped = 0;
+    lbm_events_max_used = 0;
     lbm_event_handler_pid = -1;
     r = true;
   }
+  // Pending events in the producer queues refer to memory that is
+  // no longer valid. The queues have to be added again by their owners.
+  lbm_event_queue_t *q = lbm_event_queues;
+  while (q) {
+    lbm_event_queue_t *next = q->next;
+    q->active = false;
+    q->next = NULL;
+    q = next;
+  }
+  __atomic_store_n(&lbm_event_queues, NULL, __ATOMIC_RELEASE);
   mutex_unlock(&lbm_events_mutex);
   return r;
 }
@@ -52,6 +52,15 @@ static lbm_value array_extensions_bufclear(lbm_value *args, lbm_uint argn);
 static lbm_value array_extensions_bufcpy(lbm_value *args, lbm_uint argn);
 static lbm_value array_extensions_bufset_bit(lbm_value *args, lbm_uint argn);
 
+static lbm_value array_extensions_f32_axpy(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_dot(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_scale(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_add(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_mul(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_stats(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_fir(lbm_value *args, lbm_uint argn);
+static lbm_value array_extensions_f32_biquad(lbm_value *args, lbm_uint argn);
+
 void lbm_array_extensions_init(void) {
 
   lbm_add_symbol_const("little-endian", &little_endian);
@@ -80,12 +89,21 @@ void lbm_array_extensions_init(void) {
   lbm_add_extension("bufclear", array_extensions_bufclear);
   lbm_add_extension("bufcpy", array_extensions_bufcpy);
   lbm_add_extension("bufset-bit", array_extensions_bufset_bit);
+
+  lbm_add_extension("buf-f32-axpy", array_extensions_f32_axpy);
+  lbm_add_extension("buf-f32-dot", array_extensions_f32_dot);
+  lbm_add_extension("buf-f32-scale", array_extensions_f32_scale);
+  lbm_add_extension("buf-f32-add", array_extensions_f32_add);
+  lbm_add_extension("buf-f32-mul", array_extensions_f32_mul);
+  lbm_add_extension("buf-f32-stats", array_extensions_f32_stats);
+  lbm_add_extension("buf-f32-fir", array_extensions_f32_fir);
+  lbm_add_extension("buf-f32-biquad", array_extensions_f32_biquad);
 }
 
 lbm_value array_extension_unsafe_free_array(lbm_value *args, lbm_uint argn) {
   lbm_value res = ENC_SYM_EERROR;
   if (argn == 1) {
-    if (lbm_is_array_rw(args[0])) {
+    if (lbm_is_array_rw(args[0]) || lbm_is_array_borrowed(args[0])) {
       if (lbm_heap_explicit_free_array(args[0])) {
         res = ENC_SYM_TRUE;
       } else {
@@ -682,3 +700,282 @@ static lbm_value array_extensions_bufset_bit(lbm_value *args, lbm_uint argn) {
   }
   return res;
 }
+
+// Numeric kernels over byte arrays of f32 values. They use the same
+// encoding as bufget-f32 and bufset-f32, big-endian unless little-endian
+// is given as the last argument, and run over whole buffers so that only
+// one extension call is needed instead of one call per element.
+
+static inline float f32_load(const uint8_t *p, bool be) {
+  uint32_t u;
+  if (be) {
+    u = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  } else {
+    u = ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+  }
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline void f32_store(uint8_t *p, float f, bool be) {
+  // Same as float_to_u, subnormals are stored as 0
+  if (fabsf(f) < 1.5e-38f) {
+    f = 0.0f;
+  }
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  if (be) {
+    p[0] = (uint8_t)(u >> 24); p[1] = (uint8_t)(u >> 16);
+    p[2] = (uint8_t)(u >> 8);  p[3] = (uint8_t)u;
+  } else {
+    p[3] = (uint8_t)(u >> 24); p[2] = (uint8_t)(u >> 16);
+    p[1] = (uint8_t)(u >> 8);  p[0] = (uint8_t)u;
+  }
+}
+
+// Strip an optional trailing endianness symbol from the arguments.
+static lbm_uint f32_decode_endian(lbm_value *args, lbm_uint argn, bool *be) {
+  *be = true;
+  if (argn > 0 && lbm_is_symbol(args[argn - 1])) {
+    lbm_uint sym = lbm_dec_sym(args[argn - 1]);
+    if (sym == little_endian) {
+      *be = false;
+      return argn - 1;
+    } else if (sym == big_endian) {
+      return argn - 1;
+    }
+  }
+  return argn;
+}
+
+static uint8_t *f32_buf(lbm_value v, bool rw, lbm_uint *n) {
+  lbm_array_header_t *array = rw ? lbm_dec_array_rw(v) : lbm_dec_array_r(v);
+  if (!array) return NULL;
+  *n = array->size / 4;
+  return (uint8_t*)array->data;
+}
+
+// Buffer ops of the form (op y x) where y is updated in place.
+static lbm_value f32_binop(lbm_value *args, lbm_uint argn, bool mul) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 2) return ENC_SYM_EERROR;
+
+  lbm_uint ny, nx;
+  uint8_t *y = f32_buf(args[0], true, &ny);
+  uint8_t *x = f32_buf(args[1], false, &nx);
+  if (!y || !x) return ENC_SYM_TERROR;
+
+  lbm_uint n = ny < nx ? ny : nx;
+  for (lbm_uint i = 0;i < n;i++) {
+    float a = f32_load(y + 4 * i, be);
+    float b = f32_load(x + 4 * i, be);
+    f32_store(y + 4 * i, mul ? a * b : a + b, be);
+  }
+  return ENC_SYM_TRUE;
+}
+
+/* (buf-f32-axpy y a x) -> y = a * x + y */
+static lbm_value array_extensions_f32_axpy(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 3) return ENC_SYM_EERROR;
+
+  lbm_uint ny, nx;
+  uint8_t *y = f32_buf(args[0], true, &ny);
+  uint8_t *x = f32_buf(args[2], false, &nx);
+  if (!y || !x || !lbm_is_number(args[1])) return ENC_SYM_TERROR;
+
+  float a = lbm_dec_as_float(args[1]);
+  lbm_uint n = ny < nx ? ny : nx;
+  for (lbm_uint i = 0;i < n;i++) {
+    f32_store(y + 4 * i, a * f32_load(x + 4 * i, be) + f32_load(y + 4 * i, be), be);
+  }
+  return ENC_SYM_TRUE;
+}
+
+/* (buf-f32-dot x y) */
+static lbm_value array_extensions_f32_dot(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 2) return ENC_SYM_EERROR;
+
+  lbm_uint nx, ny;
+  uint8_t *x = f32_buf(args[0], false, &nx);
+  uint8_t *y = f32_buf(args[1], false, &ny);
+  if (!x || !y) return ENC_SYM_TERROR;
+
+  lbm_uint n = ny < nx ? ny : nx;
+  float sum = 0.0f;
+  for (lbm_uint i = 0;i < n;i++) {
+    sum += f32_load(x + 4 * i, be) * f32_load(y + 4 * i, be);
+  }
+  return lbm_enc_float(sum);
+}
+
+/* (buf-f32-scale x a optB) -> x = a * x + b */
+static lbm_value array_extensions_f32_scale(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 2 && argn != 3) return ENC_SYM_EERROR;
+
+  lbm_uint n;
+  uint8_t *x = f32_buf(args[0], true, &n);
+  if (!x || !lbm_is_number(args[1]) || (argn == 3 && !lbm_is_number(args[2]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  float a = lbm_dec_as_float(args[1]);
+  float b = argn == 3 ? lbm_dec_as_float(args[2]) : 0.0f;
+  for (lbm_uint i = 0;i < n;i++) {
+    f32_store(x + 4 * i, a * f32_load(x + 4 * i, be) + b, be);
+  }
+  return ENC_SYM_TRUE;
+}
+
+/* (buf-f32-add y x) -> y = y + x */
+static lbm_value array_extensions_f32_add(lbm_value *args, lbm_uint argn) {
+  return f32_binop(args, argn, false);
+}
+
+/* (buf-f32-mul y x) -> y = y * x */
+static lbm_value array_extensions_f32_mul(lbm_value *args, lbm_uint argn) {
+  return f32_binop(args, argn, true);
+}
+
+/* (buf-f32-stats x) -> (min max mean rms) */
+static lbm_value array_extensions_f32_stats(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 1) return ENC_SYM_EERROR;
+
+  lbm_uint n;
+  uint8_t *x = f32_buf(args[0], false, &n);
+  if (!x) return ENC_SYM_TERROR;
+  if (n == 0) return ENC_SYM_EERROR;
+
+  // 4 list cells and, on 32-bit, 4 boxed floats
+  if (lbm_heap_num_free() < 8) return ENC_SYM_MERROR;
+
+  float min = f32_load(x, be);
+  float max = min;
+  float sum = 0.0f;
+  float sum_sq = 0.0f;
+  for (lbm_uint i = 0;i < n;i++) {
+    float v = f32_load(x + 4 * i, be);
+    if (v < min) min = v;
+    if (v > max) max = v;
+    sum += v;
+    sum_sq += v * v;
+  }
+
+  return lbm_heap_allocate_list_init(4,
+                                     lbm_enc_float(min),
+                                     lbm_enc_float(max),
+                                     lbm_enc_float(sum / (float)n),
+                                     lbm_enc_float(sqrtf(sum_sq / (float)n)));
+}
+
+/* (buf-f32-fir x taps optState)
+ *
+ * y[i] = sum taps[k] * x[i - k], written back to x. The state buffer holds
+ * the last num-taps - 1 inputs of the previous call, oldest first, so that
+ * a signal can be filtered one block at a time. Without state the samples
+ * before the start of x are taken as 0.
+ */
+static lbm_value array_extensions_f32_fir(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 2 && argn != 3) return ENC_SYM_EERROR;
+
+  lbm_uint n, n_taps, n_state = 0;
+  uint8_t *x = f32_buf(args[0], true, &n);
+  uint8_t *taps = f32_buf(args[1], false, &n_taps);
+  uint8_t *state = NULL;
+  if (!x || !taps) return ENC_SYM_TERROR;
+  if (n_taps == 0) return ENC_SYM_EERROR;
+
+  lbm_uint hist = n_taps - 1;
+  if (argn == 3) {
+    state = f32_buf(args[2], true, &n_state);
+    if (!state) return ENC_SYM_TERROR;
+    if (n_state < hist) return ENC_SYM_EERROR;
+  }
+
+  // The new state is collected before x is overwritten
+  float *new_state = NULL;
+  if (state && hist > 0) {
+    new_state = (float*)lbm_malloc(hist * sizeof(float));
+    if (!new_state) return ENC_SYM_MERROR;
+    for (lbm_uint j = 0;j < hist;j++) {
+      // Input number n - hist + j, counted from the start of x
+      lbm_int ix = (lbm_int)n - (lbm_int)hist + (lbm_int)j;
+      new_state[j] = ix >= 0 ? f32_load(x + 4 * ix, be) :
+        f32_load(state + 4 * (lbm_uint)((lbm_int)hist + ix), be);
+    }
+  }
+
+  // Going backwards every input is read before it is overwritten
+  for (lbm_uint i = n;i-- > 0;) {
+    float sum = 0.0f;
+    for (lbm_uint k = 0;k < n_taps;k++) {
+      float v;
+      if (k <= i) {
+        v = f32_load(x + 4 * (i - k), be);
+      } else if (state) {
+        v = f32_load(state + 4 * (hist - (k - i)), be);
+      } else {
+        break;
+      }
+      sum += f32_load(taps + 4 * k, be) * v;
+    }
+    f32_store(x + 4 * i, sum, be);
+  }
+
+  if (new_state) {
+    for (lbm_uint j = 0;j < hist;j++) {
+      f32_store(state + 4 * j, new_state[j], be);
+    }
+    lbm_memory_free((lbm_uint*)new_state);
+  }
+  return ENC_SYM_TRUE;
+}
+
+/* (buf-f32-biquad x coeffs)
+ *
+ * coeffs holds a0 a1 a2 b1 b2 z1 z2, the same fields and order as the
+ * biquad in the VESC digital filters. z1 and z2 are updated so that the
+ * filter continues where it stopped on the next call.
+ */
+static lbm_value array_extensions_f32_biquad(lbm_value *args, lbm_uint argn) {
+  bool be;
+  argn = f32_decode_endian(args, argn, &be);
+  if (argn != 2) return ENC_SYM_EERROR;
+
+  lbm_uint n, n_c;
+  uint8_t *x = f32_buf(args[0], true, &n);
+  uint8_t *c = f32_buf(args[1], true, &n_c);
+  if (!x || !c) return ENC_SYM_TERROR;
+  if (n_c < 7) return ENC_SYM_EERROR;
+
+  float a0 = f32_load(c, be);
+  float a1 = f32_load(c + 4, be);
+  float a2 = f32_load(c + 8, be);
+  float b1 = f32_load(c + 12, be);
+  float b2 = f32_load(c + 16, be);
+  float z1 = f32_load(c + 20, be);
+  float z2 = f32_load(c + 24, be);
+
+  for (lbm_uint i = 0;i < n;i++) {
+    float in = f32_load(x + 4 * i, be);
+    float out = in * a0 + z1;
+    z1 = in * a1 + z2 - b1 * out;
+    z2 = in * a2 - b2 * out;
+    f32_store(x + 4 * i, out, be);
+  }
+
+  f32_store(c + 20, z1, be);
+  f32_store(c + 24, z2, be);
+  return ENC_SYM_TRUE;
+}
@@ -174,15 +174,91 @@ uint32_t image_dims_to_size_bytes(color_format_t fmt, uint16_t width, uint16_t h
   }
 }
 
+// Dirty rectangle tracking
+
+static const uint8_t dirty_magic[4] = {'D', 'I', 'R', 'T'};
+
+static inline uint16_t dirty_get(uint8_t *d, int i) {
+  return (uint16_t)(d[i * 2] << 8 | d[i * 2 + 1]);
+}
+
+static inline void dirty_put(uint8_t *d, int i, uint16_t v) {
+  d[i * 2] = (uint8_t)(v >> 8);
+  d[i * 2 + 1] = (uint8_t)v;
+}
+
+static void dirty_set(uint8_t *d, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  dirty_put(d, 0, x0);
+  dirty_put(d, 1, y0);
+  dirty_put(d, 2, x1);
+  dirty_put(d, 3, y1);
+}
+
+static inline void dirty_reset(uint8_t *d) {
+  dirty_set(d, 0xFFFF, 0xFFFF, 0, 0);
+}
+
+static inline bool dirty_is_empty(uint8_t *d) {
+  return dirty_get(d, 0) >= dirty_get(d, 2) || dirty_get(d, 1) >= dirty_get(d, 3);
+}
+
+// Returns the dirty rectangle of the image buffer in data, or NULL if the
+// buffer has no dirty trailer.
+static uint8_t *image_buffer_dirty(uint8_t *data, lbm_uint size) {
+  uint32_t pix_bytes = image_dims_to_size_bytes(image_buffer_format(data),
+                                                image_buffer_width(data),
+                                                image_buffer_height(data));
+  if (size != IMAGE_BUFFER_HEADER_SIZE + pix_bytes + IMAGE_BUFFER_DIRTY_SIZE) {
+    return NULL;
+  }
+  uint8_t *d = data + IMAGE_BUFFER_HEADER_SIZE + pix_bytes;
+  if (memcmp(d, dirty_magic, sizeof(dirty_magic)) != 0) {
+    return NULL;
+  }
+  return d + sizeof(dirty_magic);
+}
+
+// Grow the dirty rectangle to include the already clipped rectangle
+// x0, y0 to x1, y1 (end exclusive).
+static inline void image_buffer_mark_dirty(image_buffer_t *img, int x0, int y0, int x1, int y1) {
+  uint8_t *d = img->dirty;
+  if (!d) {
+    return;
+  }
+  if (x0 < dirty_get(d, 0)) dirty_put(d, 0, (uint16_t)x0);
+  if (y0 < dirty_get(d, 1)) dirty_put(d, 1, (uint16_t)y0);
+  if (x1 > dirty_get(d, 2)) dirty_put(d, 2, (uint16_t)x1);
+  if (y1 > dirty_get(d, 3)) dirty_put(d, 3, (uint16_t)y1);
+}
+
+void image_buffer_from_array(image_buffer_t *img, lbm_array_header_t *arr) {
+  uint8_t *data = (uint8_t*)arr->data;
+  img->width = image_buffer_width(data);
+  img->height = image_buffer_height(data);
+  img->fmt = image_buffer_format(data);
+  img->mem_base = data;
+  img->data = image_buffer_data(data);
+  img->dirty = image_buffer_dirty(data, arr->size);
+}
+
+static void image_buffer_init(uint8_t *buf, color_format_t fmt, uint16_t width, uint16_t height) {
+  buf[0] = (uint8_t)(width >> 8);
+  buf[1] = (uint8_t)width;
+  buf[2] = (uint8_t)(height >> 8);
+  buf[3] = (uint8_t)height;
+  buf[4] = color_format_to_byte(fmt);
+
+  // A new buffer has not been rendered yet, so all of it is dirty.
+  uint8_t *d = buf + IMAGE_BUFFER_HEADER_SIZE + image_dims_to_size_bytes(fmt, width, height);
+  memcpy(d, dirty_magic, sizeof(dirty_magic));
+  dirty_set(d + sizeof(dirty_magic), 0, 0, width, height);
+}
+
 static lbm_value image_buffer_lift(uint8_t *buf, color_format_t fmt, uint16_t width, uint16_t height) {
   lbm_value res = ENC_SYM_MERROR;
   lbm_uint size = image_dims_to_size_bytes(fmt, width, height);
-  if ( lbm_lift_array(&res, (char*)buf, IMAGE_BUFFER_HEADER_SIZE + size)) {
-    buf[0] = (uint8_t)(width >> 8);
-    buf[1] = (uint8_t)width;
-    buf[2] = (uint8_t)(height >> 8);
-    buf[3] = (uint8_t)height;
-    buf[4] = color_format_to_byte(fmt);
+  if ( lbm_lift_array(&res, (char*)buf, IMAGE_BUFFER_HEADER_SIZE + size + IMAGE_BUFFER_DIRTY_SIZE)) {
+    image_buffer_init(buf, fmt, width, height);
   }
   return res;
 }
@@ -258,7 +334,7 @@ static lbm_value color_allocate(COLOR_TYPE type, int32_t color1, int32_t color2,
 static lbm_value image_buffer_allocate(color_format_t fmt, uint16_t width, uint16_t height) {
   uint32_t size_bytes = image_dims_to_size_bytes(fmt, width, height);
 
-  uint8_t *buf = lbm_malloc(IMAGE_BUFFER_HEADER_SIZE + size_bytes);
+  uint8_t *buf = lbm_malloc(IMAGE_BUFFER_HEADER_SIZE + size_bytes + IMAGE_BUFFER_DIRTY_SIZE);
   if (!buf) {
     return ENC_SYM_MERROR;
   }
@@ -273,15 +349,10 @@ static lbm_value image_buffer_allocate(color_format_t fmt, uint16_t width, uint1
 static lbm_value image_buffer_allocate_dm(lbm_uint *dm, color_format_t fmt, uint16_t width, uint16_t height) {
   uint32_t size_bytes = image_dims_to_size_bytes(fmt, width, height);
 
-  lbm_value res = lbm_defrag_mem_alloc(dm, IMAGE_BUFFER_HEADER_SIZE + size_bytes);
+  lbm_value res = lbm_defrag_mem_alloc(dm, IMAGE_BUFFER_HEADER_SIZE + size_bytes + IMAGE_BUFFER_DIRTY_SIZE);
   lbm_array_header_t *arr = lbm_dec_array_r(res);
   if (arr) {
-    uint8_t *buf = (uint8_t*)arr->data;
-    buf[0] = (uint8_t)(width >> 8);
-    buf[1] = (uint8_t)width;
-    buf[2] = (uint8_t)(height >> 8);
-    buf[3] = (uint8_t)height;
-    buf[4] = color_format_to_byte(fmt);
+    image_buffer_init((uint8_t*)arr->data, fmt, width, height);
   }
   return res;
 }
@@ -472,6 +543,8 @@ static uint32_t  rgb565to888(uint16_t rgb) {
   return res_rgb888;
 }
 
+static void fill_bytes(uint8_t *data, color_format_t fmt, uint32_t pos, uint32_t len, uint32_t c);
+
 void image_buffer_clear(image_buffer_t *img, uint32_t cc) {
   color_format_t fmt = img->fmt;
   uint32_t w = img->width;
@@ -499,31 +572,15 @@ void image_buffer_clear(image_buffer_t *img, uint32_t cc) {
     memset(data, color, bytes);
   }
     break;
-  case rgb332: {
-    memset(data, rgb888to332(cc), img_size);
-  }
-    break;
-  case rgb565: {
-    uint16_t c = rgb888to565(cc);
-    uint8_t *dp = (uint8_t*)data;
-    for (unsigned int i = 0; i < img_size/2; i +=2) {
-      dp[i] = (uint8_t)(c >> 8);
-      dp[i+1] = (uint8_t)c;
-    }
-  }
-    break;
-  case rgb888: {
-    uint8_t *dp = (uint8_t*)data;
-    for (unsigned int i = 0; i < img_size * 3; i+= 3) {
-      dp[i]   = (uint8_t)(cc >> 16);
-      dp[i+1] = (uint8_t)(cc >> 8);
-      dp[i+2] = (uint8_t)cc;
-    }
-  }
+  case rgb332:
+  case rgb565:
+  case rgb888:
+    fill_bytes(data, fmt, 0, img_size, cc);
     break;
   default:
     break;
   }
+  image_buffer_mark_dirty(img, 0, 0, (int)w, (int)h);
 }
 
 static const uint8_t indexed4_mask[4] = {0x03, 0x0C, 0x30, 0xC0};
@@ -539,6 +596,7 @@ void putpixel(image_buffer_t* img, int x_i, int y_i, uint32_t c) {
   uint16_t y = (uint16_t)y_i;
 
   if (x < w && y < h) {
+    image_buffer_mark_dirty(img, x, y, x + 1, y + 1);
     color_format_t fmt = img->fmt;
     uint8_t *data = img->data;
     switch(fmt) {
@@ -643,18 +701,166 @@ uint32_t getpixel(image_buffer_t* img, int x_i, int y_i) {
   return 0;
 }
 
-static void h_line(image_buffer_t* img, int x, int y, int len, uint32_t c) {
-  for (int i = 0; i < len; i ++) {
-    putpixel(img, x+i, y, c);
+// Span kernels. Clipping is done once per span or rectangle and the colour
+// is converted to the buffer format once, after which the pixels are
+// written with memset and memcpy instead of one putpixel call per pixel.
+
+static inline bool is_byte_format(color_format_t fmt) {
+  return fmt == rgb332 || fmt == rgb565 || fmt == rgb888;
+}
+
+static inline uint32_t bytes_per_pixel(color_format_t fmt) {
+  switch (fmt) {
+  case rgb565: return 2;
+  case rgb888: return 3;
+  default: return 1;
   }
 }
 
-static void v_line(image_buffer_t* img, int x, int y, int len, uint32_t c) {
-  for (int i = 0; i < len; i ++) {
-    putpixel(img, x, y+i, c);
+// Fill len pixels starting at pixel pos for the formats with whole bytes
+// per pixel. The first pixel is written and then copied in doubling
+// chunks, so that the bulk of the work is done by memcpy.
+static void fill_bytes(uint8_t *data, color_format_t fmt, uint32_t pos, uint32_t len, uint32_t c) {
+  if (len == 0) {
+    return;
+  }
+
+  switch (fmt) {
+  case rgb332:
+    memset(data + pos, rgb888to332(c), len);
+    return;
+  case rgb565: {
+    uint16_t color = rgb888to565(c);
+    data += pos * 2;
+    data[0] = (uint8_t)(color >> 8);
+    data[1] = (uint8_t)color;
+    len *= 2;
+    break;
+  }
+  case rgb888:
+    data += pos * 3;
+    data[0] = (uint8_t)(c >> 16);
+    data[1] = (uint8_t)(c >> 8);
+    data[2] = (uint8_t)c;
+    len *= 3;
+    break;
+  default:
+    return;
+  }
+
+  uint32_t done = bytes_per_pixel(fmt);
+  while (done < len) {
+    uint32_t n = done < (len - done) ? done : (len - done);
+    memcpy(data + done, data, n);
+    done += n;
   }
 }
 
+// Fill len pixels starting at pixel pos for the indexed formats. Partial
+// bytes at the ends are masked and the whole bytes in between are set
+// with memset.
+static void fill_indexed(uint8_t *data, color_format_t fmt, uint32_t pos, uint32_t len, uint32_t c) {
+  uint32_t ppb; // Pixels per byte
+  uint32_t bits;
+  uint8_t pattern;
+
+  switch (fmt) {
+  case indexed2:
+    ppb = 8; bits = 1; c = c ? 1 : 0; pattern = c ? 0xFF : 0x00;
+    break;
+  case indexed4:
+    ppb = 4; bits = 2; c &= 0x3; pattern = (uint8_t)(c * 0x55);
+    break;
+  case indexed16:
+    ppb = 2; bits = 4; c &= 0xF; pattern = (uint8_t)(c * 0x11);
+    break;
+  default:
+    return;
+  }
+
+  uint32_t end = pos + len;
+
+  // The first pixel in a byte is stored in the most significant bits
+  while (pos < end && (pos % ppb) != 0) {
+    uint32_t shift = (ppb - 1 - (pos % ppb)) * bits;
+    uint8_t mask = (uint8_t)(((1u << bits) - 1) << shift);
+    data[pos / ppb] = (uint8_t)((data[pos / ppb] & ~mask) | (c << shift));
+    pos++;
+  }
+
+  uint32_t whole = (end - pos) / ppb;
+  memset(data + pos / ppb, pattern, whole);
+  pos += whole * ppb;
+
+  while (pos < end) {
+    uint32_t shift = (ppb - 1 - (pos % ppb)) * bits;
+    uint8_t mask = (uint8_t)(((1u << bits) - 1) << shift);
+    data[pos / ppb] = (uint8_t)((data[pos / ppb] & ~mask) | (c << shift));
+    pos++;
+  }
+}
+
+static inline void fill_pixels(image_buffer_t *img, uint32_t pos, uint32_t len, uint32_t c) {
+  if (is_byte_format(img->fmt)) {
+    fill_bytes(img->data, img->fmt, pos, len, c);
+  } else {
+    fill_indexed(img->data, img->fmt, pos, len, c);
+  }
+}
+
+// Clip the rectangle to the image. Returns false if nothing is left. The
+// corners are computed in 64 bits as x + w overflows for large widths.
+static bool clip_rect(image_buffer_t *img, int *x, int *y, int *w, int *h) {
+  int64_t x0 = *x;
+  int64_t y0 = *y;
+  int64_t x1 = x0 + *w;
+  int64_t y1 = y0 + *h;
+  if (x0 < 0) { x0 = 0; }
+  if (y0 < 0) { y0 = 0; }
+  if (x1 > img->width) { x1 = img->width; }
+  if (y1 > img->height) { y1 = img->height; }
+  if (x1 <= x0 || y1 <= y0) {
+    return false;
+  }
+  *x = (int)x0;
+  *y = (int)y0;
+  *w = (int)(x1 - x0);
+  *h = (int)(y1 - y0);
+  return true;
+}
+
+static void fill_rect(image_buffer_t *img, int x, int y, int w, int h, uint32_t c) {
+  if (!clip_rect(img, &x, &y, &w, &h)) {
+    return;
+  }
+  image_buffer_mark_dirty(img, x, y, x + w, y + h);
+
+  uint32_t img_w = img->width;
+  uint32_t pos = (uint32_t)y * img_w + (uint32_t)x;
+  fill_pixels(img, pos, (uint32_t)w, c);
+
+  if (is_byte_format(img->fmt)) {
+    // Copy the first row to the others
+    uint32_t bpp = bytes_per_pixel(img->fmt);
+    uint8_t *first = img->data + pos * bpp;
+    for (int i = 1;i < h;i++) {
+      memcpy(first + (uint32_t)i * img_w * bpp, first, (uint32_t)w * bpp);
+    }
+  } else {
+    for (int i = 1;i < h;i++) {
+      fill_pixels(img, pos + (uint32_t)i * img_w, (uint32_t)w, c);
+    }
+  }
+}
+
+static void h_line(image_buffer_t* img, int x, int y, int len, uint32_t c) {
+  fill_rect(img, x, y, len, 1, c);
+}
+
+static void v_line(image_buffer_t* img, int x, int y, int len, uint32_t c) {
+  fill_rect(img, x, y, 1, len, c);
+}
+
 static void fill_circle(image_buffer_t *img, int x, int y, int radius, uint32_t color) {
   switch (radius) {
   case 0:
@@ -906,9 +1112,7 @@ static void rectangle(image_buffer_t *img, int x, int y, int width, int height,
   thickness /= 2;
 
   if (fill) {
-    for (int i = y; i < (y + height);i++) {
-      h_line(img, x, i, width, color);
-    }
+    fill_rect(img, x, y, width, height, color);
   } else {
     if (thickness <= 0 && dot1 == 0) {
       h_line(img, x, y, width, color);
@@ -935,24 +1139,40 @@ static void rectangle(image_buffer_t *img, int x, int y, int width, int height,
 #define NMIN(a, b) ((a) < (b) ? (a) : (b))
 #define NMAX(a, b) ((a) > (b) ? (a) : (b))
 
+static inline bool triangle_inside(int x, int y, int x0, int y0,
+                                   int x1, int y1, int x2, int y2) {
+  int w0 = point_past_line(x, y, x1, y1, x2, y2);
+  int w1 = point_past_line(x, y, x2, y2, x0, y0);
+  int w2 = point_past_line(x, y, x0, y0, x1, y1);
+
+  return (w0 >= 0 && w1 >= 0 && w2 >= 0) || (w0 <= 0 && w1 <= 0 && w2 <= 0);
+}
+
 static void fill_triangle(image_buffer_t *img, int x0, int y0,
                           int x1, int y1, int x2, int y2, uint32_t color) {
-  int x_min = NMIN(x0, NMIN(x1, x2));
-  int x_max = NMAX(x0, NMAX(x1, x2));
-  int y_min = NMIN(y0, NMIN(y1, y2));
-  int y_max = NMAX(y0, NMAX(y1, y2));
+  int x_min = NMAX(NMIN(x0, NMIN(x1, x2)), 0);
+  int x_max = NMIN(NMAX(x0, NMAX(x1, x2)), img->width - 1);
+  int y_min = NMAX(NMIN(y0, NMIN(y1, y2)), 0);
+  int y_max = NMIN(NMAX(y0, NMAX(y1, y2)), img->height - 1);
 
+  // The triangle is convex, so the inside of every row is one span that
+  // is found by searching for its ends from both sides.
   for (int y = y_min;y <= y_max;y++) {
-    for (int x = x_min;x <= x_max;x++) {
-      int w0 = point_past_line(x, y, x1, y1, x2, y2);
-      int w1 = point_past_line(x, y, x2, y2, x0, y0);
-      int w2 = point_past_line(x, y, x0, y0, x1, y1);
-
-      if ((w0 >= 0 && w1 >= 0 && w2 >= 0)
-          || (w0 <= 0 && w1 <= 0 && w2 <= 0)) {
-        putpixel(img, x, y, color);
-      }
+    int x_left = x_min;
+    while (x_left <= x_max && !triangle_inside(x_left, y, x0, y0, x1, y1, x2, y2)) {
+      x_left++;
+    }
+
+    if (x_left > x_max) {
+      continue;
+    }
+
+    int x_right = x_max;
+    while (x_right > x_left && !triangle_inside(x_right, y, x0, y0, x1, y1, x2, y2)) {
+      x_right--;
     }
+
+    h_line(img, x_left, y, x_right - x_left + 1, color);
   }
 }
 
@@ -1814,17 +2034,42 @@ void blit_rot_scale(
     if ((des_x_end - x) > src_w) des_x_end = src_w + x;
     if ((des_y_end - y) > src_h) des_y_end = src_h + y;
 
-    for (int j = des_y_start; j < des_y_end; j++) {
-      for (int i = des_x_start; i < des_x_end; i++) {
-        int px = i - x;
-        int py = j - y;
+    if (des_x_start >= des_x_end || des_y_start >= des_y_end) {
+      return;
+    }
 
-        if (px >= 0 && px < src_w && py >= 0 && py < src_h) {
-          uint32_t p = getpixel(img_src, px, py);
+    // Rows can be copied directly when the formats match, there is no
+    // transparent colour and every pixel is a whole number of bytes.
+    if (img_src->fmt == img_dest->fmt && transparent_color < 0 &&
+        is_byte_format(img_dest->fmt)) {
+      uint32_t bpp = bytes_per_pixel(img_dest->fmt);
+      uint32_t row_bytes = (uint32_t)(des_x_end - des_x_start) * bpp;
+      image_buffer_mark_dirty(img_dest, des_x_start, des_y_start, des_x_end, des_y_end);
+      // A buffer can be blitted onto itself. Rows may then overlap and
+      // when moving down the bottom row has to be copied first.
+      bool bottom_up = img_dest->data == img_src->data && y > 0;
+      for (int r = 0; r < des_y_end - des_y_start; r++) {
+        int j = bottom_up ? des_y_end - 1 - r : des_y_start + r;
+        uint32_t des_pos = (uint32_t)j * (uint32_t)des_w + (uint32_t)des_x_start;
+        uint32_t src_pos = (uint32_t)(j - y) * (uint32_t)src_w + (uint32_t)(des_x_start - x);
+        memmove(img_dest->data + des_pos * bpp, img_src->data + src_pos * bpp, row_bytes);
+      }
+      return;
+    }
 
-          if (p != (uint32_t) transparent_color) {
-            putpixel(img_dest, i, j, p);
-          }
+    // When blitting a buffer onto itself, walk against the direction it
+    // moves in so that every pixel is read before it is overwritten.
+    bool self = img_dest->data == img_src->data;
+    bool rev_y = self && y > 0;
+    bool rev_x = self && x > 0;
+    for (int r = 0; r < des_y_end - des_y_start; r++) {
+      int j = rev_y ? des_y_end - 1 - r : des_y_start + r;
+      for (int c = 0; c < des_x_end - des_x_start; c++) {
+        int i = rev_x ? des_x_end - 1 - c : des_x_start + c;
+        uint32_t p = getpixel(img_src, i - x, j - y);
+
+        if (p != (uint32_t) transparent_color) {
+          putpixel(img_dest, i, j, p);
         }
       }
     }
@@ -1928,11 +2173,7 @@ static img_args_t decode_args(lbm_value *args, lbm_uint argn, int num_expected)
   lbm_array_header_t *arr;
   if (argn >= 1 && (arr = get_image_buffer(args[0]))) {
     // at least one argument which is an image buffer.
-    res.img.width = image_buffer_width((uint8_t*)arr->data);
-    res.img.height = image_buffer_height((uint8_t*)arr->data);
-    res.img.fmt = image_buffer_format((uint8_t*)arr->data);
-    res.img.mem_base = (uint8_t*)arr->data;
-    res.img.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&res.img, arr);
 
 
     int num_dec = 0;
@@ -2302,11 +2543,7 @@ static lbm_value ext_clear(lbm_value *args, lbm_uint argn) {
       (arr = get_image_buffer(args[0])) &&   // assignment
       (argn != 2 || lbm_is_number(args[1]))) { // ( argn == 2 -> lbm_is_number(args[1]))
     image_buffer_t img_buf;
-    img_buf.width = image_buffer_width((uint8_t*)arr->data);
-    img_buf.height = image_buffer_height((uint8_t*)arr->data);
-    img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    img_buf.mem_base = (uint8_t*)arr->data;
-    img_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&img_buf, arr);
 
     uint32_t color = 0;
     if (argn == 2) {
@@ -2626,11 +2863,7 @@ static lbm_value ext_text(lbm_value *args, lbm_uint argn) {
   }
   lbm_array_header_t *arr = (lbm_array_header_t *)lbm_car(args[0]);
   image_buffer_t img_buf;
-  img_buf.width = image_buffer_width((uint8_t*)arr->data);
-  img_buf.height = image_buffer_height((uint8_t*)arr->data);
-  img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-  img_buf.mem_base = (uint8_t*)arr->data;
-  img_buf.data = image_buffer_data((uint8_t*)arr->data);
+  image_buffer_from_array(&img_buf, arr);
 
   lbm_array_header_t *font = 0;
   // Allow both const and non-const fonts.
@@ -2682,11 +2915,7 @@ static lbm_value ext_blit(lbm_value *args, lbm_uint argn) {
   lbm_array_header_t *arr;
   if (arg_dec.is_valid && (arr = get_image_buffer(args[0]))) { //assignment
     image_buffer_t dest_buf;
-    dest_buf.width = image_buffer_width((uint8_t*)arr->data);
-    dest_buf.height = image_buffer_height((uint8_t*)arr->data);
-    dest_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    dest_buf.mem_base = (uint8_t*)arr->data;
-    dest_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&dest_buf, arr);
 
     float scale = 1.0;
     if (arg_dec.attr_scale.is_valid) {
@@ -2770,6 +2999,35 @@ static lbm_value ext_disp_clear(lbm_value *args, lbm_uint argn) {
   return ENC_SYM_TRUE;
 }
 
+// Decode the optional list of colors given to disp-render into colors,
+// which has room for 16 colors.
+static bool decode_render_colors(lbm_value lst, color_t *colors) {
+  memset(colors, 0, sizeof(color_t) * 16);
+
+  int i = 0;
+  lbm_value curr = lst;
+  while (lbm_is_cons(curr) && i < 16) {
+    lbm_value arg = lbm_car(curr);
+    color_t *color;
+    if (lbm_is_number(arg)) {
+      colors[i].color1 = (int)lbm_dec_as_u32(arg);
+    } else if ((color = get_color(arg))) { // color assignment
+      colors[i] = *color;
+    } else {
+      return false;
+    }
+
+    curr = lbm_cdr(curr);
+    i++;
+  }
+  return true;
+}
+
+static lbm_value render_error(void) {
+  lbm_set_error_reason("Could not render image. Check if the format and location is compatible with the display.");
+  return ENC_SYM_EERROR;
+}
+
 static lbm_value ext_disp_render(lbm_value *args, lbm_uint argn) {
   if (disp_render_image == NULL) {
     lbm_set_error_reason(msg_not_supported);
@@ -2783,122 +3041,337 @@ static lbm_value ext_disp_render(lbm_value *args, lbm_uint argn) {
       lbm_is_number(args[1]) &&
       lbm_is_number(args[2])) {
     image_buffer_t img_buf;
-    img_buf.fmt = image_buffer_format((uint8_t*)arr->data);
-    img_buf.width = image_buffer_width((uint8_t*)arr->data);
-    img_buf.height = image_buffer_height((uint8_t*)arr->data);
-    img_buf.mem_base = (uint8_t*)arr->data;
-    img_buf.data = image_buffer_data((uint8_t*)arr->data);
+    image_buffer_from_array(&img_buf, arr);
 
     color_t colors[16];
-    memset(colors, 0, sizeof(color_t) * 16);
-
-    if (argn == 4 && lbm_is_list(args[3])) {
-      int i = 0;
-      lbm_value curr = args[3];
-      while (lbm_is_cons(curr) && i < 16) {
-        lbm_value arg = lbm_car(curr);
-        color_t *color;
-        if (lbm_is_number(arg)) {
-          colors[i].color1 = (int)lbm_dec_as_u32(arg);
-        } else if ((color = get_color(arg))) { // color assignment
-          colors[i] = *color;
-        } else {
-          return ENC_SYM_TERROR;
-        }
-
-        curr = lbm_cdr(curr);
-        i++;
-      }
+    if (!decode_render_colors(argn == 4 ? args[3] : ENC_SYM_NIL, colors)) {
+      return ENC_SYM_TERROR;
     }
 
     // img_buf is a stack allocated image_buffer_t.
     bool render_res = disp_render_image(&img_buf, (uint16_t)lbm_dec_as_u32(args[1]), (uint16_t)lbm_dec_as_u32(args[2]), colors);
     if (!render_res) {
-      lbm_set_error_reason("Could not render image. Check if the format and location is compatible with the display.");
-      return ENC_SYM_EERROR;
+      return render_error();
+    }
+    if (img_buf.dirty) {
+      dirty_reset(img_buf.dirty);
     }
     res = ENC_SYM_TRUE;
   }
   return res;
 }
 
+// Copy the w x h region at x, y of src into the image buffer mem.
+static void image_buffer_copy_region(image_buffer_t *src, uint8_t *mem, int x, int y, int w, int h) {
+  image_buffer_t dst;
+  image_buffer_init(mem, src->fmt, (uint16_t)w, (uint16_t)h);
+  dst.fmt = src->fmt;
+  dst.width = (uint16_t)w;
+  dst.height = (uint16_t)h;
+  dst.mem_base = mem;
+  dst.data = image_buffer_data(mem);
+  dst.dirty = NULL;
+
+  if (is_byte_format(src->fmt)) {
+    uint32_t bpp = bytes_per_pixel(src->fmt);
+    for (int j = 0;j < h;j++) {
+      uint32_t src_pos = (uint32_t)(y + j) * src->width + (uint32_t)x;
+      memcpy(dst.data + (uint32_t)j * (uint32_t)w * bpp, src->data + src_pos * bpp, (uint32_t)w * bpp);
+    }
+  } else {
+    for (int j = 0;j < h;j++) {
+      for (int i = 0;i < w;i++) {
+        putpixel(&dst, i, j, getpixel(src, x + i, y + j));
+      }
+    }
+  }
+}
+
+// Like disp-render, but only the part of the image that has been drawn to
+// since it was rendered last is sent to the display. Returns nil when
+// nothing has changed.
+static lbm_value ext_disp_render_dirty(lbm_value *args, lbm_uint argn) {
+  if (disp_render_image == NULL) {
+    lbm_set_error_reason(msg_not_supported);
+    return ENC_SYM_EERROR;
+  }
+
+  lbm_array_header_t *arr;
+  if (!((argn == 3 || argn == 4) &&
+        (arr = get_image_buffer(args[0])) &&
+        lbm_is_number(args[1]) &&
+        lbm_is_number(args[2]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  image_buffer_t img_buf;
+  image_buffer_from_array(&img_buf, arr);
+
+  color_t colors[16];
+  if (!decode_render_colors(argn == 4 ? args[3] : ENC_SYM_NIL, colors)) {
+    return ENC_SYM_TERROR;
+  }
+
+  uint16_t x = (uint16_t)lbm_dec_as_u32(args[1]);
+  uint16_t y = (uint16_t)lbm_dec_as_u32(args[2]);
+
+  // Buffers without a dirty trailer are rendered in full.
+  if (!img_buf.dirty) {
+    return disp_render_image(&img_buf, x, y, colors) ? ENC_SYM_TRUE : render_error();
+  }
+
+  if (dirty_is_empty(img_buf.dirty)) {
+    return ENC_SYM_NIL;
+  }
+
+  int x0 = dirty_get(img_buf.dirty, 0);
+  int y0 = dirty_get(img_buf.dirty, 1);
+  int w = dirty_get(img_buf.dirty, 2) - x0;
+  int h = dirty_get(img_buf.dirty, 3) - y0;
+  if (!clip_rect(&img_buf, &x0, &y0, &w, &h)) {
+    dirty_reset(img_buf.dirty);
+    return ENC_SYM_NIL;
+  }
+
+  bool render_res;
+  uint8_t *mem = NULL;
+  if (w < img_buf.width || h < img_buf.height) {
+    mem = lbm_malloc(IMAGE_BUFFER_HEADER_SIZE +
+                     image_dims_to_size_bytes(img_buf.fmt, (uint16_t)w, (uint16_t)h) +
+                     IMAGE_BUFFER_DIRTY_SIZE);
+  }
+
+  if (mem) {
+    image_buffer_copy_region(&img_buf, mem, x0, y0, w, h);
+    image_buffer_t sub;
+    sub.fmt = img_buf.fmt;
+    sub.width = (uint16_t)w;
+    sub.height = (uint16_t)h;
+    sub.mem_base = mem;
+    sub.data = image_buffer_data(mem);
+    sub.dirty = NULL;
+    render_res = disp_render_image(&sub, (uint16_t)(x + x0), (uint16_t)(y + y0), colors);
+    lbm_free(mem);
+  } else {
+    // The whole image is dirty or there is no memory for a copy of the
+    // dirty region. Rendering everything gives the same result.
+    render_res = disp_render_image(&img_buf, x, y, colors);
+  }
+
+  if (!render_res) {
+    return render_error();
+  }
+  dirty_reset(img_buf.dirty);
+  return ENC_SYM_TRUE;
+}
+
+static lbm_value ext_image_dirty(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *arr;
+  if (argn != 1 || !(arr = get_image_buffer(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  image_buffer_t img_buf;
+  image_buffer_from_array(&img_buf, arr);
+
+  int x0 = 0, y0 = 0, w = img_buf.width, h = img_buf.height;
+  if (img_buf.dirty) {
+    if (dirty_is_empty(img_buf.dirty)) {
+      return ENC_SYM_NIL;
+    }
+    x0 = dirty_get(img_buf.dirty, 0);
+    y0 = dirty_get(img_buf.dirty, 1);
+    w = dirty_get(img_buf.dirty, 2) - x0;
+    h = dirty_get(img_buf.dirty, 3) - y0;
+  }
+
+  lbm_value res = lbm_heap_allocate_list(4);
+  if (lbm_is_symbol(res)) {
+    return res;
+  }
+  lbm_value curr = res;
+  int vals[4] = {x0, y0, w, h};
+  for (int i = 0;i < 4;i++) {
+    lbm_set_car(curr, lbm_enc_i(vals[i]));
+    curr = lbm_cdr(curr);
+  }
+  return res;
+}
+
+static lbm_value ext_image_mark_dirty(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *arr;
+  if ((argn != 1 && argn != 5) || !(arr = get_image_buffer(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  image_buffer_t img_buf;
+  image_buffer_from_array(&img_buf, arr);
+
+  int x = 0, y = 0, w = img_buf.width, h = img_buf.height;
+  if (argn == 5) {
+    for (int i = 1;i < 5;i++) {
+      if (!lbm_is_number(args[i])) {
+        return ENC_SYM_TERROR;
+      }
+    }
+    x = lbm_dec_as_i32(args[1]);
+    y = lbm_dec_as_i32(args[2]);
+    w = lbm_dec_as_i32(args[3]);
+    h = lbm_dec_as_i32(args[4]);
+  }
+
+  if (img_buf.dirty && clip_rect(&img_buf, &x, &y, &w, &h)) {
+    image_buffer_mark_dirty(&img_buf, x, y, x + w, y + h);
+  }
+  return ENC_SYM_TRUE;
+}
+
+static lbm_value ext_image_clear_dirty(lbm_value *args, lbm_uint argn) {
+  lbm_array_header_t *arr;
+  if (argn != 1 || !(arr = get_image_buffer(args[0]))) {
+    return ENC_SYM_TERROR;
+  }
+
+  uint8_t *dirty = image_buffer_dirty((uint8_t*)arr->data, arr->size);
+  if (dirty) {
+    dirty_reset(dirty);
+  }
+  return ENC_SYM_TRUE;
+}
+
 // Jpg decoder
+//
+// The compressed data is pulled through a read function in chunks of at
+// most JD_SZBUF bytes and every decoded block is passed to the render
+// callback as soon as it is ready. The memory needed is the decoder work
+// area and one block, independent of the size of the image.
+
+#define JPG_WORK_SIZE   4096
+#define JPG_BLOCK_SIZE  (IMAGE_BUFFER_HEADER_SIZE + 16 * 16 * 3) // Largest MCU in rgb888
+
+static bool(* volatile disp_jpg_source)(lbm_value v, disp_jpg_read_t *read, void **arg) = NULL;
 
 typedef struct {
-  uint8_t *data;
-  int pos;
-  int size;
+  disp_jpg_read_t read;
+  void *arg;
   int ofs_x;
   int ofs_y;
-} jpg_bufdef;
+  uint8_t *block;
+} jpg_stream_t;
 
-size_t jpg_input_func (JDEC* jd, uint8_t* buff, size_t ndata) {
-  jpg_bufdef *dev = (jpg_bufdef*)jd->device;
-
-  if ((int)ndata > (dev->size - dev->pos)) {
-    ndata = (size_t)(dev->size - dev->pos);
-  }
+typedef struct {
+  uint8_t *data;
+  size_t pos;
+  size_t size;
+} jpg_array_src_t;
 
-  if (buff) {
-    memcpy(buff, dev->data + dev->pos, ndata);
-  }
-  dev->pos += (int)ndata;
-  return ndata;
+static size_t jpg_input_func(JDEC* jd, uint8_t* buff, size_t ndata) {
+  jpg_stream_t *dev = (jpg_stream_t*)jd->device;
+  return dev->read(dev->arg, buff, ndata);
 }
 
-int jpg_output_func (	/* 1:Ok, 0:Aborted */
+static int jpg_output_func (	/* 1:Ok, 0:Aborted */
                      JDEC* jd,		/* Decompression object */
                      void* bitmap,	/* Bitmap data to be output */
                      JRECT* rect		/* Rectangular region to output */
                         ) {
-  jpg_bufdef *dev = (jpg_bufdef*)jd->device;
+  jpg_stream_t *dev = (jpg_stream_t*)jd->device;
+
+  uint16_t w = (uint16_t)(rect->right - rect->left + 1);
+  uint16_t h = (uint16_t)(rect->bottom - rect->top + 1);
+
+  // The block is copied after an image buffer header, as render callbacks
+  // may look at the header through mem_base.
+  image_buffer_init(dev->block, rgb888, w, h);
+  memcpy(image_buffer_data(dev->block), bitmap, (size_t)w * h * 3);
 
   image_buffer_t img;
-  img.mem_base = (uint8_t*)bitmap;
-  img.data = (uint8_t*)bitmap;
-  img.width = (uint16_t)(rect->right - rect->left + 1);
-  img.height = (uint16_t)(rect->bottom - rect->top + 1);
+  img.mem_base = dev->block;
+  img.data = image_buffer_data(dev->block);
+  img.dirty = NULL;
+  img.width = w;
+  img.height = h;
   img.fmt = rgb888;
 
-  disp_render_image(&img, (uint16_t)(rect->left + dev->ofs_x), (uint16_t)(rect->top + dev->ofs_y), 0);
-
-  return 1;
+  return disp_render_image(&img, (uint16_t)(rect->left + dev->ofs_x), (uint16_t)(rect->top + dev->ofs_y), 0) ? 1 : 0;
 }
 
-static lbm_value ext_disp_render_jpg(lbm_value *args, lbm_uint argn) {
+lbm_value lbm_display_render_jpg(disp_jpg_read_t read, void *arg, int x, int y) {
+  if (disp_render_image == NULL) {
+    lbm_set_error_reason(msg_not_supported);
+    return ENC_SYM_EERROR;
+  }
 
-  lbm_array_header_t *array;
-  lbm_value res = ENC_SYM_TERROR;
+  uint8_t *mem = lbm_malloc(JPG_WORK_SIZE + JPG_BLOCK_SIZE + IMAGE_BUFFER_DIRTY_SIZE);
+  if (!mem) {
+    return ENC_SYM_MERROR;
+  }
 
-  if (argn == 3 &&
-      (array = lbm_dec_array_r(args[0])) && //asignment
-      lbm_is_number(args[1]) &&
-      lbm_is_number(args[2])) {
+  jpg_stream_t dev;
+  dev.read = read;
+  dev.arg = arg;
+  dev.ofs_x = x;
+  dev.ofs_y = y;
+  dev.block = mem + JPG_WORK_SIZE;
 
-    JDEC jd;
-    void *jdwork;
-    // make a bit of room before the buffer.
-    const size_t sz_work = 4096 + IMAGE_BUFFER_HEADER_SIZE;
+  JDEC jd;
+  JRESULT r = jd_prepare(&jd, jpg_input_func, mem, JPG_WORK_SIZE, &dev);
+  if (r == JDR_OK) {
+    r = jd_decomp(&jd, jpg_output_func, 0);
+  }
+  lbm_free(mem);
 
-    jdwork = lbm_malloc(sz_work);
-    if (!jdwork) {
-      return ENC_SYM_MERROR;
-    }
+  if (r != JDR_OK) {
+    lbm_set_error_reason(r == JDR_INTR ?
+                         "Could not render image. Check if the format and location is compatible with the display." :
+                         "Could not decode jpg.");
+    return ENC_SYM_EERROR;
+  }
+  return ENC_SYM_TRUE;
+}
 
+static size_t jpg_array_read(void *arg, uint8_t *buf, size_t len) {
+  jpg_array_src_t *src = (jpg_array_src_t*)arg;
 
+  if (len > (src->size - src->pos)) {
+    len = src->size - src->pos;
+  }
 
-    jpg_bufdef iodev;
-    iodev.data = (uint8_t*)(array->data);
-    iodev.size = (int)array->size;
-    iodev.pos = 0;
-    iodev.ofs_x = lbm_dec_as_i32(args[1]);
-    iodev.ofs_y = lbm_dec_as_i32(args[2]);
-    jd_prepare(&jd, jpg_input_func, jdwork, sz_work + IMAGE_BUFFER_HEADER_SIZE, &iodev);
-    jd_decomp(&jd, jpg_output_func, 0);
-    lbm_free(jdwork);
-    res = ENC_SYM_TRUE;
+  if (buf) {
+    memcpy(buf, src->data + src->pos, len);
   }
-  return res;
+  src->pos += len;
+  return len;
+}
+
+// The jpg is either a byte array, which can be a constant array in flash,
+// or a value that the jpg source callback can read from.
+static lbm_value ext_disp_render_jpg(lbm_value *args, lbm_uint argn) {
+  if (argn != 3 ||
+      !lbm_is_number(args[1]) ||
+      !lbm_is_number(args[2])) {
+    return ENC_SYM_TERROR;
+  }
+
+  int x = lbm_dec_as_i32(args[1]);
+  int y = lbm_dec_as_i32(args[2]);
+
+  disp_jpg_read_t read;
+  void *arg;
+  if (disp_jpg_source && disp_jpg_source(args[0], &read, &arg)) {
+    return lbm_display_render_jpg(read, arg, x, y);
+  }
+
+  lbm_array_header_t *array = lbm_dec_array_r(args[0]);
+  if (!array) {
+    return ENC_SYM_TERROR;
+  }
+
+  jpg_array_src_t src;
+  src.data = (uint8_t*)array->data;
+  src.pos = 0;
+  src.size = array->size;
+  return lbm_display_render_jpg(jpg_array_read, &src, x, y);
 }
 
 void lbm_display_extensions_init(void) {
@@ -2927,13 +3400,21 @@ void lbm_display_extensions_init(void) {
   lbm_add_extension("img-rectangle", ext_rectangle);
   lbm_add_extension("img-triangle", ext_triangle);
   lbm_add_extension("img-blit", ext_blit);
+  lbm_add_extension("img-dirty", ext_image_dirty);
+  lbm_add_extension("img-mark-dirty", ext_image_mark_dirty);
+  lbm_add_extension("img-clear-dirty", ext_image_clear_dirty);
 
   lbm_add_extension("disp-reset", ext_disp_reset);
   lbm_add_extension("disp-clear", ext_disp_clear);
   lbm_add_extension("disp-render", ext_disp_render);
+  lbm_add_extension("disp-render-dirty", ext_disp_render_dirty);
   lbm_add_extension("disp-render-jpg", ext_disp_render_jpg);
 }
 
+void lbm_display_extensions_set_jpg_source(bool(* volatile source)(lbm_value v, disp_jpg_read_t *read, void **arg)) {
+  disp_jpg_source = source;
+}
+
 void lbm_display_extensions_set_callbacks(
                                           bool(* volatile render_image)(image_buffer_t *img, uint16_t x, uint16_t y, color_t *colors),
                                           void(* volatile clear)(uint32_t color),
@@ -0,0 +1,419 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "extensions/hashmap_extensions.h"
+
+#include "extensions.h"
+#include "fundamental.h"
+#include "lbm_memory.h"
+
+#include <string.h>
+
+// Layout of the lisp array backing a map
+#define HM_MARKER       0
+#define HM_COUNT        1
+#define HM_BUCKETS      2
+
+#define HM_MIN_BUCKETS  4
+#define HM_DEF_BUCKETS  16
+#define HM_MAX_BUCKETS  (1 << 16)
+// Grow when the average bucket holds more than this many entries
+#define HM_LOAD_FACTOR  2
+
+// Limits for hashing nested keys. Only part of a large key is hashed, the
+// rest is still compared by struct_eq on lookup.
+#define HM_HASH_DEPTH   4
+#define HM_HASH_ELTS    16
+
+static lbm_uint sym_hashmap;
+
+static void hash_add(uint32_t *h, uint32_t v) {
+  *h = (*h ^ v) * 16777619u;
+}
+
+static void hash_add_64(uint32_t *h, uint64_t v) {
+  hash_add(h, (uint32_t)v);
+  hash_add(h, (uint32_t)(v >> 32));
+}
+
+// Hash a key consistently with struct_eq, so that keys that are equal
+// according to struct_eq always end up in the same bucket. Returns false
+// for key types that struct_eq never considers equal.
+static bool hash_value(lbm_value v, uint32_t *h, int depth) {
+  lbm_type t = lbm_type_of_functional(v);
+  hash_add(h, (uint32_t)t);
+
+  switch (t) {
+  case LBM_TYPE_SYMBOL:
+    hash_add_64(h, (uint64_t)lbm_dec_sym(v)); break;
+  case LBM_TYPE_I:
+    hash_add_64(h, (uint64_t)lbm_dec_i(v)); break;
+  case LBM_TYPE_U:
+    hash_add_64(h, (uint64_t)lbm_dec_u(v)); break;
+  case LBM_TYPE_CHAR:
+    hash_add(h, lbm_dec_char(v)); break;
+  case LBM_TYPE_I32:
+    hash_add(h, (uint32_t)lbm_dec_i32(v)); break;
+  case LBM_TYPE_U32:
+    hash_add(h, lbm_dec_u32(v)); break;
+  case LBM_TYPE_I64:
+    hash_add_64(h, (uint64_t)lbm_dec_i64(v)); break;
+  case LBM_TYPE_U64:
+    hash_add_64(h, lbm_dec_u64(v)); break;
+  case LBM_TYPE_FLOAT: {
+    // 0.0 and -0.0 are equal, but have different bits
+    float f = lbm_dec_float(v);
+    if (f == 0.0f) f = 0.0f;
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    hash_add(h, b);
+  } break;
+  case LBM_TYPE_DOUBLE: {
+    double d = lbm_dec_double(v);
+    if (d == 0.0) d = 0.0;
+    uint64_t b;
+    memcpy(&b, &d, sizeof(b));
+    hash_add_64(h, b);
+  } break;
+  case LBM_TYPE_ARRAY: {
+    lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(v);
+    if (!arr) return false;
+    uint8_t *data = (uint8_t*)arr->data;
+    hash_add(h, (uint32_t)arr->size);
+    for (lbm_uint i = 0;i < arr->size;i++) {
+      hash_add(h, data[i]);
+    }
+  } break;
+  case LBM_TYPE_CONS: {
+    int n = 0;
+    while (lbm_is_cons(v) && n < HM_HASH_ELTS) {
+      if (depth < HM_HASH_DEPTH && !hash_value(lbm_car(v), h, depth + 1)) {
+        return false;
+      }
+      v = lbm_cdr(v);
+      n++;
+    }
+    if (!lbm_is_cons(v) && depth < HM_HASH_DEPTH) {
+      return hash_value(v, h, depth + 1);
+    }
+  } break;
+  case LBM_TYPE_LISPARRAY: {
+    lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(v);
+    if (!arr) return false;
+    lbm_value *data = (lbm_value*)arr->data;
+    lbm_uint n = arr->size / sizeof(lbm_value);
+    hash_add(h, (uint32_t)n);
+    if (n > HM_HASH_ELTS) n = HM_HASH_ELTS;
+    if (depth < HM_HASH_DEPTH) {
+      for (lbm_uint i = 0;i < n;i++) {
+        if (!hash_value(data[i], h, depth + 1)) return false;
+      }
+    }
+  } break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static bool hash_key(lbm_value key, uint32_t *res) {
+  uint32_t h = 2166136261u;
+  if (!hash_value(key, &h, 0)) return false;
+  // Final mix so that the low bits used for the bucket depend on all bits
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  *res = h;
+  return true;
+}
+
+// Returns the map data and the number of buckets, or NULL if m is not a map.
+static lbm_value *dec_map(lbm_value m, bool rw, lbm_uint *n_buckets) {
+  lbm_array_header_t *arr = rw ? lbm_dec_lisp_array_rw(m) : lbm_dec_lisp_array_r(m);
+  if (!arr) return NULL;
+  lbm_uint n = arr->size / sizeof(lbm_value);
+  if (n <= HM_BUCKETS) return NULL;
+  lbm_value *data = (lbm_value*)arr->data;
+  if (data[HM_MARKER] != lbm_enc_sym(sym_hashmap)) return NULL;
+  n -= HM_BUCKETS;
+  if ((n & (n - 1)) != 0) return NULL;
+  *n_buckets = n;
+  return data;
+}
+
+static bool is_map_r(lbm_value m) {
+  lbm_uint n;
+  return lbm_is_lisp_array_r(m) && dec_map(m, false, &n) != NULL;
+}
+
+// Find the (key . val) pair of key, or ENC_SYM_NIL.
+static lbm_value bucket_find(lbm_value bucket, lbm_value key) {
+  while (lbm_is_cons(bucket)) {
+    lbm_value pair = lbm_car(bucket);
+    if (struct_eq(lbm_car(pair), key)) {
+      return pair;
+    }
+    bucket = lbm_cdr(bucket);
+  }
+  return ENC_SYM_NIL;
+}
+
+// Move all bucket list cells from the old buckets into the new ones. No cells
+// are allocated, so this cannot fail. old and new may be the same buffer.
+static void redistribute(lbm_value *old_b, lbm_uint old_n, lbm_value *new_b, lbm_uint new_n) {
+  lbm_value all = ENC_SYM_NIL;
+  for (lbm_uint i = 0;i < old_n;i++) {
+    lbm_value curr = old_b[i];
+    while (lbm_is_cons(curr)) {
+      lbm_value next = lbm_cdr(curr);
+      lbm_set_cdr(curr, all);
+      all = curr;
+      curr = next;
+    }
+    old_b[i] = ENC_SYM_NIL;
+  }
+
+  for (lbm_uint i = 0;i < new_n;i++) {
+    new_b[i] = ENC_SYM_NIL;
+  }
+
+  while (lbm_is_cons(all)) {
+    lbm_value next = lbm_cdr(all);
+    uint32_t h = 0;
+    hash_key(lbm_car(lbm_car(all)), &h);
+    lbm_uint b = h & (new_n - 1);
+    lbm_set_cdr(all, new_b[b]);
+    new_b[b] = all;
+    all = next;
+  }
+}
+
+// Double the number of buckets. This is best effort, if there is no memory
+// for a larger bucket array the map keeps working with longer buckets.
+static void grow(lbm_value m, lbm_uint n_buckets) {
+  lbm_uint new_n = n_buckets * 2;
+  if (new_n > HM_MAX_BUCKETS) return;
+
+  lbm_array_header_t *arr = lbm_dec_lisp_array_rw(m);
+  lbm_value *old_data = (lbm_value*)arr->data;
+  lbm_value *new_data = (lbm_value*)lbm_malloc((HM_BUCKETS + new_n) * sizeof(lbm_value));
+  if (!new_data) return;
+
+  new_data[HM_MARKER] = old_data[HM_MARKER];
+  new_data[HM_COUNT] = old_data[HM_COUNT];
+  redistribute(old_data + HM_BUCKETS, n_buckets, new_data + HM_BUCKETS, new_n);
+
+  arr->data = (lbm_uint*)new_data;
+  arr->size = (HM_BUCKETS + new_n) * sizeof(lbm_value);
+  lbm_memory_free((lbm_uint*)old_data);
+}
+
+/**
+ * signature: (mkhashmap optNumBuckets) -> map
+ */
+static lbm_value ext_mkhashmap(lbm_value *args, lbm_uint argn) {
+  lbm_uint n = HM_DEF_BUCKETS;
+  if (argn == 1) {
+    if (!lbm_is_number(args[0])) return ENC_SYM_TERROR;
+    lbm_int req = lbm_dec_as_i32(args[0]);
+    if (req > HM_MAX_BUCKETS) req = HM_MAX_BUCKETS;
+    n = HM_MIN_BUCKETS;
+    while ((lbm_int)n < req) n *= 2;
+  } else if (argn != 0) {
+    return ENC_SYM_TERROR;
+  }
+
+  lbm_value res;
+  if (!lbm_heap_allocate_lisp_array(&res, HM_BUCKETS + n)) {
+    return ENC_SYM_MERROR;
+  }
+  lbm_value *data = (lbm_value*)lbm_dec_lisp_array_rw(res)->data;
+  data[HM_MARKER] = lbm_enc_sym(sym_hashmap);
+  data[HM_COUNT] = lbm_enc_i(0);
+  return res;
+}
+
+/**
+ * signature: (hashmap? expr) -> bool
+ */
+static lbm_value ext_hashmap_p(lbm_value *args, lbm_uint argn) {
+  if (argn != 1) return ENC_SYM_TERROR;
+  return is_map_r(args[0]) ? ENC_SYM_TRUE : ENC_SYM_NIL;
+}
+
+/**
+ * signature: (hashmap-get map key optDefault) -> value
+ */
+static lbm_value ext_hashmap_get(lbm_value *args, lbm_uint argn) {
+  if (argn != 2 && argn != 3) return ENC_SYM_TERROR;
+  lbm_uint n;
+  lbm_value *data = dec_map(args[0], false, &n);
+  uint32_t h;
+  if (!data || !hash_key(args[1], &h)) return ENC_SYM_TERROR;
+
+  lbm_value pair = bucket_find(data[HM_BUCKETS + (h & (n - 1))], args[1]);
+  if (lbm_is_cons(pair)) {
+    return lbm_cdr(pair);
+  }
+  return argn == 3 ? args[2] : ENC_SYM_NIL;
+}
+
+/**
+ * signature: (hashmap-set map key value) -> map
+ */
+static lbm_value ext_hashmap_set(lbm_value *args, lbm_uint argn) {
+  if (argn != 3) return ENC_SYM_TERROR;
+  lbm_uint n;
+  lbm_value *data = dec_map(args[0], true, &n);
+  uint32_t h;
+  if (!data || !hash_key(args[1], &h)) return ENC_SYM_TERROR;
+
+  lbm_value *bucket = &data[HM_BUCKETS + (h & (n - 1))];
+  lbm_value pair = bucket_find(*bucket, args[1]);
+  if (lbm_is_cons(pair)) {
+    lbm_set_cdr(pair, args[2]);
+    return args[0];
+  }
+
+  // Allocate everything before the map is modified, so that the call
+  // can be repeated after GC on a memory error.
+  pair = lbm_cons(args[1], args[2]);
+  if (pair == ENC_SYM_MERROR) return ENC_SYM_MERROR;
+  lbm_value cell = lbm_cons(pair, *bucket);
+  if (cell == ENC_SYM_MERROR) return ENC_SYM_MERROR;
+
+  *bucket = cell;
+  lbm_int cnt = lbm_dec_i(data[HM_COUNT]) + 1;
+  data[HM_COUNT] = lbm_enc_i(cnt);
+
+  if ((lbm_uint)cnt > n * HM_LOAD_FACTOR) {
+    grow(args[0], n);
+  }
+  return args[0];
+}
+
+/**
+ * signature: (hashmap-remove map key) -> map
+ */
+static lbm_value ext_hashmap_remove(lbm_value *args, lbm_uint argn) {
+  if (argn != 2) return ENC_SYM_TERROR;
+  lbm_uint n;
+  lbm_value *data = dec_map(args[0], true, &n);
+  uint32_t h;
+  if (!data || !hash_key(args[1], &h)) return ENC_SYM_TERROR;
+
+  lbm_value *bucket = &data[HM_BUCKETS + (h & (n - 1))];
+  lbm_value prev = ENC_SYM_NIL;
+  lbm_value curr = *bucket;
+  while (lbm_is_cons(curr)) {
+    if (struct_eq(lbm_car(lbm_car(curr)), args[1])) {
+      if (prev == ENC_SYM_NIL) {
+        *bucket = lbm_cdr(curr);
+      } else {
+        lbm_set_cdr(prev, lbm_cdr(curr));
+      }
+      data[HM_COUNT] = lbm_enc_i(lbm_dec_i(data[HM_COUNT]) - 1);
+      break;
+    }
+    prev = curr;
+    curr = lbm_cdr(curr);
+  }
+  return args[0];
+}
+
+/**
+ * signature: (hashmap-count map) -> int
+ */
+static lbm_value ext_hashmap_count(lbm_value *args, lbm_uint argn) {
+  if (argn != 1) return ENC_SYM_TERROR;
+  lbm_uint n;
+  lbm_value *data = dec_map(args[0], false, &n);
+  if (!data) return ENC_SYM_TERROR;
+  return data[HM_COUNT];
+}
+
+// Collect keys or fresh (key . value) pairs into a list.
+static lbm_value map_to_list(lbm_value m, bool pairs) {
+  lbm_uint n;
+  lbm_value *data = dec_map(m, false, &n);
+  if (!data) return ENC_SYM_TERROR;
+
+  lbm_uint cnt = (lbm_uint)lbm_dec_i(data[HM_COUNT]);
+  if (lbm_heap_num_free() < (pairs ? cnt * 2 : cnt)) {
+    return ENC_SYM_MERROR;
+  }
+
+  lbm_value res = ENC_SYM_NIL;
+  for (lbm_uint i = 0;i < n;i++) {
+    lbm_value curr = data[HM_BUCKETS + i];
+    while (lbm_is_cons(curr)) {
+      lbm_value pair = lbm_car(curr);
+      lbm_value elt = lbm_car(pair);
+      if (pairs) {
+        elt = lbm_cons(elt, lbm_cdr(pair));
+      }
+      res = lbm_cons(elt, res);
+      curr = lbm_cdr(curr);
+    }
+  }
+  return res;
+}
+
+/**
+ * signature: (hashmap-keys map) -> list
+ */
+static lbm_value ext_hashmap_keys(lbm_value *args, lbm_uint argn) {
+  if (argn != 1) return ENC_SYM_TERROR;
+  return map_to_list(args[0], false);
+}
+
+/**
+ * signature: (hashmap-to-list map) -> list
+ */
+static lbm_value ext_hashmap_to_list(lbm_value *args, lbm_uint argn) {
+  if (argn != 1) return ENC_SYM_TERROR;
+  return map_to_list(args[0], true);
+}
+
+/**
+ * signature: (hashmap-rehash map) -> map
+ *
+ * Symbol ids are local to a runtime, so a map that was flattened in one
+ * runtime and unflattened in another must be rehashed before it is used.
+ */
+static lbm_value ext_hashmap_rehash(lbm_value *args, lbm_uint argn) {
+  if (argn != 1) return ENC_SYM_TERROR;
+  lbm_uint n;
+  lbm_value *data = dec_map(args[0], true, &n);
+  if (!data) return ENC_SYM_TERROR;
+  redistribute(data + HM_BUCKETS, n, data + HM_BUCKETS, n);
+  return args[0];
+}
+
+void lbm_hashmap_extensions_init(void) {
+  lbm_add_symbol_const("hashmap", &sym_hashmap);
+
+  lbm_add_extension("mkhashmap", ext_mkhashmap);
+  lbm_add_extension("hashmap?", ext_hashmap_p);
+  lbm_add_extension("hashmap-get", ext_hashmap_get);
+  lbm_add_extension("hashmap-set", ext_hashmap_set);
+  lbm_add_extension("hashmap-remove", ext_hashmap_remove);
+  lbm_add_extension("hashmap-count", ext_hashmap_count);
+  lbm_add_extension("hashmap-keys", ext_hashmap_keys);
+  lbm_add_extension("hashmap-to-list", ext_hashmap_to_list);
+  lbm_add_extension("hashmap-rehash", ext_hashmap_rehash);
+}
@@ -22,6 +22,7 @@
 #include <lbm_utils.h>
 #include <lbm_version.h>
 #include <env.h>
+#include <lbm_prof.h>
 
 #ifdef FULL_RTS_LIB
 static lbm_uint sym_heap_size;
@@ -261,6 +262,132 @@ lbm_value ext_mailbox_get(lbm_uint *args, lbm_uint argn) {
 }
 #endif
 
+#ifdef LBM_USE_PROF_STATS
+
+#define CTX_STATS_NUM 8
+
+static void ctx_stats_it(eval_context_t *ctx, void *arg1, void *arg2) {
+  (void) arg2;
+  lbm_value *res = (lbm_value*)arg1;
+  if (lbm_is_symbol_merror(*res)) return;
+
+  lbm_value v[CTX_STATS_NUM];
+  v[0] = lbm_enc_i(ctx->id);
+  v[1] = ENC_SYM_NIL;
+  if (ctx->name) {
+    size_t len = strlen(ctx->name);
+    if (!lbm_heap_allocate_array(&v[1], len + 1)) {
+      *res = ENC_SYM_MERROR;
+      return;
+    }
+    lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(v[1]);
+    memcpy(arr->data, ctx->name, len + 1);
+  }
+  v[2] = lbm_enc_u64(ctx->stats.steps);
+  v[3] = lbm_enc_u64(ctx->stats.run_us);
+  v[4] = lbm_enc_u64(ctx->stats.blocked_us);
+  v[5] = lbm_enc_u64(ctx->stats.cells);
+  v[6] = lbm_enc_u(ctx->stats.gc_num);
+  v[7] = lbm_enc_u(ctx->stats.mail_max);
+  lbm_value entry = lbm_heap_allocate_list(CTX_STATS_NUM);
+  if (!lbm_is_cons(entry)) {
+    *res = ENC_SYM_MERROR;
+    return;
+  }
+  lbm_value curr = entry;
+  for (int i = 0; i < CTX_STATS_NUM; i ++) {
+    if (lbm_is_symbol_merror(v[i])) {
+      *res = ENC_SYM_MERROR;
+      return;
+    }
+    lbm_set_car(curr, v[i]);
+    curr = lbm_cdr(curr);
+  }
+  *res = lbm_cons(entry, *res);
+}
+
+// (prof-ctx-stats) -> list of (cid name steps run-us blocked-us cells gc-num mail-max)
+lbm_value ext_prof_ctx_stats(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res = ENC_SYM_NIL;
+  lbm_all_ctxs_iterator(ctx_stats_it, (void*)&res, NULL);
+  return res;
+}
+
+// (prof-ext-stats) -> list of (extension calls time-us) for called extensions
+lbm_value ext_prof_ext_stats(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res = ENC_SYM_NIL;
+  lbm_uint n = lbm_get_max_extensions();
+  if (n > lbm_prof_ext_num) n = lbm_prof_ext_num;
+  for (lbm_uint i = n; i > 0; i --) {
+    lbm_prof_ext_t *p = &lbm_prof_ext_data[i - 1];
+    if (p->calls == 0) continue;
+    lbm_value calls = lbm_enc_u64(p->calls);
+    lbm_value time = lbm_enc_u64(p->time_us);
+    if (lbm_is_symbol_merror(calls) || lbm_is_symbol_merror(time)) {
+      return ENC_SYM_MERROR;
+    }
+    lbm_value entry = lbm_heap_allocate_list_init(3,
+                                                  lbm_enc_sym(EXTENSION_SYMBOLS_START | (i - 1)),
+                                                  calls,
+                                                  time);
+    if (!lbm_is_cons(entry)) return ENC_SYM_MERROR;
+    res = lbm_cons(entry, res);
+    if (!lbm_is_cons(res)) return ENC_SYM_MERROR;
+  }
+  return res;
+}
+
+lbm_value ext_prof_reset(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_prof_stats_reset();
+  return ENC_SYM_TRUE;
+}
+#endif
+
+static lbm_value event_queue_entry(const char *name, uint32_t size, uint32_t dropped, uint32_t max_used) {
+  lbm_value str;
+  size_t len = strlen(name);
+  if (!lbm_heap_allocate_array(&str, len + 1)) return ENC_SYM_MERROR;
+  lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(str);
+  memcpy(arr->data, name, len + 1);
+  lbm_value entry = lbm_heap_allocate_list_init(4,
+                                                str,
+                                                lbm_enc_u(size),
+                                                lbm_enc_u(dropped),
+                                                lbm_enc_u(max_used));
+  if (!lbm_is_cons(entry)) return ENC_SYM_MERROR;
+  return entry;
+}
+
+// (event-queue-stats) -> list of (name size dropped max-used)
+// The first entry is the shared event queue followed by the producer queues.
+lbm_value ext_event_queue_stats(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res = ENC_SYM_NIL;
+  lbm_event_queue_t *q = lbm_event_queue_first();
+  while (q) {
+    if (q->active) {
+      lbm_value entry = event_queue_entry(q->name, q->size, q->dropped, q->max_used);
+      if (lbm_is_symbol_merror(entry)) return entry;
+      res = lbm_cons(entry, res);
+      if (!lbm_is_cons(res)) return ENC_SYM_MERROR;
+    }
+    q = q->next;
+  }
+  uint32_t dropped, max_used;
+  uint32_t size = lbm_event_stats(&dropped, &max_used);
+  lbm_value entry = event_queue_entry("events", size, dropped, max_used);
+  if (lbm_is_symbol_merror(entry)) return entry;
+  res = lbm_cons(entry, res);
+  if (!lbm_is_cons(res)) return ENC_SYM_MERROR;
+  return res;
+}
 
 void lbm_runtime_extensions_init(void) {
 
@@ -304,5 +431,11 @@ void lbm_runtime_extensions_init(void) {
     lbm_add_extension("symtab-size-flash", ext_symbol_table_size_flash);
     lbm_add_extension("symtab-size-names", ext_symbol_table_size_names);
     lbm_add_extension("symtab-size-names-flash", ext_symbol_table_size_names_flash);
+#endif
+    lbm_add_extension("event-queue-stats", ext_event_queue_stats);
+#ifdef LBM_USE_PROF_STATS
+    lbm_add_extension("prof-ctx-stats", ext_prof_ctx_stats);
+    lbm_add_extension("prof-ext-stats", ext_prof_ext_stats);
+    lbm_add_extension("prof-reset", ext_prof_reset);
 #endif
 }
@@ -50,11 +50,13 @@ static SFT mk_sft(SFT_Font *ft, float x_scale, float y_scale) {
 // If we are not bin searching then sorting the UTF32 codes is not needed.
 
 #define FONT_MAX_ID_STRING_LENGTH   10
-#define FONT_VERSION                0
+#define FONT_VERSION                1
 #define FONT_MAGIC_STRING           "font"
 #define FONT_LINE_METRICS_STRING    "lmtx"
 #define FONT_KERNING_STRING         "kern"
 #define FONT_GLYPHS_STRING          "glyphs"
+#define FONT_KERN_INDEX_STRING      "kindex"
+#define FONT_GLYPH_INDEX_STRING     "gindex"
 
 // sizeof when used on string literals include the the terminating 0
 #define FONT_PREAMBLE_SIZE          (sizeof(uint16_t) * 2 + sizeof(FONT_MAGIC_STRING))
@@ -67,6 +69,15 @@ static SFT mk_sft(SFT_Font *ft, float x_scale, float y_scale) {
 #define FONT_GLYPH_TABLE_SIZE       (uint32_t)(sizeof(FONT_GLYPHS_STRING) + 4 + 4 + 4)
 #define FONT_GLYPH_SIZE             (uint32_t)(6*4)
 
+// Version 1 adds two index tables that map a code to the position of its
+// glyph or kerning row in the buffer. The entries are sorted by code so that
+// lookups can binary search. Readers that do not know about the tables skip
+// them, and bins without them are searched linearly.
+//  - "gindex" : glyph index, one entry per glyph
+//  - "kindex" : kerning row index, one entry per row in the kerning table
+#define FONT_INDEX_ENTRY_SIZE       (uint32_t)(4 + 4)
+#define FONT_INDEX_TABLE_SIZE       (uint32_t)(sizeof(FONT_GLYPH_INDEX_STRING) + 4 + 4)
+
 static int num_kern_pairs_row(SFT *sft, uint32_t utf32, uint32_t *codes, uint32_t num_codes) {
 
   int num = 0;
@@ -118,15 +129,14 @@ static bool kern_table_dims(SFT *sft, uint32_t *codes, uint32_t num_codes, int *
   return true;
 }
 
-static int kern_table_size_bytes(SFT *sft, uint32_t *codes, uint32_t num_codes) {
-  int rows = 0;
+static int kern_table_size_bytes(SFT *sft, uint32_t *codes, uint32_t num_codes, int *rows) {
   int tot_pairs = 0;
 
   int size_bytes;
-  if (kern_table_dims(sft, codes, num_codes, &rows, &tot_pairs)) {
+  if (kern_table_dims(sft, codes, num_codes, rows, &tot_pairs)) {
     size_bytes =
       (int)(FONT_KERN_PAIR_SIZE * (uint32_t)tot_pairs +
-            FONT_KERN_ROW_SIZE * (uint32_t)rows +
+            FONT_KERN_ROW_SIZE * (uint32_t)*rows +
             FONT_KERN_TABLE_SIZE);
   } else {
     return -1;
@@ -143,7 +153,7 @@ static void buffer_append_string(uint8_t *buffer, char *str, int32_t *index) {
 
 static void buffer_append_font_preamble(uint8_t *buffer, int32_t *index) {
   buffer_append_uint16(buffer, 0, index); // 2 leading zero bytes
-  buffer_append_uint16(buffer, 0, index); // version 0
+  buffer_append_uint16(buffer, FONT_VERSION, index);
   buffer_append_string(buffer, FONT_MAGIC_STRING, index);
 }
 
@@ -254,6 +264,7 @@ static int buffer_append_glyph(uint8_t *buffer, SFT *sft, color_format_t fmt, ui
   img.fmt = fmt;
   img.mem_base = &buffer[*index];
   img.data = &buffer[*index];
+  img.dirty = NULL;
 
   int r = sft_render(sft, gid, &img);
   *index += (int32_t)image_dims_to_size_bytes(fmt, (uint16_t)gmtx.minWidth, (uint16_t)gmtx.minHeight);
@@ -281,6 +292,43 @@ static int buffer_append_glyph_table(uint8_t *buffer, SFT *sft, color_format_t f
   return r;
 }
 
+// Append an index table with num entries for the records starting at
+// table. The records start with their code and get_next returns the
+// position of the record after the one at i.
+static void buffer_append_index_table(uint8_t *buffer,
+                                      char *name,
+                                      int32_t table,
+                                      uint32_t num,
+                                      int32_t (*get_next)(uint8_t *buffer, int32_t i, color_format_t fmt),
+                                      color_format_t fmt,
+                                      int32_t *index) {
+  buffer_append_string(buffer, name, index);
+  buffer_append_uint32(buffer, 4 + num * FONT_INDEX_ENTRY_SIZE, index);
+  buffer_append_uint32(buffer, num, index);
+
+  int32_t i = table;
+  for (uint32_t n = 0; n < num; n ++) {
+    int32_t code_ix = i;
+    buffer_append_uint32(buffer, buffer_get_uint32(buffer, &code_ix), index);
+    buffer_append_int32(buffer, i, index);
+    i = get_next(buffer, i, fmt);
+  }
+}
+
+static int32_t next_kern_row(uint8_t *buffer, int32_t i, color_format_t fmt) {
+  (void)fmt;
+  i += 4;
+  uint32_t row_len = buffer_get_uint32(buffer, &i);
+  return i + (int32_t)(row_len * FONT_KERN_PAIR_SIZE);
+}
+
+static int32_t next_glyph(uint8_t *buffer, int32_t i, color_format_t fmt) {
+  i += 16;
+  int32_t w = buffer_get_int32(buffer, &i);
+  int32_t h = buffer_get_int32(buffer, &i);
+  return i + (int32_t)image_dims_to_size_bytes(fmt, (uint16_t)w, (uint16_t)h);
+}
+
 //returns the increment for n
 static int insert_nub(uint32_t *arr, uint32_t n, uint32_t new_elt) {
   uint32_t i;
@@ -347,7 +395,8 @@ lbm_value ext_ttf_prepare_bin(lbm_value *args, lbm_uint argn) {
       // There could be zero kerning pairs and then we dont
       // need the kerning table at all.
       // TODO: Fix this.
-      int kern_tab_bytes = kern_table_size_bytes(&sft, unique_utf32, n);
+      int kern_rows = 0;
+      int kern_tab_bytes = kern_table_size_bytes(&sft, unique_utf32, n, &kern_rows);
       if (kern_tab_bytes <=  0) {
         lbm_free(unique_utf32);
         return ENC_SYM_EERROR;
@@ -365,7 +414,9 @@ lbm_value ext_ttf_prepare_bin(lbm_value *args, lbm_uint argn) {
         (uint32_t)kern_tab_bytes +
         FONT_GLYPH_TABLE_SIZE +
         n * FONT_GLYPH_SIZE + // per glyph metrics
-        (uint32_t)glyph_gfx_size;
+        (uint32_t)glyph_gfx_size +
+        FONT_INDEX_TABLE_SIZE * 2 +
+        ((uint32_t)kern_rows + n) * FONT_INDEX_ENTRY_SIZE;
 
       uint8_t *buffer = (uint8_t*)lbm_malloc(bytes_required);
       if (!buffer) {
@@ -387,9 +438,17 @@ lbm_value ext_ttf_prepare_bin(lbm_value *args, lbm_uint argn) {
                                  lmtx.descender,
                                  lmtx.lineGap,
                                  &index);
+      int32_t kern_rows_index = index + (int32_t)FONT_KERN_TABLE_SIZE;
       buffer_append_kerning_table(buffer, &sft, unique_utf32, n, &index);
+      buffer_append_index_table(buffer, FONT_KERN_INDEX_STRING, kern_rows_index,
+                                (uint32_t)kern_rows, next_kern_row, fmt, &index);
 
+      int32_t glyphs_index = index + (int32_t)FONT_GLYPH_TABLE_SIZE;
       int r = buffer_append_glyph_table(buffer, &sft, fmt, unique_utf32, n, &index);
+      if (r >= 0) {
+        buffer_append_index_table(buffer, FONT_GLYPH_INDEX_STRING, glyphs_index,
+                                  n, next_glyph, fmt, &index);
+      }
       if ( r == SFT_MEM_ERROR) {
         lbm_free(unique_utf32);
         lbm_free(buffer);
@@ -475,6 +534,41 @@ static bool font_get_glyphs_table_index(uint8_t *buffer, int32_t buffer_size, in
   return false;
 }
 
+// The index tables are optional, res_index is left at 0 if there is none.
+static void font_get_index_table(uint8_t *buffer, int32_t buffer_size, char *name, int32_t *res_index, int32_t index) {
+  size_t name_size = strlen(name) + 1;
+  while (index < buffer_size) {
+    char *str = (char*)&buffer[index];
+    if (strncmp(str, name, name_size) == 0) {
+      *res_index = index + (int32_t)name_size + 4;
+      return;
+    }
+    index += (int32_t)(strlen(str) + 1);
+    index += (int32_t)buffer_get_uint32(buffer,&index);
+  }
+}
+
+// Binary search for code in the index table at table_index.
+static bool font_index_lookup(uint8_t *buffer, int32_t table_index, uint32_t code, int32_t *res) {
+  uint32_t num = buffer_get_uint32(buffer, &table_index);
+  uint32_t lo = 0;
+  uint32_t hi = num;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int32_t i = table_index + (int32_t)(mid * FONT_INDEX_ENTRY_SIZE);
+    uint32_t c = buffer_get_uint32(buffer, &i);
+    if (c == code) {
+      *res = buffer_get_int32(buffer, &i);
+      return true;
+    } else if (c < code) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
 static bool font_get_glyph(uint8_t *buffer,
                            float *advance_width,
                            float *left_side_bearing,
@@ -485,9 +579,17 @@ static bool font_get_glyph(uint8_t *buffer,
                            uint32_t utf32,
                            uint32_t num_codes,
                            color_format_t fmt,
-                           int32_t index) {
+                           int32_t index,
+                           int32_t glyph_index) {
 
   uint32_t i = 0;
+  // With an index only the record it points to is decoded below.
+  if (glyph_index) {
+    if (!font_index_lookup(buffer, glyph_index, utf32, &index)) {
+      return false;
+    }
+    num_codes = 1;
+  }
   while (i < num_codes) {
     uint32_t c = buffer_get_uint32(buffer, &index);
     if (c == utf32) {
@@ -509,7 +611,32 @@ static bool font_get_glyph(uint8_t *buffer,
   return false;
 }
 
-bool font_get_kerning(uint8_t *buffer, uint32_t left, uint32_t right, float *x_shift, float *y_shift, int32_t index) {
+bool font_get_kerning(uint8_t *buffer, uint32_t left, uint32_t right, float *x_shift, float *y_shift, int32_t index, int32_t kern_index) {
+
+  if (kern_index) {
+    int32_t row;
+    if (!font_index_lookup(buffer, kern_index, left, &row)) {
+      return false;
+    }
+    row += 4;
+    uint32_t lo = 0;
+    uint32_t hi = buffer_get_uint32(buffer, &row);
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int32_t i = row + (int32_t)(mid * FONT_KERN_PAIR_SIZE);
+      uint32_t c = buffer_get_uint32(buffer, &i);
+      if (c == right) {
+        *x_shift = buffer_get_float32_auto(buffer, &i);
+        *y_shift = buffer_get_float32_auto(buffer, &i);
+        return true;
+      } else if (c < right) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return false;
+  }
 
   uint32_t num_rows = buffer_get_uint32(buffer, &index);
 
@@ -611,16 +738,17 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
     return ENC_SYM_EERROR;
   }
 
+  int32_t kern_index_table = 0;
+  int32_t glyph_index_table = 0;
+  font_get_index_table((uint8_t*)font_arr->data, (int32_t)font_arr->size, FONT_KERN_INDEX_STRING, &kern_index_table, index);
+  font_get_index_table((uint8_t*)font_arr->data, (int32_t)font_arr->size, FONT_GLYPH_INDEX_STRING, &glyph_index_table, index);
+
   color_format_t fmt = (color_format_t)color_fmt;
   float x = 0.0;
   float y = 0.0;
 
   image_buffer_t tgt;
-  tgt.width = image_buffer_width((uint8_t*)img_arr->data);
-  tgt.height = image_buffer_height((uint8_t*)img_arr->data);
-  tgt.fmt = image_buffer_format((uint8_t*)img_arr->data);
-  tgt.mem_base = (uint8_t*)img_arr->data;
-  tgt.data = image_buffer_data((uint8_t*)img_arr->data);
+  image_buffer_from_array(&tgt, img_arr);
 
   uint32_t utf32;
   uint32_t prev;
@@ -655,7 +783,8 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       glyph_index_table)) {
 
       float x_shift = 0;
       float y_shift = 0;
@@ -665,7 +794,8 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
                          utf32,
                          &x_shift,
                          &y_shift,
-                         kern_index);
+                         kern_index,
+                         kern_index_table);
       }
       x_n += x_shift;
       y_n += y_shift;
@@ -677,6 +807,7 @@ lbm_value ttf_text_bin(lbm_value *args, lbm_uint argn) {
       src.fmt = fmt;
       //src.mem_base = gfx;
       src.data = gfx;
+      src.dirty = NULL;
 
       uint32_t num_colors = 1 << src.fmt;
       for (int j = 0; j < src.height; j++) {
@@ -770,6 +901,11 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
     return ENC_SYM_EERROR;
   }
 
+  int32_t kern_index_table = 0;
+  int32_t glyph_index_table = 0;
+  font_get_index_table((uint8_t*)font_arr->data, (int32_t)font_arr->size, FONT_KERN_INDEX_STRING, &kern_index_table, index);
+  font_get_index_table((uint8_t*)font_arr->data, (int32_t)font_arr->size, FONT_GLYPH_INDEX_STRING, &glyph_index_table, index);
+
   float x = 0.0;
   float y = 0.0;
   float max_x = 0.0;
@@ -808,7 +944,8 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        (color_format_t)color_fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       glyph_index_table)) {
 
       float x_shift = 0;
       float y_shift = 0;
@@ -818,7 +955,8 @@ lbm_value ext_ttf_wh(lbm_value *args, lbm_uint argn) {
                          utf32,
                          &x_shift,
                          &y_shift,
-                         kern_index);
+                         kern_index,
+                         kern_index_table);
       }
       x_n += x_shift;
       y_n += y_shift;
@@ -866,6 +1004,9 @@ lbm_value ext_ttf_glyph_dims(lbm_value *args, lbm_uint argn) {
       return ENC_SYM_EERROR;
     }
 
+    int32_t glyph_index_table = 0;
+    font_get_index_table((uint8_t*)font_arr->data, (int32_t)font_arr->size, FONT_GLYPH_INDEX_STRING, &glyph_index_table, index);
+
     lbm_array_header_t *utf8_array_header = (lbm_array_header_t*)(lbm_car(args[1]));
 
     uint32_t next_i = 0;
@@ -889,7 +1030,8 @@ lbm_value ext_ttf_glyph_dims(lbm_value *args, lbm_uint argn) {
                        utf32,
                        num_codes,
                        (color_format_t)color_fmt,
-                       glyphs_index)) {
+                       glyphs_index,
+                       glyph_index_table)) {
 
       return lbm_heap_allocate_list_init(2,
                                         lbm_enc_u((uint32_t)(width)),
@@ -1494,3 +1494,5 @@ const fundamental_fun fundamental_table[] =
    fundamental_array,
    fundamental_is_string
   };
+
+const unsigned int fundamental_table_size = sizeof(fundamental_table) / sizeof(fundamental_fun);
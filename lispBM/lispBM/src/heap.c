@@ -73,6 +73,12 @@ static bool    lbm_const_heap_mutex_initialized = false;
 static mutex_t lbm_mark_mutex;
 static bool    lbm_mark_mutex_initialized = false;
 
+static void array_release_nonsense(lbm_array_header_t *header) {
+  (void) header;
+}
+
+static void (*array_release_callback)(lbm_array_header_t *) = array_release_nonsense;
+
 #ifdef USE_GC_PTR_REV
 void lbm_gc_lock(void) {
   mutex_lock(&lbm_mark_mutex);
@@ -943,9 +949,13 @@ int lbm_gc_sweep_phase(void) {
         case ENC_SYM_LISPARRAY_TYPE: /* fall through */
         case ENC_SYM_ARRAY_TYPE:{
           lbm_array_header_t *arr = (lbm_array_header_t*)heap[i].car;
-          lbm_memory_free((lbm_uint *)arr->data);
-          lbm_heap_state.gc_recovered_arrays++;
-          lbm_memory_free((lbm_uint *)arr);
+          if (lbm_memory_ptr_inside((lbm_uint*)arr)) {
+            lbm_memory_free((lbm_uint *)arr->data);
+            lbm_heap_state.gc_recovered_arrays++;
+            lbm_memory_free((lbm_uint *)arr);
+          } else {
+            array_release_callback(arr);
+          }
         } break;
         case ENC_SYM_CHANNEL_TYPE:{
           lbm_char_channel_t *chan = (lbm_char_channel_t*)heap[i].car;
@@ -1303,6 +1313,24 @@ int lbm_lift_array(lbm_value *value, char *data, lbm_uint num_elt) {
   return 1;
 }
 
+void lbm_heap_set_array_release_callback(void (*fptr)(lbm_array_header_t *)) {
+  array_release_callback = fptr ? fptr : array_release_nonsense;
+}
+
+int lbm_heap_borrow_array(lbm_value *value, lbm_array_header_t *header) {
+  if (lbm_memory_ptr_inside((lbm_uint*)header)) {
+    *value = ENC_SYM_EERROR;
+    return 0;
+  }
+  lbm_value cell = lbm_heap_allocate_cell(LBM_TYPE_CONS, (lbm_uint)header, ENC_SYM_ARRAY_TYPE);
+  if (cell == ENC_SYM_MERROR) {
+    *value = cell;
+    return 0;
+  }
+  *value = lbm_set_ptr_type(cell, LBM_TYPE_ARRAY);
+  return 1;
+}
+
 lbm_int lbm_heap_array_get_size(lbm_value arr) {
 
   lbm_int r = -1;
@@ -1352,13 +1380,18 @@ uint8_t *lbm_heap_array_get_data_rw(lbm_value arr) {
 int lbm_heap_explicit_free_array(lbm_value arr) {
 
   int r = 0;
-  if (lbm_is_array_rw(arr) && lbm_cdr(arr) == ENC_SYM_ARRAY_TYPE) {
+  if ((lbm_is_array_rw(arr) || lbm_is_array_borrowed(arr)) &&
+      lbm_cdr(arr) == ENC_SYM_ARRAY_TYPE) {
     lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(arr);
     if (header == NULL) {
       return 0;
     }
-    lbm_memory_free((lbm_uint*)header->data);
-    lbm_memory_free((lbm_uint*)header);
+    if (lbm_memory_ptr_inside((lbm_uint*)header)) {
+      lbm_memory_free((lbm_uint*)header->data);
+      lbm_memory_free((lbm_uint*)header);
+    } else {
+      array_release_callback(header);
+    }
 
     arr = lbm_set_ptr_type(arr, LBM_TYPE_CONS);
     lbm_set_car(arr, ENC_SYM_NIL);
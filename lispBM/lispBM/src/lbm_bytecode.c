@@ -0,0 +1,731 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "lbm_bytecode.h"
+#include "heap.h"
+#include "env.h"
+#include "symrepr.h"
+#include "lbm_memory.h"
+
+#define BC_MAX_CODE      2048
+#define BC_MAX_CONSTS    128
+#define BC_MAX_LOCALS    64
+#define BC_MAX_DEPTH     255
+#define BC_MAX_ARGS      255
+#define BC_MAX_LOOPS     4
+#define BC_MAX_NESTING   20
+
+// Jumps that are not yet resolved are chained through their operands,
+// terminated by BC_NO_JUMP.
+#define BC_NO_JUMP       0xFFFF
+
+typedef struct {
+  lbm_uint res_slot;
+  lbm_uint depth;
+  lbm_uint breaks;
+} bc_loop_t;
+
+typedef struct {
+  uint8_t code[BC_MAX_CODE];
+  lbm_value consts[BC_MAX_CONSTS];
+  lbm_value scope[BC_MAX_LOCALS];
+  bc_loop_t loops[BC_MAX_LOOPS];
+  lbm_uint pc;
+  lbm_uint num_consts;
+  lbm_uint num_scope;
+  lbm_uint num_locals;
+  lbm_uint depth;
+  lbm_uint max_depth;
+  lbm_uint num_loops;
+  lbm_uint nesting;
+  lbm_uint num_params;
+  lbm_value self;
+  lbm_value sym_loopwhile;
+  lbm_value sym_looprange;
+  lbm_value sym_loopfor;
+  lbm_value sym_loopforeach;
+  lbm_value sym_break;
+  int error;
+  lbm_value error_exp;
+} bc_compiler_t;
+
+static const char *bc_error_str = "";
+
+const char *lbm_bytecode_error_str(void) {
+  return bc_error_str;
+}
+
+static bool fail(bc_compiler_t *c, int error, lbm_value exp, const char *str) {
+  if (c->error == LBM_BC_COMPILE_OK) {
+    c->error = error;
+    c->error_exp = exp;
+    bc_error_str = str;
+  }
+  return false;
+}
+
+static bool too_large(bc_compiler_t *c, lbm_value exp) {
+  return fail(c, LBM_BC_COMPILE_TOO_LARGE, exp, "Function is too large to compile.");
+}
+
+static bool unsupported(bc_compiler_t *c, lbm_value exp) {
+  return fail(c, LBM_BC_COMPILE_UNSUPPORTED, exp, "Expression is not supported by compile.");
+}
+
+static lbm_value sym_by_name(char *name) {
+  lbm_uint id;
+  if (lbm_get_symbol_by_name(name, &id)) {
+    return lbm_enc_sym(id);
+  }
+  return ENC_SYM_NIL;
+}
+
+// Emitting code
+
+static bool emit(bc_compiler_t *c, uint8_t b) {
+  if (c->pc >= BC_MAX_CODE) return too_large(c, ENC_SYM_NIL);
+  c->code[c->pc++] = b;
+  return true;
+}
+
+static bool emit_u16(bc_compiler_t *c, lbm_uint w) {
+  return emit(c, (uint8_t)(w >> 8)) && emit(c, (uint8_t)w);
+}
+
+static void patch_u16(bc_compiler_t *c, lbm_uint pos, lbm_uint w) {
+  c->code[pos] = (uint8_t)(w >> 8);
+  c->code[pos + 1] = (uint8_t)w;
+}
+
+static lbm_uint read_u16(bc_compiler_t *c, lbm_uint pos) {
+  return ((lbm_uint)c->code[pos] << 8) | c->code[pos + 1];
+}
+
+static bool adjust_depth(bc_compiler_t *c, int delta) {
+  c->depth = (lbm_uint)((int)c->depth + delta);
+  if (c->depth > BC_MAX_DEPTH) return too_large(c, ENC_SYM_NIL);
+  if (c->depth > c->max_depth) c->max_depth = c->depth;
+  return true;
+}
+
+static bool op(bc_compiler_t *c, uint8_t o, int delta) {
+  return emit(c, o) && adjust_depth(c, delta);
+}
+
+static bool op_u8(bc_compiler_t *c, uint8_t o, lbm_uint a, int delta) {
+  return emit(c, o) && emit(c, (uint8_t)a) && adjust_depth(c, delta);
+}
+
+static bool op_u16(bc_compiler_t *c, uint8_t o, lbm_uint a, int delta) {
+  return emit(c, o) && emit_u16(c, a) && adjust_depth(c, delta);
+}
+
+// Emit a jump and add it to the chain of jumps that go to the same
+// unknown target.
+static bool op_jump_chain(bc_compiler_t *c, uint8_t o, lbm_uint *chain, int delta) {
+  lbm_uint pos = c->pc + 1;
+  if (!op_u16(c, o, *chain, delta)) return false;
+  *chain = pos;
+  return true;
+}
+
+static void resolve_chain(bc_compiler_t *c, lbm_uint chain) {
+  while (chain != BC_NO_JUMP) {
+    lbm_uint next = read_u16(c, chain);
+    patch_u16(c, chain, c->pc);
+    chain = next;
+  }
+}
+
+static bool add_const(bc_compiler_t *c, lbm_value v, lbm_uint *ix) {
+  for (lbm_uint i = 0; i < c->num_consts; i ++) {
+    if (c->consts[i] == v) {
+      *ix = i;
+      return true;
+    }
+  }
+  if (c->num_consts >= BC_MAX_CONSTS) return too_large(c, v);
+  c->consts[c->num_consts] = v;
+  *ix = c->num_consts++;
+  return true;
+}
+
+static bool push_value(bc_compiler_t *c, lbm_value v) {
+  if (v == ENC_SYM_NIL) return op(c, LBM_BC_NIL, 1);
+  if (v == ENC_SYM_TRUE) return op(c, LBM_BC_TRUE, 1);
+  lbm_uint ix;
+  return add_const(c, v, &ix) && op_u16(c, LBM_BC_CONST, ix, 1);
+}
+
+// Local slots
+
+static bool is_runtime_symbol(lbm_value v) {
+  return lbm_is_symbol(v) && lbm_dec_sym(v) >= RUNTIME_SYMBOLS_START;
+}
+
+static int lookup_local(bc_compiler_t *c, lbm_value sym) {
+  for (int i = (int)c->num_scope - 1; i >= 0; i --) {
+    if (c->scope[i] == sym) return i;
+  }
+  return -1;
+}
+
+// Hidden slots are added with sym nil, which never is looked up.
+static bool new_local(bc_compiler_t *c, lbm_value sym, lbm_uint *slot) {
+  if (c->num_scope >= BC_MAX_LOCALS) return too_large(c, sym);
+  c->scope[c->num_scope] = sym;
+  *slot = c->num_scope++;
+  if (c->num_scope > c->num_locals) c->num_locals = c->num_scope;
+  return true;
+}
+
+static bool list_n(lbm_value l, lbm_value *parts, lbm_uint n) {
+  for (lbm_uint i = 0; i < n; i ++) {
+    if (!lbm_is_cons(l)) return false;
+    parts[i] = lbm_car(l);
+    l = lbm_cdr(l);
+  }
+  return lbm_is_symbol_nil(l);
+}
+
+static bool compile_exp(bc_compiler_t *c, lbm_value e, bool tail);
+
+static bool compile_symbol(bc_compiler_t *c, lbm_value s) {
+  if (!is_runtime_symbol(s)) {
+    // Built in symbols evaluate to themselves
+    return push_value(c, s);
+  }
+  int slot = lookup_local(c, s);
+  if (slot >= 0) {
+    return op_u8(c, LBM_BC_LOAD, (lbm_uint)slot, 1);
+  }
+  lbm_uint ix;
+  return add_const(c, s, &ix) && op_u16(c, LBM_BC_LOAD_VAR, ix, 1);
+}
+
+static bool compile_if(bc_compiler_t *c, lbm_value e, lbm_value args, bool tail) {
+  lbm_value parts[3] = {ENC_SYM_NIL, ENC_SYM_NIL, ENC_SYM_NIL};
+  if (!list_n(args, parts, 3) && !list_n(args, parts, 2)) return unsupported(c, e);
+
+  lbm_uint else_chain = BC_NO_JUMP;
+  lbm_uint end_chain = BC_NO_JUMP;
+  if (!compile_exp(c, parts[0], false) ||
+      !op_jump_chain(c, LBM_BC_JMP_NIL, &else_chain, -1) ||
+      !compile_exp(c, parts[1], tail) ||
+      !op_jump_chain(c, LBM_BC_JMP, &end_chain, -1)) {
+    return false;
+  }
+  resolve_chain(c, else_chain);
+  if (!compile_exp(c, parts[2], tail)) return false;
+  resolve_chain(c, end_chain);
+  return true;
+}
+
+static bool compile_cond(bc_compiler_t *c, lbm_value e, lbm_value args, bool tail) {
+  lbm_uint end_chain = BC_NO_JUMP;
+  while (lbm_is_cons(args)) {
+    lbm_value clause[2];
+    if (!list_n(lbm_car(args), clause, 2)) return unsupported(c, e);
+    lbm_uint next_chain = BC_NO_JUMP;
+    if (!compile_exp(c, clause[0], false) ||
+        !op_jump_chain(c, LBM_BC_JMP_NIL, &next_chain, -1) ||
+        !compile_exp(c, clause[1], tail) ||
+        !op_jump_chain(c, LBM_BC_JMP, &end_chain, -1)) {
+      return false;
+    }
+    resolve_chain(c, next_chain);
+    args = lbm_cdr(args);
+  }
+  if (!op(c, LBM_BC_NIL, 1)) return false;
+  resolve_chain(c, end_chain);
+  return true;
+}
+
+// and/or: each value but the last decides if evaluation stops there.
+static bool compile_and_or(bc_compiler_t *c, lbm_value args, bool is_and, bool tail) {
+  if (lbm_is_symbol_nil(args)) {
+    return op(c, is_and ? LBM_BC_TRUE : LBM_BC_NIL, 1);
+  }
+  lbm_uint end_chain = BC_NO_JUMP;
+  while (lbm_is_cons(args)) {
+    lbm_value rest = lbm_cdr(args);
+    bool last = !lbm_is_cons(rest);
+    if (!compile_exp(c, lbm_car(args), tail && last)) return false;
+    if (!last) {
+      if (!op(c, LBM_BC_DUP, 1) ||
+          !op_jump_chain(c, is_and ? LBM_BC_JMP_NIL : LBM_BC_JMP_NOT_NIL, &end_chain, -1) ||
+          !op(c, LBM_BC_POP, -1)) {
+        return false;
+      }
+    }
+    args = rest;
+  }
+  resolve_chain(c, end_chain);
+  return true;
+}
+
+static bool compile_progn(bc_compiler_t *c, lbm_value e, lbm_value args, bool tail) {
+  if (lbm_is_symbol_nil(args)) return op(c, LBM_BC_NIL, 1);
+
+  lbm_uint scope = c->num_scope;
+  while (lbm_is_cons(args)) {
+    lbm_value exp = lbm_car(args);
+    lbm_value rest = lbm_cdr(args);
+    bool last = !lbm_is_cons(rest);
+    if (lbm_is_cons(exp) && lbm_car(exp) == ENC_SYM_PROGN_VAR) {
+      // (var key value), key is in scope until the end of the progn
+      lbm_value parts[3];
+      lbm_uint slot;
+      if (!list_n(exp, parts, 3) || !is_runtime_symbol(parts[1])) return unsupported(c, exp);
+      if (!compile_exp(c, parts[2], false) ||
+          !new_local(c, parts[1], &slot) ||
+          !op(c, LBM_BC_DUP, 1) ||
+          !op_u8(c, LBM_BC_STORE, slot, -1)) {
+        return false;
+      }
+    } else if (!compile_exp(c, exp, tail && last)) {
+      return false;
+    }
+    if (!last && !op(c, LBM_BC_POP, -1)) return false;
+    args = rest;
+  }
+  if (!lbm_is_symbol_nil(args)) return unsupported(c, e);
+  c->num_scope = scope;
+  return true;
+}
+
+// Allocates slots for all keys and then stores the values in order.
+static bool compile_bindings(bc_compiler_t *c, lbm_value e, lbm_value binds) {
+  lbm_uint first = c->num_scope;
+  lbm_value b = binds;
+  while (lbm_is_cons(b)) {
+    lbm_value kv[2];
+    lbm_uint slot;
+    if (!list_n(lbm_car(b), kv, 2) || !is_runtime_symbol(kv[0])) return unsupported(c, e);
+    if (!new_local(c, kv[0], &slot)) return false;
+    b = lbm_cdr(b);
+  }
+  if (!lbm_is_symbol_nil(b)) return unsupported(c, e);
+
+  lbm_uint slot = first;
+  for (b = binds; lbm_is_cons(b); b = lbm_cdr(b)) {
+    if (!compile_exp(c, lbm_cadr(lbm_car(b)), false) ||
+        !op_u8(c, LBM_BC_STORE, slot, -1)) {
+      return false;
+    }
+    slot ++;
+  }
+  return true;
+}
+
+static bool compile_let(bc_compiler_t *c, lbm_value e, lbm_value args, bool tail) {
+  lbm_value parts[2];
+  if (!list_n(args, parts, 2)) return unsupported(c, e);
+  lbm_uint scope = c->num_scope;
+  if (!compile_bindings(c, e, parts[0]) ||
+      !compile_exp(c, parts[1], tail)) {
+    return false;
+  }
+  c->num_scope = scope;
+  return true;
+}
+
+// (loop bindings cond body) evaluates to nil
+static bool compile_loop(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value parts[3];
+  if (!list_n(args, parts, 3)) return unsupported(c, e);
+  lbm_uint scope = c->num_scope;
+  if (!compile_bindings(c, e, parts[0])) return false;
+
+  lbm_uint top = c->pc;
+  lbm_uint end_chain = BC_NO_JUMP;
+  if (!compile_exp(c, parts[1], false) ||
+      !op_jump_chain(c, LBM_BC_JMP_NIL, &end_chain, -1) ||
+      !compile_exp(c, parts[2], false) ||
+      !op(c, LBM_BC_POP, -1) ||
+      !op_u16(c, LBM_BC_JMP, top, 0)) {
+    return false;
+  }
+  resolve_chain(c, end_chain);
+  c->num_scope = scope;
+  return op(c, LBM_BC_NIL, 1);
+}
+
+static bool compile_setq(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value parts[2];
+  if (!list_n(args, parts, 2) || !is_runtime_symbol(parts[0])) return unsupported(c, e);
+  if (!compile_exp(c, parts[1], false)) return false;
+  int slot = lookup_local(c, parts[0]);
+  if (slot >= 0) {
+    return op(c, LBM_BC_DUP, 1) && op_u8(c, LBM_BC_STORE, (lbm_uint)slot, -1);
+  }
+  lbm_uint ix;
+  return add_const(c, parts[0], &ix) && op_u16(c, LBM_BC_SET_VAR, ix, 0);
+}
+
+static bool compile_define(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value parts[2];
+  lbm_uint ix;
+  if (!list_n(args, parts, 2) || !is_runtime_symbol(parts[0])) return unsupported(c, e);
+  return compile_exp(c, parts[1], false) &&
+    add_const(c, parts[0], &ix) &&
+    op_u16(c, LBM_BC_DEFINE, ix, 0);
+}
+
+/* The loop macros from the dynamic library are compiled directly. They
+ * evaluate to the value of the last iteration of body, or to the argument
+ * of break. Like the expansions, the next iterator value is computed before
+ * body is evaluated.
+ */
+
+static bool loop_begin(bc_compiler_t *c, lbm_uint *res_slot) {
+  if (c->num_loops >= BC_MAX_LOOPS) return too_large(c, ENC_SYM_NIL);
+  if (!new_local(c, ENC_SYM_NIL, res_slot) ||
+      !op(c, LBM_BC_NIL, 1) ||
+      !op_u8(c, LBM_BC_STORE, *res_slot, -1)) {
+    return false;
+  }
+  bc_loop_t *l = &c->loops[c->num_loops++];
+  l->res_slot = *res_slot;
+  l->depth = c->depth;
+  l->breaks = BC_NO_JUMP;
+  return true;
+}
+
+static bool loop_end(bc_compiler_t *c, lbm_uint end_chain, lbm_uint scope) {
+  bc_loop_t *l = &c->loops[--c->num_loops];
+  resolve_chain(c, end_chain);
+  resolve_chain(c, l->breaks);
+  c->num_scope = scope;
+  return op_u8(c, LBM_BC_LOAD, l->res_slot, 1);
+}
+
+static bool compile_break(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  if (c->num_loops == 0) return unsupported(c, e);
+  bc_loop_t *l = &c->loops[c->num_loops - 1];
+  lbm_value v = ENC_SYM_NIL;
+  if (lbm_is_cons(args)) {
+    if (!list_n(args, &v, 1)) return unsupported(c, e);
+  }
+  lbm_uint depth = c->depth;
+  if (!compile_exp(c, v, false) ||
+      !op_u8(c, LBM_BC_STORE, l->res_slot, -1)) {
+    return false;
+  }
+  if (c->depth > l->depth &&
+      !op_u8(c, LBM_BC_POPN, c->depth - l->depth, 0)) {
+    return false;
+  }
+  if (!op_jump_chain(c, LBM_BC_JMP, &l->breaks, 0)) return false;
+  // Nothing after break is reached, but the code around it expects a value.
+  c->depth = depth;
+  return adjust_depth(c, 1);
+}
+
+static bool compile_loopwhile(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value parts[2];
+  lbm_uint res, top;
+  lbm_uint end_chain = BC_NO_JUMP;
+  lbm_uint scope = c->num_scope;
+  if (!list_n(args, parts, 2)) return unsupported(c, e);
+  if (!loop_begin(c, &res)) return false;
+  top = c->pc;
+  if (!compile_exp(c, parts[0], false) ||
+      !op_jump_chain(c, LBM_BC_JMP_NIL, &end_chain, -1) ||
+      !compile_exp(c, parts[1], false) ||
+      !op_u8(c, LBM_BC_STORE, res, -1) ||
+      !op_u16(c, LBM_BC_JMP, top, 0)) {
+    return false;
+  }
+  return loop_end(c, end_chain, scope);
+}
+
+// looprange and loopfor, with cond and update as expressions
+static bool compile_loop_iter(bc_compiler_t *c, lbm_value it, lbm_value start,
+                              lbm_value cond, lbm_value end, lbm_value update, lbm_value body) {
+  lbm_uint it_slot, next, res, top, ix;
+  lbm_uint end_chain = BC_NO_JUMP;
+  lbm_uint scope = c->num_scope;
+  if (!is_runtime_symbol(it)) return unsupported(c, it);
+  if (!compile_exp(c, start, false) ||
+      !new_local(c, it, &it_slot) ||
+      !op_u8(c, LBM_BC_STORE, it_slot, -1) ||
+      !new_local(c, ENC_SYM_NIL, &next) ||
+      !loop_begin(c, &res)) {
+    return false;
+  }
+  top = c->pc;
+  if (lbm_is_symbol_nil(cond)) {
+    // (< it end)
+    if (!op_u8(c, LBM_BC_LOAD, it_slot, 1) ||
+        !compile_exp(c, end, false) ||
+        !op(c, LBM_BC_CALL_FUND, -1) ||
+        !emit(c, (uint8_t)SYMBOL_IX(SYM_LT)) ||
+        !emit(c, 2)) {
+      return false;
+    }
+  } else if (!compile_exp(c, cond, false)) {
+    return false;
+  }
+  if (!op_jump_chain(c, LBM_BC_JMP_NIL, &end_chain, -1)) return false;
+  if (lbm_is_symbol_nil(update)) {
+    // (+ it 1)
+    if (!op_u8(c, LBM_BC_LOAD, it_slot, 1) ||
+        !add_const(c, lbm_enc_i(1), &ix) ||
+        !op_u16(c, LBM_BC_CONST, ix, 1) ||
+        !op(c, LBM_BC_CALL_FUND, -1) ||
+        !emit(c, (uint8_t)SYMBOL_IX(SYM_ADD)) ||
+        !emit(c, 2)) {
+      return false;
+    }
+  } else if (!compile_exp(c, update, false)) {
+    return false;
+  }
+  if (!op_u8(c, LBM_BC_STORE, next, -1) ||
+      !compile_exp(c, body, false) ||
+      !op_u8(c, LBM_BC_STORE, res, -1) ||
+      !op_u8(c, LBM_BC_LOAD, next, 1) ||
+      !op_u8(c, LBM_BC_STORE, it_slot, -1) ||
+      !op_u16(c, LBM_BC_JMP, top, 0)) {
+    return false;
+  }
+  return loop_end(c, end_chain, scope);
+}
+
+static bool compile_looprange(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value p[4];
+  if (!list_n(args, p, 4)) return unsupported(c, e);
+  return compile_loop_iter(c, p[0], p[1], ENC_SYM_NIL, p[2], ENC_SYM_NIL, p[3]);
+}
+
+static bool compile_loopfor(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value p[5];
+  if (!list_n(args, p, 5) || lbm_is_symbol_nil(p[2]) || lbm_is_symbol_nil(p[3])) {
+    return unsupported(c, e);
+  }
+  return compile_loop_iter(c, p[0], p[1], p[2], ENC_SYM_NIL, p[3], p[4]);
+}
+
+// Stops at the first element that is nil, like the expansion.
+static bool compile_loopforeach(bc_compiler_t *c, lbm_value e, lbm_value args) {
+  lbm_value p[3];
+  lbm_uint it, rst, next_it, next_rst, res, top;
+  lbm_uint end_chain = BC_NO_JUMP;
+  lbm_uint scope = c->num_scope;
+  if (!list_n(args, p, 3) || !is_runtime_symbol(p[0])) return unsupported(c, e);
+  if (!compile_exp(c, p[1], false) ||
+      !new_local(c, p[0], &it) ||
+      !new_local(c, ENC_SYM_NIL, &rst) ||
+      !new_local(c, ENC_SYM_NIL, &next_it) ||
+      !new_local(c, ENC_SYM_NIL, &next_rst) ||
+      !op(c, LBM_BC_DUP, 1) ||
+      !op_u8(c, LBM_BC_CALL_FUND, SYMBOL_IX(SYM_CAR), 0) || !emit(c, 1) ||
+      !op_u8(c, LBM_BC_STORE, it, -1) ||
+      !op_u8(c, LBM_BC_CALL_FUND, SYMBOL_IX(SYM_CDR), 0) || !emit(c, 1) ||
+      !op_u8(c, LBM_BC_STORE, rst, -1) ||
+      !loop_begin(c, &res)) {
+    return false;
+  }
+  top = c->pc;
+  if (!op_u8(c, LBM_BC_LOAD, it, 1) ||
+      !op_jump_chain(c, LBM_BC_JMP_NIL, &end_chain, -1) ||
+      !op_u8(c, LBM_BC_LOAD, rst, 1) ||
+      !op(c, LBM_BC_DUP, 1) ||
+      !op_u8(c, LBM_BC_CALL_FUND, SYMBOL_IX(SYM_CAR), 0) || !emit(c, 1) ||
+      !op_u8(c, LBM_BC_STORE, next_it, -1) ||
+      !op_u8(c, LBM_BC_CALL_FUND, SYMBOL_IX(SYM_CDR), 0) || !emit(c, 1) ||
+      !op_u8(c, LBM_BC_STORE, next_rst, -1) ||
+      !compile_exp(c, p[2], false) ||
+      !op_u8(c, LBM_BC_STORE, res, -1) ||
+      !op_u8(c, LBM_BC_LOAD, next_it, 1) ||
+      !op_u8(c, LBM_BC_STORE, it, -1) ||
+      !op_u8(c, LBM_BC_LOAD, next_rst, 1) ||
+      !op_u8(c, LBM_BC_STORE, rst, -1) ||
+      !op_u16(c, LBM_BC_JMP, top, 0)) {
+    return false;
+  }
+  return loop_end(c, end_chain, scope);
+}
+
+static bool compile_args(bc_compiler_t *c, lbm_value e, lbm_value args, lbm_uint *argn) {
+  lbm_uint n = 0;
+  while (lbm_is_cons(args)) {
+    if (n >= BC_MAX_ARGS) return too_large(c, e);
+    if (!compile_exp(c, lbm_car(args), false)) return false;
+    n ++;
+    args = lbm_cdr(args);
+  }
+  if (!lbm_is_symbol_nil(args)) return unsupported(c, e);
+  *argn = n;
+  return true;
+}
+
+static bool compile_application(bc_compiler_t *c, lbm_value e, bool tail) {
+  lbm_value h = lbm_car(e);
+  lbm_value args = lbm_cdr(e);
+  lbm_uint argn;
+
+  if (lbm_is_symbol(h) && lookup_local(c, h) < 0) {
+    lbm_uint s = lbm_dec_sym(h);
+    switch (h) {
+    case ENC_SYM_QUOTE: {
+      lbm_value v;
+      if (!list_n(args, &v, 1)) return unsupported(c, e);
+      return push_value(c, v);
+    }
+    case ENC_SYM_IF:      return compile_if(c, e, args, tail);
+    case ENC_SYM_COND:    return compile_cond(c, e, args, tail);
+    case ENC_SYM_AND:     return compile_and_or(c, args, true, tail);
+    case ENC_SYM_OR:      return compile_and_or(c, args, false, tail);
+    case ENC_SYM_PROGN:   return compile_progn(c, e, args, tail);
+    case ENC_SYM_LET:     return compile_let(c, e, args, tail);
+    case ENC_SYM(SYM_LOOP): return compile_loop(c, e, args);
+    case ENC_SYM_SETQ:    return compile_setq(c, e, args);
+    case ENC_SYM_DEFINE:  return compile_define(c, e, args);
+    case ENC_SYM_REST_ARGS: return unsupported(c, e); // Parameters are not in the environment
+    default: break;
+    }
+
+    if (s >= SPECIAL_FORMS_START && s <= SPECIAL_FORMS_END) {
+      return unsupported(c, e);
+    }
+
+    if (SYMBOL_KIND(s) == SYMBOL_KIND_FUNDAMENTAL) {
+      if (!compile_args(c, e, args, &argn)) return false;
+      return op_u8(c, LBM_BC_CALL_FUND, SYMBOL_IX(s), 1 - (int)argn) && emit(c, (uint8_t)argn);
+    }
+
+    if (s >= RUNTIME_SYMBOLS_START) {
+      if (h == c->self && tail) {
+        if (!compile_args(c, e, args, &argn)) return false;
+        if (argn == c->num_params) {
+          return op_u8(c, LBM_BC_SELF_TAIL_CALL, argn, 1 - (int)argn);
+        }
+        // Wrong number of arguments, let the normal call report it
+        if (!op_u8(c, LBM_BC_POPN, argn, -(int)argn)) return false;
+      }
+
+      lbm_value v;
+      bool bound = lbm_global_env_lookup(&v, h);
+      if (!bound || (lbm_is_cons(v) && lbm_car(v) == ENC_SYM_MACRO)) {
+        if (h == c->sym_break)       return compile_break(c, e, args);
+        if (h == c->sym_loopwhile)   return compile_loopwhile(c, e, args);
+        if (h == c->sym_looprange)   return compile_looprange(c, e, args);
+        if (h == c->sym_loopfor)     return compile_loopfor(c, e, args);
+        if (h == c->sym_loopforeach) return compile_loopforeach(c, e, args);
+      }
+      if (bound && lbm_is_cons(v) && lbm_car(v) == ENC_SYM_MACRO) {
+        return unsupported(c, e);
+      }
+    }
+  }
+
+  if (!compile_exp(c, h, false) ||
+      !compile_args(c, e, args, &argn)) {
+    return false;
+  }
+  return op_u8(c, tail ? LBM_BC_TAIL_CALL : LBM_BC_CALL, argn, -(int)argn);
+}
+
+static bool compile_exp(bc_compiler_t *c, lbm_value e, bool tail) {
+  if (c->error != LBM_BC_COMPILE_OK) return false;
+  if (lbm_is_symbol(e)) return compile_symbol(c, e);
+  if (!lbm_is_cons(e)) return push_value(c, e);
+
+  if (c->nesting >= BC_MAX_NESTING) return too_large(c, e);
+  c->nesting ++;
+  bool r = compile_application(c, e, tail);
+  c->nesting --;
+  return r;
+}
+
+static int compile_closure(bc_compiler_t *c, lbm_value name, lbm_value closure, lbm_value *res) {
+  lbm_value cl[4];
+  if (!list_n(closure, cl, 4) || cl[0] != ENC_SYM_CLOSURE) {
+    fail(c, LBM_BC_COMPILE_UNSUPPORTED, closure, "Argument is not a closure.");
+    return c->error;
+  }
+  lbm_value params = cl[1];
+  lbm_value body = cl[2];
+
+  if (lbm_is_cons(body) && lbm_car(body) == ENC_SYM_BYTECODE) {
+    // Already compiled
+    *res = closure;
+    return LBM_BC_COMPILE_OK;
+  }
+
+  c->self = name;
+  c->sym_loopwhile = sym_by_name("loopwhile");
+  c->sym_looprange = sym_by_name("looprange");
+  c->sym_loopfor = sym_by_name("loopfor");
+  c->sym_loopforeach = sym_by_name("loopforeach");
+  c->sym_break = sym_by_name("break");
+
+  c->pc = LBM_BC_HEADER_SIZE;
+  for (lbm_value p = params; lbm_is_cons(p); p = lbm_cdr(p)) {
+    lbm_value sym = lbm_car(p);
+    lbm_uint slot, ix;
+    if (!is_runtime_symbol(sym) || lookup_local(c, sym) >= 0) {
+      fail(c, LBM_BC_COMPILE_UNSUPPORTED, params, "Incorrect parameter list.");
+      return c->error;
+    }
+    if (!new_local(c, sym, &slot) || !add_const(c, sym, &ix)) return c->error;
+    c->num_params ++;
+  }
+
+  if (!compile_exp(c, body, true) ||
+      !op(c, LBM_BC_RET, -1) ||
+      !emit(c, 0) || !emit(c, 0)) {
+    return c->error;
+  }
+
+  c->code[0] = (uint8_t)c->num_params;
+  c->code[1] = (uint8_t)c->num_locals;
+  c->code[2] = (uint8_t)c->max_depth;
+  c->code[3] = 0;
+
+  lbm_value code;
+  lbm_value consts;
+  if (!lbm_heap_allocate_array(&code, c->pc)) return LBM_BC_COMPILE_MERROR;
+  memcpy(((lbm_array_header_t*)lbm_car(code))->data, c->code, c->pc);
+  lbm_value bc = lbm_heap_allocate_list_init(3, ENC_SYM_BYTECODE, code, ENC_SYM_NIL);
+  if (!lbm_is_cons(bc)) return LBM_BC_COMPILE_MERROR;
+  if (!lbm_heap_allocate_lisp_array(&consts, c->num_consts)) return LBM_BC_COMPILE_MERROR;
+  memcpy(((lbm_array_header_t*)lbm_car(consts))->data, c->consts, c->num_consts * sizeof(lbm_value));
+  lbm_set_car(lbm_cdr(lbm_cdr(bc)), consts);
+
+  *res = lbm_heap_allocate_list_init(4, ENC_SYM_CLOSURE, params, bc, cl[3]);
+  if (!lbm_is_cons(*res)) return LBM_BC_COMPILE_MERROR;
+  return LBM_BC_COMPILE_OK;
+}
+
+int lbm_bytecode_compile(lbm_value name, lbm_value closure, lbm_value *res) {
+  bc_compiler_t *c = lbm_malloc(sizeof(bc_compiler_t));
+  if (!c) return LBM_BC_COMPILE_MERROR;
+  memset(c, 0, sizeof(bc_compiler_t));
+  c->error = LBM_BC_COMPILE_OK;
+  c->error_exp = ENC_SYM_NIL;
+
+  int r = compile_closure(c, name, closure, res);
+  if (r != LBM_BC_COMPILE_OK && r != LBM_BC_COMPILE_MERROR) {
+    *res = c->error_exp;
+  }
+  lbm_free(c);
+  return r;
+}
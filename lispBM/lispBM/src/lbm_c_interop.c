@@ -164,6 +164,25 @@ lbm_cid lbm_load_and_eval_program_incremental(lbm_char_channel_t *tokenizer, cha
   return eval_cps_load_and_eval(tokenizer, true, true, name);
 }
 
+lbm_cid lbm_load_and_eval_image(char *data, lbm_uint size, char *name) {
+  lbm_value img;
+  if (!lbm_share_array(&img, data, size)) {
+    return -1;
+  }
+
+  /* LISP ZONE */
+  lbm_value launcher = lbm_cons(img, ENC_SYM_NIL);
+  launcher = lbm_cons(ENC_SYM_EVAL_IMAGE, launcher);
+  lbm_value start_prg = lbm_cons(launcher, ENC_SYM_NIL);
+  /* LISP ZONE ENDS */
+
+  if (lbm_type_of(launcher) != LBM_TYPE_CONS ||
+      lbm_type_of(start_prg) != LBM_TYPE_CONS) {
+    return -1;
+  }
+  return lbm_create_ctx(start_prg, ENC_SYM_NIL, 256, name);
+}
+
 lbm_cid lbm_load_and_define_program(lbm_char_channel_t *tokenizer, char *symbol) {
   return eval_cps_load_and_define(tokenizer, symbol, true);
 }
@@ -795,3 +795,161 @@ bool lbm_unflatten_value(lbm_flat_value_t *v, lbm_value *res) {
   // 2: unflatten called from event processing -> event processor frees buffer.
   return b;
 }
+
+// ------------------------------------------------------------
+// Unflattening into the constant heap
+
+extern lbm_flash_status lbm_write_const_array_padded(uint8_t *data, lbm_uint n, lbm_uint *res);
+
+static int flash_status_to_unflatten(lbm_flash_status s) {
+  switch (s) {
+  case LBM_FLASH_WRITE_OK: return UNFLATTEN_OK;
+  case LBM_FLASH_FULL: return UNFLATTEN_FLASH_FULL;
+  default: return UNFLATTEN_FLASH_ERROR;
+  }
+}
+
+static int write_const_array_header(lbm_value cell, lbm_uint data, lbm_uint size, lbm_value type) {
+  lbm_array_header_t header;
+  header.size = size;
+  header.data = (lbm_uint*)data;
+  lbm_uint header_ptr;
+  lbm_flash_status s = lbm_write_const_raw((lbm_uint*)&header,
+                                           sizeof(lbm_array_header_t) / sizeof(lbm_uint),
+                                           &header_ptr);
+  if (s == LBM_FLASH_WRITE_OK) s = write_const_car(cell, header_ptr);
+  if (s == LBM_FLASH_WRITE_OK) s = write_const_cdr(cell, type);
+  return flash_status_to_unflatten(s);
+}
+
+/* Boxed numbers are unflattened onto the heap and then copied. Everything
+ * that is already unflattened is in flash, so the heap can be collected
+ * at any point. */
+static int unflatten_leaf_const(lbm_flat_value_t *v, lbm_value *res) {
+  lbm_uint pos = v->buf_pos;
+  lbm_value val;
+  int r = lbm_unflatten_value_internal(v, &val);
+  if (r == UNFLATTEN_GC_RETRY) {
+    lbm_perform_gc();
+    v->buf_pos = pos;
+    r = lbm_unflatten_value_internal(v, &val);
+  }
+  if (r != UNFLATTEN_OK) return r;
+
+  if (!lbm_is_ptr(val)) {
+    *res = val;
+    return UNFLATTEN_OK;
+  }
+
+  lbm_cons_t *ref = lbm_ref_cell(val);
+  lbm_value cell;
+  lbm_flash_status s = request_flash_storage_cell(val, &cell);
+  if (s == LBM_FLASH_WRITE_OK) {
+    switch (ref->cdr) {
+    case ENC_SYM_RAW_I_TYPE: /* fall through */
+    case ENC_SYM_RAW_U_TYPE:
+    case ENC_SYM_RAW_F_TYPE:
+      s = write_const_car(cell, ref->car);
+      break;
+#ifndef LBM64
+    case ENC_SYM_IND_I_TYPE: /* fall through */
+    case ENC_SYM_IND_U_TYPE:
+    case ENC_SYM_IND_F_TYPE: {
+      lbm_uint flash_ptr;
+      s = lbm_write_const_raw((lbm_uint*)ref->car, 2, &flash_ptr);
+      if (s == LBM_FLASH_WRITE_OK) s = write_const_car(cell, flash_ptr);
+    } break;
+#endif
+    default:
+      return UNFLATTEN_MALFORMED;
+    }
+  }
+  if (s == LBM_FLASH_WRITE_OK) s = write_const_cdr(cell, ref->cdr);
+  *res = cell;
+  return flash_status_to_unflatten(s);
+}
+
+/* Recursive in the car direction only, lists are built in a loop. */
+static int unflatten_value_const_internal(lbm_flat_value_t *v, lbm_value *res) {
+  if (v->buf_size == v->buf_pos) return UNFLATTEN_MALFORMED;
+
+  switch (v->buf[v->buf_pos]) {
+  case S_CONS: {
+    lbm_value first = ENC_SYM_NIL;
+    lbm_value last = ENC_SYM_NIL;
+    while (v->buf_pos < v->buf_size && v->buf[v->buf_pos] == S_CONS) {
+      v->buf_pos++;
+      lbm_value a;
+      int r = unflatten_value_const_internal(v, &a);
+      if (r != UNFLATTEN_OK) return r;
+      lbm_value cell;
+      lbm_flash_status s = lbm_allocate_const_cell(&cell);
+      if (s == LBM_FLASH_WRITE_OK) s = write_const_car(cell, a);
+      if (s == LBM_FLASH_WRITE_OK && !lbm_is_symbol_nil(last)) s = write_const_cdr(last, cell);
+      if (s != LBM_FLASH_WRITE_OK) return flash_status_to_unflatten(s);
+      if (lbm_is_symbol_nil(first)) first = cell;
+      last = cell;
+    }
+    lbm_value tail;
+    int r = unflatten_value_const_internal(v, &tail);
+    if (r != UNFLATTEN_OK) return r;
+    r = flash_status_to_unflatten(write_const_cdr(last, tail));
+    *res = first;
+    return r;
+  }
+  case S_LBM_LISP_ARRAY: {
+    v->buf_pos++;
+    uint32_t num_elt;
+    if (!extract_word(v, &num_elt)) return UNFLATTEN_MALFORMED;
+    lbm_value cell;
+    lbm_uint data = 0;
+    lbm_flash_status s = request_flash_storage_cell(LBM_PTR_BIT | LBM_TYPE_LISPARRAY, &cell);
+    if (s == LBM_FLASH_WRITE_OK) s = lbm_allocate_const_raw(num_elt, &data);
+    if (s != LBM_FLASH_WRITE_OK) return flash_status_to_unflatten(s);
+    int r = write_const_array_header(cell, data, num_elt * sizeof(lbm_uint), ENC_SYM_LISPARRAY_TYPE);
+    for (uint32_t i = 0; i < num_elt && r == UNFLATTEN_OK; i ++) {
+      lbm_value a;
+      r = unflatten_value_const_internal(v, &a);
+      if (r == UNFLATTEN_OK) {
+        r = flash_status_to_unflatten(lbm_const_write(&((lbm_uint*)data)[i], a));
+      }
+    }
+    *res = cell;
+    return r;
+  }
+  case S_LBM_ARRAY: {
+    v->buf_pos++;
+    uint32_t num_bytes;
+    if (!extract_word(v, &num_bytes) || v->buf_size < v->buf_pos + num_bytes) {
+      return UNFLATTEN_MALFORMED;
+    }
+    lbm_value cell;
+    lbm_uint data = 0;
+    lbm_flash_status s = request_flash_storage_cell(LBM_PTR_BIT | LBM_TYPE_ARRAY, &cell);
+    if (s == LBM_FLASH_WRITE_OK) s = lbm_write_const_array_padded(v->buf + v->buf_pos, num_bytes, &data);
+    if (s != LBM_FLASH_WRITE_OK) return flash_status_to_unflatten(s);
+    v->buf_pos += num_bytes;
+    *res = cell;
+    return write_const_array_header(cell, data, num_bytes, ENC_SYM_ARRAY_TYPE);
+  }
+  case S_SYM_STRING: {
+    v->buf_pos++;
+    char *name = (char *)(v->buf + v->buf_pos);
+    lbm_uint sym_id;
+    if (!lbm_add_symbol_flash(name, &sym_id)) return UNFLATTEN_FLASH_FULL;
+    v->buf_pos += strlen(name) + 1;
+    *res = lbm_enc_sym(sym_id);
+    return UNFLATTEN_OK;
+  }
+  default:
+    return unflatten_leaf_const(v, res);
+  }
+}
+
+int lbm_unflatten_value_const(lbm_flat_value_t *v, lbm_value *res) {
+  int r = unflatten_value_const_internal(v, res);
+  if (r != UNFLATTEN_OK) {
+    *res = ENC_SYM_EERROR;
+  }
+  return r;
+}
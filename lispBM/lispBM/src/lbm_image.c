@@ -0,0 +1,93 @@
+/*
+    Copyright 2025 Benjamin Vedder    benjamin@vedder.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lbm_image.h"
+
+static void put_u32(uint8_t *buf, uint32_t w) {
+  buf[0] = (uint8_t)(w >> 24);
+  buf[1] = (uint8_t)(w >> 16);
+  buf[2] = (uint8_t)(w >> 8);
+  buf[3] = (uint8_t)w;
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+    ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+bool lbm_image_start(uint8_t *buf, lbm_uint buf_size) {
+  if (buf_size < LBM_IMAGE_HEADER_SIZE) return false;
+  put_u32(buf, LBM_IMAGE_MAGIC);
+  buf[4] = LBM_IMAGE_VERSION;
+  buf[5] = sizeof(lbm_uint);
+  buf[6] = 0;
+  buf[7] = 0;
+  put_u32(buf + 8, 0);
+  put_u32(buf + 12, LBM_IMAGE_HEADER_SIZE);
+  return true;
+}
+
+int lbm_image_add_exp(uint8_t *buf, lbm_uint buf_size, lbm_value exp, bool constant) {
+  lbm_uint pos = get_u32(buf + 12);
+  if (buf_size < pos + LBM_IMAGE_EXP_HEADER) {
+    return FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL;
+  }
+
+  lbm_flat_value_t fv;
+  fv.buf = buf + pos + LBM_IMAGE_EXP_HEADER;
+  fv.buf_size = buf_size - pos - LBM_IMAGE_EXP_HEADER;
+  fv.buf_pos = 0;
+
+  int r = flatten_value_c(&fv, exp);
+  if (r == FLATTEN_VALUE_OK) {
+    buf[pos] = constant ? LBM_IMAGE_EXP_CONST : LBM_IMAGE_EXP_RAM;
+    put_u32(buf + pos + 1, (uint32_t)fv.buf_pos);
+    put_u32(buf + 8, get_u32(buf + 8) + 1);
+    put_u32(buf + 12, (uint32_t)(pos + LBM_IMAGE_EXP_HEADER + fv.buf_pos));
+  }
+  return r;
+}
+
+lbm_uint lbm_image_size(const uint8_t *data, lbm_uint size) {
+  if (size < LBM_IMAGE_HEADER_SIZE ||
+      get_u32(data) != LBM_IMAGE_MAGIC ||
+      data[4] != LBM_IMAGE_VERSION ||
+      data[5] != sizeof(lbm_uint)) {
+    return 0;
+  }
+  lbm_uint img_size = get_u32(data + 12);
+  if (img_size < LBM_IMAGE_HEADER_SIZE || img_size > size) {
+    return 0;
+  }
+  return img_size;
+}
+
+bool lbm_image_get_exp(const uint8_t *data, lbm_uint *pos, lbm_flat_value_t *fv, bool *constant) {
+  lbm_uint img_size = get_u32(data + 12);
+  lbm_uint p = *pos;
+  if (p + LBM_IMAGE_EXP_HEADER > img_size) return false;
+
+  lbm_uint fv_size = get_u32(data + p + 1);
+  if (fv_size > img_size - p - LBM_IMAGE_EXP_HEADER) return false;
+
+  *constant = data[p] == LBM_IMAGE_EXP_CONST;
+  fv->buf = (uint8_t*)(data + p + LBM_IMAGE_EXP_HEADER);
+  fv->buf_size = fv_size;
+  fv->buf_pos = 0;
+  *pos = p + LBM_IMAGE_EXP_HEADER + fv_size;
+  return true;
+}
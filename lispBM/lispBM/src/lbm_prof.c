@@ -116,3 +116,37 @@ void lbm_prof_sample(void) {
   }
   mutex_unlock(&qmutex);
 }
+
+#ifdef LBM_USE_PROF_STATS
+lbm_prof_ext_t *lbm_prof_ext_data = NULL;
+lbm_uint        lbm_prof_ext_num = 0;
+
+void lbm_prof_ext_init(lbm_prof_ext_t *prof_ext_buf,
+                       lbm_uint        prof_ext_buf_num) {
+  lbm_prof_ext_data = NULL;
+  lbm_prof_ext_num = 0;
+  if (prof_ext_buf && prof_ext_buf_num > 0) {
+    memset(prof_ext_buf, 0, prof_ext_buf_num * sizeof(lbm_prof_ext_t));
+    lbm_prof_ext_num = prof_ext_buf_num;
+    lbm_prof_ext_data = prof_ext_buf;
+  }
+}
+
+static void reset_ctx_stats(eval_context_t *ctx, void *arg1, void *arg2) {
+  (void) arg1;
+  (void) arg2;
+  ctx->stats.steps = 0;
+  ctx->stats.run_us = 0;
+  ctx->stats.blocked_us = 0;
+  ctx->stats.cells = 0;
+  ctx->stats.gc_num = 0;
+  ctx->stats.mail_max = ctx->num_mail;
+}
+
+void lbm_prof_stats_reset(void) {
+  lbm_all_ctxs_iterator(reset_ctx_stats, NULL, NULL);
+  if (lbm_prof_ext_data) {
+    memset(lbm_prof_ext_data, 0, lbm_prof_ext_num * sizeof(lbm_prof_ext_t));
+  }
+}
+#endif
@@ -81,7 +81,11 @@ special_sym const special_symbols[] =  {
   {"trap"         , SYM_TRAP},
   {"rest-args"    , SYM_REST_ARGS},
   {"rotate"       , SYM_ROTATE},
+  {"read-image"   , SYM_READ_IMAGE},
+  {"eval-image"   , SYM_EVAL_IMAGE},
   {"call-cc-unsafe", SYM_CALL_CC_UNSAFE},
+  {"bytecode"     , SYM_BYTECODE},
+  {"compile"      , SYM_COMPILE},
 
   // pattern matching
   {"?"          , SYM_MATCH_ANY},
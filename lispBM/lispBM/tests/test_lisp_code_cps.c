@@ -31,10 +31,13 @@
 #include "extensions/runtime_extensions.h"
 #include "extensions/random_extensions.h"
 #include "extensions/set_extensions.h"
+#include "extensions/hashmap_extensions.h"
+#include "extensions/display_extensions.h"
 #include "extensions/mutex_extensions.h"
 #include "extensions/lbm_dyn_lib.h"
 #include "lbm_channel.h"
 #include "lbm_flat_value.h"
+#include "lbm_prof.h"
 
 #define WAIT_TIMEOUT 2500
 
@@ -48,6 +51,9 @@
 #define SUCCESS 1
 
 lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
+#ifdef LBM_USE_PROF_STATS
+lbm_prof_ext_t prof_ext_data[EXTENSION_STORAGE_SIZE];
+#endif
 lbm_uint constants_memory[CONSTANT_MEMORY_SIZE];
 
 #ifndef LONGER_DELAY
@@ -236,6 +242,117 @@ LBM_EXTENSION(ext_event_sym, args, argn) {
   return res;
 }
 
+#define TEST_EVENT_QUEUE_SIZE 8
+static lbm_event_t test_event_queue_storage[TEST_EVENT_QUEUE_SIZE];
+static lbm_event_queue_t test_event_queue;
+
+// (event-q-burst sym n) sends n events through the producer queue
+// and returns the number of events that were accepted.
+LBM_EXTENSION(ext_event_q_burst, args, argn) {
+  if (argn != 2 || !lbm_is_symbol(args[0]) || !lbm_is_number(args[1])) {
+    return ENC_SYM_TERROR;
+  }
+  int32_t n = lbm_dec_as_i32(args[1]);
+  int32_t sent = 0;
+  for (int32_t i = 0; i < n; i ++) {
+    lbm_flat_value_t v;
+    if (!lbm_start_flatten(&v, 1 + sizeof(lbm_uint) + 20)) break;
+    f_sym(&v, lbm_dec_sym(args[0]));
+    lbm_finish_flatten(&v);
+    if (lbm_event_queue_event(&test_event_queue, &v)) {
+      sent ++;
+    } else {
+      lbm_free(v.buf);
+    }
+  }
+  return lbm_enc_i(sent);
+}
+
+// Pool of platform owned frames that are lent to LBM as borrowed arrays.
+#define TEST_FRAME_POOL_SIZE 4
+#define TEST_FRAME_SIZE      8
+
+typedef struct {
+  lbm_array_header_t header;
+  uint8_t data[TEST_FRAME_SIZE];
+  bool used;
+} test_frame_t;
+
+static test_frame_t test_frames[TEST_FRAME_POOL_SIZE];
+static lbm_uint sym_frame;
+
+static void test_frame_release(lbm_array_header_t *header) {
+  for (int i = 0; i < TEST_FRAME_POOL_SIZE; i ++) {
+    if (header == &test_frames[i].header) {
+      test_frames[i].used = false;
+    }
+  }
+}
+
+static test_frame_t *test_frame_get(lbm_uint len) {
+  if (len > TEST_FRAME_SIZE) return NULL;
+  for (int i = 0; i < TEST_FRAME_POOL_SIZE; i ++) {
+    test_frame_t *f = &test_frames[i];
+    if (!f->used) {
+      for (lbm_uint j = 0; j < len; j ++) {
+        f->data[j] = (uint8_t)j;
+      }
+      f->header.data = (lbm_uint*)f->data;
+      f->header.size = len;
+      return f;
+    }
+  }
+  return NULL;
+}
+
+// (frame-borrow n) -> read-only array of n bytes or nil if the pool is empty
+LBM_EXTENSION(ext_frame_borrow, args, argn) {
+  LBM_CHECK_ARGN_NUMBER(1);
+  test_frame_t *f = test_frame_get(lbm_dec_as_u32(args[0]));
+  if (!f) return ENC_SYM_NIL;
+  lbm_value arr;
+  if (!lbm_heap_borrow_array(&arr, &f->header)) return arr;
+  f->used = true;
+  return arr;
+}
+
+LBM_EXTENSION(ext_frame_num_free, args, argn) {
+  (void) args;
+  (void) argn;
+  int n = 0;
+  for (int i = 0; i < TEST_FRAME_POOL_SIZE; i ++) {
+    if (!test_frames[i].used) n ++;
+  }
+  return lbm_enc_i(n);
+}
+
+static lbm_value test_frame_build(lbm_uint arg, bool retry) {
+  test_frame_t *f = &test_frames[arg];
+  lbm_value ev = lbm_cons(lbm_enc_sym(sym_frame), ENC_SYM_NIL);
+  lbm_value arr = ENC_SYM_MERROR;
+  if (lbm_is_cons(ev) && lbm_heap_borrow_array(&arr, &f->header)) {
+    lbm_set_cdr(ev, arr);
+    return ev;
+  }
+  if (retry) f->used = false;
+  return ENC_SYM_MERROR;
+}
+
+// (event-q-frame n) sends (frame . arr) to the event handler without
+// flattening. Returns nil if the pool or the queue is full.
+LBM_EXTENSION(ext_event_q_frame, args, argn) {
+  LBM_CHECK_ARGN_NUMBER(1);
+  test_frame_t *f = test_frame_get(lbm_dec_as_u32(args[0]));
+  if (!f) return ENC_SYM_NIL;
+  f->used = true;
+  if (!lbm_event_queue_build(&test_event_queue, -1, test_frame_build,
+                             (lbm_uint)(f - test_frames))) {
+    f->used = false;
+    return ENC_SYM_NIL;
+  }
+  return ENC_SYM_TRUE;
+}
+
 LBM_EXTENSION(ext_event_float, args, argn) {
   lbm_value res = ENC_SYM_EERROR;
   if (argn == 1 && lbm_is_number(args[0])) {
@@ -549,6 +666,9 @@ int main(int argc, char **argv) {
     printf ("FAILED to initialize LBM\n");
     return FAIL;
   }
+#ifdef LBM_USE_PROF_STATS
+  lbm_prof_ext_init(prof_ext_data, EXTENSION_STORAGE_SIZE);
+#endif
 
   if (!lbm_const_heap_init(const_heap_write,
                            &const_heap,constants_memory,
@@ -565,6 +685,10 @@ int main(int argc, char **argv) {
     printf("Error initializing events.\n");
     return FAIL;
   }
+  lbm_event_queue_init(&test_event_queue, "test",
+                       test_event_queue_storage, TEST_EVENT_QUEUE_SIZE);
+  lbm_event_queue_add(&test_event_queue);
+  lbm_heap_set_array_release_callback(test_frame_release);
 
   lbm_array_extensions_init();
   lbm_math_extensions_init();
@@ -573,6 +697,8 @@ int main(int argc, char **argv) {
   lbm_random_extensions_init();
   lbm_mutex_extensions_init();
   lbm_set_extensions_init();
+  lbm_hashmap_extensions_init();
+  lbm_display_extensions_init();
   lbm_dyn_lib_init();
 
   lbm_add_extension("ext-even", ext_even);
@@ -582,6 +708,11 @@ int main(int argc, char **argv) {
   lbm_add_extension("event-float", ext_event_float);
   lbm_add_extension("event-list-of-float", ext_event_list_of_float);
   lbm_add_extension("event-array", ext_event_array);
+  lbm_add_extension("event-q-burst", ext_event_q_burst);
+  lbm_add_extension("event-q-frame", ext_event_q_frame);
+  lbm_add_extension("frame-borrow", ext_frame_borrow);
+  lbm_add_extension("frame-num-free", ext_frame_num_free);
+  lbm_add_symbol_const("frame", &sym_frame);
   lbm_add_extension("block", ext_block);
   lbm_add_extension("unblock", ext_unblock);
   lbm_add_extension("block-rmbr", ext_block_rmbr);
@@ -0,0 +1,34 @@
+
+; frame-borrow lends a frame from a pool of 4 in the test runner.
+(define a (frame-borrow 4))
+
+(define r1 (and (eq (type-of a) 'type-array)
+                (= (buflen a) 4)
+                (= (bufget-u8 a 3) 3)
+                (= (frame-num-free) 3)))
+
+; Borrowed arrays are read-only
+(define r2 (eq '(exit-error type_error) (trap (bufset-u8 a 0 10))))
+
+; free returns the frame to the pool and invalidates the array
+(free a)
+(define r3 (= (frame-num-free) 4))
+
+; The GC returns frames that are no longer referenced
+(define b (frame-borrow 8))
+(define c (frame-borrow 8))
+(define r4 (= (frame-num-free) 2))
+(setq b nil)
+(setq c nil)
+(gc)
+(define r5 (= (frame-num-free) 4))
+
+; The pool can run dry
+(define fs (map (lambda (x) (frame-borrow 2)) (range 5)))
+(define r6 (and (eq (ix fs 4) nil)
+                (= (frame-num-free) 0)))
+(setq fs nil)
+(gc)
+(define r7 (= (frame-num-free) 4))
+
+(check (and r1 r2 r3 r4 r5 r6 r7))
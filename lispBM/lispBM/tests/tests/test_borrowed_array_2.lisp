@@ -0,0 +1,26 @@
+
+(event-register-handler (self))
+
+; event-q-frame sends (frame . arr) where arr is borrowed from the
+; pool of 4 frames in the test runner.
+(define sent (map (lambda (x) (event-q-frame 3)) (range 6)))
+
+(define n 0)
+(define sum 0)
+(define go t)
+(loopwhile go
+  (recv-to 0.1
+           ((frame . (? a)) {
+             (setq n (+ n 1))
+             (setq sum (+ sum (bufget-u8 a 2)))
+             })
+           (timeout (setq go nil))))
+
+(define r1 (and (eq sent '(t t t t nil nil))
+                (= n 4)
+                (= sum 8)))
+
+(gc)
+(define r2 (= (frame-num-free) 4))
+
+(check (and r1 r2))
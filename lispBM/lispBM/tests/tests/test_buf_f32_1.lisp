@@ -0,0 +1,47 @@
+; Element-wise kernels, dot product and statistics over f32 buffers.
+
+(defun mk-f32 (lst) {
+       (var b (bufcreate (* 4 (length lst))))
+       (looprange i 0 (length lst) (bufset-f32 b (* i 4) (ix lst i)))
+       b
+       })
+
+(defun to-list (b)
+  (map (lambda (i) (bufget-f32 b (* i 4))) (range (/ (buflen b) 4))))
+
+(defun close (a b) (< (abs (- a b)) 0.0001))
+
+(defun all-close (l1 l2)
+  (and (= (length l1) (length l2))
+       (foldl (lambda (acc p) (and acc (close (car p) (cdr p)))) t (zip l1 l2))))
+
+(define x (mk-f32 '(1.0 2.0 3.0 4.0)))
+(define y (mk-f32 '(0.5 0.5 0.5 0.5)))
+
+(buf-f32-axpy y 2.0 x)
+(define r-axpy (all-close (to-list y) '(2.5 4.5 6.5 8.5)))
+
+(define r-dot (close (buf-f32-dot x x) 30.0))
+
+(buf-f32-scale x 2.0 -1.0)
+(define r-scale (all-close (to-list x) '(1.0 3.0 5.0 7.0)))
+
+(buf-f32-add y x)
+(define r-add (all-close (to-list y) '(3.5 7.5 11.5 15.5)))
+
+(buf-f32-mul x (mk-f32 '(2.0 0.5 -1.0)))
+(define r-mul (all-close (to-list x) '(2.0 1.5 -5.0 7.0)))
+
+(define st (buf-f32-stats (mk-f32 '(3.0 -4.0 0.0 5.0))))
+(define r-stats (all-close st (list -4.0 5.0 1.0 (sqrt 12.5))))
+
+(define le (bufcreate 8))
+(bufset-f32 le 0 1.5 'little-endian)
+(bufset-f32 le 4 -2.0 'little-endian)
+(buf-f32-scale le 2.0 'little-endian)
+(define r-le (and (close (bufget-f32 le 0 'little-endian) 3.0)
+                  (close (bufget-f32 le 4 'little-endian) -4.0)))
+
+(define r-err (eq (trap (buf-f32-dot x 1)) '(exit-error type_error)))
+
+(check (and r-axpy r-dot r-scale r-add r-mul r-stats r-le r-err))
@@ -0,0 +1,42 @@
+; FIR and biquad filters in place. Filtering in two blocks with a state
+; buffer gives the same result as filtering everything at once.
+
+(defun mk-f32 (lst) {
+       (var b (bufcreate (* 4 (length lst))))
+       (looprange i 0 (length lst) (bufset-f32 b (* i 4) (ix lst i)))
+       b
+       })
+
+(defun to-list (b)
+  (map (lambda (i) (bufget-f32 b (* i 4))) (range (/ (buflen b) 4))))
+
+(defun close (a b) (< (abs (- a b)) 0.0001))
+
+(defun all-close (l1 l2)
+  (and (= (length l1) (length l2))
+       (foldl (lambda (acc p) (and acc (close (car p) (cdr p)))) t (zip l1 l2))))
+
+(define sig '(1.0 2.0 3.0 4.0 5.0 6.0 7.0 8.0))
+(define taps (mk-f32 '(0.5 0.25 0.25)))
+
+(define x (mk-f32 sig))
+(buf-f32-fir x taps)
+(define r-fir (all-close (to-list x) '(0.5 1.25 2.25 3.25 4.25 5.25 6.25 7.25)))
+
+(define st (bufcreate 8))
+(define x1 (mk-f32 (take sig 3)))
+(define x2 (mk-f32 (drop sig 3)))
+(buf-f32-fir x1 taps st)
+(buf-f32-fir x2 taps st)
+(define r-fir-blocks (all-close (append (to-list x1) (to-list x2))
+                                '(0.5 1.25 2.25 3.25 4.25 5.25 6.25 7.25)))
+
+; a0 a1 a2 b1 b2 z1 z2
+(define bq (mk-f32 '(0.5 0.0 0.0 -0.5 0.0 0.0 0.0)))
+(define y1 (mk-f32 '(1.0 1.0)))
+(define y2 (mk-f32 '(1.0 1.0)))
+(buf-f32-biquad y1 bq)
+(buf-f32-biquad y2 bq)
+(define r-bq (all-close (append (to-list y1) (to-list y2)) '(0.5 0.75 0.875 0.9375)))
+
+(check (and r-fir r-fir-blocks r-bq))
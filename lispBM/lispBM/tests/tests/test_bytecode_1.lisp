@@ -0,0 +1,18 @@
+
+(defun fib (n)
+  (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+
+(defun sum (acc n)
+  (if (= n 0) acc (sum (+ acc n) (- n 1))))
+
+(define fib-i (fib 12))
+(define sum-i (sum 0 100))
+
+(compile 'fib)
+(compile 'sum)
+
+(check (and (eq (car (car (cdr (cdr fib)))) 'bytecode)
+            (= (fib 12) fib-i)
+            (= (sum 0 100) sum-i)
+            (= (sum 0 10000) 50005000)
+            (eq (map fib '(0 1 2 3 4 5)) '(0 1 1 2 3 5))))
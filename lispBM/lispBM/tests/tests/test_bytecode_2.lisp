@@ -0,0 +1,55 @@
+
+(defun find-first (f lst)
+  (loopforeach e lst
+               (if (f e) (break e) nil)))
+
+(defun sum-range (n)
+  (let ((s 0))
+    (progn
+      (looprange i 0 n (setq s (+ s i)))
+      s)))
+
+(defun count-while (n)
+  (let ((i 0))
+    (loopwhile (< i n) (setq i (+ i 1)))))
+
+(defun evens (n)
+  (let ((acc nil))
+    (progn
+      (loopfor i 0 (< i n) (+ i 2) (setq acc (cons i acc)))
+      acc)))
+
+(defun nested (n)
+  (looprange i 0 n
+             (looprange j 0 n
+                        (if (= (* i j) 6) (break (list i j)) nil))))
+
+(defun plain-loop (n)
+  (let ((r 0))
+    (progn
+      (loop ((i 0)) (< i n) (progn (setq r (+ r i)) (setq i (+ i 1))))
+      r)))
+
+(define res-i (list (find-first (lambda (x) (> x 2)) '(1 2 3 4))
+                    (sum-range 10)
+                    (count-while 7)
+                    (evens 9)
+                    (nested 4)
+                    (plain-loop 5)))
+
+(compile 'find-first)
+(compile 'sum-range)
+(compile 'count-while)
+(compile 'evens)
+(compile 'nested)
+(compile 'plain-loop)
+
+(define res-c (list (find-first (lambda (x) (> x 2)) '(1 2 3 4))
+                    (sum-range 10)
+                    (count-while 7)
+                    (evens 9)
+                    (nested 4)
+                    (plain-loop 5)))
+
+(check (and (eq res-i res-c)
+            (eq res-c '(3 45 7 (8 6 4 2 0) (3 2) 10))))
@@ -0,0 +1,38 @@
+
+(define glob 1)
+
+(defun mul (a b) (* a b))
+
+(defun rest-len (a) (length (rest-args)))
+
+(defun sq (x) (* x x))
+(compile 'sq)
+
+(defun f (x)
+  (let ((a (+ x glob))
+        (b (mul x 2)))
+    (progn
+      (var c (sq a))
+      (setq glob (+ glob 1))
+      (cond ((> c 100) (list 'big a b c))
+            ((and (> c 10) (or (= b 0) (> b 4))) (list 'mid a b c))
+            (t (list 'small a b c (rest-len 1 2 3)))))))
+
+(defun g (x)
+  (progn
+    (define from-g (str-join (list "a" (to-str x)) "-"))
+    (mul x 3)))
+
+(compile 'f)
+(compile 'g)
+
+(define r1 (f 2))
+(define r2 (f 3))
+(define r3 (f 20))
+
+(check (and (eq r1 '(small 3 4 9 2))
+            (eq r2 '(mid 5 6 25))
+            (eq r3 '(big 23 40 529))
+            (= glob 4)
+            (= (g 5) 15)
+            (eq from-g "a-5")))
@@ -0,0 +1,24 @@
+
+(defun uses-match (x)
+  (match x
+         (1 'one)
+         (_ 'other)))
+
+(defun add1 (x) (+ x 1))
+
+(compile 'add1)
+
+(defun bad-arg (x) (add1 x))
+(compile 'bad-arg)
+
+(define r1 (trap (compile 'uses-match)))
+(define r2 (trap (bad-arg 'a)))
+(define r3 (trap (add1)))
+(define r4 (trap (compile 'not-defined)))
+
+(check (and (eq r1 '(exit-error eval_error))
+            (eq r2 '(exit-error type_error))
+            (eq r3 '(exit-error eval_error))
+            (eq r4 '(exit-error variable_not_bound))
+            (eq (uses-match 1) 'one)
+            (= (bad-arg 1) 2)))
@@ -0,0 +1,21 @@
+
+(defun spin (n)
+  (looprange i 0 n i))
+
+(compile 'spin)
+
+(define ticks 0)
+
+(defun ticker ()
+  (progn
+    (setq ticks (+ ticks 1))
+    (yield 10)
+    (ticker)))
+
+(spawn ticker)
+
+;; A long compiled loop yields to the scheduler so the ticker keeps running.
+(define r (spin 200000))
+
+(check (and (= r 199999)
+            (> ticks 0)))
@@ -0,0 +1,21 @@
+
+(event-register-handler (self))
+
+; The producer queue in the test runner holds 8 events.
+(define sent (event-q-burst 'apa 10))
+
+(define n 0)
+(define go t)
+(loopwhile go
+  (recv-to 0.1
+           (apa (setq n (+ n 1)))
+           (timeout (setq go nil))))
+
+(define stats (ix (event-queue-stats) 1))
+
+(check (and (= sent 8)
+            (= n 8)
+            (eq (ix stats 0) "test")
+            (= (ix stats 1) 8)
+            (= (ix stats 2) 2)
+            (= (ix stats 3) 8)))
@@ -0,0 +1,19 @@
+
+(event-register-handler (self))
+
+; Events are drained as they arrive, so repeated small bursts
+; are all delivered and nothing is dropped.
+(define n 0)
+(define sent 0)
+(looprange i 0 20 {
+           (setq sent (+ sent (event-q-burst 'bepa 4)))
+           (looprange j 0 4
+                      (recv-to 0.1 (bepa (setq n (+ n 1)))))
+           })
+
+(define stats (ix (event-queue-stats) 1))
+
+(check (and (= sent 80)
+            (= n 80)
+            (= (ix stats 2) 0)
+            (<= (ix stats 3) 4)))
@@ -0,0 +1,37 @@
+; Basic operations on a hash map with keys of different types.
+
+(define m (mkhashmap))
+
+(hashmap-set m 'a 1)
+(hashmap-set m 10 "ten")
+(hashmap-set m 2.5 'float)
+(hashmap-set m "str" 'string)
+(hashmap-set m '(1 2) 'list)
+(hashmap-set m [1 2 3] 'bytes)
+(hashmap-set m 'a 2)
+
+(define r-get (and (= (hashmap-get m 'a) 2)
+                   (eq (hashmap-get m 10) "ten")
+                   (eq (hashmap-get m 2.5) 'float)
+                   (eq (hashmap-get m "str") 'string)
+                   (eq (hashmap-get m (list 1 2)) 'list)
+                   (eq (hashmap-get m [1 2 3]) 'bytes)
+                   (eq (hashmap-get m 'b) nil)
+                   (eq (hashmap-get m 'b 'none) 'none)
+                   (eq (hashmap-get m 10u) nil)))
+
+(define r-count (= (hashmap-count m) 6))
+
+(hashmap-remove m 'a)
+(hashmap-remove m 'not-there)
+
+(define r-remove (and (= (hashmap-count m) 5)
+                      (eq (hashmap-get m 'a) nil)))
+
+(define r-pred (and (hashmap? m)
+                    (not (hashmap? '(1 2)))
+                    (not (hashmap? [| 1 2 3 4 |]))))
+
+(define r-err (eq (trap (hashmap-get '(1 2) 1)) '(exit-error type_error)))
+
+(check (and r-get r-count r-remove r-pred r-err))
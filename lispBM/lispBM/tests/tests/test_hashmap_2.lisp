@@ -0,0 +1,31 @@
+; Grow a map well past its initial size, with GC in between, and
+; iterate over it.
+
+(define m (mkhashmap 4))
+(define n 60)
+
+(looprange i 0 n {
+           (hashmap-set m i (* i i))
+           (if (= (mod i 20) 0) (gc))
+           })
+
+(define r-all (and (= (hashmap-count m) n)
+                   (eq (hashmap-get m 0) 0)
+                   (eq (hashmap-get m 37) (* 37 37))
+                   (eq (hashmap-get m 59) (* 59 59))))
+
+(looprange i 0 n
+           (if (= (mod i 2) 0) (hashmap-remove m i)))
+
+(gc)
+
+(define pairs (hashmap-to-list m))
+(define keys (sort < (hashmap-keys m)))
+
+(define r-iter (and (= (length pairs) (/ n 2))
+                    (= (length keys) (/ n 2))
+                    (= (car keys) 1)
+                    (= (ix keys -1) 59)
+                    (foldl (lambda (acc p) (and acc (= (cdr p) (* (car p) (car p))))) t pairs)))
+
+(check (and r-all r-iter))
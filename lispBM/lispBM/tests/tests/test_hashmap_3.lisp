@@ -0,0 +1,29 @@
+; A map survives flatten and unflatten, which is how it is sent
+; between contexts as a flat value.
+
+(define m (mkhashmap))
+(hashmap-set m 'speed 10.5)
+(hashmap-set m "name" 'motor)
+(hashmap-set m 7 '(1 2 3))
+
+(define m2 (unflatten (flatten m)))
+(hashmap-rehash m2)
+
+(hashmap-set m2 'speed 20.0)
+
+(define r-copy (and (hashmap? m2)
+                    (= (hashmap-count m2) 3)
+                    (= (hashmap-get m2 'speed) 20.0)
+                    (eq (hashmap-get m2 "name") 'motor)
+                    (eq (hashmap-get m2 7) '(1 2 3))
+                    (= (hashmap-get m 'speed) 10.5)))
+
+(defun receiver ()
+  (recv ((? mp) (send (hashmap-get mp 'parent) (hashmap-get mp 7)))))
+
+(define pid (spawn receiver))
+(hashmap-set m 'parent (self))
+(send pid m)
+(define r-send (eq (recv ((? x) x)) '(1 2 3)))
+
+(check (and r-copy r-send))
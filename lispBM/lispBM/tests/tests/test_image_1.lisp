@@ -0,0 +1,13 @@
+
+(define src "(define a 10) @const-start (defun f (x) (+ x a)) (def lst '(1 2 3 \"str\" 1.5 2u32)) @const-end (f 1)")
+
+(define buf (bufcreate 512))
+
+(define n (read-image src buf))
+
+(define r (eval-image buf))
+
+(check (and (> n 16)
+            (= r 11)
+            (eq (map f '(1 2)) '(11 12))
+            (eq lst '(1 2 3 "str" 1.5 2u32))))
@@ -0,0 +1,23 @@
+
+(define src (str-merge
+             "@const-start "
+             "(defun g (x) (match x ((? y) (if (> y 0) (list 'pos y [1 2 3] [| 1 2.5 \"a\" |]) 'neg)))) "
+             "(def big '(1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 (a b (c d (e . f))))) "
+             "(def nums (list 1i64 2u64 3.25f64 -1i32)) "
+             "@const-end "
+             "(define h (lambda (x) (* x 2))) "
+             "(h (car (cdr (g 5))))"))
+
+(define buf (bufcreate 1024))
+(define n (read-image src buf))
+
+(define r (eval-image buf))
+
+(check (and (= r 10)
+            (= n (read-image src buf))
+            (eq (g 5) '(pos 5 [1 2 3] [| 1 2.5 "a" |]))
+            (eq (g -1) 'neg)
+            (eq (ix big 20) '(a b (c d (e . f))))
+            (eq nums (list 1i64 2u64 3.25f64 -1i32))
+            (eq (trap (eval-image "not an image")) '(exit-error eval_error))
+            (eq (trap (read-image src (bufcreate 20))) '(exit-error eval_error))))
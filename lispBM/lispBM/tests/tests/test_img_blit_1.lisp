@@ -0,0 +1,29 @@
+; Blitting a buffer onto itself so that source and destination overlap,
+; moved down and right and then back up and left, must give the same
+; pixels as drawing the moved picture pixel by pixel.
+
+(defun check-self-blit (fmt col)
+  (let ((s (img-buffer fmt 16 12))
+        (e (img-buffer fmt 16 12))) {
+        (looprange j 0 12
+                   (looprange i 0 16 {
+                              (img-setpix s i j (col i j))
+                              (img-setpix e i j (col i j))
+                              }))
+        (img-blit s s 3 2 -1)
+        (looprange j 2 12
+                   (looprange i 3 16 (img-setpix e i j (col (- i 3) (- j 2)))))
+        (var ok1 (eq s e))
+        (img-blit s s -3 -2 -1)
+        (looprange j 0 10
+                   (looprange i 0 13 (img-setpix e i j (col i j))))
+        (and ok1 (eq s e))
+        }))
+
+(defun col-idx (i j) (mod (+ i (* 2 j)) 4))
+(defun col-rgb (i j) (+ (shl (* j 16) 16) (shl (* i 8) 8) (* (+ i j) 4)))
+
+(check (and (check-self-blit 'indexed4 col-idx)
+            (check-self-blit 'rgb332 col-rgb)
+            (check-self-blit 'rgb565 col-rgb)
+            (check-self-blit 'rgb888 col-rgb)))
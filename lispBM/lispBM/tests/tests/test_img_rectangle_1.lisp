@@ -0,0 +1,31 @@
+; Filled rectangles that are clipped by the image edges must set the
+; same pixels as drawing the clipped area pixel by pixel.
+
+(defun ref-rect (img x0 y0 x1 y1 c)
+  (looprange j y0 y1
+             (looprange i x0 x1 (img-setpix img i j c))))
+
+(defun check-rect (fmt c x y w h x0 y0 x1 y1)
+  (let ((a (img-buffer fmt 16 12))
+        (b (img-buffer fmt 16 12))) {
+        (img-rectangle a x y w h c '(filled))
+        (ref-rect b x0 y0 x1 y1 c)
+        (eq a b)
+        }))
+
+(defun check-fmt (fmt c)
+  (and (check-rect fmt c 3 2 5 4 3 2 8 6)
+       (check-rect fmt c -3 -2 7 6 0 0 4 4)
+       (check-rect fmt c 12 9 10 10 12 9 16 12)
+       (check-rect fmt c -5 4 30 2 0 4 16 6)
+       (check-rect fmt c 10 2 2147483647i32 3 10 2 16 5)
+       (check-rect fmt c 2 8 5 2147483647i32 2 8 7 12)
+       (check-rect fmt c -10 2 -2147483647i32 3 0 0 0 0)
+       (check-rect fmt c 20 2 4 4 0 0 0 0)))
+
+(check (and (check-fmt 'indexed2 1)
+            (check-fmt 'indexed4 2)
+            (check-fmt 'indexed16 11)
+            (check-fmt 'rgb332 0xFF8000)
+            (check-fmt 'rgb565 0x12AB34)
+            (check-fmt 'rgb888 0x12AB34)))
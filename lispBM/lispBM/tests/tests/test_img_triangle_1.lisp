@@ -0,0 +1,34 @@
+; Filled triangles with a flat top or bottom edge, and triangles that are
+; clipped by the image, must set the same pixels as testing every pixel
+; against the three edges.
+
+(defun edge (x y sx sy ex ey)
+  (- (* (- x sx) (- ey sy)) (* (- y sy) (- ex sx))))
+
+(defun inside (x y x0 y0 x1 y1 x2 y2)
+  (let ((w0 (edge x y x1 y1 x2 y2))
+        (w1 (edge x y x2 y2 x0 y0))
+        (w2 (edge x y x0 y0 x1 y1)))
+    (or (and (>= w0 0) (>= w1 0) (>= w2 0))
+        (and (<= w0 0) (<= w1 0) (<= w2 0)))))
+
+(defun check-tri (fmt c x0 y0 x1 y1 x2 y2)
+  (let ((a (img-buffer fmt 16 12))
+        (b (img-buffer fmt 16 12))) {
+        (img-triangle a x0 y0 x1 y1 x2 y2 c '(filled))
+        (looprange j 0 12
+                   (looprange i 0 16
+                              (if (inside i j x0 y0 x1 y1 x2 y2)
+                                  (img-setpix b i j c))))
+        (eq a b)
+        }))
+
+(defun check-fmt (fmt c)
+  (and (check-tri fmt c 2 1 13 1 7 10)
+       (check-tri fmt c 8 1 3 10 12 10)
+       (check-tri fmt c 1 2 14 6 1 10)
+       (check-tri fmt c -6 3 22 3 8 15)
+       (check-tri fmt c 4 -3 4 14 20 5)))
+
+(check (and (check-fmt 'indexed4 2)
+            (check-fmt 'rgb565 0x12AB34)))
@@ -0,0 +1,41 @@
+
+(define parent (self))
+
+(define worker (spawn (fn ()
+                        (progn
+                          (sleep 0.01)
+                          (recv ((? x) x))
+                          (recv ((? x) x))
+                          (recv ((? x) x))
+                          (send parent 'done)
+                          (recv ((? x) x))))))
+
+(send worker 1)
+(send worker 2)
+(send worker 3)
+
+(define l (range 100))
+
+(recv ((? x) x))
+
+;; (name steps run-us blocked-us cells gc-num mail-max)
+(define ws (assoc (prof-ctx-stats) worker))
+(define me (assoc (prof-ctx-stats) (self)))
+
+(define r1 (> (ix ws 1) 0))
+(define r2 (>= (ix ws 3) 5000))
+(define r3 (= (ix ws 6) 3))
+(define r4 (> (ix me 1) 0))
+(define r5 (>= (ix me 4) 100))
+
+(define es (assoc (prof-ext-stats) 'prof-ctx-stats))
+(define r6 (>= (car es) 2))
+
+(prof-reset)
+(define ws2 (assoc (prof-ctx-stats) worker))
+(define r7 (and (= (ix ws2 1) 0) (= (ix ws2 6) 0)))
+(define r8 (= (car (assoc (prof-ext-stats) 'prof-ctx-stats)) 1))
+
+(send worker 'stop)
+
+(check (and r1 r2 r3 r4 r5 r6 r7 r8))
@@ -0,0 +1,29 @@
+; Pass a counter around a ring of contexts. Every send looks up the
+; receiver by cid, whether it is blocked in recv, ready or running.
+
+(define n-ctx 16)
+
+(defun relay (next)
+  (recv ((? n) (send next (+ n 1)))))
+
+(define next (self))
+(define pids nil)
+
+(looprange i 0 n-ctx {
+           (setq next (spawn 48 relay next))
+           (setq pids (cons next pids))
+           })
+
+(send next 0)
+(define r (recv ((? n) n)))
+
+(loopforeach p pids (wait p))
+
+(define dead-send (send (car pids) 1))
+(define self-send (send (self) 'me))
+(define self-recv (recv ((? x) x)))
+
+(check (and (= r n-ctx)
+            (eq dead-send nil)
+            (eq self-send t)
+            (eq self-recv 'me)))
@@ -17,12 +17,15 @@ LISPBMSRC = $(LISPBM)/src/env.c \
             $(LISPBM)/src/lbm_custom_type.c \
             $(LISPBM)/src/lbm_flags.c \
             $(LISPBM)/src/lbm_flat_value.c \
+            $(LISPBM)/src/lbm_image.c \
+            $(LISPBM)/src/lbm_bytecode.c \
             $(LISPBM)/src/lbm_prof.c \
             $(LISPBM)/src/lbm_defrag_mem.c \
             $(LISPBM)/src/extensions/array_extensions.c \
             $(LISPBM)/src/extensions/math_extensions.c \
             $(LISPBM)/src/extensions/string_extensions.c \
             $(LISPBM)/src/extensions/mutex_extensions.c \
+            $(LISPBM)/src/extensions/hashmap_extensions.c \
             $(LISPBM)/src/extensions/lbm_dyn_lib.c \
 			lispBM/lispif.c \
 			lispBM/lispif_vesc_extensions.c \
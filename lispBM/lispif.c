@@ -29,15 +29,17 @@
 #include "timeout.h"
 #include "lispbm.h"
 #include "mempools.h"
+#include "packet.h"
 #include "stm32f4xx_conf.h"
 #include "lbm_prof.h"
+#include "lbm_image.h"
 #include "utils.h"
 
 #define LBM_MEMORY_SIZE_28K LBM_MEMORY_SIZE_64BYTES_TIMES_X(448)
 #define LBM_MEMORY_BITMAP_SIZE_28K LBM_MEMORY_BITMAP_SIZE(448)
 
 #ifndef EXTENSION_STORAGE_SIZE
-#define EXTENSION_STORAGE_SIZE		300
+#define EXTENSION_STORAGE_SIZE		320
 #endif
 
 #ifndef ADC_SAMPLE_MAX_LEN
@@ -58,6 +60,9 @@ __attribute__((section(".ram4"))) static uint32_t bitmap_array[LISP_MEM_BITMAP_S
 __attribute__((section(".ram4"))) static lbm_extension_t extension_storage[EXTENSION_STORAGE_SIZE];
 __attribute__((section(".ram4"))) static lbm_prof_t prof_data[PROF_DATA_NUM];
 static volatile bool prof_running = false;
+#ifdef LBM_USE_PROF_STATS
+static lbm_prof_ext_t *prof_ext_data = 0;
+#endif
 
 static lbm_string_channel_state_t string_tok_state;
 static lbm_char_channel_t string_tok;
@@ -138,6 +143,64 @@ static void print_ctx_info(eval_context_t *ctx, void *arg1, void *arg2) {
 	commands_printf_lisp("Result%s: %s", print_ret ? "" : " (trunc)", output);
 }
 
+#ifdef LBM_USE_PROF_STATS
+typedef struct {
+	uint8_t *buffer;
+	int32_t *ind;
+	uint16_t num;
+	uint16_t total;
+} prof_report_t;
+
+static void prof_report_ctx(eval_context_t *ctx, void *arg1, void *arg2) {
+	(void) arg2;
+	prof_report_t *r = (prof_report_t*)arg1;
+
+	r->total++;
+	if (*r->ind > 300) {
+		return;
+	}
+
+	char name[LBM_PROF_MAX_NAME_SIZE] = {0};
+	if (ctx->name) {
+		strncpy(name, ctx->name, sizeof(name) - 1);
+	}
+
+	buffer_append_int32(r->buffer, ctx->id, r->ind);
+	strcpy((char*)(r->buffer + *r->ind), name);
+	*r->ind += strlen(name) + 1;
+	buffer_append_uint32(r->buffer, ctx->stats.steps, r->ind);
+	buffer_append_float32_auto(r->buffer, (float)ctx->stats.run_us * 1e-6, r->ind);
+	buffer_append_float32_auto(r->buffer, (float)ctx->stats.blocked_us * 1e-6, r->ind);
+	buffer_append_uint32(r->buffer, ctx->stats.cells, r->ind);
+	buffer_append_uint32(r->buffer, ctx->stats.gc_num, r->ind);
+	buffer_append_uint16(r->buffer, ctx->stats.mail_max, r->ind);
+	r->num++;
+}
+
+#define PROF_QUEUE_NAME_MAX		11
+#define PROF_QUEUE_ENTRY_MAX	(PROF_QUEUE_NAME_MAX + 1 + 8)
+#define PROF_QUEUE_RESERVE		(1 + 5 * PROF_QUEUE_ENTRY_MAX)
+
+static void prof_report_queue(uint8_t *buffer, int32_t *ind, const char *name,
+		uint32_t size, uint32_t dropped, uint32_t max_used) {
+	int name_len = strnlen(name, PROF_QUEUE_NAME_MAX);
+	memcpy(buffer + *ind, name, name_len);
+	*ind += name_len;
+	buffer[(*ind)++] = '\0';
+	buffer_append_uint16(buffer, size, ind);
+	buffer_append_uint32(buffer, dropped, ind);
+	buffer_append_uint16(buffer, max_used, ind);
+}
+
+static void prof_ext_start(void) {
+	if (!prof_ext_data) {
+		prof_ext_data = lbm_malloc(EXTENSION_STORAGE_SIZE * sizeof(lbm_prof_ext_t));
+	}
+	lbm_prof_ext_init(prof_ext_data, prof_ext_data ? EXTENSION_STORAGE_SIZE : 0);
+	lbm_prof_stats_reset();
+}
+#endif
+
 static void sym_it(const char *str) {
 	bool sym_name_flash = lbm_symbol_in_flash((char *)str);
 	bool sym_entry_flash = lbm_symbol_list_entry_in_flash((char *)str);
@@ -277,6 +340,91 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 		mempools_free_packet_buffer(send_buffer_global);
 	} break;
 
+	case COMM_LISP_GET_PROF: {
+#ifdef LBM_USE_PROF_STATS
+		/*
+		 * Request: [ext_start:u16]
+		 * Reply:   [ctx_total:u16][ctx_num:u16] ctx_num * [cid:i32][name:str][steps:u32]
+		 *          [run_s:f32][blocked_s:f32][cells:u32][gc:u32][mail_max:u16]
+		 *          [ext_num:u16] ext_num * [ix:u16][name:str][calls:u32][time_s:f32]
+		 *          [ext_next:i16], -1 when all called extensions have been sent.
+		 *          [queue_num:u8] queue_num * [name:str][size:u16][dropped:u32][max_used:u16]
+		 *          The first queue is the shared event queue.
+		 */
+		int32_t ind = 0;
+		uint16_t ext_start = 0;
+		if (len >= 2) {
+			ext_start = buffer_get_uint16(data, &ind);
+		}
+
+		if (!pause_eval(0, 2000)) {
+			break;
+		}
+
+		uint8_t *send_buffer_global = mempools_get_packet_buffer();
+		ind = 0;
+		send_buffer_global[ind++] = packet_id;
+
+		int32_t ind_ctx = ind;
+		ind += 4;
+		prof_report_t r = {send_buffer_global, &ind, 0, 0};
+		lbm_all_ctxs_iterator(prof_report_ctx, &r, NULL);
+		buffer_append_uint16(send_buffer_global, r.total, &ind_ctx);
+		buffer_append_uint16(send_buffer_global, r.num, &ind_ctx);
+
+		int32_t ind_ext = ind;
+		ind += 2;
+		uint16_t ext_num = 0;
+		int16_t ext_next = -1;
+		lbm_uint ext_max = lbm_get_max_extensions();
+		if (ext_max > lbm_prof_ext_num) {
+			ext_max = lbm_prof_ext_num;
+		}
+		for (lbm_uint i = ext_start; i < ext_max; i++) {
+			lbm_prof_ext_t *p = &lbm_prof_ext_data[i];
+			if (p->calls == 0 || !extension_table[i].name) {
+				continue;
+			}
+
+			int name_len = strlen(extension_table[i].name);
+			if ((ind + name_len + 13) > (PACKET_MAX_PL_LEN - 10 - PROF_QUEUE_RESERVE)) {
+				ext_next = i;
+				break;
+			}
+
+			buffer_append_uint16(send_buffer_global, i, &ind);
+			strcpy((char*)(send_buffer_global + ind), extension_table[i].name);
+			ind += name_len + 1;
+			buffer_append_uint32(send_buffer_global, p->calls, &ind);
+			buffer_append_float32_auto(send_buffer_global, (float)p->time_us * 1e-6, &ind);
+			ext_num++;
+		}
+		buffer_append_uint16(send_buffer_global, ext_num, &ind_ext);
+		buffer_append_int16(send_buffer_global, ext_next, &ind);
+
+		int32_t ind_queue = ind++;
+		uint8_t queue_num = 0;
+		uint32_t dropped, max_used;
+		uint32_t size = lbm_event_stats(&dropped, &max_used);
+		prof_report_queue(send_buffer_global, &ind, "events", size, dropped, max_used);
+		queue_num++;
+		lbm_event_queue_t *q = lbm_event_queue_first();
+		while (q && (ind + PROF_QUEUE_ENTRY_MAX) <= PACKET_MAX_PL_LEN) {
+			if (q->active) {
+				prof_report_queue(send_buffer_global, &ind, q->name, q->size, q->dropped, q->max_used);
+				queue_num++;
+			}
+			q = q->next;
+		}
+		send_buffer_global[ind_queue] = queue_num;
+
+		lbm_continue_eval();
+
+		reply_func(send_buffer_global, ind);
+		mempools_free_packet_buffer(send_buffer_global);
+#endif
+	} break;
+
 	case COMM_LISP_REPL_CMD: {
 		if (UTILS_AGE_S(repl_time) <= 0.5) {
 			return;
@@ -362,6 +510,9 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 				commands_printf_lisp("Used cells: %d\n", const_heap.next);
 				commands_printf_lisp("Free cells: %d\n", const_heap.size / 4 - const_heap.next);
 			} else if (strncmp(str, ":prof start", 11) == 0) {
+#ifdef LBM_USE_PROF_STATS
+				prof_ext_start();
+#endif
 				if (prof_running) {
 					lbm_prof_init(prof_data, PROF_DATA_NUM);
 					commands_printf_lisp("Profiler restarted\n");
@@ -656,6 +807,11 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 
 	restart_cnt++;
 	prof_running = false;
+#ifdef LBM_USE_PROF_STATS
+	// The storage is in lbm_memory, which is cleared on restart
+	lbm_prof_ext_init(0, 0);
+	prof_ext_data = 0;
+#endif
 	string_tok_valid = false;
 
 	char *code_data = (char*)flash_helper_code_data(CODE_IND_LISP);
@@ -712,9 +868,13 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 			ext_load_callbacks[i]();
 		}
 
+		// The code is either source or an image from read-image. In both
+		// cases the imports start after a terminating zero.
 		int code_chars = 0;
+		int image_size = 0;
 		if (code_data) {
-			code_chars = strnlen(code_data, code_len);
+			image_size = lbm_image_size((uint8_t*)code_data, code_len);
+			code_chars = image_size > 0 ? image_size : (int)strnlen(code_data, code_len);
 		}
 
 		if (code_data == 0) {
@@ -748,12 +908,20 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 		}
 
 		if (load_code) {
-			if (print) {
-				commands_printf_lisp("Parsing %d characters", code_chars);
-			}
+			if (image_size > 0) {
+				if (print) {
+					commands_printf_lisp("Loading image of %d bytes", image_size);
+				}
+
+				lbm_load_and_eval_image(code_data, image_size, "main-u");
+			} else {
+				if (print) {
+					commands_printf_lisp("Parsing %d characters", code_chars);
+				}
 
-			lbm_create_string_char_channel(&string_tok_state, &string_tok, code_data);
-			lbm_load_and_eval_program_incremental(&string_tok, "main-u");
+				lbm_create_string_char_channel(&string_tok_state, &string_tok, code_data);
+				lbm_load_and_eval_program_incremental(&string_tok, "main-u");
+			}
 		}
 
 		lbm_continue_eval();
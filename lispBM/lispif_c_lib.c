@@ -655,6 +655,28 @@ static void lib_sem_reset(lib_semaphore s) {
 	chSemReset((semaphore_t*)s, 0);
 }
 
+static bool lib_foc_set_control_hook(foc_hook_fun hook, void *arg, int div, float budget_us) {
+	if (hook != NULL && (!utils_is_func_valid(hook) || div < 1 || budget_us <= 0.0)) {
+		return false;
+	}
+
+	mcpwm_foc_set_control_hook(hook, arg, div, budget_us * 1e-6);
+	return true;
+}
+
+static float lib_foc_control_hook_max_time_us(bool reset) {
+	return mcpwm_foc_get_control_hook_max_time(reset) * 1e6;
+}
+
+// The hook runs from the FOC interrupt, so it has to be removed before the
+// library code it points to goes away.
+static void lib_remove_control_hook(uint32_t addr_start, uint32_t addr_end) {
+	uint32_t hook = (uint32_t)mcpwm_foc_get_control_hook();
+	if (hook >= addr_start && hook < addr_end) {
+		mcpwm_foc_set_control_hook(NULL, NULL, 1, 0.0);
+	}
+}
+
 static remote_state lib_get_remote_state(void) {
 	remote_state res;
 	res.js_x = app_nunchuk_get_decoded_x();
@@ -1023,6 +1045,11 @@ lbm_value ext_load_native_lib(lbm_value *args, lbm_uint argn) {
 		cif.cif.sem_wait_to = lib_sem_wait_to;
 		cif.cif.sem_reset = lib_sem_reset;
 
+		// FOC control hook
+		cif.cif.foc_set_control_hook = lib_foc_set_control_hook;
+		cif.cif.foc_control_hook_overrun = mcpwm_foc_control_hook_overrun;
+		cif.cif.foc_control_hook_max_time_us = lib_foc_control_hook_max_time_us;
+
 		lib_init_done = true;
 	}
 
@@ -1072,6 +1099,8 @@ lbm_value ext_unload_native_lib(lbm_value *args, lbm_uint argn) {
 	lbm_array_header_t *array = (lbm_array_header_t *)lbm_car(args[0]);
 	uint32_t addr = (uint32_t)array->data;
 
+	lib_remove_control_hook(addr, addr + array->size);
+
 	bool ok = false;
 	for (int i = 0;i < LIB_NUM_MAX;i++) {
 		if (loaded_libs[i].stop_fun != NULL && loaded_libs[i].base_addr == addr) {
@@ -1090,6 +1119,8 @@ lbm_value ext_unload_native_lib(lbm_value *args, lbm_uint argn) {
 }
 
 void lispif_stop_lib(void) {
+	mcpwm_foc_set_control_hook(NULL, NULL, 1, 0.0);
+
 	for (int i = 0;i < LIB_NUM_MAX;i++) {
 		if (loaded_libs[i].stop_fun != NULL) {
 			loaded_libs[i].stop_fun(loaded_libs[i].arg);
@@ -27,6 +27,7 @@
 #include "extensions/math_extensions.h"
 #include "extensions/string_extensions.h"
 #include "extensions/mutex_extensions.h"
+#include "extensions/hashmap_extensions.h"
 #include "extensions/lbm_dyn_lib.h"
 #include "lbm_constants.h"
 #include "lbm_vesc_utils.h"
@@ -60,6 +61,7 @@
 #include "app.h"
 #include "comm_usb.h"
 #include "flash_helper.h"
+#include "digital_filter.h"
 
 #include <math.h>
 #include <ctype.h>
@@ -191,6 +193,12 @@ typedef struct {
 	lbm_uint foc_fw_current_max;
 	lbm_uint foc_fw_duty_start;
 	lbm_uint foc_short_ls_on_zero_duty;
+	lbm_uint sp_pid_loop_in_isr;
+	lbm_uint p_pid_traj_vel_max;
+	lbm_uint p_pid_traj_acc_max;
+	lbm_uint p_pid_traj_jerk_max;
+	lbm_uint p_pid_traj_ff_vel;
+	lbm_uint p_pid_traj_ff_acc;
 	lbm_uint m_invert_direction;
 	lbm_uint m_out_aux_mode;
 	lbm_uint m_motor_temp_sens_type;
@@ -260,6 +268,10 @@ typedef struct {
 	// Arrays
 	lbm_uint copy;
 	lbm_uint mut;
+
+	// Filters
+	lbm_uint lowpass;
+	lbm_uint highpass;
 	
 	// Other
 	lbm_uint half_duplex;
@@ -513,6 +525,18 @@ static bool compare_symbol(lbm_uint sym, lbm_uint *comp) {
 			lbm_add_symbol_const("foc-fw-duty-start", comp);
 		} else if (comp == &syms_vesc.foc_short_ls_on_zero_duty) {
 			lbm_add_symbol_const("foc-short-ls-on-zero-duty", comp);
+		} else if (comp == &syms_vesc.sp_pid_loop_in_isr) {
+			lbm_add_symbol_const("sp-pid-loop-in-isr", comp);
+		} else if (comp == &syms_vesc.p_pid_traj_vel_max) {
+			lbm_add_symbol_const("p-pid-traj-vel-max", comp);
+		} else if (comp == &syms_vesc.p_pid_traj_acc_max) {
+			lbm_add_symbol_const("p-pid-traj-acc-max", comp);
+		} else if (comp == &syms_vesc.p_pid_traj_jerk_max) {
+			lbm_add_symbol_const("p-pid-traj-jerk-max", comp);
+		} else if (comp == &syms_vesc.p_pid_traj_ff_vel) {
+			lbm_add_symbol_const("p-pid-traj-ff-vel", comp);
+		} else if (comp == &syms_vesc.p_pid_traj_ff_acc) {
+			lbm_add_symbol_const("p-pid-traj-ff-acc", comp);
 		} else if (comp == &syms_vesc.m_invert_direction) {
 			lbm_add_symbol_const("m-invert-direction", comp);
 		} else if (comp == &syms_vesc.m_out_aux_mode) {
@@ -645,6 +669,12 @@ static bool compare_symbol(lbm_uint sym, lbm_uint *comp) {
 			lbm_add_symbol_const("mut", comp);
 		}
 
+		else if (comp == &syms_vesc.lowpass) {
+			lbm_add_symbol_const("lowpass", comp);
+		} else if (comp == &syms_vesc.highpass) {
+			lbm_add_symbol_const("highpass", comp);
+		}
+
 		else if (comp == &syms_vesc.half_duplex) {
 			lbm_add_symbol_const("half-duplex", comp);
 		}
@@ -3428,6 +3458,7 @@ static lbm_value ext_conf_set(lbm_value *args, lbm_uint argn) {
 	int changed_app = 0;
 
 	mc_configuration *mcconf = (mc_configuration*)mc_interface_get_configuration();
+	mc_local_configuration *conf_local = (mc_local_configuration*)mc_interface_get_local_configuration();
 	app_configuration *appconf = (app_configuration*)app_get_configuration();
 
 	const float speed_fact = ((mcconf->si_motor_poles / 2.0) * 60.0 *
@@ -3559,6 +3590,24 @@ static lbm_value ext_conf_set(lbm_value *args, lbm_uint argn) {
 	} else if (compare_symbol(name, &syms_vesc.foc_short_ls_on_zero_duty)) {
 		mcconf->foc_short_ls_on_zero_duty = lbm_dec_as_i32(args[1]);
 		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.sp_pid_loop_in_isr)) {
+		conf_local->sp_pid_loop_in_isr = lbm_dec_as_i32(args[1]);
+		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_vel_max)) {
+		conf_local->p_pid_traj_vel_max = lbm_dec_as_float(args[1]);
+		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_acc_max)) {
+		conf_local->p_pid_traj_acc_max = lbm_dec_as_float(args[1]);
+		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_jerk_max)) {
+		conf_local->p_pid_traj_jerk_max = lbm_dec_as_float(args[1]);
+		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_ff_vel)) {
+		conf_local->p_pid_traj_ff_vel = lbm_dec_as_float(args[1]);
+		changed_mc = 1;
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_ff_acc)) {
+		conf_local->p_pid_traj_ff_acc = lbm_dec_as_float(args[1]);
+		changed_mc = 1;
 	} else if (compare_symbol(name, &syms_vesc.controller_id)) {
 		appconf->controller_id = lbm_dec_as_i32(args[1]);
 		changed_app = 1;
@@ -3800,12 +3849,15 @@ static lbm_value ext_conf_get(lbm_value *args, lbm_uint argn) {
 	lbm_uint name = lbm_dec_sym(args[0]);
 
 	mc_configuration *mcconf;
+	mc_local_configuration *conf_local;
 	app_configuration *appconf;
 
 	if (defaultcfg) {
 		mcconf = mempools_alloc_mcconf();
+		conf_local = mempools_alloc_mc_local();
 		appconf = mempools_alloc_appconf();
 		confgenerator_set_defaults_mcconf(mcconf);
+		conf_general_set_defaults_mc_local(conf_local);
 		confgenerator_set_defaults_appconf(appconf);
 
 		if (defaultcfg == 2) {
@@ -3862,6 +3914,7 @@ static lbm_value ext_conf_get(lbm_value *args, lbm_uint argn) {
 		}
 	} else {
 		mcconf = (mc_configuration*)mc_interface_get_configuration();
+		conf_local = (mc_local_configuration*)mc_interface_get_local_configuration();
 		appconf = (app_configuration*)app_get_configuration();
 	}
 
@@ -4002,6 +4055,18 @@ static lbm_value ext_conf_get(lbm_value *args, lbm_uint argn) {
 		res = lbm_enc_float(mcconf->foc_fw_duty_start);
 	} else if (compare_symbol(name, &syms_vesc.foc_short_ls_on_zero_duty)) {
 		res = lbm_enc_i(mcconf->foc_short_ls_on_zero_duty);
+	} else if (compare_symbol(name, &syms_vesc.sp_pid_loop_in_isr)) {
+		res = lbm_enc_i(conf_local->sp_pid_loop_in_isr);
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_vel_max)) {
+		res = lbm_enc_float(conf_local->p_pid_traj_vel_max);
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_acc_max)) {
+		res = lbm_enc_float(conf_local->p_pid_traj_acc_max);
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_jerk_max)) {
+		res = lbm_enc_float(conf_local->p_pid_traj_jerk_max);
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_ff_vel)) {
+		res = lbm_enc_float(conf_local->p_pid_traj_ff_vel);
+	} else if (compare_symbol(name, &syms_vesc.p_pid_traj_ff_acc)) {
+		res = lbm_enc_float(conf_local->p_pid_traj_ff_acc);
 	} else if (compare_symbol(name, &syms_vesc.m_invert_direction)) {
 		res = lbm_enc_i(mcconf->m_invert_direction);
 	} else if (compare_symbol(name, &syms_vesc.m_out_aux_mode)) {
@@ -4074,6 +4139,7 @@ static lbm_value ext_conf_get(lbm_value *args, lbm_uint argn) {
 
 	if (defaultcfg) {
 		mempools_free_mcconf(mcconf);
+		mempools_free_mc_local(conf_local);
 		mempools_free_appconf(appconf);
 	}
 
@@ -4092,6 +4158,11 @@ static lbm_value ext_conf_store(lbm_value *args, lbm_uint argn) {
 	bool res_mc = conf_general_store_mc_configuration(mcconf, mc_interface_get_motor_thread() == 2);
 	mempools_free_mcconf(mcconf);
 
+	mc_local_configuration *conf_local = mempools_alloc_mc_local();
+	*conf_local = *mc_interface_get_local_configuration();
+	res_mc = conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2) && res_mc;
+	mempools_free_mc_local(conf_local);
+
 	app_configuration *appconf = mempools_alloc_appconf();
 	*appconf = *app_get_configuration();
 	bool res_app = conf_general_store_app_configuration(appconf);
@@ -4337,6 +4408,11 @@ static lbm_value ext_conf_restore_mc(lbm_value *args, lbm_uint argn) {
 	mc_interface_set_configuration(mcconf);
 	mempools_free_mcconf(mcconf);
 
+	mc_local_configuration *conf_local = mempools_alloc_mc_local();
+	conf_general_set_defaults_mc_local(conf_local);
+	mc_interface_set_local_configuration(conf_local);
+	mempools_free_mc_local(conf_local);
+
 	return ENC_SYM_TRUE;
 }
 
@@ -4823,6 +4899,43 @@ typedef struct {
 static mutex_t rmsg_mutex;
 static volatile rmsg_state rmsg_slots[RMSG_SLOT_NUM];
 
+// Event queues. CAN and ICU events have a single producer thread each
+// and are sent without locking. Custom app data can arrive from several
+// communication threads, so those producers are serialized with a mutex
+// that the evaluator never takes.
+#define CAN_EVENT_QUEUE_SIZE		32
+#define DATA_RX_EVENT_QUEUE_SIZE	8
+#define ICU_EVENT_QUEUE_SIZE		4
+
+static lbm_event_t can_event_storage[CAN_EVENT_QUEUE_SIZE];
+static lbm_event_t data_rx_event_storage[DATA_RX_EVENT_QUEUE_SIZE];
+static lbm_event_t icu_event_storage[ICU_EVENT_QUEUE_SIZE];
+static lbm_event_queue_t can_event_queue;
+static lbm_event_queue_t data_rx_event_queue;
+static lbm_event_queue_t icu_event_queue;
+static mutex_t data_rx_mutex;
+
+// CAN frames are delivered to LBM as borrowed arrays that point into this
+// pool, so receiving a frame does not allocate from lbm_memory. Slots are
+// taken by the CAN process thread and returned by the evaluator when the
+// array is freed or collected. When the pool is empty the frame is copied
+// into a flat value as before.
+#define CAN_FRAME_POOL_SIZE		CAN_EVENT_QUEUE_SIZE
+
+typedef struct {
+	lbm_array_header_t header; // Must be first
+	uint8_t data[8];
+	uint32_t id;
+	bool is_ext;
+	bool recv;
+	volatile bool used;
+} can_frame_t;
+
+static can_frame_t can_frame_pool[CAN_FRAME_POOL_SIZE];
+static int can_frame_next = 0;
+
+static void can_frame_release(lbm_array_header_t *header);
+
 static THD_FUNCTION(event_thread, arg) {
 	(void)arg;
 	event_tp = chThdGetSelfX();
@@ -4840,7 +4953,9 @@ static THD_FUNCTION(event_thread, arg) {
 				f_i(&v, icu_last_width);
 				f_i(&v, icu_last_period);
 				lbm_finish_flatten(&v);
-				lbm_event(&v);
+				if (!lbm_event_queue_event(&icu_event_queue, &v)) {
+					lbm_free(v.buf);
+				}
 			}
 		}
 
@@ -4855,7 +4970,9 @@ static THD_FUNCTION(event_thread, arg) {
 				f_i(&v, icu_last_width);
 				f_i(&v, icu_last_period);
 				lbm_finish_flatten(&v);
-				lbm_event(&v);
+				if (!lbm_event_queue_event(&icu_event_queue, &v)) {
+					lbm_free(v.buf);
+				}
 			}
 		}
 
@@ -4966,6 +5083,99 @@ static lbm_value ext_crc32(lbm_value *args, lbm_uint argn) {
 	return lbm_enc_u32(crc32_with_init((uint8_t*)array->data, len, lbm_dec_as_u32(args[1])));
 }
 
+/**
+ * signature: (buf-f32-biquad-config coeffs:array type:symbol fc:number)
+ * -> t
+ *
+ * Design a lowpass or highpass biquad with biquad_config and write its
+ * coefficients and a cleared state to coeffs in the layout used by
+ * buf-f32-biquad. fc is the cutoff frequency divided by the sample rate.
+ */
+static lbm_value ext_buf_f32_biquad_config(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN(3);
+
+	lbm_array_header_t *array = lbm_dec_array_rw(args[0]);
+	if (!array || array->size < 28 || !lbm_is_symbol(args[1]) || !lbm_is_number(args[2])) {
+		return ENC_SYM_TERROR;
+	}
+
+	BiquadType type;
+	lbm_uint sym = lbm_dec_sym(args[1]);
+	if (compare_symbol(sym, &syms_vesc.lowpass)) {
+		type = BQ_LOWPASS;
+	} else if (compare_symbol(sym, &syms_vesc.highpass)) {
+		type = BQ_HIGHPASS;
+	} else {
+		lbm_set_error_suspect(args[1]);
+		return ENC_SYM_TERROR;
+	}
+
+	float fc = lbm_dec_as_float(args[2]);
+	if (fc <= 0.0f || fc >= 0.5f) {
+		return ENC_SYM_EERROR;
+	}
+
+	Biquad bq;
+	biquad_config(&bq, type, fc);
+	biquad_reset(&bq);
+
+	uint8_t *data = (uint8_t*)array->data;
+	int32_t ind = 0;
+	buffer_append_float32_auto(data, bq.a0, &ind);
+	buffer_append_float32_auto(data, bq.a1, &ind);
+	buffer_append_float32_auto(data, bq.a2, &ind);
+	buffer_append_float32_auto(data, bq.b1, &ind);
+	buffer_append_float32_auto(data, bq.b2, &ind);
+	buffer_append_float32_auto(data, bq.z1, &ind);
+	buffer_append_float32_auto(data, bq.z2, &ind);
+
+	return ENC_SYM_TRUE;
+}
+
+/**
+ * signature: (buf-f32-fir-lowpass taps:array f-break:number [hamming:bool])
+ * -> t
+ *
+ * Design a lowpass FIR filter with filter_create_fir_lowpass and write the
+ * taps to the array for use with buf-f32-fir. The number of taps is given
+ * by the array size and must be a power of two from 2 to 64.
+ */
+static lbm_value ext_buf_f32_fir_lowpass(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN_RANGE(2, 3);
+
+	lbm_array_header_t *array = lbm_dec_array_rw(args[0]);
+	if (!array || !lbm_is_number(args[1])) {
+		return ENC_SYM_TERROR;
+	}
+
+	int taps = array->size / 4;
+	int bits = 0;
+	while ((1 << bits) < taps) {
+		bits++;
+	}
+
+	if (taps < 2 || taps > 64 || (1 << bits) != taps) {
+		return ENC_SYM_EERROR;
+	}
+
+	bool hamming = argn == 3 ? !lbm_is_symbol_nil(args[2]) : true;
+
+	float *vec = lbm_malloc(taps * sizeof(float));
+	if (!vec) {
+		return ENC_SYM_MERROR;
+	}
+
+	filter_create_fir_lowpass(vec, lbm_dec_as_float(args[1]), bits, hamming);
+
+	int32_t ind = 0;
+	for (int i = 0;i < taps;i++) {
+		buffer_append_float32_auto((uint8_t*)array->data, vec[i], &ind);
+	}
+
+	lbm_free(vec);
+	return ENC_SYM_TRUE;
+}
+
 /**
  * signature: (buf-resize arr:array delta-size:number|nil [new-size:number])
  * -> array
@@ -5258,6 +5468,7 @@ void lispif_load_vesc_extensions(void) {
 
 	if (event_tp == NULL) {
 		chMtxObjectInit(&rmsg_mutex);
+		chMtxObjectInit(&data_rx_mutex);
 
 		chMtxLock(&rmsg_mutex);
 		for (int i = 0;i < RMSG_SLOT_NUM;i++) {
@@ -5269,6 +5480,20 @@ void lispif_load_vesc_extensions(void) {
 		chThdCreateStatic(event_thread_wa, sizeof(event_thread_wa), NORMALPRIO - 2, event_thread, NULL);
 	}
 
+	// The queues are unregistered when the events are initialized on restart
+	lbm_event_queue_init(&can_event_queue, "can", can_event_storage, CAN_EVENT_QUEUE_SIZE);
+	lbm_event_queue_init(&data_rx_event_queue, "data-rx", data_rx_event_storage, DATA_RX_EVENT_QUEUE_SIZE);
+	lbm_event_queue_init(&icu_event_queue, "icu", icu_event_storage, ICU_EVENT_QUEUE_SIZE);
+	lbm_event_queue_add(&can_event_queue);
+	lbm_event_queue_add(&data_rx_event_queue);
+	lbm_event_queue_add(&icu_event_queue);
+
+	// Frames lent to the previous LBM instance are gone with its heap
+	for (int i = 0;i < CAN_FRAME_POOL_SIZE;i++) {
+		can_frame_pool[i].used = false;
+	}
+	lbm_heap_set_array_release_callback(can_frame_release);
+
 #ifdef HW_ADC_EXT_GPIO
 	palSetPadMode(HW_ADC_EXT_GPIO, HW_ADC_EXT_PIN, PAL_MODE_INPUT_ANALOG);
 #endif
@@ -5335,6 +5560,8 @@ void lispif_load_vesc_extensions(void) {
 	lbm_add_extension("crc16", ext_crc16);
 	lbm_add_extension("crc32", ext_crc32);
 	lbm_add_extension("buf-resize", ext_buf_resize);
+	lbm_add_extension("buf-f32-biquad-config", ext_buf_f32_biquad_config);
+	lbm_add_extension("buf-f32-fir-lowpass", ext_buf_f32_fir_lowpass);
 	lbm_add_extension("shutdown-hold", ext_shutdown_hold);
 	lbm_add_extension("const-heap-erase", ext_const_heap_erase);
 
@@ -5559,6 +5786,7 @@ void lispif_load_vesc_extensions(void) {
 	lbm_math_extensions_init();
 	lbm_string_extensions_init();
 	lbm_mutex_extensions_init();
+	lbm_hashmap_extensions_init();
 	lbm_dyn_lib_init();
 
 	lbm_set_dynamic_load_callback(dynamic_loader);
@@ -5581,6 +5809,84 @@ static bool start_flatten_with_gc(lbm_flat_value_t *v, size_t buffer_size) {
 	return lbm_start_flatten(v, buffer_size);
 }
 
+static void can_frame_release(lbm_array_header_t *header) {
+	can_frame_t *f = (can_frame_t*)header;
+	if (f >= can_frame_pool && f < can_frame_pool + CAN_FRAME_POOL_SIZE) {
+		f->used = false;
+	}
+}
+
+static can_frame_t *can_frame_get(void) {
+	for (int i = 0;i < CAN_FRAME_POOL_SIZE;i++) {
+		can_frame_t *f = &can_frame_pool[can_frame_next];
+		can_frame_next = (can_frame_next + 1) % CAN_FRAME_POOL_SIZE;
+		if (!f->used) {
+			f->used = true;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+// Runs in the evaluator. The frame is borrowed last, so that nothing
+// refers to it when an allocation fails.
+static lbm_value can_frame_build(lbm_uint arg, bool retry) {
+	can_frame_t *f = &can_frame_pool[arg];
+	lbm_value id = lbm_enc_i32(f->id);
+	lbm_value res = ENC_SYM_MERROR;
+	lbm_value arr;
+
+	if (!lbm_is_symbol_merror(id)) {
+		if (f->recv) {
+			// (id data)
+			res = lbm_heap_allocate_list_init(2, id, ENC_SYM_NIL);
+			if (lbm_is_cons(res) && lbm_heap_borrow_array(&arr, &f->header)) {
+				lbm_set_car(lbm_cdr(res), arr);
+				return res;
+			}
+		} else {
+			// (event-can-sid id . data)
+			res = lbm_heap_allocate_list_init(2,
+					lbm_enc_sym(f->is_ext ? sym_event_can_eid : sym_event_can_sid), id);
+			if (lbm_is_cons(res) && lbm_heap_borrow_array(&arr, &f->header)) {
+				lbm_set_cdr(lbm_cdr(res), arr);
+				return res;
+			}
+		}
+	}
+
+	if (retry) {
+		f->used = false;
+	}
+	return ENC_SYM_MERROR;
+}
+
+// Returns false when the frame has to be copied instead
+static bool can_frame_send(lbm_cid cid, uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
+	if (len < 0 || len > (int)sizeof(can_frame_pool[0].data)) {
+		return false;
+	}
+
+	can_frame_t *f = can_frame_get();
+	if (!f) {
+		return false;
+	}
+
+	memcpy(f->data, data8, len);
+	f->header.data = (lbm_uint*)f->data;
+	f->header.size = len;
+	f->id = can_id;
+	f->is_ext = is_ext;
+	f->recv = cid >= 0;
+
+	if (!lbm_event_queue_build(&can_event_queue, cid, can_frame_build, f - can_frame_pool)) {
+		// Dropped. Copying would not help as it goes through the same queue.
+		f->used = false;
+	}
+
+	return true;
+}
+
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 	if (is_ext) {
 		if (can_recv_eid_cid < 0 && !event_can_eid_en)  {
@@ -5592,6 +5898,18 @@ void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 		}
 	}
 
+	lbm_cid cid = is_ext ? can_recv_eid_cid : can_recv_sid_cid;
+	if (can_frame_send(cid, can_id, data8, len, is_ext)) {
+		if (cid >= 0) {
+			if (is_ext) {
+				can_recv_eid_cid = -1;
+			} else {
+				can_recv_sid_cid = -1;
+			}
+		}
+		return;
+	}
+
 	lbm_flat_value_t v;
 	if (start_flatten_with_gc(&v, 50 + len)) {
 		f_cons(&v);
@@ -5611,17 +5929,17 @@ void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 		lbm_finish_flatten(&v);
 
 		if (can_recv_sid_cid >= 0 && !is_ext) {
-			if (!lbm_unblock_ctx(can_recv_sid_cid, &v)) {
+			if (!lbm_event_queue_unblock_ctx(&can_event_queue, can_recv_sid_cid, &v)) {
 				lbm_free(v.buf);
 			}
 			can_recv_sid_cid = -1;
 		} else if (can_recv_eid_cid >= 0 && is_ext) {
-			if (!lbm_unblock_ctx(can_recv_eid_cid, &v)) {
+			if (!lbm_event_queue_unblock_ctx(&can_event_queue, can_recv_eid_cid, &v)) {
 				lbm_free(v.buf);
 			}
 			can_recv_eid_cid = -1;
 		} else {
-			if (!lbm_event(&v)) {
+			if (!lbm_event_queue_event(&can_event_queue, &v)) {
 				lbm_free(v.buf);
 			}
 		}
@@ -5642,16 +5960,18 @@ void lispif_process_custom_app_data(unsigned char *data, unsigned int len) {
 		f_lbm_array(&v, len, data);
 		lbm_finish_flatten(&v);
 
+		chMtxLock(&data_rx_mutex);
 		if (recv_data_cid >= 0) {
-			if (!lbm_unblock_ctx(recv_data_cid, &v)) {
+			if (!lbm_event_queue_unblock_ctx(&data_rx_event_queue, recv_data_cid, &v)) {
 				lbm_free(v.buf);
 			}
 			recv_data_cid = -1;
 		} else {
-			if (!lbm_event(&v)) {
+			if (!lbm_event_queue_event(&data_rx_event_queue, &v)) {
 				lbm_free(v.buf);
 			}
 		}
+		chMtxUnlock(&data_rx_mutex);
 	}
 }
 
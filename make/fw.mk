@@ -10,7 +10,7 @@ ifeq ($(USE_OPT),)
   USE_OPT = -O2 -ggdb -fomit-frame-pointer -falign-functions=16 -std=gnu99 -D_GNU_SOURCE
   USE_OPT += -DBOARD_OTG_NOVBUSSENS $(build_args)
   USE_OPT += -DLBM_USE_DYN_FUNS -DLBM_USE_DYN_MACROS -DLBM_USE_DYN_LOOPS -DLBM_USE_TIME_QUOTA
-  USE_OPT += -DLBM_USE_ERROR_LINENO
+  USE_OPT += -DLBM_USE_ERROR_LINENO -DLBM_USE_PROF_STATS
 #  USE_OPT += -DUSE_GC_PTR_REV
   USE_OPT += -fsingle-precision-constant -Wdouble-promotion -specs=nosys.specs
 endif
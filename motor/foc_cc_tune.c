@@ -0,0 +1,279 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "foc_cc_tune.h"
+#include "utils_math.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Set up the multi-sine used for tuning the current controller. The tones are
+ * log spaced integer harmonics of one period, from below the electrical
+ * corner frequency of most motors up to a tenth of the sample rate. Each tone
+ * gets the voltage that gives about the same current based on the R and L
+ * from the motor detection.
+ *
+ * @param s
+ * The tuning state.
+ *
+ * @param r
+ * Motor resistance from the detection.
+ *
+ * @param l
+ * Motor inductance from the detection.
+ *
+ * @param dt
+ * Sample time.
+ *
+ * @param current
+ * Peak current of all tones together.
+ *
+ * @param v_max
+ * Maximum voltage of all tones together.
+ */
+void foc_cc_tune_init(foc_cc_tune_state *s, float r, float l, float dt, float current, float v_max) {
+	memset(s, 0, sizeof(foc_cc_tune_state));
+
+	const float h_min = 3.0;
+	const float h_max = (float)FOC_CC_TUNE_PERIOD / 10.0;
+	const float i_tone = current / (float)FOC_CC_TUNE_TONES;
+	float v_sum = 0.0;
+
+	for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+		int h = (int)roundf(h_min * powf(h_max / h_min, (float)k / (float)(FOC_CC_TUNE_TONES - 1)));
+		if (k > 0 && h <= s->harm[k - 1]) {
+			h = s->harm[k - 1] + 1;
+		}
+		s->harm[k] = h;
+
+		const float w = 2.0 * M_PI * (float)h / ((float)FOC_CC_TUNE_PERIOD * dt);
+		s->amp[k] = i_tone * sqrtf(SQ(r) + SQ(w * l));
+		v_sum += s->amp[k];
+
+		// Schroeder phases keep the crest factor low
+		const float ph = -M_PI * (float)(k * (k - 1)) / (float)FOC_CC_TUNE_TONES;
+		utils_fast_sincos_better(ph, &s->phase_sin[k], &s->phase_cos[k]);
+	}
+
+	if (v_sum > v_max) {
+		for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+			s->amp[k] *= v_max / v_sum;
+		}
+	}
+}
+
+/**
+ * Get the voltage to inject at the present sample. Has to be followed by
+ * foc_cc_tune_sample for the same sample.
+ *
+ * @param s
+ * The tuning state.
+ *
+ * @return
+ * The voltage.
+ */
+float foc_cc_tune_signal(foc_cc_tune_state *s) {
+	float out = 0.0;
+
+	for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+		const int ind = (s->harm[k] * s->n) % FOC_CC_TUNE_PERIOD;
+		const float ang = (2.0 * M_PI / (float)FOC_CC_TUNE_PERIOD) * (float)ind;
+		utils_fast_sincos_better(ang, &s->s[k], &s->c[k]);
+		out += s->amp[k] * (s->c[k] * s->phase_cos[k] - s->s[k] * s->phase_sin[k]);
+	}
+
+	return out;
+}
+
+/**
+ * Record the applied voltage and the measured current for the present
+ * sample. Only whole periods are recorded, so the tones fall exactly into
+ * their frequency bins and the rest of the control loop does not leak in.
+ *
+ * @param s
+ * The tuning state.
+ *
+ * @param v
+ * The total voltage that was applied on the injection axis, including the
+ * output of the current controller.
+ *
+ * @param i
+ * The current that was measured on the injection axis.
+ *
+ * @param dt
+ * Sample time.
+ */
+void foc_cc_tune_sample(foc_cc_tune_state *s, float v, float i, float dt) {
+	if (s->periods >= FOC_CC_TUNE_SKIP && !foc_cc_tune_done(s)) {
+		for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+			s->v_re[k] += v * s->c[k];
+			s->v_im[k] -= v * s->s[k];
+			s->i_re[k] += i * s->c[k];
+			s->i_im[k] -= i * s->s[k];
+		}
+
+		s->t_rec += dt;
+	}
+
+	s->n++;
+	if (s->n >= FOC_CC_TUNE_PERIOD) {
+		s->n = 0;
+		s->periods++;
+	}
+}
+
+bool foc_cc_tune_done(const foc_cc_tune_state *s) {
+	return s->periods >= (FOC_CC_TUNE_SKIP + FOC_CC_TUNE_RECORD);
+}
+
+/**
+ * Fit R + sL with a time delay to the recorded response. The magnitude of
+ * the impedance gives R and L and the phase that is left gives the delay,
+ * which includes the computation delay, the PWM update, dead time effects
+ * and current sensor filters.
+ *
+ * @param s
+ * The tuning state after the recording is done.
+ *
+ * @param r
+ * Fitted resistance.
+ *
+ * @param l
+ * Fitted inductance.
+ *
+ * @param delay
+ * Fitted delay in seconds.
+ *
+ * @return
+ * True if the fit succeeded.
+ */
+bool foc_cc_tune_fit(const foc_cc_tune_state *s, float *r, float *l, float *delay) {
+	if (!foc_cc_tune_done(s) || s->t_rec <= 0.0) {
+		return false;
+	}
+
+	const float dt = s->t_rec / (float)(FOC_CC_TUNE_RECORD * FOC_CC_TUNE_PERIOD);
+	const float w_max = 2.0 * M_PI * (float)s->harm[FOC_CC_TUNE_TONES - 1] / ((float)FOC_CC_TUNE_PERIOD * dt);
+
+	float w[FOC_CC_TUNE_TONES];
+	float z_re[FOC_CC_TUNE_TONES];
+	float z_im[FOC_CC_TUNE_TONES];
+
+	// Least squares fit of |Z|^2 = R^2 + w^2 * L^2, relative to |Z|^2 and
+	// with the frequency normalized to keep the numbers reasonable.
+	float s11 = 0.0, s12 = 0.0, s22 = 0.0, y1 = 0.0, y2 = 0.0;
+
+	for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+		const float i_mag2 = SQ(s->i_re[k]) + SQ(s->i_im[k]);
+		if (i_mag2 < 1e-20) {
+			return false;
+		}
+
+		w[k] = 2.0 * M_PI * (float)s->harm[k] / ((float)FOC_CC_TUNE_PERIOD * dt);
+		z_re[k] = (s->v_re[k] * s->i_re[k] + s->v_im[k] * s->i_im[k]) / i_mag2;
+		z_im[k] = (s->v_im[k] * s->i_re[k] - s->v_re[k] * s->i_im[k]) / i_mag2;
+
+		const float z2 = SQ(z_re[k]) + SQ(z_im[k]);
+		const float x = SQ(w[k] / w_max);
+		const float wt = 1.0 / SQ(z2);
+		s11 += wt;
+		s12 += wt * x;
+		s22 += wt * SQ(x);
+		y1 += wt * z2;
+		y2 += wt * x * z2;
+	}
+
+	const float det = s11 * s22 - SQ(s12);
+	if (fabsf(det) < 1e-30) {
+		return false;
+	}
+
+	const float r2 = (s22 * y1 - s12 * y2) / det;
+	const float l2 = (s11 * y2 - s12 * y1) / det / SQ(w_max);
+
+	if (l2 <= 0.0) {
+		return false;
+	}
+
+	*r = r2 > 0.0 ? sqrtf(r2) : 0.0;
+	*l = sqrtf(l2);
+
+	// The phase of the impedance above that of R + sL is the delay. Unwrap
+	// it from low to high frequency, as it can go beyond pi at the top.
+	float num = 0.0, den = 0.0, ph_last = 0.0;
+	for (int k = 0;k < FOC_CC_TUNE_TONES;k++) {
+		const float ph_raw = atan2f(z_im[k], z_re[k]) - atan2f(w[k] * *l, *r);
+		const float ph = ph_last + utils_angle_difference_rad(ph_raw, ph_last);
+		ph_last = ph;
+		num += w[k] * ph;
+		den += SQ(w[k]);
+	}
+
+	*delay = num / den;
+
+	return !UTILS_IS_NAN(*delay) && *delay > 0.0;
+}
+
+/**
+ * Calculate PI gains that cancel the electrical pole, which gives the open
+ * loop kp / (L * s) * e^(-s * delay). The crossover frequency is then kp / L
+ * and the phase margin is pi / 2 minus the crossover frequency times the
+ * delay. With no delay this is the same as conf_general_calc_apply_foc_cc_kp_ki_gain.
+ *
+ * @param r
+ * Motor resistance.
+ *
+ * @param l
+ * Motor inductance.
+ *
+ * @param delay
+ * Loop delay in seconds.
+ *
+ * @param bw
+ * Requested bandwidth in rad/s. 0 gives the highest bandwidth that meets the
+ * phase margin, which also limits higher requests.
+ *
+ * @param pm
+ * Phase margin in radians.
+ *
+ * @param kp
+ * Proportional gain.
+ *
+ * @param ki
+ * Integral gain.
+ *
+ * @return
+ * The bandwidth that was used, in rad/s.
+ */
+float foc_cc_tune_gains(float r, float l, float delay, float bw, float pm, float *kp, float *ki) {
+	utils_truncate_number(&pm, 0.0, M_PI / 2.0 - 0.01);
+
+	if (delay > 0.0) {
+		const float bw_max = (M_PI / 2.0 - pm) / delay;
+		if (bw <= 0.0 || bw > bw_max) {
+			bw = bw_max;
+		}
+	}
+
+	*kp = l * bw;
+	*ki = r * bw;
+
+	return bw;
+}
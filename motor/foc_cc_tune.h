@@ -0,0 +1,58 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef FOC_CC_TUNE_H_
+#define FOC_CC_TUNE_H_
+
+#include <stdbool.h>
+
+// Tones in the multi-sine and samples in one period of it
+#define FOC_CC_TUNE_TONES		8
+#define FOC_CC_TUNE_PERIOD		2000
+
+// Periods to let the response settle and periods to record
+#define FOC_CC_TUNE_SKIP		2
+#define FOC_CC_TUNE_RECORD		8
+
+typedef struct {
+	int harm[FOC_CC_TUNE_TONES]; // Tone frequencies in cycles per period
+	float amp[FOC_CC_TUNE_TONES]; // Tone voltage amplitudes
+	float phase_sin[FOC_CC_TUNE_TONES]; // Tone phase offsets
+	float phase_cos[FOC_CC_TUNE_TONES];
+	float s[FOC_CC_TUNE_TONES]; // Tone angles at the present sample
+	float c[FOC_CC_TUNE_TONES];
+	float v_re[FOC_CC_TUNE_TONES]; // Voltage and current spectra
+	float v_im[FOC_CC_TUNE_TONES];
+	float i_re[FOC_CC_TUNE_TONES];
+	float i_im[FOC_CC_TUNE_TONES];
+	int n; // Sample within the period
+	int periods; // Completed periods
+	float t_rec; // Recorded time
+} foc_cc_tune_state;
+
+// Functions
+void foc_cc_tune_init(foc_cc_tune_state *s, float r, float l, float dt, float current, float v_max);
+float foc_cc_tune_signal(foc_cc_tune_state *s);
+void foc_cc_tune_sample(foc_cc_tune_state *s, float v, float i, float dt);
+bool foc_cc_tune_done(const foc_cc_tune_state *s);
+bool foc_cc_tune_fit(const foc_cc_tune_state *s, float *r, float *l, float *delay);
+float foc_cc_tune_gains(float r, float l, float delay, float bw, float pm, float *kp, float *ki);
+
+#endif /* FOC_CC_TUNE_H_ */
@@ -0,0 +1,212 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "foc_cogging.h"
+#include <math.h>
+
+/**
+ * Look up the cogging compensation current with linear interpolation.
+ *
+ * @param table
+ * The cogging table.
+ *
+ * @param len
+ * Number of entries in the table.
+ *
+ * @param scale
+ * Current per table LSB.
+ *
+ * @param phase
+ * Electrical angle in radians, preferably in the range 0 to 2 * pi.
+ *
+ * @return
+ * The q axis current to add.
+ */
+float foc_cogging_lookup(const int8_t *table, int len, float scale, float phase) {
+	float pos = phase * ((float)len / (2.0 * M_PI));
+
+	while (pos < 0.0) {
+		pos += (float)len;
+	}
+
+	while (pos >= (float)len) {
+		pos -= (float)len;
+	}
+
+	int i0 = (int)pos;
+	if (i0 >= len) {
+		i0 = len - 1;
+	}
+
+	int i1 = i0 + 1;
+	if (i1 >= len) {
+		i1 = 0;
+	}
+
+	float frac = pos - (float)i0;
+	return scale * ((float)table[i0] + frac * (float)(table[i1] - table[i0]));
+}
+
+/**
+ * Add a calibration sample to the bin closest to the given angle.
+ *
+ * @param sum
+ * Sum of the samples in each bin.
+ *
+ * @param cnt
+ * Number of samples in each bin.
+ *
+ * @param len
+ * Number of bins.
+ *
+ * @param phase
+ * Electrical angle in radians.
+ *
+ * @param value
+ * The sample.
+ */
+void foc_cogging_bin_add(float *sum, uint16_t *cnt, int len, float phase, float value) {
+	float pos = phase * ((float)len / (2.0 * M_PI)) + 0.5;
+
+	while (pos < 0.0) {
+		pos += (float)len;
+	}
+
+	while (pos >= (float)len) {
+		pos -= (float)len;
+	}
+
+	int ind = (int)pos;
+	if (ind >= len) {
+		ind = 0;
+	}
+
+	if (cnt[ind] < UINT16_MAX) {
+		sum[ind] += value;
+		cnt[ind]++;
+	}
+}
+
+/**
+ * Turn the bin sums into averages. Empty bins are filled in by linear
+ * interpolation between the closest bins that have samples.
+ *
+ * @param sum
+ * Sum of the samples in each bin. Replaced by the average.
+ *
+ * @param cnt
+ * Number of samples in each bin.
+ *
+ * @param len
+ * Number of bins.
+ *
+ * @return
+ * false if all bins are empty.
+ */
+bool foc_cogging_bin_mean(float *sum, const uint16_t *cnt, int len) {
+	int first = -1;
+
+	for (int i = 0;i < len;i++) {
+		if (cnt[i] > 0) {
+			sum[i] /= (float)cnt[i];
+			if (first < 0) {
+				first = i;
+			}
+		}
+	}
+
+	if (first < 0) {
+		return false;
+	}
+
+	int prev = first;
+	for (int n = 1;n <= len;n++) {
+		int i = (first + n) % len;
+
+		if (cnt[i] == 0) {
+			continue;
+		}
+
+		int gap = (i - prev + len) % len;
+		if (gap == 0) {
+			gap = len;
+		}
+
+		for (int j = 1;j < gap;j++) {
+			float frac = (float)j / (float)gap;
+			sum[(prev + j) % len] = sum[prev] + frac * (sum[i] - sum[prev]);
+		}
+
+		prev = i;
+	}
+
+	return true;
+}
+
+/**
+ * Remove the average from a set of values and quantize them to a table.
+ *
+ * @param values
+ * The values to quantize.
+ *
+ * @param len
+ * Number of values and table entries.
+ *
+ * @param table
+ * The resulting table.
+ *
+ * @return
+ * The scale of the table, i.e. the value per LSB. 0 if all values are equal.
+ */
+float foc_cogging_quantize(const float *values, int len, int8_t *table) {
+	float mean = 0.0;
+	for (int i = 0;i < len;i++) {
+		mean += values[i];
+	}
+	mean /= (float)len;
+
+	float max_abs = 0.0;
+	for (int i = 0;i < len;i++) {
+		float v = fabsf(values[i] - mean);
+		if (v > max_abs) {
+			max_abs = v;
+		}
+	}
+
+	if (max_abs <= 0.0) {
+		for (int i = 0;i < len;i++) {
+			table[i] = 0;
+		}
+		return 0.0;
+	}
+
+	float scale = max_abs / 127.0;
+	for (int i = 0;i < len;i++) {
+		float v = roundf((values[i] - mean) / scale);
+		if (v > 127.0) {
+			v = 127.0;
+		} else if (v < -127.0) {
+			v = -127.0;
+		}
+		table[i] = (int8_t)v;
+	}
+
+	return scale;
+}
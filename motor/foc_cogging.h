@@ -0,0 +1,41 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef FOC_COGGING_H_
+#define FOC_COGGING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The cogging table holds the q axis current needed to cancel the cogging
+ * torque over one electrical revolution. Cogging torque has an integer number
+ * of periods per electrical revolution, so indexing by the electrical angle
+ * keeps the table small regardless of the pole count. Entry i corresponds to
+ * the electrical angle i * 2 * pi / len and is scaled by scale (A / LSB).
+ */
+
+// Functions
+float foc_cogging_lookup(const int8_t *table, int len, float scale, float phase);
+void foc_cogging_bin_add(float *sum, uint16_t *cnt, int len, float phase, float value);
+bool foc_cogging_bin_mean(float *sum, const uint16_t *cnt, int len);
+float foc_cogging_quantize(const float *values, int len, int8_t *table);
+
+#endif /* FOC_COGGING_H_ */
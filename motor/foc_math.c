@@ -30,9 +30,25 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	float R = conf_now->foc_motor_r;
 	float L = conf_now->foc_motor_l;
 	float lambda = conf_now->foc_motor_flux_linkage;
+	float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
+	float id = motor->m_motor_state.id;
+	float iq = motor->m_motor_state.iq;
+	SAT_COMP_MODE sat_mode = conf_now->foc_sat_comp_mode;
+	const mc_local_configuration *conf_local = motor->m_conf_local;
+
+	// The measured saturation map replaces the saturation compensation
+	if (conf_local->foc_sat_map_i_max > 0.0) {
+		float ld, lq;
+		foc_sat_map_lookup(conf_local->foc_sat_map_ld, conf_local->foc_sat_map_lq,
+				conf_local->foc_sat_map_lambda, FOC_SAT_MAP_ID_N, FOC_SAT_MAP_IQ_N,
+				conf_local->foc_sat_map_i_max, id, iq, &ld, &lq, &lambda);
+		L = 0.5 * (ld + lq);
+		ld_lq_diff = lq - ld;
+		sat_mode = SAT_COMP_DISABLED;
+	}
 
 	// Saturation compensation
-	switch(conf_now->foc_sat_comp_mode) {
+	switch(sat_mode) {
 	case SAT_COMP_LAMBDA:
 		// Here we assume that the inductance drops by the same amount as the flux linkage. I have
 		// no idea if this is a valid or even a reasonable assumption.
@@ -70,10 +86,6 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 		R = motor->m_res_temp_comp;
 	}
 
-	float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
-	float id = motor->m_motor_state.id;
-	float iq = motor->m_motor_state.iq;
-
 	// Adjust inductance for saliency.
 	if (fabsf(id) > 0.1 || fabsf(iq) > 0.1) {
 		L = L - ld_lq_diff / 2.0 + ld_lq_diff * SQ(iq) / (SQ(id) + SQ(iq));
@@ -398,9 +410,21 @@ void foc_run_pid_control_pos(bool index_found, float dt, motor_all_state_t *moto
 		motor->m_pos_prev_proc = angle_now;
 		motor->m_pos_d_filter = 0.0;
 		motor->m_pos_d_filter_proc = 0.0;
+		foc_traj_reset(&motor->m_pos_traj, angle_now);
 		return;
 	}
 
+	// Follow a jerk limited trajectory to the set position
+	const mc_local_configuration *conf_local = motor->m_conf_local;
+	bool use_traj = conf_local->p_pid_traj_vel_max > 0.0 && conf_local->p_pid_traj_acc_max > 0.0;
+	if (use_traj) {
+		foc_traj_update(&motor->m_pos_traj, angle_set, conf_local->p_pid_traj_vel_max,
+				conf_local->p_pid_traj_acc_max, conf_local->p_pid_traj_jerk_max, dt);
+		angle_set = motor->m_pos_traj.pos;
+	} else {
+		foc_traj_reset(&motor->m_pos_traj, angle_now);
+	}
+
 	// Compute parameters
 	float error = utils_angle_difference(angle_set, angle_now);
 	float error_sign = 1.0;
@@ -474,6 +498,15 @@ void foc_run_pid_control_pos(bool index_found, float dt, motor_all_state_t *moto
 
 	// Calculate output
 	float output = p_term + motor->m_pos_i_term + d_term + d_term_proc;
+
+	// Feedforward from the trajectory. Unlike the PID gains the feedforward
+	// is in amperes, so it is scaled to the output range here.
+	if (use_traj) {
+		float ff = conf_local->p_pid_traj_ff_vel * motor->m_pos_traj.vel +
+				conf_local->p_pid_traj_ff_acc * motor->m_pos_traj.acc;
+		output += ff * error_sign / (conf_now->l_current_max * conf_now->l_current_max_scale);
+	}
+
 	utils_truncate_number(&output, -1.0, 1.0);
 
 	if (conf_now->m_sensor_port_mode != SENSOR_PORT_MODE_HALL) {
@@ -763,4 +796,11 @@ void foc_precalc_values(motor_all_state_t *motor) {
 	motor->p_v2_v3_inv_avg_half = (0.5 / motor->p_lq + 0.5 / motor->p_ld) * 0.9; // With the 0.9 we undo the adjustment from the detection
 	motor->m_observer_state.lambda_est = conf_now->foc_motor_flux_linkage;
 	motor->p_duty_norm = TWO_BY_SQRT3 / conf_now->foc_overmod_factor;
+
+	const mc_local_configuration *conf_local = motor->m_conf_local;
+	if (conf_local->foc_sat_map_i_max > 0.0) {
+		foc_sat_map_calc_mtpa(conf_local->foc_sat_map_ld, conf_local->foc_sat_map_lq,
+				conf_local->foc_sat_map_lambda, FOC_SAT_MAP_ID_N, FOC_SAT_MAP_IQ_N,
+				conf_local->foc_sat_map_i_max, motor->p_sat_mtpa_id);
+	}
 }
@@ -21,6 +21,9 @@
 #define FOC_MATH_H_
 
 #include "datatypes.h"
+#include "foc_traj.h"
+#include "foc_sat_map.h"
+#include "foc_cc_tune.h"
 
 // Types
 typedef struct {
@@ -137,6 +140,7 @@ typedef enum {
 
 typedef struct {
 	mc_configuration *m_conf;
+	mc_local_configuration *m_conf_local;
 	mc_state m_state;
 	mc_control_mode m_control_mode;
 	motor_state_t m_motor_state;
@@ -217,6 +221,11 @@ typedef struct {
 	float m_pos_dt_int_proc;
 	float m_pos_d_filter;
 	float m_pos_d_filter_proc;
+	foc_traj_state m_pos_traj;
+	int m_pid_isr_cnt;
+	bool m_pid_isr_running;
+	uint32_t m_pid_isr_time_last;
+	int m_hook_cnt;
 	float m_speed_i_term;
 	float m_speed_prev_error;
 	float m_speed_d_filter;
@@ -236,12 +245,25 @@ typedef struct {
 	float m_res_temp_comp;
 	float m_current_ki_temp_comp;
 
+	// Saturation map measurement
+	bool m_flux_int_run;
+	float m_flux_int_vd;
+	float m_flux_int_vq;
+	float m_flux_int_id;
+	float m_flux_int_iq;
+	float m_flux_int_t;
+
+	// Current controller tuning
+	bool m_cc_tune_run;
+	foc_cc_tune_state m_cc_tune;
+
 	// Pre-calculated values
 	float p_lq;
 	float p_ld;
 	float p_inv_ld_lq; // (1.0/lq - 1.0/ld)
 	float p_v2_v3_inv_avg_half; // (0.5/ld + 0.5/lq)
 	float p_duty_norm;
+	float p_sat_mtpa_id[FOC_SAT_MAP_MTPA_LEN]; // MTPA id from the saturation map
 } motor_all_state_t;
 
 // Functions
@@ -0,0 +1,316 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "foc_sat_map.h"
+#include "utils_math.h"
+#include <math.h>
+
+/*
+ * Ld, Lq and flux linkage maps over the d and q axis current.
+ *
+ * The tables have n_id rows for id from 0 to -i_max and n_iq columns for
+ * |iq| from 0 to i_max, so element k * n_iq + j is at
+ * id = -i_max * k / (n_id - 1) and |iq| = i_max * j / (n_iq - 1). Positive
+ * id and currents above i_max use the closest edge of the map.
+ *
+ * The values are defined so that the flux linkage becomes
+ *
+ * psi_d = lambda(id, iq) + Ld(id, iq) * id
+ * psi_q = Lq(id, iq) * iq
+ *
+ * which is what the observer and MTPA already assume with constant values.
+ */
+
+/**
+ * Look up Ld, Lq and flux linkage with bilinear interpolation.
+ *
+ * @param ld_tab
+ * Ld table.
+ *
+ * @param lq_tab
+ * Lq table.
+ *
+ * @param lambda_tab
+ * Flux linkage table.
+ *
+ * @param n_id
+ * Number of id points, at least 2.
+ *
+ * @param n_iq
+ * Number of iq points, at least 2.
+ *
+ * @param i_max
+ * The current at the end of the map.
+ *
+ * @param id
+ * D axis current.
+ *
+ * @param iq
+ * Q axis current.
+ *
+ * @param ld
+ * Interpolated Ld.
+ *
+ * @param lq
+ * Interpolated Lq.
+ *
+ * @param lambda
+ * Interpolated flux linkage.
+ */
+void foc_sat_map_lookup(const float *ld_tab, const float *lq_tab, const float *lambda_tab,
+		int n_id, int n_iq, float i_max, float id, float iq,
+		float *ld, float *lq, float *lambda) {
+	float x = -id / i_max * (float)(n_id - 1);
+	float y = fabsf(iq) / i_max * (float)(n_iq - 1);
+	UTILS_NAN_ZERO(x);
+	UTILS_NAN_ZERO(y);
+	utils_truncate_number(&x, 0.0, (float)(n_id - 1));
+	utils_truncate_number(&y, 0.0, (float)(n_iq - 1));
+
+	int k = (int)x;
+	int j = (int)y;
+	if (k > (n_id - 2)) {
+		k = n_id - 2;
+	}
+	if (j > (n_iq - 2)) {
+		j = n_iq - 2;
+	}
+
+	const float fx = x - (float)k;
+	const float fy = y - (float)j;
+	const float w00 = (1.0 - fx) * (1.0 - fy);
+	const float w01 = (1.0 - fx) * fy;
+	const float w10 = fx * (1.0 - fy);
+	const float w11 = fx * fy;
+
+	const int i00 = k * n_iq + j;
+	const int i10 = i00 + n_iq;
+
+	*ld = ld_tab[i00] * w00 + ld_tab[i00 + 1] * w01 + ld_tab[i10] * w10 + ld_tab[i10 + 1] * w11;
+	*lq = lq_tab[i00] * w00 + lq_tab[i00 + 1] * w01 + lq_tab[i10] * w10 + lq_tab[i10 + 1] * w11;
+	*lambda = lambda_tab[i00] * w00 + lambda_tab[i00 + 1] * w01 +
+			lambda_tab[i10] * w10 + lambda_tab[i10 + 1] * w11;
+}
+
+/**
+ * Get the current to apply when measuring a point in the map.
+ *
+ * @param k
+ * Row in the map.
+ *
+ * @param j
+ * Column in the map.
+ *
+ * @param n_id
+ * Number of id points.
+ *
+ * @param n_iq
+ * Number of iq points.
+ *
+ * @param i_max
+ * The current at the end of the map.
+ *
+ * @param id
+ * D axis current.
+ *
+ * @param iq
+ * Q axis current.
+ */
+void foc_sat_map_meas_current(int k, int j, int n_id, int n_iq, float i_max, float *id, float *iq) {
+	*id = -i_max * (float)k / (float)(n_id - 1);
+	*iq = i_max * (float)j / (float)(n_iq - 1);
+}
+
+/**
+ * Calculate the change in flux linkage over a current step from zero, with
+ * the resistive voltage removed. The voltage that is left after the step is
+ * treated as an offset, which takes care of dead time and of errors in the
+ * resistance. They then only matter while the current rises.
+ *
+ * @param s
+ * The integrals from the step.
+ *
+ * @param r
+ * Motor resistance.
+ *
+ * @return
+ * The flux linkage change.
+ */
+float foc_sat_map_step_flux(const foc_sat_map_step *s, float r) {
+	return s->v_int - r * s->i_int - (s->v_ss - r * s->i_ss) * s->t;
+}
+
+// Inductance at zero current from the first two points, assuming that it
+// changes with the square of the current.
+static float extrapolate_zero(float l1, float l2) {
+	return (4.0 * l1 - l2) / 3.0;
+}
+
+/**
+ * Fill the maps from measured flux linkage changes. The inductances can not
+ * be measured at zero current, so they are extrapolated there. n_id and n_iq
+ * must be at least 3.
+ *
+ * @param psi_d
+ * D axis flux linkage change from zero current for every map point,
+ * measured at foc_sat_map_meas_current. The point at zero current is not
+ * used.
+ *
+ * @param psi_q
+ * Q axis flux linkage for every map point.
+ *
+ * @param n_id
+ * Number of id points.
+ *
+ * @param n_iq
+ * Number of iq points.
+ *
+ * @param i_max
+ * The current at the end of the map.
+ *
+ * @param lambda0
+ * Flux linkage at zero current.
+ *
+ * @param ld
+ * Ld table output.
+ *
+ * @param lq
+ * Lq table output.
+ *
+ * @param lambda
+ * Flux linkage table output.
+ */
+void foc_sat_map_from_flux(const float *psi_d, const float *psi_q,
+		int n_id, int n_iq, float i_max, float lambda0,
+		float *ld, float *lq, float *lambda) {
+	for (int j = 0;j < n_iq;j++) {
+		// Flux linkage along the d axis at id = 0, which changes with iq
+		// from cross saturation.
+		const float psi_d0 = j > 0 ? psi_d[j] : 0.0;
+
+		for (int k = 0;k < n_id;k++) {
+			const int ind = k * n_iq + j;
+			float id, iq;
+			foc_sat_map_meas_current(k, j, n_id, n_iq, i_max, &id, &iq);
+
+			if (k > 0) {
+				ld[ind] = (psi_d[ind] - psi_d0) / id;
+			}
+
+			if (j > 0) {
+				lq[ind] = psi_q[ind] / iq;
+			}
+
+			lambda[ind] = lambda0 + psi_d0;
+		}
+
+		ld[j] = extrapolate_zero(ld[n_iq + j], ld[2 * n_iq + j]);
+	}
+
+	for (int k = 0;k < n_id;k++) {
+		lq[k * n_iq] = extrapolate_zero(lq[k * n_iq + 1], lq[k * n_iq + 2]);
+	}
+}
+
+/**
+ * Calculate the d axis current that gives the most torque per amp, using
+ * the map. The usual MTPA equation assumes constant inductances, which gives
+ * the wrong angle when they saturate, so this searches for the maximum
+ * torque instead. It is too slow for the control loop, so it is done once
+ * for FOC_SAT_MAP_MTPA_LEN currents between 0 and i_max.
+ *
+ * @param ld_tab
+ * Ld table.
+ *
+ * @param lq_tab
+ * Lq table.
+ *
+ * @param lambda_tab
+ * Flux linkage table.
+ *
+ * @param n_id
+ * Number of id points in the map.
+ *
+ * @param n_iq
+ * Number of iq points in the map.
+ *
+ * @param i_max
+ * The current at the end of the map.
+ *
+ * @param id_mtpa
+ * The d axis current for each point, FOC_SAT_MAP_MTPA_LEN long.
+ */
+void foc_sat_map_calc_mtpa(const float *ld_tab, const float *lq_tab, const float *lambda_tab,
+		int n_id, int n_iq, float i_max, float *id_mtpa) {
+	id_mtpa[0] = 0.0;
+
+	for (int i = 1;i < FOC_SAT_MAP_MTPA_LEN;i++) {
+		const float i_abs = i_max * (float)i / (float)(FOC_SAT_MAP_MTPA_LEN - 1);
+		float torque_best = -1.0e9;
+		float id_best = 0.0;
+
+		// 0.5 degree steps between 0 and 75 degrees
+		for (int step = 0;step <= 150;step++) {
+			float s, c;
+			utils_fast_sincos_better(DEG2RAD_f(0.5 * (float)step), &s, &c);
+			const float id = -i_abs * s;
+			const float iq = i_abs * c;
+
+			float ld, lq, lambda;
+			foc_sat_map_lookup(ld_tab, lq_tab, lambda_tab, n_id, n_iq, i_max, id, iq, &ld, &lq, &lambda);
+
+			const float torque = (lambda + (ld - lq) * id) * iq;
+			if (torque > torque_best) {
+				torque_best = torque;
+				id_best = id;
+			}
+		}
+
+		id_mtpa[i] = id_best;
+	}
+}
+
+/**
+ * Get the MTPA d axis current.
+ *
+ * @param id_mtpa
+ * The curve from foc_sat_map_calc_mtpa.
+ *
+ * @param i_max
+ * The current at the end of the map.
+ *
+ * @param i_abs
+ * The current magnitude.
+ *
+ * @return
+ * The d axis current. Above i_max the current angle at i_max is used.
+ */
+float foc_sat_map_mtpa_id(const float *id_mtpa, float i_max, float i_abs) {
+	i_abs = fabsf(i_abs);
+	UTILS_NAN_ZERO(i_abs);
+
+	if (i_abs >= i_max) {
+		return id_mtpa[FOC_SAT_MAP_MTPA_LEN - 1] * i_abs / i_max;
+	}
+
+	const float x = i_abs / i_max * (float)(FOC_SAT_MAP_MTPA_LEN - 1);
+	const int ind = (int)x;
+	return utils_map(x, (float)ind, (float)(ind + 1), id_mtpa[ind], id_mtpa[ind + 1]);
+}
@@ -0,0 +1,49 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef FOC_SAT_MAP_H_
+#define FOC_SAT_MAP_H_
+
+// Number of points in the MTPA curve
+#define FOC_SAT_MAP_MTPA_LEN		16
+
+// Integrals from one current step of the saturation map measurement
+typedef struct {
+	float v_int; // Voltage integrated over the step window
+	float i_int; // Current integrated over the step window
+	float t; // Length of the step window
+	float v_ss; // Average voltage after the step
+	float i_ss; // Average current after the step
+} foc_sat_map_step;
+
+// Functions
+void foc_sat_map_lookup(const float *ld_tab, const float *lq_tab, const float *lambda_tab,
+		int n_id, int n_iq, float i_max, float id, float iq,
+		float *ld, float *lq, float *lambda);
+void foc_sat_map_meas_current(int k, int j, int n_id, int n_iq, float i_max, float *id, float *iq);
+float foc_sat_map_step_flux(const foc_sat_map_step *s, float r);
+void foc_sat_map_from_flux(const float *psi_d, const float *psi_q,
+		int n_id, int n_iq, float i_max, float lambda0,
+		float *ld, float *lq, float *lambda);
+void foc_sat_map_calc_mtpa(const float *ld_tab, const float *lq_tab, const float *lambda_tab,
+		int n_id, int n_iq, float i_max, float *id_mtpa);
+float foc_sat_map_mtpa_id(const float *id_mtpa, float i_max, float i_abs);
+
+#endif /* FOC_SAT_MAP_H_ */
@@ -0,0 +1,283 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "foc_traj.h"
+#include "utils_math.h"
+#include <math.h>
+
+/*
+ * Jerk limited (S-curve) trajectory generator for position control.
+ *
+ * The first stage moves towards the target at constant velocity. Its
+ * velocity is then averaged over Ta = v / a and after that over Tj = a / j,
+ * which gives a trapezoidal acceleration with at most a and j. For a move
+ * from rest this is the standard double S profile, taking
+ * D / v + v / a + a / j seconds. Short moves lower v and a, which gives
+ * the time optimal profile also when the limits are not reached.
+ *
+ * The first stage output is a single velocity pulse that ends with a
+ * partial step at the target. The two moving averages of that pulse are
+ * evaluated in closed form from the step counts, so no history has to be
+ * kept and the averaging time does not depend on the PID rate.
+ *
+ * The averaging lengths are planned when a move starts from rest. If the
+ * target moves further away during the pulse, the pulse gets longer. If it
+ * moves closer, the first stage still finishes the planned pulse length,
+ * and a pulse that has ended is not restarted until the output is at rest.
+ * That way the limits hold also when the target changes.
+ *
+ * Positions are in degrees and wrap around at 360 the same way as the
+ * position PID, so moves always take the shortest way.
+ */
+
+// Private functions
+static void plan_move(foc_traj_state *s, float dist, float vel_max,
+		float acc_max, float jerk_max, float dt);
+static int64_t ma_step_sum(int n, int len_a, int len_j);
+static float ma_pulse_sum(foc_traj_state *s, int n_ofs);
+
+/**
+ * Reset the trajectory to rest at a position.
+ *
+ * @param s
+ * The trajectory state.
+ *
+ * @param pos
+ * The position in degrees.
+ */
+void foc_traj_reset(foc_traj_state *s, float pos) {
+	s->pos_in = pos;
+	s->vel_move = 0.0;
+	s->dir = 0.0;
+	s->move_cnt = 0;
+	s->move_frac = 0.0;
+	s->move_done = true;
+	s->pos = pos;
+	s->vel = 0.0;
+	s->acc = 0.0;
+	s->len_a = 1;
+	s->len_j = 1;
+	s->step_cnt = 0;
+	s->end_cnt = 0;
+}
+
+/**
+ * Run one step of the trajectory generator. Call at the position PID rate.
+ *
+ * @param s
+ * The trajectory state. The references are in pos, vel and acc.
+ *
+ * @param target
+ * The target position in degrees.
+ *
+ * @param vel_max
+ * Max velocity in degrees/s.
+ *
+ * @param acc_max
+ * Max acceleration in degrees/s^2.
+ *
+ * @param jerk_max
+ * Max jerk in degrees/s^3. 0 disables the jerk limit.
+ *
+ * @param dt
+ * Time since the previous step in seconds.
+ */
+void foc_traj_update(foc_traj_state *s, float target, float vel_max,
+		float acc_max, float jerk_max, float dt) {
+	if (dt <= 0.0 || vel_max <= 0.0 || acc_max <= 0.0) {
+		return;
+	}
+
+	float err = utils_angle_difference(target, s->pos_in);
+
+	if (foc_traj_at_rest(s)) {
+		if (err == 0.0) {
+			return;
+		}
+
+		plan_move(s, fabsf(err), vel_max, acc_max, jerk_max, dt);
+		s->dir = SIGN(err);
+	}
+
+	int len = s->len_a + s->len_j;
+
+	// First stage. The pulse has to be at least as long as planned, so a
+	// move that is cut short continues past the target and comes back.
+	if (!s->move_done) {
+		float step = s->vel_move * dt;
+		float left = s->dir * err;
+
+		if (s->move_cnt < len || left > step) {
+			s->pos_in += s->dir * step;
+			utils_norm_angle(&s->pos_in);
+
+			if (s->move_cnt < len) {
+				s->move_cnt++;
+			}
+		} else {
+			// The last step is partial and ends on the target. Small
+			// rounding errors from the full steps are removed here too.
+			if (left > -1e-3 * step) {
+				s->move_frac = fmaxf(left, 0.0) / step;
+				s->pos_in = target;
+			}
+
+			s->move_done = true;
+		}
+	}
+
+	// The acceleration is taken from the difference of the sums directly, as
+	// the difference of the velocities loses too much precision.
+	float scale = s->dir * s->vel_move / ((float)s->len_a * (float)s->len_j);
+	s->vel = scale * ma_pulse_sum(s, 0);
+	s->acc = scale * ma_pulse_sum(s, 1) / dt;
+	s->pos += s->vel * dt;
+	utils_norm_angle(&s->pos);
+
+	// The sums are constant after len steps
+	if (s->step_cnt < len) {
+		s->step_cnt++;
+	}
+
+	if (s->move_done) {
+		s->end_cnt++;
+	}
+
+	// Remove rounding errors when the move is done. The velocity is 0 from
+	// len - 1 steps after the end of the pulse, and the acceleration one
+	// step later.
+	if (s->move_done && s->end_cnt > len) {
+		s->pos = s->pos_in;
+		s->vel = 0.0;
+		s->acc = 0.0;
+		s->dir = 0.0;
+	}
+}
+
+/**
+ * Check if the trajectory has finished.
+ *
+ * @param s
+ * The trajectory state.
+ *
+ * @return
+ * true if the output is at rest.
+ */
+bool foc_traj_at_rest(foc_traj_state *s) {
+	return s->dir == 0.0;
+}
+
+static void plan_move(foc_traj_state *s, float dist, float vel_max,
+		float acc_max, float jerk_max, float dt) {
+	float vel = vel_max;
+	float acc = acc_max;
+	float len_j = 1.0;
+
+	if (jerk_max > 0.0) {
+		// Ta >= Tj
+		acc = fminf(acc, sqrtf(vel * jerk_max));
+
+		// The velocity pulse must be at least Ta + Tj long, otherwise the
+		// jerk limit does not hold. Lower the velocity for short moves, and
+		// also the acceleration for very short moves.
+		if ((dist / vel) < ((vel / acc) + (acc / jerk_max))) {
+			float t_j = acc / jerk_max;
+			vel = 0.5 * acc * (sqrtf(SQ(t_j) + 4.0 * dist / acc) - t_j);
+
+			if ((vel / acc) < t_j) {
+				float t = cbrtf(dist / (2.0 * jerk_max));
+				acc = jerk_max * t;
+				vel = acc * t;
+			}
+		}
+
+		len_j = ceilf(acc / (jerk_max * dt));
+	} else if ((dist / vel) < (vel / acc)) {
+		vel = sqrtf(dist * acc);
+	}
+
+	float len_a = ceilf(vel / (acc * dt));
+
+	utils_truncate_number(&len_a, 1.0, FOC_TRAJ_LEN_MAX);
+	utils_truncate_number(&len_j, 1.0, FOC_TRAJ_LEN_MAX);
+
+	// Rounding up the lengths only lowers the acceleration and jerk. The
+	// rounding is compensated for in the length of the pulse.
+	vel = fminf(vel, acc_max * len_a * dt);
+	if (jerk_max > 0.0) {
+		vel = fminf(vel, jerk_max * len_a * len_j * SQ(dt));
+	}
+	vel = fminf(vel, dist / ((len_a + len_j) * dt));
+
+	s->len_a = (int)len_a;
+	s->len_j = (int)len_j;
+	s->vel_move = vel;
+	s->move_cnt = 0;
+	s->move_frac = 0.0;
+	s->move_done = false;
+	s->step_cnt = 0;
+	s->end_cnt = 0;
+}
+
+/*
+ * Unit step after moving averages of length len_a and len_j, n samples
+ * after the step and times len_a * len_j. This is the number of pairs
+ * (a, b) with a < len_a, b < len_j and a + b <= n.
+ */
+static int64_t ma_step_sum(int n, int len_a, int len_j) {
+	if (n < 0) {
+		return 0;
+	}
+
+	// Constant from here
+	if (n > (len_a + len_j)) {
+		n = len_a + len_j;
+	}
+
+	int64_t t[4] = {n, n - len_a, n - len_j, n - len_a - len_j};
+	for (int i = 0;i < 4;i++) {
+		t[i] = t[i] < 0 ? 0 : (t[i] + 1) * (t[i] + 2) / 2;
+	}
+
+	return t[0] - t[1] - t[2] + t[3];
+}
+
+/*
+ * The averaged first stage pulse at the current step, times len_a * len_j.
+ * A pulse of N full steps is a step up at 0 and a step down at N, and the
+ * partial step is split between N and N + 1. With n_ofs = 1 the difference
+ * to the previous step is returned instead.
+ */
+static float ma_pulse_sum(foc_traj_state *s, int n_ofs) {
+	int n = s->step_cnt;
+	int e = s->end_cnt;
+	int la = s->len_a;
+	int lj = s->len_j;
+
+	float sum = (float)(ma_step_sum(n, la, lj) - n_ofs * ma_step_sum(n - 1, la, lj));
+	if (s->move_done) {
+		sum -= (1.0 - s->move_frac) *
+				(float)(ma_step_sum(e, la, lj) - n_ofs * ma_step_sum(e - 1, la, lj));
+		sum -= s->move_frac *
+				(float)(ma_step_sum(e - 1, la, lj) - n_ofs * ma_step_sum(e - 2, la, lj));
+	}
+
+	return sum;
+}
@@ -0,0 +1,56 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef FOC_TRAJ_H_
+#define FOC_TRAJ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Max moving average length in PID iterations. Only there to keep the
+// integer math in range, at 10 kHz this is 100 s of smoothing.
+#define FOC_TRAJ_LEN_MAX		1000000
+
+typedef struct {
+	// Velocity limited stage
+	float pos_in;
+	float vel_move;
+	float dir;
+	int move_cnt;
+	float move_frac;
+	bool move_done;
+	// Jerk limited output
+	float pos;
+	float vel;
+	float acc;
+	// Moving average lengths for the acceleration and jerk limits
+	int len_a;
+	int len_j;
+	int step_cnt;
+	int end_cnt;
+} foc_traj_state;
+
+// Functions
+void foc_traj_reset(foc_traj_state *s, float pos);
+void foc_traj_update(foc_traj_state *s, float target, float vel_max,
+		float acc_max, float jerk_max, float dt);
+bool foc_traj_at_rest(foc_traj_state *s);
+
+#endif /* FOC_TRAJ_H_ */
@@ -56,6 +56,7 @@ volatile float ADC_curr_raw[6];
 
 typedef struct {
 	mc_configuration m_conf;
+	mc_local_configuration m_conf_local;
 	mc_fault_code m_fault_now;
 	setup_stats m_stats;
 	int m_ignore_iterations;
@@ -170,8 +171,10 @@ void mc_interface_init(void) {
 #endif
 
 	conf_general_read_mc_configuration((mc_configuration*)&m_motor_1.m_conf, false);
+	conf_general_read_mc_local_configuration((mc_local_configuration*)&m_motor_1.m_conf_local, false);
 #ifdef HW_HAS_DUAL_MOTORS
 	conf_general_read_mc_configuration((mc_configuration*)&m_motor_2.m_conf, true);
+	conf_general_read_mc_local_configuration((mc_local_configuration*)&m_motor_2.m_conf_local, true);
 #endif
 
 #ifdef HW_HAS_DUAL_MOTORS
@@ -229,6 +232,7 @@ void mc_interface_init(void) {
 	mc_interface_select_motor_thread(motor_old);
 
 	encoder_init(&motor_now()->m_conf);
+	encoder_set_corr(&motor_now()->m_conf_local);
 
 	// Initialize selected implementation
 	switch (motor_now()->m_conf.motor_type) {
@@ -414,6 +418,37 @@ void mc_interface_set_configuration(mc_configuration *configuration) {
 	bms_init(&configuration->bms);
 }
 
+const volatile mc_local_configuration* mc_interface_get_local_configuration(void) {
+	return &motor_now()->m_conf_local;
+}
+
+void mc_interface_set_local_configuration(mc_local_configuration *configuration) {
+	motor_now()->m_conf_local = *configuration;
+	encoder_set_corr(configuration);
+
+	if (motor_now()->m_conf.motor_type == MOTOR_TYPE_FOC) {
+		mcpwm_foc_update_local_configuration();
+	}
+}
+
+/**
+ * Get the local configuration of a motor for the motor implementation, which
+ * reads it directly from its control loop.
+ *
+ * @param is_motor_2
+ * true for motor 2. On hardware with a single motor motor 1 is returned.
+ */
+mc_local_configuration* mc_interface_get_local_configuration_motor(bool is_motor_2) {
+#ifdef HW_HAS_DUAL_MOTORS
+	if (is_motor_2) {
+		return (mc_local_configuration*)&m_motor_2.m_conf_local;
+	}
+#else
+	(void)is_motor_2;
+#endif
+	return (mc_local_configuration*)&m_motor_1.m_conf_local;
+}
+
 bool mc_interface_dccal_done(void) {
 	bool ret = false;
 	switch (motor_now()->m_conf.motor_type) {
@@ -133,6 +133,9 @@
 #ifndef MCCONF_SP_PID_LOOP_RATE
 #define MCCONF_SP_PID_LOOP_RATE			PID_RATE_1000_HZ // PID loop rate
 #endif
+#ifndef MCCONF_SP_PID_LOOP_IN_ISR
+#define MCCONF_SP_PID_LOOP_IN_ISR		false	// Run the PID loops from the control interrupt instead of a thread
+#endif
 
 // Speed PID parameters
 #ifndef MCCONF_S_PID_KP
@@ -185,6 +188,21 @@
 #ifndef MCCONF_P_PID_OFFSET
 #define MCCONF_P_PID_OFFSET				0.0		// Angle offset
 #endif
+#ifndef MCCONF_P_PID_TRAJ_VEL_MAX
+#define MCCONF_P_PID_TRAJ_VEL_MAX		0.0		// Trajectory max velocity in deg/s. 0 disables the trajectory.
+#endif
+#ifndef MCCONF_P_PID_TRAJ_ACC_MAX
+#define MCCONF_P_PID_TRAJ_ACC_MAX		3600.0	// Trajectory max acceleration in deg/s^2
+#endif
+#ifndef MCCONF_P_PID_TRAJ_JERK_MAX
+#define MCCONF_P_PID_TRAJ_JERK_MAX		72000.0	// Trajectory max jerk in deg/s^3. 0 disables the jerk limit.
+#endif
+#ifndef MCCONF_P_PID_TRAJ_FF_VEL
+#define MCCONF_P_PID_TRAJ_FF_VEL		0.0		// Velocity feedforward in A/(deg/s)
+#endif
+#ifndef MCCONF_P_PID_TRAJ_FF_ACC
+#define MCCONF_P_PID_TRAJ_FF_ACC		0.0		// Acceleration feedforward in A/(deg/s^2)
+#endif
 
 // Current control parameters
 #ifndef MCCONF_CC_GAIN
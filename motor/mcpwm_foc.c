@@ -41,16 +41,30 @@
 #include <stdio.h>
 #include "virtual_motor.h"
 #include "foc_math.h"
+#include "foc_cogging.h"
+#include "encoder/encoder_corr.h"
 
 // Private variables
 static volatile bool m_dccal_done = false;
 static volatile float m_last_adc_isr_duration;
+static volatile float m_max_adc_isr_duration;
+static volatile float m_max_pid_jitter;
+static volatile foc_hook_fun m_hook = NULL;
+static void * volatile m_hook_arg = NULL;
+static volatile int m_hook_div = 1;
+static volatile float m_hook_budget = 0.0;
+static volatile float m_hook_max_time = 0.0;
+static volatile bool m_hook_overrun = false;
 static volatile bool m_init_done = false;
 static volatile motor_all_state_t m_motor_1;
 #ifdef HW_HAS_DUAL_MOTORS
 static volatile motor_all_state_t m_motor_2;
 #endif
 static volatile int m_isr_motor = 0;
+// Bins for the cogging and encoder correction calibrations. One set per direction.
+#define CAL_BIN_MAX		(FOC_COGGING_TABLE_SIZE > ENCODER_CORR_TABLE_SIZE ? FOC_COGGING_TABLE_SIZE : ENCODER_CORR_TABLE_SIZE)
+static float m_cal_bin_sum[2][CAL_BIN_MAX];
+static uint16_t m_cal_bin_cnt[2][CAL_BIN_MAX];
 
 // Private functions
 static void control_current(motor_all_state_t *motor, float dt);
@@ -61,6 +75,10 @@ static void full_brake_hw(motor_all_state_t *motor);
 static void terminal_plot_hfi(int argc, const char **argv);
 static void timer_update(motor_all_state_t *motor, float dt);
 static void hfi_update(volatile motor_all_state_t *motor, float dt);
+static float pid_rate_hz(PID_RATE rate);
+static void update_pid_jitter(float jitter);
+static void run_pid_isr(motor_all_state_t *motor, float dt);
+static void run_control_hook(motor_all_state_t *motor, float dt);
 
 // Threads
 static THD_WORKING_AREA(timer_thread_wa, 512);
@@ -358,6 +376,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 	m_isr_motor = 0;
 
 	m_motor_1.m_conf = conf_m1;
+	m_motor_1.m_conf_local = mc_interface_get_local_configuration_motor(false);
 	m_motor_1.m_state = MC_STATE_OFF;
 	m_motor_1.m_control_mode = CONTROL_MODE_NONE;
 	m_motor_1.m_hall_dt_diff_last = 1.0;
@@ -370,6 +389,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 #ifdef HW_HAS_DUAL_MOTORS
 	memset((void*)&m_motor_2, 0, sizeof(motor_all_state_t));
 	m_motor_2.m_conf = conf_m2;
+	m_motor_2.m_conf_local = mc_interface_get_local_configuration_motor(true);
 	m_motor_2.m_state = MC_STATE_OFF;
 	m_motor_2.m_control_mode = CONTROL_MODE_NONE;
 	m_motor_2.m_hall_dt_diff_last = 1.0;
@@ -663,6 +683,14 @@ void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 	virtual_motor_set_configuration(configuration);
 }
 
+/**
+ * Update the values that are derived from the local configuration of the
+ * current motor. Call this after it has been changed.
+ */
+void mcpwm_foc_update_local_configuration(void) {
+	foc_precalc_values((motor_all_state_t*)get_motor_now());
+}
+
 mc_state mcpwm_foc_get_state(void) {
 	return get_motor_now()->m_state;
 }
@@ -1729,6 +1757,534 @@ int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ra
 	return fault;
 }
 
+/**
+ * Calibrate the cogging compensation table. The rotor is swept slowly one
+ * revolution forward and one revolution back under position control while
+ * the q axis current requested by the position PID is recorded against the
+ * electrical encoder angle. Averaging both directions cancels friction and
+ * removing the average cancels constant load torque. The position PID has to
+ * be tuned and the encoder has to be set up before running this.
+ *
+ * @param sweep_time
+ * Time for one revolution in seconds. Slower gives a more accurate table.
+ *
+ * @param print
+ * Print progress.
+ *
+ * @param table
+ * The resulting table with FOC_COGGING_TABLE_SIZE entries.
+ *
+ * @param scale
+ * The resulting table scale in A / LSB.
+ *
+ * @return
+ * The fault code
+ */
+int mcpwm_foc_cogging_calibrate(float sweep_time, bool print, int8_t *table, float *scale) {
+	int fault = FAULT_CODE_NONE;
+	mc_interface_lock();
+
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	// Disable timeout
+	systime_t tout = timeout_get_timeout_msec();
+	float tout_c = timeout_get_brake_current();
+	KILL_SW_MODE tout_ksw = timeout_get_kill_sw_mode();
+	timeout_reset();
+	timeout_configure(60000, 0.0, KILL_SW_MODE_DISABLED);
+
+	// Measure without compensation
+	float scale_old = motor->m_conf_local->foc_cogging_comp_scale;
+	motor->m_conf_local->foc_cogging_comp_scale = 0.0;
+
+	memset(m_cal_bin_sum, 0, sizeof(m_cal_bin_sum));
+	memset(m_cal_bin_cnt, 0, sizeof(m_cal_bin_cnt));
+
+	motor->m_pos_pid_set = motor->m_pos_pid_now;
+	motor->m_id_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_POS;
+	motor->m_motor_released = false;
+	motor->m_state = MC_STATE_RUNNING;
+
+	chThdSleepMilliseconds(500);
+
+	// Run a lead-in of 10 % before recording so that the PID settles after
+	// starting and after changing direction.
+	const int steps = (int)(sweep_time * 1000.0);
+	const int steps_lead = steps / 10;
+	const float step_deg = 360.0 / (float)steps;
+
+	for (int dir = 0;dir < 2;dir++) {
+		float pos_start = motor->m_pos_pid_set;
+
+		for (int i = 0;i < (steps + steps_lead);i++) {
+			float pos = pos_start + (dir == 0 ? 1.0 : -1.0) * step_deg * (float)i;
+			utils_norm_angle(&pos);
+			motor->m_pos_pid_set = pos;
+
+			fault = mc_interface_get_fault();
+			if (fault != FAULT_CODE_NONE) {
+				goto exit_cogging_calibrate;
+			}
+
+			chThdSleepMilliseconds(1);
+			timeout_reset();
+
+			if (i >= steps_lead) {
+				foc_cogging_bin_add(m_cal_bin_sum[dir], m_cal_bin_cnt[dir], FOC_COGGING_TABLE_SIZE,
+						motor->m_phase_now_encoder, motor->m_iq_set);
+			}
+		}
+
+		if (print) {
+			commands_printf("Sweep %d done", dir + 1);
+		}
+	}
+
+	if (foc_cogging_bin_mean(m_cal_bin_sum[0], m_cal_bin_cnt[0], FOC_COGGING_TABLE_SIZE) &&
+			foc_cogging_bin_mean(m_cal_bin_sum[1], m_cal_bin_cnt[1], FOC_COGGING_TABLE_SIZE)) {
+		for (int i = 0;i < FOC_COGGING_TABLE_SIZE;i++) {
+			m_cal_bin_sum[0][i] = 0.5 * (m_cal_bin_sum[0][i] + m_cal_bin_sum[1][i]);
+		}
+
+		*scale = foc_cogging_quantize(m_cal_bin_sum[0], FOC_COGGING_TABLE_SIZE, table);
+	} else {
+		*scale = 0.0;
+	}
+
+	exit_cogging_calibrate:
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_NONE;
+	motor->m_state = MC_STATE_OFF;
+	stop_pwm_hw((motor_all_state_t*)motor);
+
+	// Restore configuration
+	motor->m_conf_local->foc_cogging_comp_scale = scale_old;
+
+	// Enable timeout
+	timeout_configure(tout, tout_c, tout_ksw);
+
+	mc_interface_unlock();
+	return fault;
+}
+
+/**
+ * Calibrate the encoder nonlinearity correction table. The motor is run open
+ * loop at constant speed one mechanical revolution forward and one back
+ * while the raw encoder angle is compared to the open loop angle. Averaging
+ * both directions cancels the lag of the rotor behind the open loop angle.
+ * The encoder offset, ratio and direction have to be detected before running
+ * this.
+ *
+ * @param current
+ * The open loop current. Should be high enough to keep cogging from moving
+ * the rotor away from the open loop angle.
+ *
+ * @param rev_time
+ * Time for one mechanical revolution in seconds.
+ *
+ * @param print
+ * Print progress.
+ *
+ * @param table
+ * The resulting table with ENCODER_CORR_TABLE_SIZE entries.
+ *
+ * @param max_err
+ * The largest correction in degrees.
+ *
+ * @return
+ * The fault code
+ */
+int mcpwm_foc_encoder_corr_calibrate(float current, float rev_time, bool print, int16_t *table, float *max_err) {
+	int fault = FAULT_CODE_NONE;
+	mc_interface_lock();
+
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	*max_err = 0.0;
+
+	motor->m_phase_override = true;
+	motor->m_phase_now_override = 0.0;
+	motor->m_id_set = current;
+	motor->m_iq_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_CURRENT;
+	motor->m_motor_released = false;
+	motor->m_state = MC_STATE_RUNNING;
+
+	// Disable timeout
+	systime_t tout = timeout_get_timeout_msec();
+	float tout_c = timeout_get_brake_current();
+	KILL_SW_MODE tout_ksw = timeout_get_kill_sw_mode();
+	timeout_reset();
+	timeout_configure(60000, 0.0, KILL_SW_MODE_DISABLED);
+
+	// Save configuration
+	float ldiff_old = motor->m_conf->foc_motor_ld_lq_diff;
+	motor->m_conf->foc_motor_ld_lq_diff = 0.0;
+
+	memset(m_cal_bin_sum, 0, sizeof(m_cal_bin_sum));
+	memset(m_cal_bin_cnt, 0, sizeof(m_cal_bin_cnt));
+
+	chThdSleepMilliseconds(1000);
+
+	// The open loop angle in the same direction and unit as the raw encoder angle
+	const float ratio = motor->m_conf->foc_encoder_ratio;
+	const float ref_scale = (motor->m_conf->foc_encoder_inverted ? -1.0 : 1.0) / ratio;
+	const int steps = (int)(rev_time * 1000.0);
+	const int steps_lead = steps / 10;
+	const float step_rad = (2.0 * M_PI * ratio) / (float)steps;
+	float phase = 0.0;
+	float diff_first = utils_angle_difference(0.0, encoder_read_deg_raw());
+
+	for (int dir = 0;dir < 2;dir++) {
+		for (int i = 0;i < (steps + steps_lead);i++) {
+			phase += (dir == 0 ? 1.0 : -1.0) * step_rad;
+			motor->m_phase_now_override = phase;
+			utils_norm_angle_rad((float*)&motor->m_phase_now_override);
+
+			fault = mc_interface_get_fault();
+			if (fault != FAULT_CODE_NONE) {
+				goto exit_encoder_corr_calibrate;
+			}
+
+			chThdSleepMilliseconds(1);
+			timeout_reset();
+
+			if (i >= steps_lead) {
+				float raw = encoder_read_deg_raw();
+				float diff = utils_angle_difference(RAD2DEG_f(phase) * ref_scale, raw);
+				foc_cogging_bin_add(m_cal_bin_sum[dir], m_cal_bin_cnt[dir], ENCODER_CORR_TABLE_SIZE,
+						DEG2RAD_f(raw), utils_angle_difference(diff, diff_first));
+			}
+		}
+
+		if (print) {
+			commands_printf("Sweep %d done", dir + 1);
+		}
+	}
+
+	if (foc_cogging_bin_mean(m_cal_bin_sum[0], m_cal_bin_cnt[0], ENCODER_CORR_TABLE_SIZE) &&
+			foc_cogging_bin_mean(m_cal_bin_sum[1], m_cal_bin_cnt[1], ENCODER_CORR_TABLE_SIZE)) {
+		for (int i = 0;i < ENCODER_CORR_TABLE_SIZE;i++) {
+			m_cal_bin_sum[0][i] = 0.5 * (m_cal_bin_sum[0][i] + m_cal_bin_sum[1][i]);
+		}
+
+		encoder_corr_quantize(m_cal_bin_sum[0], ENCODER_CORR_TABLE_SIZE, table);
+
+		for (int i = 0;i < ENCODER_CORR_TABLE_SIZE;i++) {
+			float err = fabsf((float)table[i] * ENCODER_CORR_SCALE);
+			if (err > *max_err) {
+				*max_err = err;
+			}
+		}
+	} else {
+		memset(table, 0, sizeof(int16_t) * ENCODER_CORR_TABLE_SIZE);
+	}
+
+	exit_encoder_corr_calibrate:
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_phase_override = false;
+	motor->m_control_mode = CONTROL_MODE_NONE;
+	motor->m_state = MC_STATE_OFF;
+	stop_pwm_hw((motor_all_state_t*)motor);
+
+	// Restore configuration
+	motor->m_conf->foc_motor_ld_lq_diff = ldiff_old;
+
+	// Enable timeout
+	timeout_configure(tout, tout_c, tout_ksw);
+
+	mc_interface_unlock();
+	return fault;
+}
+
+static void flux_int_window(volatile motor_all_state_t *motor, int ms, bool step, float id, float iq,
+		foc_sat_map_step *step_d, foc_sat_map_step *step_q) {
+	motor->m_flux_int_vd = 0.0;
+	motor->m_flux_int_vq = 0.0;
+	motor->m_flux_int_id = 0.0;
+	motor->m_flux_int_iq = 0.0;
+	motor->m_flux_int_t = 0.0;
+	motor->m_flux_int_run = true;
+
+	if (step) {
+		motor->m_id_set = id;
+		motor->m_iq_set = iq;
+	}
+
+	chThdSleepMilliseconds(ms);
+	motor->m_flux_int_run = false;
+	timeout_reset();
+
+	const float t = motor->m_flux_int_t;
+	if (step) {
+		step_d->v_int = motor->m_flux_int_vd;
+		step_d->i_int = motor->m_flux_int_id;
+		step_d->t = t;
+		step_q->v_int = motor->m_flux_int_vq;
+		step_q->i_int = motor->m_flux_int_iq;
+		step_q->t = t;
+	} else if (t > 0.0) {
+		step_d->v_ss = motor->m_flux_int_vd / t;
+		step_d->i_ss = motor->m_flux_int_id / t;
+		step_q->v_ss = motor->m_flux_int_vq / t;
+		step_q->i_ss = motor->m_flux_int_iq / t;
+	}
+}
+
+/**
+ * Measure the saturation map with the rotor locked. For every point in the
+ * map, the current is stepped from zero to the point along the d axis of
+ * the encoder and the voltage minus the resistive drop is integrated, which
+ * gives the change in flux linkage on both axes. The current control gains,
+ * resistance, flux linkage and encoder have to be set up before running this,
+ * and the rotor must not be able to move as the q axis current produces
+ * torque.
+ *
+ * @param i_max
+ * The largest current in the map.
+ *
+ * @param print
+ * Print progress.
+ *
+ * @param ld
+ * Ld table output with FOC_SAT_MAP_SIZE entries.
+ *
+ * @param lq
+ * Lq table output with FOC_SAT_MAP_SIZE entries.
+ *
+ * @param lambda
+ * Flux linkage table output with FOC_SAT_MAP_SIZE entries.
+ *
+ * @return
+ * The fault code
+ */
+int mcpwm_foc_measure_sat_map(float i_max, bool print, float *ld, float *lq, float *lambda) {
+	int fault = FAULT_CODE_NONE;
+	mc_interface_lock();
+
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	motor->m_phase_override = true;
+	motor->m_phase_now_override = motor->m_phase_now_encoder;
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_CURRENT;
+	motor->m_motor_released = false;
+	motor->m_state = MC_STATE_RUNNING;
+
+	// Disable timeout
+	systime_t tout = timeout_get_timeout_msec();
+	float tout_c = timeout_get_brake_current();
+	KILL_SW_MODE tout_ksw = timeout_get_kill_sw_mode();
+	timeout_reset();
+	timeout_configure(60000, 0.0, KILL_SW_MODE_DISABLED);
+
+	// Save configuration
+	float ldiff_old = motor->m_conf->foc_motor_ld_lq_diff;
+	float sat_i_old = motor->m_conf_local->foc_sat_map_i_max;
+	motor->m_conf->foc_motor_ld_lq_diff = 0.0;
+	motor->m_conf_local->foc_sat_map_i_max = 0.0;
+
+	// The flux linkages are stored in the output tables until the end
+	float *psi_d = ld;
+	float *psi_q = lq;
+	memset(psi_d, 0, sizeof(float) * FOC_SAT_MAP_SIZE);
+	memset(psi_q, 0, sizeof(float) * FOC_SAT_MAP_SIZE);
+
+	chThdSleepMilliseconds(500);
+
+	for (int k = 0;k < FOC_SAT_MAP_ID_N;k++) {
+		for (int j = 0;j < FOC_SAT_MAP_IQ_N;j++) {
+			if (k == 0 && j == 0) {
+				continue;
+			}
+
+			float id, iq;
+			foc_sat_map_meas_current(k, j, FOC_SAT_MAP_ID_N, FOC_SAT_MAP_IQ_N, i_max, &id, &iq);
+
+			foc_sat_map_step step_d = {0};
+			foc_sat_map_step step_q = {0};
+			flux_int_window(motor, 30, true, id, iq, &step_d, &step_q);
+			flux_int_window(motor, 10, false, id, iq, &step_d, &step_q);
+			motor->m_id_set = 0.0;
+			motor->m_iq_set = 0.0;
+
+			const int ind = k * FOC_SAT_MAP_IQ_N + j;
+			psi_d[ind] = foc_sat_map_step_flux(&step_d, motor->m_conf->foc_motor_r);
+			psi_q[ind] = foc_sat_map_step_flux(&step_q, motor->m_conf->foc_motor_r);
+
+			fault = mc_interface_get_fault();
+			if (fault != FAULT_CODE_NONE) {
+				goto exit_measure_sat_map;
+			}
+
+			// Let the flux decay before the next step
+			chThdSleepMilliseconds(20);
+			timeout_reset();
+		}
+
+		if (print) {
+			commands_printf("Row %d of %d done", k + 1, FOC_SAT_MAP_ID_N);
+		}
+	}
+
+	foc_sat_map_from_flux(psi_d, psi_q, FOC_SAT_MAP_ID_N, FOC_SAT_MAP_IQ_N, i_max,
+			motor->m_conf->foc_motor_flux_linkage, ld, lq, lambda);
+
+	exit_measure_sat_map:
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_phase_override = false;
+	motor->m_control_mode = CONTROL_MODE_NONE;
+	motor->m_state = MC_STATE_OFF;
+	stop_pwm_hw((motor_all_state_t*)motor);
+
+	// Restore configuration
+	motor->m_conf->foc_motor_ld_lq_diff = ldiff_old;
+	motor->m_conf_local->foc_sat_map_i_max = sat_i_old;
+
+	// Enable timeout
+	timeout_configure(tout, tout_c, tout_ksw);
+
+	mc_interface_unlock();
+	return fault;
+}
+
+/**
+ * Tune the current controller from a measurement of the plant. A multi-sine
+ * voltage is added to the d axis on top of a bias current and the response
+ * is fitted to R + sL with a delay. The delay includes everything the gains
+ * from conf_general_calc_apply_foc_cc_kp_ki_gain do not account for, such as
+ * the PWM update, the sampling mode and current filters. The bias current
+ * keeps the current away from zero during the measurement, so that dead time
+ * does not show up as resistance. The motor resistance and inductance have to
+ * be detected before running this.
+ *
+ * @param current
+ * Bias current and peak current of the multi-sine.
+ *
+ * @param bw
+ * Requested bandwidth in rad/s, 0 for the highest that meets the phase margin.
+ *
+ * @param pm
+ * Phase margin in radians.
+ *
+ * @param print
+ * Print progress.
+ *
+ * @param r
+ * Fitted resistance.
+ *
+ * @param l
+ * Fitted inductance.
+ *
+ * @param delay
+ * Fitted loop delay in seconds.
+ *
+ * @param kp
+ * Resulting proportional gain.
+ *
+ * @param ki
+ * Resulting integral gain.
+ *
+ * @return
+ * The fault code. The gains are set to 0 if the fit failed.
+ */
+int mcpwm_foc_tune_current_loop(float current, float bw, float pm, bool print,
+		float *r, float *l, float *delay, float *kp, float *ki) {
+	int fault = FAULT_CODE_NONE;
+	mc_interface_lock();
+
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	*kp = 0.0;
+	*ki = 0.0;
+
+	motor->m_phase_override = true;
+	motor->m_phase_now_override = 0.0;
+	motor->m_id_set = current;
+	motor->m_iq_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_CURRENT;
+	motor->m_motor_released = false;
+	motor->m_state = MC_STATE_RUNNING;
+
+	// Disable timeout
+	systime_t tout = timeout_get_timeout_msec();
+	float tout_c = timeout_get_brake_current();
+	KILL_SW_MODE tout_ksw = timeout_get_kill_sw_mode();
+	timeout_reset();
+	timeout_configure(60000, 0.0, KILL_SW_MODE_DISABLED);
+
+	// Save configuration
+	float ldiff_old = motor->m_conf->foc_motor_ld_lq_diff;
+	float kp_old = motor->m_conf->foc_current_kp;
+	float ki_old = motor->m_conf->foc_current_ki;
+	bool temp_comp_old = motor->m_conf->foc_temp_comp;
+	motor->m_conf->foc_motor_ld_lq_diff = 0.0;
+	motor->m_conf->foc_temp_comp = false;
+
+	// Settle at the bias current with the configured gains
+	chThdSleepMilliseconds(500);
+
+	const float dt = 1.0 / mcpwm_foc_get_sampling_frequency_now();
+	const float r_det = motor->m_conf->foc_motor_r;
+	const float l_det = motor->m_conf->foc_motor_l;
+	foc_cc_tune_init((foc_cc_tune_state*)&motor->m_cc_tune, r_det, l_det, dt, current,
+			0.25 * mc_interface_get_input_voltage_filtered());
+
+	// Only integral action far below the lowest tone, which holds the bias
+	// current without reacting to the multi-sine.
+	const float f_min = (float)motor->m_cc_tune.harm[0] / ((float)FOC_CC_TUNE_PERIOD * dt);
+	motor->m_conf->foc_current_kp = 0.0;
+	motor->m_conf->foc_current_ki = r_det * 2.0 * M_PI * f_min * 0.1;
+	motor->m_cc_tune_run = true;
+
+	if (print) {
+		commands_printf("Recording for %.2f s", (double)((float)((FOC_CC_TUNE_SKIP + FOC_CC_TUNE_RECORD) *
+				FOC_CC_TUNE_PERIOD) * dt));
+	}
+
+	while (!foc_cc_tune_done((foc_cc_tune_state*)&motor->m_cc_tune)) {
+		fault = mc_interface_get_fault();
+		if (fault != FAULT_CODE_NONE) {
+			goto exit_tune_current_loop;
+		}
+
+		chThdSleepMilliseconds(10);
+		timeout_reset();
+	}
+
+	motor->m_cc_tune_run = false;
+
+	if (foc_cc_tune_fit((foc_cc_tune_state*)&motor->m_cc_tune, r, l, delay)) {
+		foc_cc_tune_gains(*r, *l, *delay, bw, pm, kp, ki);
+	}
+
+	exit_tune_current_loop:
+	motor->m_cc_tune_run = false;
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_phase_override = false;
+	motor->m_control_mode = CONTROL_MODE_NONE;
+	motor->m_state = MC_STATE_OFF;
+	stop_pwm_hw((motor_all_state_t*)motor);
+
+	// Restore configuration
+	motor->m_conf->foc_motor_ld_lq_diff = ldiff_old;
+	motor->m_conf->foc_current_kp = kp_old;
+	motor->m_conf->foc_current_ki = ki_old;
+	motor->m_conf->foc_temp_comp = temp_comp_old;
+
+	// Enable timeout
+	timeout_configure(tout, tout_c, tout_ksw);
+
+	mc_interface_unlock();
+	return fault;
+}
+
 /**
  * Lock the motor with a current and sample the voltage and current to
  * calculate the motor resistance.
@@ -2802,6 +3358,110 @@ float mcpwm_foc_get_last_adc_isr_duration(void) {
 	return m_last_adc_isr_duration;
 }
 
+/**
+ * Get the longest ADC interrupt duration.
+ *
+ * @param reset
+ * Start over from the next interrupt.
+ *
+ * @return
+ * The duration in seconds.
+ */
+float mcpwm_foc_get_max_adc_isr_duration(bool reset) {
+	float ret = m_max_adc_isr_duration;
+	if (reset) {
+		m_max_adc_isr_duration = 0.0;
+	}
+	return ret;
+}
+
+/**
+ * Get the largest deviation of the speed and position PID sample time from
+ * the configured loop rate. This is the scheduling jitter when the PIDs run
+ * in a thread and the interrupt latency jitter when they run in the ADC
+ * interrupt.
+ *
+ * @param reset
+ * Start over.
+ *
+ * @return
+ * The jitter in seconds.
+ */
+float mcpwm_foc_get_max_pid_jitter(bool reset) {
+	float ret = m_max_pid_jitter;
+	if (reset) {
+		m_max_pid_jitter = 0.0;
+	}
+	return ret;
+}
+
+/**
+ * Run a function in the ADC interrupt every div control loop iterations for
+ * each motor. The function gets a snapshot of the motor state and can change
+ * the d and q axis current targets, which are used when the motor runs in
+ * current control mode. The execution time of every call is measured and the
+ * hook is removed if it takes longer than the budget, after which the current
+ * targets of an engaged motor are set to 0.
+ *
+ * @param hook
+ * The function to run, NULL to remove the current hook.
+ *
+ * @param arg
+ * Argument to pass to the hook.
+ *
+ * @param div
+ * Run the hook every div control loop iterations.
+ *
+ * @param budget
+ * Maximum time the hook may take in seconds.
+ */
+void mcpwm_foc_set_control_hook(foc_hook_fun hook, void *arg, int div, float budget) {
+	utils_sys_lock_cnt();
+	m_hook = NULL;
+	m_hook_arg = arg;
+	m_hook_div = div < 1 ? 1 : div;
+	m_hook_budget = budget;
+	m_hook_max_time = 0.0;
+	m_hook_overrun = false;
+	m_motor_1.m_hook_cnt = 0;
+#ifdef HW_HAS_DUAL_MOTORS
+	m_motor_2.m_hook_cnt = 0;
+#endif
+	m_hook = hook;
+	utils_sys_unlock_cnt();
+}
+
+foc_hook_fun mcpwm_foc_get_control_hook(void) {
+	return m_hook;
+}
+
+/**
+ * Check if the control hook was removed because it exceeded its budget.
+ *
+ * @return
+ * True if the last hook that was set has been removed on overrun.
+ */
+bool mcpwm_foc_control_hook_overrun(void) {
+	return m_hook_overrun;
+}
+
+/**
+ * Get the longest execution time of the control hook.
+ *
+ * @param reset
+ * Start over.
+ *
+ * @return
+ * The time in seconds.
+ */
+float mcpwm_foc_get_control_hook_max_time(bool reset) {
+	float ret = m_hook_max_time;
+	if (reset) {
+		m_hook_max_time = 0.0;
+	}
+	return ret;
+}
+
 #pragma GCC pop_options
 
 void mcpwm_foc_tim_sample_int_handler(void) {
@@ -3406,8 +4066,17 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		}
 
 		// Apply MTPA. See: https://github.com/vedderb/bldc/pull/179
+		// With a saturation map the precalculated torque-maximizing curve is used.
 		const float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
-		if (conf_now->foc_mtpa_mode != MTPA_MODE_OFF && ld_lq_diff != 0.0) {
+		if (conf_now->foc_mtpa_mode != MTPA_MODE_OFF && motor_now->m_conf_local->foc_sat_map_i_max > 0.0) {
+			float iq_ref = iq_set_tmp;
+			if (conf_now->foc_mtpa_mode == MTPA_MODE_IQ_MEASURED) {
+				iq_ref = utils_min_abs(iq_set_tmp, motor_now->m_motor_state.iq_filter);
+			}
+
+			id_set_tmp = foc_sat_map_mtpa_id(motor_now->p_sat_mtpa_id, motor_now->m_conf_local->foc_sat_map_i_max, iq_ref);
+			iq_set_tmp = SIGN(iq_set_tmp) * sqrtf(SQ(iq_set_tmp) - SQ(id_set_tmp));
+		} else if (conf_now->foc_mtpa_mode != MTPA_MODE_OFF && ld_lq_diff != 0.0) {
 			const float lambda = conf_now->foc_motor_flux_linkage;
 
 			float iq_ref = iq_set_tmp;
@@ -3672,6 +4341,25 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		utils_norm_angle((float*)&motor_now->m_pos_pid_now);
 	}
 
+	// Flux integrals for the saturation map measurement
+	if (motor_now->m_flux_int_run) {
+		motor_now->m_flux_int_vd += motor_now->m_motor_state.vd * dt;
+		motor_now->m_flux_int_vq += motor_now->m_motor_state.vq * dt;
+		motor_now->m_flux_int_id += motor_now->m_motor_state.id * dt;
+		motor_now->m_flux_int_iq += motor_now->m_motor_state.iq * dt;
+		motor_now->m_flux_int_t += dt;
+	}
+
+	if (motor_now->m_conf_local->sp_pid_loop_in_isr) {
+		run_pid_isr(motor_now, dt);
+	} else {
+		motor_now->m_pid_isr_running = false;
+	}
+
+	if (m_hook) {
+		run_control_hook(motor_now, dt);
+	}
+
 #ifdef AD2S1205_SAMPLE_GPIO
 	// Release sample in the AD2S1205 resolver IC.
 	palSetPad(AD2S1205_SAMPLE_GPIO, AD2S1205_SAMPLE_PIN);
@@ -3685,6 +4373,10 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 
 	m_isr_motor = 0;
 	m_last_adc_isr_duration = timer_seconds_elapsed_since(t_start);
+
+	if (m_last_adc_isr_duration > m_max_adc_isr_duration) {
+		m_max_adc_isr_duration = m_last_adc_isr_duration;
+	}
 }
 
 // Private functions
@@ -4269,6 +4961,21 @@ static THD_FUNCTION(pid_thread, arg) {
 			return;
 		}
 
+		bool run_m1 = !m_motor_1.m_conf_local->sp_pid_loop_in_isr;
+#ifdef HW_HAS_DUAL_MOTORS
+		bool run_m2 = !m_motor_2.m_conf_local->sp_pid_loop_in_isr;
+#else
+		bool run_m2 = false;
+#endif
+
+		// The PIDs run from the ADC interrupt, only check for stop and
+		// configuration changes.
+		if (!run_m1 && !run_m2) {
+			chThdSleepMilliseconds(1);
+			last_time = timer_time_now();
+			continue;
+		}
+
 		switch (m_motor_1.m_conf->sp_pid_loop_rate) {
 		case PID_RATE_25_HZ: chThdSleepMicroseconds(1000000 / 25); break;
 		case PID_RATE_50_HZ: chThdSleepMicroseconds(1000000 / 50); break;
@@ -4284,16 +4991,126 @@ static THD_FUNCTION(pid_thread, arg) {
 		float dt = timer_seconds_elapsed_since(last_time);
 		last_time = timer_time_now();
 
+		update_pid_jitter(dt - 1.0 / pid_rate_hz(m_motor_1.m_conf->sp_pid_loop_rate));
+
 		bool index_found = encoder_index_found();
-		foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_1);
-		foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_1);
+		if (run_m1) {
+			foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_1);
+			foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_1);
+		}
 #ifdef HW_HAS_DUAL_MOTORS
-		foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_2);
-		foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_2);
+		if (run_m2) {
+			foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_2);
+			foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_2);
+		}
 #endif
 	}
 }
 
+static float pid_rate_hz(PID_RATE rate) {
+	switch (rate) {
+	case PID_RATE_25_HZ: return 25.0;
+	case PID_RATE_50_HZ: return 50.0;
+	case PID_RATE_100_HZ: return 100.0;
+	case PID_RATE_250_HZ: return 250.0;
+	case PID_RATE_500_HZ: return 500.0;
+	case PID_RATE_1000_HZ: return 1000.0;
+	case PID_RATE_2500_HZ: return 2500.0;
+	case PID_RATE_5000_HZ: return 5000.0;
+	case PID_RATE_10000_HZ: return 10000.0;
+	default: return 1000.0;
+	}
+}
+
+static void update_pid_jitter(float jitter) {
+	jitter = fabsf(jitter);
+	if (jitter > m_max_pid_jitter) {
+		m_max_pid_jitter = jitter;
+	}
+}
+
+/*
+ * Run the speed and position PIDs every N-th control loop iteration, where N
+ * is as close as possible to the configured PID rate. The sample time is then
+ * exactly N control periods instead of whatever the scheduler gives the PID
+ * thread.
+ */
+static void run_pid_isr(motor_all_state_t *motor, float dt) {
+	int div = (int)(1.0 / (pid_rate_hz(motor->m_conf->sp_pid_loop_rate) * dt) + 0.5);
+	utils_truncate_number_int(&div, 1, 10000);
+
+	motor->m_pid_isr_cnt++;
+	if (motor->m_pid_isr_cnt < div) {
+		return;
+	}
+	motor->m_pid_isr_cnt = 0;
+
+	float dt_pid = (float)div * dt;
+
+	if (motor->m_pid_isr_running) {
+		update_pid_jitter(timer_seconds_elapsed_since(motor->m_pid_isr_time_last) - dt_pid);
+	}
+	motor->m_pid_isr_time_last = timer_time_now();
+	motor->m_pid_isr_running = true;
+
+	bool index_found = encoder_index_found();
+	foc_run_pid_control_pos(index_found, dt_pid, motor);
+	foc_run_pid_control_speed(index_found, dt_pid, motor);
+}
+
+static void run_control_hook(motor_all_state_t *motor, float dt) {
+	motor->m_hook_cnt++;
+	if (motor->m_hook_cnt < m_hook_div) {
+		return;
+	}
+	motor->m_hook_cnt = 0;
+
+	foc_hook_fun hook = m_hook;
+	mc_configuration *conf = motor->m_conf;
+
+	foc_hook_state s;
+	s.motor = m_isr_motor;
+	s.dt = (float)m_hook_div * dt;
+	s.phase = motor->m_motor_state.phase;
+	s.speed = motor->m_pll_speed;
+	s.pos = motor->m_pos_pid_now;
+	s.id = motor->m_motor_state.id;
+	s.iq = motor->m_motor_state.iq;
+	s.vd = motor->m_motor_state.vd;
+	s.vq = motor->m_motor_state.vq;
+	s.v_in = motor->m_motor_state.v_bus;
+	s.engaged = motor->m_state == MC_STATE_RUNNING && motor->m_control_mode == CONTROL_MODE_CURRENT;
+	s.id_set = motor->m_id_set;
+	s.iq_set = motor->m_iq_set;
+
+	uint32_t t_start = timer_time_now();
+	hook(&s, m_hook_arg);
+	float t = timer_seconds_elapsed_since(t_start);
+
+	if (t > m_hook_max_time) {
+		m_hook_max_time = t;
+	}
+
+	// Whatever the hook was controlling is gone, so do not leave the
+	// last targets it wrote running.
+	if (t > m_hook_budget) {
+		m_hook = NULL;
+		m_hook_overrun = true;
+		if (s.engaged) {
+			motor->m_id_set = 0.0;
+			motor->m_iq_set = 0.0;
+		}
+		return;
+	}
+
+	if (s.engaged) {
+		utils_truncate_number(&s.iq_set, conf->lo_current_min, conf->lo_current_max);
+		utils_truncate_number_abs(&s.id_set, conf->lo_current_max);
+		motor->m_id_set = s.id_set;
+		motor->m_iq_set = s.iq_set;
+	}
+}
+
 /**
  * Run the current control loop.
  *
@@ -4372,6 +5189,20 @@ static void control_current(motor_all_state_t *motor, float dt) {
 
 	motor->m_cc_was_hfi = do_hfi;
 
+	// Cogging compensation as q axis current feedforward. The table is indexed by
+	// the electrical encoder angle it was calibrated against.
+	if (motor->m_conf_local->foc_cogging_comp_scale > 0.0 &&
+			conf_now->foc_sensor_mode == FOC_SENSOR_MODE_ENCODER &&
+			!motor->m_phase_override &&
+			(motor->m_control_mode == CONTROL_MODE_CURRENT ||
+					motor->m_control_mode == CONTROL_MODE_SPEED ||
+					motor->m_control_mode == CONTROL_MODE_POS)) {
+		state_m->iq_target += foc_cogging_lookup(motor->m_conf_local->foc_cogging_comp_table, FOC_COGGING_TABLE_SIZE,
+				motor->m_conf_local->foc_cogging_comp_scale, motor->m_phase_now_encoder);
+		utils_truncate_number_abs((float*)&state_m->iq_target,
+				fabsf(utils_max_abs(conf_now->lo_current_max, conf_now->lo_current_min)));
+	}
+
 	float max_duty = fabsf(state_m->max_duty);
 	utils_truncate_number(&max_duty, 0.0, conf_now->l_max_duty);
 
@@ -4447,6 +5278,11 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	state_m->vd -= dec_vd; //Negative sign as in the PMSM equations
 	state_m->vq += dec_vq + dec_bemf;
 
+	// Multi-sine on the d axis for tuning the current controller
+	if (motor->m_cc_tune_run) {
+		state_m->vd += foc_cc_tune_signal(&motor->m_cc_tune);
+	}
+
 	// Calculate the max length of the voltage space vector without overmodulation.
 	// Is simply 1/sqrt(3) * v_bus. See https://microchipdeveloper.com/mct5001:start. Adds margin with max_duty.
 	float max_v_mag = ONE_BY_SQRT3 * max_duty * state_m->v_bus * conf_now->foc_overmod_factor;
@@ -4464,6 +5300,10 @@ static void control_current(motor_all_state_t *motor, float dt) {
 
 	utils_saturate_vector_2d((float*)&state_m->vd, (float*)&state_m->vq, max_v_mag);
 
+	if (motor->m_cc_tune_run) {
+		foc_cc_tune_sample(&motor->m_cc_tune, state_m->vd, state_m->id, dt);
+	}
+
 	// mod_d and mod_q are normalized such that 1 corresponds to the max possible voltage:
 	//    voltage_normalize = 1/(2/3*V_bus)
 	// This includes overmodulation and therefore cannot be made in any direction.
@@ -30,6 +30,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2);
 void mcpwm_foc_deinit(void);
 bool mcpwm_foc_init_done(void);
 void mcpwm_foc_set_configuration(mc_configuration *configuration);
+void mcpwm_foc_update_local_configuration(void);
 mc_state mcpwm_foc_get_state(void);
 mc_control_mode mcpwm_foc_control_mode(void);
 bool mcpwm_foc_is_dccal_done(void);
@@ -91,6 +92,11 @@ float mcpwm_foc_get_est_res(void);
 float mcpwm_foc_get_est_ind(void);
 volatile const hfi_state_t *mcpwm_foc_get_hfi_state(void);
 int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ratio, bool *inverted);
+int mcpwm_foc_cogging_calibrate(float sweep_time, bool print, int8_t *table, float *scale);
+int mcpwm_foc_encoder_corr_calibrate(float current, float rev_time, bool print, int16_t *table, float *max_err);
+int mcpwm_foc_measure_sat_map(float i_max, bool print, float *ld, float *lq, float *lambda);
+int mcpwm_foc_tune_current_loop(float current, float bw, float pm, bool print,
+		float *r, float *l, float *delay, float *kp, float *ki);
 int mcpwm_foc_measure_resistance(float current, int samples, bool stop_after, float *resistance);
 int mcpwm_foc_measure_inductance(float duty, int samples, float *curr, float *ld_lq_diff, float *inductance);
 int mcpwm_foc_measure_inductance_current(float curr_goal, int samples, float *curr, float *ld_lq_diff, float *inductance);
@@ -108,6 +114,12 @@ int mcpwm_foc_hall_detect(float current, uint8_t *hall_table, bool *result);
 int mcpwm_foc_dc_cal(bool cal_undriven);
 void mcpwm_foc_print_state(void);
 float mcpwm_foc_get_last_adc_isr_duration(void);
+float mcpwm_foc_get_max_adc_isr_duration(bool reset);
+float mcpwm_foc_get_max_pid_jitter(bool reset);
+void mcpwm_foc_set_control_hook(foc_hook_fun hook, void *arg, int div, float budget);
+foc_hook_fun mcpwm_foc_get_control_hook(void);
+bool mcpwm_foc_control_hook_overrun(void);
+float mcpwm_foc_get_control_hook_max_time(bool reset);
 void mcpwm_foc_get_current_offsets(
 		volatile float *curr0_offset,
 		volatile float *curr1_offset,
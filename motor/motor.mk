@@ -1,5 +1,9 @@
 CSRC += \
 	motor/foc_math.c \
+	motor/foc_cogging.c \
+	motor/foc_traj.c \
+	motor/foc_sat_map.c \
+	motor/foc_cc_tune.c \
 	motor/mc_interface.c \
 	motor/mcpwm.c \
 	motor/mcpwm_foc.c \
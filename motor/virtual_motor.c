@@ -48,6 +48,8 @@ typedef struct{
 	bool connected;				//true => connected; false => disconnected;
 	float tsj;					// Ts / J;
 	float ml;					//load torque
+	float cog_torque;			//cogging torque amplitude in Nm
+	int cog_periods;			//cogging periods per electrical revolution
 	float v_alpha;				//alpha axis voltage in Volts
 	float v_beta; 				//beta axis voltage in Volts
 	float va;					//phase a voltage in Volts
@@ -77,6 +79,7 @@ static inline void run_virtual_motor(float v_alpha, float v_beta, float ml);
 static inline void run_virtual_motor_park_clark_inverse( void );
 static void terminal_cmd_connect_virtual_motor(int argc, const char **argv);
 static void terminal_cmd_disconnect_virtual_motor(int argc, const char **argv);
+static void terminal_cmd_virtual_motor_cogging(int argc, const char **argv);
 
 //Public Functions
 
@@ -104,6 +107,8 @@ void virtual_motor_init(volatile mc_configuration *conf){
 	virtual_motor.i_beta = 0.0;
 	virtual_motor.id_int = 0.0;
 	virtual_motor.iq = 0.0;
+	virtual_motor.cog_torque = 0.0;
+	virtual_motor.cog_periods = 0;
 
 	// Register terminal callbacks used for virtual motor setup
 	terminal_register_command_callback(
@@ -117,6 +122,12 @@ void virtual_motor_init(volatile mc_configuration *conf){
 				"disconnect virtual motor",
 				0,
 				terminal_cmd_disconnect_virtual_motor);
+
+	terminal_register_command_callback(
+				"virtual_motor_cogging",
+				"sets cogging torque of virtual motor",
+				"[torque][periods]",
+				terminal_cmd_virtual_motor_cogging);
 }
 
 void virtual_motor_set_configuration(volatile mc_configuration *conf){
@@ -335,8 +346,14 @@ static inline void run_virtual_motor_mechanics(float ml){
 	virtual_motor.me =  virtual_motor.km * (m_conf->foc_motor_flux_linkage +
 											(virtual_motor.ld - virtual_motor.lq) *
 											virtual_motor.id ) * virtual_motor.iq;
+	// cogging torque, periodic in the electrical angle
+	float mc = 0.0;
+	if (virtual_motor.cog_periods > 0) {
+		mc = virtual_motor.cog_torque * sinf((float)virtual_motor.cog_periods * virtual_motor.phi);
+	}
+
 	// omega
-	virtual_motor.we += virtual_motor.tsj * (virtual_motor.me - ml);
+	virtual_motor.we += virtual_motor.tsj * (virtual_motor.me - ml - mc);
 
 	// phi
 	virtual_motor.phi += virtual_motor.we * virtual_motor.Ts;
@@ -422,3 +439,23 @@ static void terminal_cmd_disconnect_virtual_motor(int argc, const char **argv) {
 	commands_printf("virtual motor disconnected");
 	commands_printf(" ");
 }
+
+/**
+ * virtual_motor_cogging command
+ */
+static void terminal_cmd_virtual_motor_cogging(int argc, const char **argv) {
+	if( argc == 3 ){
+		float torque; //cogging torque amplitude
+		int periods; //periods per electrical revolution
+
+		sscanf(argv[1], "%f", &torque);
+		sscanf(argv[2], "%d", &periods);
+
+		virtual_motor.cog_torque = torque;
+		virtual_motor.cog_periods = periods;
+		commands_printf("virtual motor cogging set");
+	}
+	else{
+		commands_printf("arguments should be 2" );
+	}
+}
@@ -0,0 +1,231 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#include "virtual_motor_batch.h"
+#include <math.h>
+#include <string.h>
+
+// Branchless version of utils_norm_angle_rad, to the range -pi to pi
+static inline float wrap_pi(float a) {
+	return a - (2.0f * (float)M_PI) * floorf((a + (float)M_PI) * (1.0f / (2.0f * (float)M_PI)));
+}
+
+/**
+ * Initialize a batch of virtual motors at standstill. All parameters are
+ * zero, so every motor has to be set up with virtual_motor_batch_set_motor.
+ *
+ * @param m
+ * The batch.
+ *
+ * @param n
+ * Number of motors, up to VIRTUAL_MOTOR_BATCH_SIZE.
+ *
+ * @param ts
+ * Sample time.
+ */
+void virtual_motor_batch_init(virtual_motor_batch *m, int n, float ts) {
+	memset(m, 0, sizeof(virtual_motor_batch));
+	m->n = n > VIRTUAL_MOTOR_BATCH_SIZE ? VIRTUAL_MOTOR_BATCH_SIZE : n;
+	m->ts = ts;
+
+	for (int i = 0;i < VIRTUAL_MOTOR_BATCH_SIZE;i++) {
+		m->cos_phi[i] = 1.0f;
+	}
+}
+
+/**
+ * Set the parameters of one motor in a batch, the same way as
+ * virtual_motor_set_configuration does from the motor configuration.
+ */
+void virtual_motor_batch_set_motor(virtual_motor_batch *m, int ind, float r, float l, float ld_lq_diff,
+		float lambda, int poles, float J) {
+	m->r[ind] = r;
+	m->ld[ind] = l - ld_lq_diff / 2.0f;
+	m->lq[ind] = l + ld_lq_diff / 2.0f;
+	m->lambda[ind] = lambda;
+	m->pole_pairs[ind] = (float)(poles / 2);
+	m->ts_j[ind] = m->ts / J;
+}
+
+/**
+ * Run one sample of all motors in a batch.
+ *
+ * @param m
+ * The batch.
+ *
+ * @param v_alpha
+ * Alpha voltage for every motor.
+ *
+ * @param v_beta
+ * Beta voltage for every motor.
+ */
+void virtual_motor_batch_run(virtual_motor_batch *m, const float *v_alpha, const float *v_beta) {
+	const int n = m->n;
+	const float ts = m->ts;
+
+	// Electrical model
+	for (int i = 0;i < n;i++) {
+		const float c = m->cos_phi[i];
+		const float s = m->sin_phi[i];
+		const float vd = c * v_alpha[i] + s * v_beta[i];
+		const float vq = c * v_beta[i] - s * v_alpha[i];
+		const float id = m->id[i];
+		const float iq = m->iq[i];
+		const float we = m->we[i];
+
+		m->id[i] = id + (vd + we * m->lq[i] * iq - m->r[i] * id) * ts / m->ld[i];
+		m->iq[i] = iq + (vq - we * (m->ld[i] * id + m->lambda[i]) - m->r[i] * iq) * ts / m->lq[i];
+	}
+
+	// Mechanics
+	for (int i = 0;i < n;i++) {
+		const float pp = m->pole_pairs[i];
+		const float me = 1.5f * pp * (m->lambda[i] + (m->ld[i] - m->lq[i]) * m->id[i]) * m->iq[i];
+		const float wm = m->we[i] / pp;
+		m->we[i] += pp * m->ts_j[i] * (me - m->ml[i] - m->b[i] * wm);
+		m->phi[i] = wrap_pi(m->phi[i] + m->we[i] * ts);
+	}
+
+	// Currents in the stationary frame. Separate loops for sin and cos, as
+	// sincosf does not vectorize.
+	for (int i = 0;i < n;i++) {
+		m->sin_phi[i] = sinf(m->phi[i]);
+	}
+
+	for (int i = 0;i < n;i++) {
+		m->cos_phi[i] = cosf(m->phi[i]);
+	}
+
+	for (int i = 0;i < n;i++) {
+		const float c = m->cos_phi[i];
+		const float s = m->sin_phi[i];
+		m->i_alpha[i] = c * m->id[i] - s * m->iq[i];
+		m->i_beta[i] = c * m->iq[i] + s * m->id[i];
+	}
+}
+
+/**
+ * Initialize the controllers for a batch. Gains, motor parameters, current
+ * setpoints and the voltage limit have to be set for each motor after this.
+ *
+ * @param c
+ * The controllers.
+ *
+ * @param n
+ * Number of motors, up to VIRTUAL_MOTOR_BATCH_SIZE.
+ *
+ * @param ts
+ * Sample time.
+ */
+void virtual_motor_batch_ctrl_init(virtual_motor_batch_ctrl *c, int n, float ts) {
+	memset(c, 0, sizeof(virtual_motor_batch_ctrl));
+	c->n = n > VIRTUAL_MOTOR_BATCH_SIZE ? VIRTUAL_MOTOR_BATCH_SIZE : n;
+	c->ts = ts;
+}
+
+/**
+ * Run one sample of the controllers. The observer is the original Ortega
+ * observer from foc_observer_update, the PLL is foc_pll_run and the current
+ * controller is the PI controller from control_current without decoupling.
+ * As in mcpwm_foc, the observer angle is used for the Park transform and the
+ * PLL gives the speed.
+ *
+ * @param c
+ * The controllers.
+ *
+ * @param i_alpha
+ * Measured alpha current for every motor.
+ *
+ * @param i_beta
+ * Measured beta current for every motor.
+ */
+void virtual_motor_batch_ctrl_run(virtual_motor_batch_ctrl *c, const float *i_alpha, const float *i_beta) {
+	const int n = c->n;
+	const float ts = c->ts;
+
+	// Observer, with the voltage that was applied during the last sample
+	for (int i = 0;i < n;i++) {
+		const float l_ia = c->l[i] * i_alpha[i];
+		const float l_ib = c->l[i] * i_beta[i];
+		const float f1 = c->x1[i] - l_ia;
+		const float f2 = c->x2[i] - l_ib;
+		const float err = fminf(c->lambda[i] * c->lambda[i] - (f1 * f1 + f2 * f2), 0.0f);
+		const float gamma_half = 0.5f * c->gamma[i];
+
+		c->x1[i] += (c->v_alpha[i] - c->r[i] * i_alpha[i] + gamma_half * f1 * err) * ts;
+		c->x2[i] += (c->v_beta[i] - c->r[i] * i_beta[i] + gamma_half * f2 * err) * ts;
+	}
+
+	for (int i = 0;i < n;i++) {
+		c->phase_obs[i] = atan2f(c->x2[i] - c->l[i] * i_beta[i], c->x1[i] - c->l[i] * i_alpha[i]);
+	}
+
+	// PLL
+	for (int i = 0;i < n;i++) {
+		const float delta = wrap_pi(c->phase_obs[i] - c->pll_phase[i]);
+		c->pll_phase[i] = wrap_pi(c->pll_phase[i] + (c->pll_speed[i] + c->pll_kp[i] * delta) * ts);
+		c->pll_speed[i] += c->pll_ki[i] * delta * ts;
+	}
+
+	// Current controller
+	float sin_obs[VIRTUAL_MOTOR_BATCH_SIZE];
+	float cos_obs[VIRTUAL_MOTOR_BATCH_SIZE];
+
+	for (int i = 0;i < n;i++) {
+		sin_obs[i] = sinf(c->phase_obs[i]);
+	}
+
+	for (int i = 0;i < n;i++) {
+		cos_obs[i] = cosf(c->phase_obs[i]);
+	}
+
+	for (int i = 0;i < n;i++) {
+		const float s = sin_obs[i];
+		const float co = cos_obs[i];
+		const float id = co * i_alpha[i] + s * i_beta[i];
+		const float iq = co * i_beta[i] - s * i_alpha[i];
+		const float err_d = c->id_set[i] - id;
+		const float err_q = c->iq_set[i] - iq;
+
+		c->vd_int[i] += err_d * c->ki[i] * ts;
+		c->vq_int[i] += err_q * c->ki[i] * ts;
+		float vd = c->vd_int[i] + err_d * c->kp[i];
+		float vq = c->vq_int[i] + err_q * c->kp[i];
+
+		// Saturation and anti-windup on the voltage magnitude
+		const float scale = fminf(1.0f, c->v_max[i] / sqrtf(vd * vd + vq * vq + 1e-12f));
+		vd *= scale;
+		vq *= scale;
+		c->vd_int[i] *= scale;
+		c->vq_int[i] *= scale;
+
+		c->v_alpha[i] = co * vd - s * vq;
+		c->v_beta[i] = co * vq + s * vd;
+	}
+}
+
+/**
+ * Run one sample of a batch of motors with their controllers. The voltage
+ * calculated in one sample is applied in the next, as with the virtual motor.
+ */
+void virtual_motor_batch_step(virtual_motor_batch *m, virtual_motor_batch_ctrl *c) {
+	virtual_motor_batch_run(m, c->v_alpha, c->v_beta);
+	virtual_motor_batch_ctrl_run(c, m->i_alpha, m->i_beta);
+}
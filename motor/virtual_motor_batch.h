@@ -0,0 +1,103 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+
+#ifndef VIRTUAL_MOTOR_BATCH_H_
+#define VIRTUAL_MOTOR_BATCH_H_
+
+// Motors in one batch. The loops run over all of them, so this is also the
+// unit the host tools split between threads.
+#define VIRTUAL_MOTOR_BATCH_SIZE		256
+
+// Many independent virtual motors as a structure of arrays, so that each
+// step is a set of plain loops that the compiler can vectorize. Same model
+// as virtual_motor.c, with the speed in electrical rad/s and an optional
+// viscous load. This is for parameter sweeps on the host and is not part of
+// the firmware build.
+typedef struct {
+	int n;
+	float ts;
+
+	// Parameters
+	float r[VIRTUAL_MOTOR_BATCH_SIZE];
+	float ld[VIRTUAL_MOTOR_BATCH_SIZE];
+	float lq[VIRTUAL_MOTOR_BATCH_SIZE];
+	float lambda[VIRTUAL_MOTOR_BATCH_SIZE];
+	float pole_pairs[VIRTUAL_MOTOR_BATCH_SIZE];
+	float ts_j[VIRTUAL_MOTOR_BATCH_SIZE]; // ts / J
+	float ml[VIRTUAL_MOTOR_BATCH_SIZE]; // Load torque in Nm
+	float b[VIRTUAL_MOTOR_BATCH_SIZE]; // Viscous load in Nm / (mechanical rad/s)
+
+	// State
+	float id[VIRTUAL_MOTOR_BATCH_SIZE];
+	float iq[VIRTUAL_MOTOR_BATCH_SIZE];
+	float we[VIRTUAL_MOTOR_BATCH_SIZE];
+	float phi[VIRTUAL_MOTOR_BATCH_SIZE];
+	float sin_phi[VIRTUAL_MOTOR_BATCH_SIZE];
+	float cos_phi[VIRTUAL_MOTOR_BATCH_SIZE];
+	float i_alpha[VIRTUAL_MOTOR_BATCH_SIZE];
+	float i_beta[VIRTUAL_MOTOR_BATCH_SIZE];
+} virtual_motor_batch;
+
+// Controller for each motor in a batch, with the parts of mcpwm_foc that
+// are swept: the current controller, the original Ortega observer and the
+// PLL.
+typedef struct {
+	int n;
+	float ts;
+
+	// Gains
+	float kp[VIRTUAL_MOTOR_BATCH_SIZE];
+	float ki[VIRTUAL_MOTOR_BATCH_SIZE];
+	float gamma[VIRTUAL_MOTOR_BATCH_SIZE];
+	float pll_kp[VIRTUAL_MOTOR_BATCH_SIZE];
+	float pll_ki[VIRTUAL_MOTOR_BATCH_SIZE];
+
+	// Motor parameters as configured
+	float r[VIRTUAL_MOTOR_BATCH_SIZE];
+	float l[VIRTUAL_MOTOR_BATCH_SIZE];
+	float lambda[VIRTUAL_MOTOR_BATCH_SIZE];
+
+	// Inputs
+	float id_set[VIRTUAL_MOTOR_BATCH_SIZE];
+	float iq_set[VIRTUAL_MOTOR_BATCH_SIZE];
+	float v_max[VIRTUAL_MOTOR_BATCH_SIZE];
+
+	// State
+	float x1[VIRTUAL_MOTOR_BATCH_SIZE];
+	float x2[VIRTUAL_MOTOR_BATCH_SIZE];
+	float phase_obs[VIRTUAL_MOTOR_BATCH_SIZE];
+	float pll_phase[VIRTUAL_MOTOR_BATCH_SIZE];
+	float pll_speed[VIRTUAL_MOTOR_BATCH_SIZE];
+	float vd_int[VIRTUAL_MOTOR_BATCH_SIZE];
+	float vq_int[VIRTUAL_MOTOR_BATCH_SIZE];
+	float v_alpha[VIRTUAL_MOTOR_BATCH_SIZE];
+	float v_beta[VIRTUAL_MOTOR_BATCH_SIZE];
+} virtual_motor_batch_ctrl;
+
+// Functions
+void virtual_motor_batch_init(virtual_motor_batch *m, int n, float ts);
+void virtual_motor_batch_set_motor(virtual_motor_batch *m, int ind, float r, float l, float ld_lq_diff,
+		float lambda, int poles, float J);
+void virtual_motor_batch_run(virtual_motor_batch *m, const float *v_alpha, const float *v_beta);
+void virtual_motor_batch_ctrl_init(virtual_motor_batch_ctrl *c, int n, float ts);
+void virtual_motor_batch_ctrl_run(virtual_motor_batch_ctrl *c, const float *i_alpha, const float *i_beta);
+void virtual_motor_batch_step(virtual_motor_batch *m, virtual_motor_batch_ctrl *c);
+
+#endif /* VIRTUAL_MOTOR_BATCH_H_ */
@@ -39,6 +39,7 @@
 #include "mempools.h"
 #include "crc.h"
 #include "firmware_metadata.h"
+#include "virtual_motor.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -97,7 +98,14 @@ void terminal_process_string(char *str) {
 	if (strcmp(argv[0], "last_adc_duration") == 0) {
 		commands_printf("Latest ADC duration: %.4f ms", (double)(mcpwm_get_last_adc_isr_duration() * 1000.0));
 		commands_printf("Latest injected ADC duration: %.4f ms", (double)(mc_interface_get_last_inj_adc_isr_duration() * 1000.0));
-		commands_printf("Latest sample ADC duration: %.4f ms\n", (double)(mc_interface_get_last_sample_adc_isr_duration() * 1000.0));
+		commands_printf("Latest sample ADC duration: %.4f ms", (double)(mc_interface_get_last_sample_adc_isr_duration() * 1000.0));
+		commands_printf("Max FOC ADC duration: %.4f ms", (double)(mcpwm_foc_get_max_adc_isr_duration(true) * 1000.0));
+		if (mcpwm_foc_get_control_hook() || mcpwm_foc_control_hook_overrun()) {
+			commands_printf("Max control hook duration: %.4f ms%s", (double)(mcpwm_foc_get_control_hook_max_time(true) * 1000.0),
+					mcpwm_foc_control_hook_overrun() ? " (removed on overrun)" : "");
+		}
+		commands_printf("Max PID loop jitter: %.4f ms (%s)\n", (double)(mcpwm_foc_get_max_pid_jitter(true) * 1000.0),
+				mc_interface_get_local_configuration()->sp_pid_loop_in_isr ? "ADC interrupt" : "thread");
 	} else if (strcmp(argv[0], "kv") == 0) {
 		commands_printf("Calculated KV: %.2f rpm/volt\n", (double)mcpwm_get_kv_filtered());
 	} else if (strcmp(argv[0], "mem") == 0) {
@@ -313,6 +321,212 @@ void terminal_process_string(char *str) {
 		} else {
 			commands_printf("This command requires one argument. [current]\n");
 		}
+	} else if (strcmp(argv[0], "foc_cogging_cal") == 0) {
+		if (argc == 2) {
+			float sweep_time = -1.0;
+			sscanf(argv[1], "%f", &sweep_time);
+
+			const volatile mc_configuration *mcconf = mc_interface_get_configuration();
+
+			if (sweep_time >= 2.0 && sweep_time <= 50.0) {
+				if (mcconf->motor_type == MOTOR_TYPE_FOC &&
+						mcconf->foc_sensor_mode == FOC_SENSOR_MODE_ENCODER &&
+						(encoder_is_configured() || virtual_motor_is_connected())) {
+					commands_printf("Calibrating cogging compensation...");
+
+					mc_local_configuration *conf_local = mempools_alloc_mc_local();
+					*conf_local = *mc_interface_get_local_configuration();
+
+					float scale = 0.0;
+					int fault = mcpwm_foc_cogging_calibrate(sweep_time, true,
+							conf_local->foc_cogging_comp_table, &scale);
+
+					if (fault != FAULT_CODE_NONE) {
+						commands_printf("Fault occured during calibration: %s\n", mc_interface_fault_to_string(fault));
+					} else {
+						conf_local->foc_cogging_comp_scale = scale;
+						conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+						mc_interface_set_local_configuration(conf_local);
+
+						commands_printf("Peak compensation: %.3f A\n", (double)(scale * 127.0));
+					}
+
+					mempools_free_mc_local(conf_local);
+				} else {
+					commands_printf("FOC with encoder must be used.\n");
+				}
+			} else {
+				commands_printf("Invalid argument. Sweep time must be between 2 and 50 seconds.\n");
+			}
+		} else {
+			commands_printf("This command requires one argument. [sweep_time]\n");
+		}
+	} else if (strcmp(argv[0], "foc_cogging_clear") == 0) {
+		mc_local_configuration *conf_local = mempools_alloc_mc_local();
+		*conf_local = *mc_interface_get_local_configuration();
+		conf_local->foc_cogging_comp_scale = 0.0;
+		memset(conf_local->foc_cogging_comp_table, 0, sizeof(conf_local->foc_cogging_comp_table));
+		conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+		mc_interface_set_local_configuration(conf_local);
+		mempools_free_mc_local(conf_local);
+		commands_printf("Cogging compensation cleared\n");
+	} else if (strcmp(argv[0], "foc_encoder_corr_cal") == 0) {
+		if (argc == 3) {
+			float current = -1.0;
+			float rev_time = -1.0;
+			sscanf(argv[1], "%f", &current);
+			sscanf(argv[2], "%f", &rev_time);
+
+			const volatile mc_configuration *mcconf = mc_interface_get_configuration();
+
+			if (current > 0.0 && current <= mcconf->l_current_max && rev_time >= 2.0 && rev_time <= 100.0) {
+				if (mcconf->motor_type == MOTOR_TYPE_FOC && encoder_is_configured()) {
+					commands_printf("Calibrating encoder correction...");
+
+					mc_local_configuration *conf_local = mempools_alloc_mc_local();
+					*conf_local = *mc_interface_get_local_configuration();
+
+					float max_err = 0.0;
+					int fault = mcpwm_foc_encoder_corr_calibrate(current, rev_time, true,
+							conf_local->m_encoder_corr_table, &max_err);
+
+					if (fault != FAULT_CODE_NONE) {
+						commands_printf("Fault occured during calibration: %s\n", mc_interface_fault_to_string(fault));
+					} else {
+						conf_local->m_encoder_corr_enable = true;
+						conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+						mc_interface_set_local_configuration(conf_local);
+
+						commands_printf("Max correction: %.3f deg\n", (double)max_err);
+					}
+
+					mempools_free_mc_local(conf_local);
+				} else {
+					commands_printf("FOC with encoder must be used.\n");
+				}
+			} else {
+				commands_printf("Invalid argument(s). Current must be between 0.0 and %.2f and "
+						"time between 2 and 100 seconds.\n", (double)mcconf->l_current_max);
+			}
+		} else {
+			commands_printf("This command requires two arguments. [current] [rev_time]\n");
+		}
+	} else if (strcmp(argv[0], "foc_encoder_corr_clear") == 0) {
+		mc_local_configuration *conf_local = mempools_alloc_mc_local();
+		*conf_local = *mc_interface_get_local_configuration();
+		conf_local->m_encoder_corr_enable = false;
+		memset(conf_local->m_encoder_corr_table, 0, sizeof(conf_local->m_encoder_corr_table));
+		conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+		mc_interface_set_local_configuration(conf_local);
+		mempools_free_mc_local(conf_local);
+		commands_printf("Encoder correction cleared\n");
+	} else if (strcmp(argv[0], "foc_sat_map_measure") == 0) {
+		if (argc == 2) {
+			float i_max = -1.0;
+			sscanf(argv[1], "%f", &i_max);
+
+			const volatile mc_configuration *mcconf = mc_interface_get_configuration();
+
+			if (i_max > 0.0 && i_max <= mcconf->l_current_max) {
+				if (mcconf->motor_type == MOTOR_TYPE_FOC && encoder_is_configured()) {
+					commands_printf("Measuring saturation map...");
+
+					mc_local_configuration *conf_local = mempools_alloc_mc_local();
+					*conf_local = *mc_interface_get_local_configuration();
+
+					int fault = mcpwm_foc_measure_sat_map(i_max, true,
+							conf_local->foc_sat_map_ld, conf_local->foc_sat_map_lq, conf_local->foc_sat_map_lambda);
+
+					if (fault != FAULT_CODE_NONE) {
+						commands_printf("Fault occured during measurement: %s\n", mc_interface_fault_to_string(fault));
+					} else {
+						conf_local->foc_sat_map_i_max = i_max;
+						conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+						mc_interface_set_local_configuration(conf_local);
+
+						const int last = FOC_SAT_MAP_SIZE - 1;
+						commands_printf("At zero current:  Ld %.2f uH, Lq %.2f uH, lambda %.3f mWb",
+								(double)(conf_local->foc_sat_map_ld[0] * 1e6),
+								(double)(conf_local->foc_sat_map_lq[0] * 1e6),
+								(double)(conf_local->foc_sat_map_lambda[0] * 1e3));
+						commands_printf("At %.1f A, %.1f A: Ld %.2f uH, Lq %.2f uH, lambda %.3f mWb\n",
+								(double)-i_max, (double)i_max,
+								(double)(conf_local->foc_sat_map_ld[last] * 1e6),
+								(double)(conf_local->foc_sat_map_lq[last] * 1e6),
+								(double)(conf_local->foc_sat_map_lambda[last] * 1e3));
+					}
+
+					mempools_free_mc_local(conf_local);
+				} else {
+					commands_printf("FOC with encoder must be used.\n");
+				}
+			} else {
+				commands_printf("Invalid argument. The current must be between 0.0 and %.2f.\n",
+						(double)mcconf->l_current_max);
+			}
+		} else {
+			commands_printf("This command requires one argument. [i_max]\n");
+		}
+	} else if (strcmp(argv[0], "foc_sat_map_clear") == 0) {
+		mc_local_configuration *conf_local = mempools_alloc_mc_local();
+		*conf_local = *mc_interface_get_local_configuration();
+		conf_local->foc_sat_map_i_max = 0.0;
+		conf_general_store_mc_local_configuration(conf_local, mc_interface_get_motor_thread() == 2);
+		mc_interface_set_local_configuration(conf_local);
+		mempools_free_mc_local(conf_local);
+		commands_printf("Saturation map cleared\n");
+	} else if (strcmp(argv[0], "foc_cc_tune") == 0) {
+		if (argc == 4) {
+			float current = -1.0;
+			float bw_hz = -1.0;
+			float pm_deg = -1.0;
+			sscanf(argv[1], "%f", &current);
+			sscanf(argv[2], "%f", &bw_hz);
+			sscanf(argv[3], "%f", &pm_deg);
+
+			mc_configuration *mcconf = mempools_alloc_mcconf();
+			*mcconf = *mc_interface_get_configuration();
+
+			if (current > 0.0 && current <= (mcconf->l_current_max / 2.0) &&
+					bw_hz >= 0.0 && pm_deg >= 20.0 && pm_deg <= 80.0) {
+				if (mcconf->motor_type == MOTOR_TYPE_FOC &&
+						mcconf->foc_motor_r > 0.0 && mcconf->foc_motor_l > 0.0) {
+					commands_printf("Tuning current controller...");
+
+					float r, l, delay, kp, ki;
+					int fault = mcpwm_foc_tune_current_loop(current, bw_hz * 2.0 * M_PI, DEG2RAD_f(pm_deg), true,
+							&r, &l, &delay, &kp, &ki);
+
+					if (fault != FAULT_CODE_NONE) {
+						commands_printf("Fault occured during tuning: %s\n", mc_interface_fault_to_string(fault));
+					} else if (kp <= 0.0) {
+						commands_printf("Could not fit the measured response\n");
+					} else {
+						mcconf->foc_current_kp = kp;
+						mcconf->foc_current_ki = ki;
+						conf_general_store_mc_configuration(mcconf, mc_interface_get_motor_thread() == 2);
+						mc_interface_set_configuration(mcconf);
+
+						commands_printf("R:         %.2f mOhm", (double)(r * 1e3));
+						commands_printf("L:         %.2f uH", (double)(l * 1e6));
+						commands_printf("Delay:     %.1f us", (double)(delay * 1e6));
+						commands_printf("Bandwidth: %.0f Hz", (double)(kp / l / (2.0 * M_PI)));
+						commands_printf("Kp:        %.4f", (double)kp);
+						commands_printf("Ki:        %.2f\n", (double)ki);
+					}
+				} else {
+					commands_printf("FOC with detected R and L must be used.\n");
+				}
+			} else {
+				commands_printf("Invalid argument(s). Current must be between 0.0 and %.2f, "
+						"bandwidth positive or 0 and phase margin between 20 and 80 degrees.\n",
+						(double)(mcconf->l_current_max / 2.0));
+			}
+
+			mempools_free_mcconf(mcconf);
+		} else {
+			commands_printf("This command requires three arguments. [current] [bw_hz] [pm_deg]\n");
+		}
 	} else if (strcmp(argv[0], "measure_res") == 0) {
 		if (argc == 2) {
 			float current = -1.0;
@@ -1150,7 +1364,8 @@ void terminal_process_string(char *str) {
 		commands_printf("  Show this help");
 
 		commands_printf("last_adc_duration");
-		commands_printf("  The time the latest ADC interrupt consumed");
+		commands_printf("  The time the latest ADC interrupt consumed, and the worst case ADC");
+		commands_printf("  interrupt time and PID loop jitter since the previous call");
 
 		commands_printf("kv");
 		commands_printf("  The calculated kv of the motor (BLDC)");
@@ -1184,6 +1399,29 @@ void terminal_process_string(char *str) {
 		commands_printf("foc_encoder_detect [current]");
 		commands_printf("  Run the motor at 1Hz on open loop and compute encoder settings");
 
+		commands_printf("foc_cogging_cal [sweep_time]");
+		commands_printf("  Sweep the motor slowly under position control and store a cogging compensation table");
+
+		commands_printf("foc_cogging_clear");
+		commands_printf("  Disable and clear the cogging compensation table");
+
+		commands_printf("foc_encoder_corr_cal [current] [rev_time]");
+		commands_printf("  Run the motor open loop one revolution each way and store an encoder nonlinearity correction");
+
+		commands_printf("foc_encoder_corr_clear");
+		commands_printf("  Disable and clear the encoder nonlinearity correction");
+
+		commands_printf("foc_sat_map_measure [i_max]");
+		commands_printf("  Step the current over a grid up to i_max with the rotor locked and store");
+		commands_printf("  maps of Ld, Lq and flux linkage for the observer and MTPA");
+
+		commands_printf("foc_sat_map_clear");
+		commands_printf("  Disable the saturation maps");
+
+		commands_printf("foc_cc_tune [current] [bw_hz] [pm_deg]");
+		commands_printf("  Measure the current loop with a multi-sine on a bias current and store gains for");
+		commands_printf("  the bandwidth and phase margin. A bandwidth of 0 gives the highest possible");
+
 		commands_printf("measure_res [current]");
 		commands_printf("  Lock the motor with a current and calculate its resistance");
 
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc.h"
+
+// Bitwise reference implementations. crc32_ref is the previous software
+// crc32_with_init.
+static unsigned short crc16_ref(const uint8_t *buf, unsigned int len) {
+	unsigned short cksum = 0;
+	for (unsigned int i = 0;i < len;i++) {
+		cksum ^= buf[i] << 8;
+		for (int j = 0;j < 8;j++) {
+			cksum = (cksum & 0x8000) ? (cksum << 1) ^ 0x1021 : (cksum << 1);
+		}
+	}
+	return cksum;
+}
+
+static uint32_t crc32_ref(const uint8_t *buf, uint32_t len, uint32_t cksum) {
+	cksum = ~cksum;
+
+	while (len--) {
+		cksum = cksum ^ *buf++;
+
+		for (uint32_t j = 0;j < 8; j++) {
+			uint32_t mask = -(cksum & 1);
+			cksum = (cksum >> 1) ^ (0xEDB88320 & mask);
+		}
+	}
+
+	return ~cksum;
+}
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint8_t data[65536 + 8];
+
+int main(void) {
+	bool ok = true;
+
+	printf("CRC_SLICE_BY: %d\r\n", CRC_SLICE_BY);
+
+	// Known answers
+	uint8_t check[] = "123456789";
+	if (crc16(check, 9) != 0x31C3) {
+		printf("crc16 check value failed: 0x%04X\r\n", crc16(check, 9));
+		ok = false;
+	}
+
+	if (crc32_with_init(check, 9, 0) != 0xCBF43926) {
+		printf("crc32 check value failed: 0x%08X\r\n", crc32_with_init(check, 9, 0));
+		ok = false;
+	}
+
+	if (crc16(check, 0) != 0 || crc32_with_init(check, 0, 0) != 0) {
+		printf("Empty buffer failed\r\n");
+		ok = false;
+	}
+
+	srand(104);
+	for (unsigned int i = 0;i < sizeof(data);i++) {
+		data[i] = rand();
+	}
+
+	// All lengths and alignments against the reference implementations
+	for (unsigned int ofs = 0;ofs < 8;ofs++) {
+		for (unsigned int len = 0;len < 300;len++) {
+			if (crc16(data + ofs, len) != crc16_ref(data + ofs, len)) {
+				printf("crc16 mismatch at ofs %u len %u\r\n", ofs, len);
+				ok = false;
+			}
+
+			if (crc32_with_init(data + ofs, len, 0) != crc32_ref(data + ofs, len, 0)) {
+				printf("crc32 mismatch at ofs %u len %u\r\n", ofs, len);
+				ok = false;
+			}
+		}
+	}
+
+	// Streaming in random chunk sizes must match one-shot calculation
+	for (int test = 0;test < 1000;test++) {
+		unsigned int len = rand() % 4096;
+		unsigned int pos = 0;
+		unsigned short c16 = 0;
+		uint32_t c32 = 0;
+
+		while (pos < len) {
+			unsigned int chunk = rand() % 67;
+			if (chunk > (len - pos)) {
+				chunk = len - pos;
+			}
+
+			c16 = crc16_with_init(data + pos, chunk, c16);
+			c32 = crc32_with_init(data + pos, chunk, c32);
+			pos += chunk;
+		}
+
+		if (c16 != crc16_ref(data, len) || c32 != crc32_ref(data, len, 0)) {
+			printf("Streaming mismatch at len %u\r\n", len);
+			ok = false;
+		}
+	}
+
+	printf("Known answer and streaming tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	// Performance
+	const int rounds = 500;
+	const double mb = (double)rounds * 65536.0 / (1024.0 * 1024.0);
+	volatile uint32_t sink = 0;
+
+	double t = time_s();
+	for (int i = 0;i < rounds;i++) {
+		sink += crc16_ref(data, 65536);
+	}
+	double t_crc16_ref = time_s() - t;
+
+	t = time_s();
+	for (int i = 0;i < rounds;i++) {
+		sink += crc16(data, 65536);
+	}
+	double t_crc16 = time_s() - t;
+
+	t = time_s();
+	for (int i = 0;i < rounds;i++) {
+		sink += crc32_ref(data, 65536, 0);
+	}
+	double t_crc32_ref = time_s() - t;
+
+	t = time_s();
+	for (int i = 0;i < rounds;i++) {
+		sink += crc32_with_init(data, 65536, 0);
+	}
+	double t_crc32 = time_s() - t;
+
+	printf("\r\nPerformance Test\r\n");
+	printf("crc16 reference: %8.1f MB/s\r\n", mb / t_crc16_ref);
+	printf("crc16:           %8.1f MB/s\r\n", mb / t_crc16);
+	printf("crc32 reference: %8.1f MB/s\r\n", mb / t_crc32_ref);
+	printf("crc32:           %8.1f MB/s\r\n", mb / t_crc32);
+	(void)sink;
+
+	return ok ? 0 : 1;
+}
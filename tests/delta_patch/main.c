@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "delta_patch.h"
+#include "buffer.h"
+
+#define IMG_SIZE	100000
+
+static uint8_t src[IMG_SIZE];
+static uint8_t target[2 * IMG_SIZE];
+static uint8_t out[2 * IMG_SIZE];
+static uint32_t target_len;
+
+static uint8_t patch[3 * IMG_SIZE];
+static int32_t patch_len;
+static int32_t op_starts[IMG_SIZE];
+static int op_num;
+
+static bool write_out(uint32_t offset, uint8_t *data, uint32_t len) {
+	memcpy(out + offset, data, len);
+	return true;
+}
+
+static bool write_fail(uint32_t offset, uint8_t *data, uint32_t len) {
+	(void)offset; (void)data; (void)len;
+	return false;
+}
+
+static void add_op_copy(uint8_t op, uint32_t src_ofs, uint32_t len, const uint8_t *data) {
+	op_starts[op_num++] = patch_len;
+	patch[patch_len++] = op;
+	buffer_append_uint32(patch, src_ofs, &patch_len);
+	buffer_append_uint16(patch, len, &patch_len);
+	if (op == DELTA_OP_ADD) {
+		memcpy(patch + patch_len, data, len);
+		patch_len += len;
+	}
+}
+
+static void add_op_data(const uint8_t *data, uint32_t len) {
+	op_starts[op_num++] = patch_len;
+	patch[patch_len++] = DELTA_OP_DATA;
+	buffer_append_uint16(patch, len, &patch_len);
+	memcpy(patch + patch_len, data, len);
+	patch_len += len;
+}
+
+// Make a new image from src with some inserted, changed and moved blocks, and
+// a patch that describes it.
+static void make_target(void) {
+	uint32_t s = 0;
+	target_len = 0;
+	patch_len = 0;
+	op_num = 0;
+
+	while (s < IMG_SIZE) {
+		uint32_t len = 1 + rand() % 3000;
+		if ((s + len) > IMG_SIZE) {
+			len = IMG_SIZE - s;
+		}
+
+		int type = rand() % 4;
+		if (type == 0) {
+			// Unchanged
+			memcpy(target + target_len, src + s, len);
+			add_op_copy(DELTA_OP_COPY, s, len, 0);
+		} else if (type == 1) {
+			// Small changes, e.g. relocated addresses
+			uint8_t diff[3000];
+			for (uint32_t i = 0;i < len;i++) {
+				diff[i] = (rand() % 20) == 0 ? rand() : 0;
+				target[target_len + i] = src[s + i] + diff[i];
+			}
+			add_op_copy(DELTA_OP_ADD, s, len, diff);
+		} else if (type == 2) {
+			// New code
+			uint32_t ins = 1 + rand() % 500;
+			for (uint32_t i = 0;i < ins;i++) {
+				target[target_len + i] = rand();
+			}
+			add_op_data(target + target_len, ins);
+			target_len += ins;
+			continue;
+		} else {
+			// Copy from somewhere else
+			uint32_t from = rand() % (IMG_SIZE - len + 1);
+			memcpy(target + target_len, src + from, len);
+			add_op_copy(DELTA_OP_COPY, from, len, 0);
+		}
+
+		target_len += len;
+		s += len;
+	}
+
+	op_starts[op_num] = patch_len;
+}
+
+int main(void) {
+	bool ok = true;
+	srand(104);
+
+	for (int i = 0;i < IMG_SIZE;i++) {
+		src[i] = rand();
+	}
+
+	for (int test = 0;test < 50;test++) {
+		make_target();
+
+		delta_patch_state st;
+		delta_patch_init(&st, src, IMG_SIZE, target_len);
+		memset(out, 0, sizeof(out));
+
+		// Apply in packets of a random number of operations
+		int op = 0;
+		while (op < op_num) {
+			int n = 1 + rand() % 5;
+			if ((op + n) > op_num) {
+				n = op_num - op;
+			}
+
+			int res = delta_patch_apply(&st, patch + op_starts[op],
+					op_starts[op + n] - op_starts[op], write_out);
+			if (res != DELTA_PATCH_OK) {
+				printf("Apply failed: %d\r\n", res);
+				ok = false;
+				break;
+			}
+
+			op += n;
+		}
+
+		if (st.out_pos != target_len || memcmp(out, target, target_len) != 0) {
+			printf("Output mismatch in test %d\r\n", test);
+			ok = false;
+		}
+	}
+
+	// Error handling
+	delta_patch_state st;
+	uint8_t bad[48];
+	int32_t ind = 0;
+
+	delta_patch_init(&st, src, IMG_SIZE, 100);
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, IMG_SIZE - 10, &ind);
+	buffer_append_uint16(bad, 20, &ind);
+	if (delta_patch_apply(&st, bad, ind, write_out) != DELTA_PATCH_ERR_SRC_RANGE) {
+		printf("Source range not detected\r\n");
+		ok = false;
+	}
+
+	delta_patch_exclude(&st, 1000, 500);
+	ind = 0;
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, 990, &ind);
+	buffer_append_uint16(bad, 20, &ind);
+	if (delta_patch_apply(&st, bad, ind, write_out) != DELTA_PATCH_ERR_SRC_RANGE) {
+		printf("Excluded source start not detected\r\n");
+		ok = false;
+	}
+
+	ind = 0;
+	bad[ind++] = DELTA_OP_ADD;
+	buffer_append_uint32(bad, 1490, &ind);
+	buffer_append_uint16(bad, 20, &ind);
+	memset(bad + ind, 0, 20);
+	ind += 20;
+	if (delta_patch_apply(&st, bad, ind, write_out) != DELTA_PATCH_ERR_SRC_RANGE) {
+		printf("Excluded source end not detected\r\n");
+		ok = false;
+	}
+
+	ind = 0;
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, 980, &ind);
+	buffer_append_uint16(bad, 20, &ind);
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, 1500, &ind);
+	buffer_append_uint16(bad, 20, &ind);
+	if (delta_patch_apply(&st, bad, ind, write_out) != DELTA_PATCH_OK ||
+			memcmp(out, src + 980, 20) != 0 || memcmp(out + 20, src + 1500, 20) != 0) {
+		printf("Source next to the excluded part not copied\r\n");
+		ok = false;
+	}
+
+	delta_patch_init(&st, src, IMG_SIZE, 100);
+	ind = 0;
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, 0, &ind);
+	buffer_append_uint16(bad, 101, &ind);
+	if (delta_patch_apply(&st, bad, ind, write_out) != DELTA_PATCH_ERR_OUT_RANGE) {
+		printf("Output range not detected\r\n");
+		ok = false;
+	}
+
+	if (delta_patch_apply(&st, bad, ind - 1, write_out) != DELTA_PATCH_ERR_FORMAT) {
+		printf("Truncated operation not detected\r\n");
+		ok = false;
+	}
+
+	ind = 0;
+	bad[ind++] = DELTA_OP_COPY;
+	buffer_append_uint32(bad, 0, &ind);
+	buffer_append_uint16(bad, 50, &ind);
+	if (delta_patch_apply(&st, bad, ind, write_fail) != DELTA_PATCH_ERR_WRITE || st.out_pos != 0) {
+		printf("Write failure not handled\r\n");
+		ok = false;
+	}
+
+	printf("Delta patch tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "encoder_corr.h"
+#include "foc_cogging.h"
+
+#define TABLE_SIZE		64
+#define RATIO			7.0
+#define OFFSET			123.4
+#define LAG				0.4
+#define REV_TIME		10.0
+#define ENC_COUNTS		16384
+
+static float angle_difference(float angle1, float angle2) {
+	float difference = angle1 - angle2;
+	while (difference < -180.0) difference += 2.0 * 180.0;
+	while (difference > 180.0) difference -= 2.0 * 180.0;
+	return difference;
+}
+
+static double norm_deg(double a) {
+	a = fmod(a, 360.0);
+	if (a < 0.0) {
+		a += 360.0;
+	}
+	return a;
+}
+
+// Eccentricity and harmonic errors of a magnetic encoder
+static double distortion(double angle) {
+	double a = angle * M_PI / 180.0;
+	return 1.2 * sin(a + 0.4) + 0.5 * sin(2.0 * a + 1.3) + 0.15 * sin(4.0 * a);
+}
+
+static float encoder_raw(double angle_true) {
+	double raw = norm_deg(angle_true + OFFSET + distortion(angle_true));
+	raw += ((double)rand() / (double)RAND_MAX - 0.5) * 0.02;
+	raw = floor(raw / 360.0 * ENC_COUNTS) * 360.0 / ENC_COUNTS;
+	return (float)norm_deg(raw);
+}
+
+static double double_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Same procedure as mcpwm_foc_encoder_corr_calibrate, with the rotor lagging
+// behind the open loop angle and some cogging ripple.
+static void calibrate(int16_t *table) {
+	static float sum[2][TABLE_SIZE];
+	static uint16_t cnt[2][TABLE_SIZE];
+	memset(sum, 0, sizeof(sum));
+	memset(cnt, 0, sizeof(cnt));
+
+	const int steps = (int)(REV_TIME * 1000.0);
+	const int steps_lead = steps / 10;
+	const double step_rad = (2.0 * M_PI * RATIO) / (double)steps;
+	double phase = 0.0;
+	float diff_first = angle_difference(0.0, encoder_raw(0.0));
+
+	for (int dir = 0;dir < 2;dir++) {
+		double sign = dir == 0 ? 1.0 : -1.0;
+
+		for (int i = 0;i < (steps + steps_lead);i++) {
+			phase += sign * step_rad;
+
+			if (i >= steps_lead) {
+				double ref = phase * 180.0 / M_PI / RATIO;
+				double rotor = ref - sign * LAG + 0.05 * sin(6.0 * RATIO * ref * M_PI / 180.0);
+				float raw = encoder_raw(rotor);
+				float diff = angle_difference((float)ref, raw);
+				foc_cogging_bin_add(sum[dir], cnt[dir], TABLE_SIZE,
+						raw * M_PI / 180.0, angle_difference(diff, diff_first));
+			}
+		}
+	}
+
+	foc_cogging_bin_mean(sum[0], cnt[0], TABLE_SIZE);
+	foc_cogging_bin_mean(sum[1], cnt[1], TABLE_SIZE);
+
+	for (int i = 0;i < TABLE_SIZE;i++) {
+		sum[0][i] = 0.5 * (sum[0][i] + sum[1][i]);
+	}
+
+	encoder_corr_quantize(sum[0], TABLE_SIZE, table);
+}
+
+// Peak to peak deviation of an angle error over one revolution
+static double error_pp(const int16_t *table) {
+	double err_min = 1e9;
+	double err_max = -1e9;
+
+	for (int i = 0;i < 10000;i++) {
+		double angle_true = 360.0 * (double)i / 10000.0;
+		float angle = encoder_raw(angle_true);
+		if (table) {
+			angle = encoder_corr_apply(table, TABLE_SIZE, angle);
+		}
+
+		double err = angle_difference(angle, (float)norm_deg(angle_true + OFFSET));
+		if (err < err_min) {
+			err_min = err;
+		}
+		if (err > err_max) {
+			err_max = err;
+		}
+	}
+
+	return err_max - err_min;
+}
+
+int main(void) {
+	bool ok = true;
+	srand(32);
+
+	// Wrap around and interpolation
+	int16_t table[TABLE_SIZE];
+	for (int i = 0;i < TABLE_SIZE;i++) {
+		table[i] = (i % 2) ? 100 : -100;
+	}
+
+	float a = encoder_corr_apply(table, TABLE_SIZE, 0.1);
+	float expected = 360.0 + 0.1 + (-100.0 + 0.1 * TABLE_SIZE / 360.0 * 200.0) * ENCODER_CORR_SCALE;
+	if (fabsf(a - expected) > 1e-3 || a < 0.0 || a >= 360.0) {
+		printf("Wrap below zero failed: %.4f\r\n", (double)a);
+		ok = false;
+	}
+
+	a = encoder_corr_apply(table, TABLE_SIZE, 360.0 - 360.0 / TABLE_SIZE + 0.01);
+	if (a < 0.0 || a >= 360.0) {
+		printf("Wrap above 360 failed: %.4f\r\n", (double)a);
+		ok = false;
+	}
+
+	a = encoder_corr_apply(table, TABLE_SIZE, 360.0 / TABLE_SIZE * 1.5);
+	if (fabsf(a - 360.0f / TABLE_SIZE * 1.5f) > 1e-4f) {
+		printf("Interpolation failed: %.4f\r\n", (double)a);
+		ok = false;
+	}
+
+	printf("Table function tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	// Calibration on distorted data
+	calibrate(table);
+
+	double pp_raw = error_pp(0);
+	double pp_corr = error_pp(table);
+
+	printf("\r\nCalibration\r\n");
+	printf("Error p-p without correction: %.4f deg\r\n", pp_raw);
+	printf("Error p-p with correction:    %.4f deg\r\n", pp_corr);
+
+	if (pp_corr > 0.1 || pp_corr > 0.05 * pp_raw) {
+		printf("Correction does not remove the distortion\r\n");
+		ok = false;
+	}
+
+	// Cost of the lookup
+	const int iterations = 10000000;
+	volatile float sink = 0.0;
+	double t = double_time();
+	for (int i = 0;i < iterations;i++) {
+		sink += encoder_corr_apply(table, TABLE_SIZE, (float)(i % 36000) * 0.01);
+	}
+	t = double_time() - t;
+	(void)sink;
+
+	printf("\r\nLookup: %.1f ns\r\n", t / (double)iterations * 1e9);
+
+	printf("\r\nResult: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#include "foc_cc_tune.h"
+
+#define MOTOR_R			0.05
+#define MOTOR_L			30e-6
+#define DT				(1.0 / 30000.0)
+#define CURRENT			10.0
+#define PM_TARGET		60.0
+
+// The d axis of the virtual motor at standstill, with the options the
+// virtual motor does not have. pwm_delay is the sample between calculating
+// the voltage and applying it, and sensor_delay is from current filters.
+typedef struct {
+	int pwm_delay;
+	int sensor_delay;
+	double v_dead;
+	double noise;
+} plant_cfg;
+
+typedef struct {
+	plant_cfg cfg;
+	double id;
+	double v_hist[4];
+	double i_hist[4];
+	double vd_int;
+} sim_state;
+
+static void sim_init(sim_state *s, plant_cfg cfg) {
+	memset(s, 0, sizeof(sim_state));
+	s->cfg = cfg;
+}
+
+// One sample of the motor, same equation as run_virtual_motor_electrical with
+// the speed at zero. Returns the current the interrupt measures.
+static double sim_motor(sim_state *s) {
+	double v = s->v_hist[s->cfg.pwm_delay];
+	v -= s->cfg.v_dead * tanh(s->id / 0.3);
+	s->id += (v - MOTOR_R * s->id) * DT / MOTOR_L;
+
+	for (int i = 3;i > 0;i--) {
+		s->i_hist[i] = s->i_hist[i - 1];
+	}
+	s->i_hist[0] = s->id;
+
+	double noise = s->cfg.noise * ((double)rand() / (double)RAND_MAX - 0.5);
+	return round((s->i_hist[s->cfg.sensor_delay] + noise) * 100.0) / 100.0;
+}
+
+static void sim_set_voltage(sim_state *s, double vd) {
+	for (int i = 3;i > 0;i--) {
+		s->v_hist[i] = s->v_hist[i - 1];
+	}
+	s->v_hist[0] = vd;
+}
+
+// The PI controller from control_current
+static double sim_pi(sim_state *s, double i_set, double i, double kp, double ki) {
+	double err = i_set - i;
+	s->vd_int += err * ki * DT;
+	return s->vd_int + err * kp;
+}
+
+// Same procedure as mcpwm_foc_tune_current_loop
+static bool run_tune(plant_cfg cfg, float *r, float *l, float *delay) {
+	static foc_cc_tune_state t;
+	sim_state s;
+	sim_init(&s, cfg);
+
+	// Start from detection results that are a bit off
+	const float r_det = MOTOR_R * 1.2;
+	const float l_det = MOTOR_L * 0.85;
+	foc_cc_tune_init(&t, r_det, l_det, DT, CURRENT, 10.0);
+
+	// Settle at the bias current with the default gains, which keeps the current
+	// away from zero and the dead time out of the measurement.
+	for (int n = 0;n < 6000;n++) {
+		double i = sim_motor(&s);
+		sim_set_voltage(&s, sim_pi(&s, CURRENT, i, l_det * 1000.0, r_det * 1000.0));
+	}
+
+	const double ki = r_det * 2.0 * M_PI * (3.0 / (FOC_CC_TUNE_PERIOD * DT)) * 0.1;
+
+	while (!foc_cc_tune_done(&t)) {
+		double i = sim_motor(&s);
+		double vd = sim_pi(&s, CURRENT, i, 0.0, ki) + foc_cc_tune_signal(&t);
+		foc_cc_tune_sample(&t, vd, i, DT);
+		sim_set_voltage(&s, vd);
+	}
+
+	return foc_cc_tune_fit(&t, r, l, delay);
+}
+
+// Phase margin in degrees of the discrete loop with the true plant
+static double phase_margin(plant_cfg cfg, double kp, double ki, double *w_cross) {
+	const double a = 1.0 - MOTOR_R * DT / MOTOR_L;
+	const double b = DT / MOTOR_L;
+	const int d = cfg.pwm_delay + cfg.sensor_delay;
+
+	for (double w = 10.0;w < M_PI / DT;w *= 1.001) {
+		double complex z = cexp(I * w * DT);
+		double complex c = kp + ki * DT * z / (z - 1.0);
+		double complex g = b / (z - a);
+		if (cabs(c * g) < 1.0) {
+			*w_cross = w;
+			double ph = carg(c) + carg(g) - (double)d * w * DT;
+			return 180.0 + ph * 180.0 / M_PI;
+		}
+	}
+
+	*w_cross = 0.0;
+	return 0.0;
+}
+
+// Overshoot in percent of a current step
+static double step_overshoot(plant_cfg cfg, double kp, double ki) {
+	cfg.noise = 0.0;
+	cfg.v_dead = 0.0;
+	sim_state s;
+	sim_init(&s, cfg);
+
+	double peak = 0.0;
+	for (int n = 0;n < 3000;n++) {
+		double i = sim_motor(&s);
+		sim_set_voltage(&s, sim_pi(&s, 10.0, i, kp, ki));
+		peak = fmax(peak, s.id);
+	}
+
+	return (peak / 10.0 - 1.0) * 100.0;
+}
+
+int main(void) {
+	bool ok = true;
+	srand(36);
+
+	const plant_cfg cases[] = {
+			{0, 0, 0.0, 0.0},
+			{1, 0, 0.2, 0.1},
+			{1, 1, 0.2, 0.1},
+	};
+	const char *names[] = {"Virtual motor", "PWM delay", "PWM and filter delay"};
+
+	float kp_first = 0.0, ki_first = 0.0;
+
+	for (int c = 0;c < 3;c++) {
+		plant_cfg cfg = cases[c];
+		float r, l, delay;
+
+		printf("%s\r\n", names[c]);
+
+		if (!run_tune(cfg, &r, &l, &delay)) {
+			printf("  Fit failed\r\n");
+			ok = false;
+			continue;
+		}
+
+		const double delay_true = (double)(cfg.pwm_delay + cfg.sensor_delay) + 0.5;
+		printf("  R:     %.2f mOhm (%.2f)\r\n", (double)r * 1e3, MOTOR_R * 1e3);
+		printf("  L:     %.2f uH (%.2f)\r\n", (double)l * 1e6, MOTOR_L * 1e6);
+		printf("  Delay: %.2f samples (%.2f)\r\n", (double)delay / DT, delay_true);
+
+		if (fabs(r / MOTOR_R - 1.0) > 0.05 || fabs(l / MOTOR_L - 1.0) > 0.05 ||
+				fabs(delay / DT - delay_true) > 0.3) {
+			printf("  Fitted plant is off\r\n");
+			ok = false;
+		}
+
+		float kp, ki;
+		float bw = foc_cc_tune_gains(r, l, delay, 0.0, PM_TARGET * M_PI / 180.0, &kp, &ki);
+		if (c == 0) {
+			kp_first = kp;
+			ki_first = ki;
+		}
+
+		double wc;
+		double pm = phase_margin(cfg, kp, ki, &wc);
+		double os = step_overshoot(cfg, kp, ki);
+		printf("  Gains: kp %.4f ki %.2f, bandwidth %.0f Hz\r\n", (double)kp, (double)ki, bw / (2.0 * M_PI));
+		printf("  Phase margin %.1f deg at %.0f Hz, step overshoot %.1f %%\r\n", pm, wc / (2.0 * M_PI), os);
+
+		if (fabs(pm - PM_TARGET) > 6.0 || os > 20.0) {
+			printf("  Phase margin not met\r\n");
+			ok = false;
+		}
+
+		// A lower requested bandwidth is used as is
+		float bw_low = foc_cc_tune_gains(r, l, delay, bw * 0.5, PM_TARGET * M_PI / 180.0, &kp, &ki);
+		if (fabs(bw_low - bw * 0.5) > 1e-3 * bw) {
+			printf("  Requested bandwidth not used\r\n");
+			ok = false;
+		}
+
+		if (c == 2) {
+			pm = phase_margin(cfg, kp_first, ki_first, &wc);
+			printf("  Gains tuned without the delays: phase margin %.1f deg\r\n", pm);
+		}
+
+		printf("\r\n");
+	}
+
+	printf("Result: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "foc_cogging.h"
+
+#define TABLE_SIZE		128
+
+// Motor and load, similar to the virtual motor with a cogging term
+#define POLE_PAIRS		7
+#define KT				(1.5 * POLE_PAIRS * 0.01)
+#define INERTIA			2e-4
+#define COG_TORQUE		0.05
+#define FRICTION		0.01
+#define LOAD			0.02
+#define DT_SIM			1e-4
+#define DT_CTRL			1e-3
+#define TAU_CURRENT		5e-4
+
+typedef struct {
+	double pos; // Mechanical angle in rad
+	double speed;
+	double iq;
+	double iq_set;
+	double i_term;
+	double err_last;
+	double kp;
+	double ki;
+	double kd;
+} sim_state;
+
+static double elec_angle(double pos) {
+	double a = fmod(pos * POLE_PAIRS, 2.0 * M_PI);
+	if (a < 0.0) {
+		a += 2.0 * M_PI;
+	}
+	return a;
+}
+
+static double cogging_torque(double pos) {
+	double a = elec_angle(pos);
+	return COG_TORQUE * sin(6.0 * a) + 0.4 * COG_TORQUE * sin(12.0 * a + 1.0);
+}
+
+static void sim_init(sim_state *s, double kp, double ki, double kd) {
+	memset(s, 0, sizeof(sim_state));
+	s->kp = kp;
+	s->ki = ki;
+	s->kd = kd;
+}
+
+// Run one control period. Returns the position error.
+static double sim_step(sim_state *s, double pos_set, const int8_t *table, float scale) {
+	double err = pos_set - s->pos;
+	s->i_term += err * s->ki * DT_CTRL;
+	s->iq_set = err * s->kp + s->i_term + (err - s->err_last) * s->kd / DT_CTRL;
+	s->err_last = err;
+
+	double iq_target = s->iq_set;
+	if (table) {
+		iq_target += foc_cogging_lookup(table, TABLE_SIZE, scale, (float)elec_angle(s->pos));
+	}
+
+	for (int i = 0;i < (int)(DT_CTRL / DT_SIM + 0.5);i++) {
+		s->iq += (iq_target - s->iq) * DT_SIM / TAU_CURRENT;
+		double friction = FRICTION * tanh(s->speed * 100.0);
+		double torque = KT * s->iq - cogging_torque(s->pos) - friction - LOAD;
+		s->speed += torque / INERTIA * DT_SIM;
+		s->pos += s->speed * DT_SIM;
+	}
+
+	return err;
+}
+
+// Same procedure as mcpwm_foc_cogging_calibrate
+static float calibrate(sim_state *s, double sweep_time, int8_t *table) {
+	static float sum[2][TABLE_SIZE];
+	static uint16_t cnt[2][TABLE_SIZE];
+	memset(sum, 0, sizeof(sum));
+	memset(cnt, 0, sizeof(cnt));
+
+	double pos_set = s->pos;
+	for (int i = 0;i < 500;i++) {
+		sim_step(s, pos_set, 0, 0.0);
+	}
+
+	int steps = (int)(sweep_time / DT_CTRL);
+	int steps_lead = steps / 10;
+	double step = 2.0 * M_PI / (double)steps;
+
+	for (int dir = 0;dir < 2;dir++) {
+		double pos_start = pos_set;
+
+		for (int i = 0;i < (steps + steps_lead);i++) {
+			pos_set = pos_start + (dir == 0 ? 1.0 : -1.0) * step * (double)i;
+			sim_step(s, pos_set, 0, 0.0);
+
+			if (i >= steps_lead) {
+				foc_cogging_bin_add(sum[dir], cnt[dir], TABLE_SIZE, (float)elec_angle(s->pos), (float)s->iq_set);
+			}
+		}
+	}
+
+	if (!foc_cogging_bin_mean(sum[0], cnt[0], TABLE_SIZE) ||
+			!foc_cogging_bin_mean(sum[1], cnt[1], TABLE_SIZE)) {
+		return 0.0;
+	}
+
+	for (int i = 0;i < TABLE_SIZE;i++) {
+		sum[0][i] = 0.5 * (sum[0][i] + sum[1][i]);
+	}
+
+	return foc_cogging_quantize(sum[0], TABLE_SIZE, table);
+}
+
+// RMS position error in degrees while tracking a slow constant speed
+static double track_rms(double kp, double ki, double kd, const int8_t *table, float scale) {
+	sim_state s;
+	sim_init(&s, kp, ki, kd);
+
+	double speed = 2.0 * M_PI / 8.0;
+	double sum = 0.0;
+	int n = 0;
+
+	for (int i = 0;i < 16000;i++) {
+		double err = sim_step(&s, speed * (double)i * DT_CTRL, table, scale);
+		if (i >= 2000) {
+			sum += err * err;
+			n++;
+		}
+	}
+
+	return sqrt(sum / (double)n) * 180.0 / M_PI;
+}
+
+static bool test_table_functions(void) {
+	bool ok = true;
+	float values[TABLE_SIZE];
+	int8_t table[TABLE_SIZE];
+
+	// Quantize and look up a sine with an offset
+	for (int i = 0;i < TABLE_SIZE;i++) {
+		values[i] = 3.0 + 2.0 * sinf(2.0 * M_PI * 5.0 * (float)i / (float)TABLE_SIZE);
+	}
+
+	float scale = foc_cogging_quantize(values, TABLE_SIZE, table);
+	float max_err = 0.0;
+	for (int i = 0;i < 1000;i++) {
+		float ang = -2.0 * M_PI + 6.0 * M_PI * (float)i / 1000.0;
+		float ref = 2.0 * sinf(5.0 * ang);
+		float err = fabsf(foc_cogging_lookup(table, TABLE_SIZE, scale, ang) - ref);
+		if (err > max_err) {
+			max_err = err;
+		}
+	}
+
+	if (max_err > 0.05) {
+		printf("Lookup error too large: %.4f\r\n", (double)max_err);
+		ok = false;
+	}
+
+	// Empty bins are interpolated, also across the wrap
+	float sum[TABLE_SIZE];
+	uint16_t cnt[TABLE_SIZE];
+	memset(sum, 0, sizeof(sum));
+	memset(cnt, 0, sizeof(cnt));
+
+	foc_cogging_bin_add(sum, cnt, TABLE_SIZE, 2.0 * M_PI * 16.0 / TABLE_SIZE, 1.0);
+	foc_cogging_bin_add(sum, cnt, TABLE_SIZE, 2.0 * M_PI * 16.0 / TABLE_SIZE, 3.0);
+	foc_cogging_bin_add(sum, cnt, TABLE_SIZE, 2.0 * M_PI * 80.0 / TABLE_SIZE, 6.0);
+
+	if (!foc_cogging_bin_mean(sum, cnt, TABLE_SIZE)) {
+		printf("bin_mean failed\r\n");
+		ok = false;
+	}
+
+	if (fabs(sum[16] - 2.0) > 1e-6 || fabs(sum[48] - 4.0) > 1e-6 ||
+			fabs(sum[80] - 6.0) > 1e-6 || fabs(sum[112] - 4.0) > 1e-6 ||
+			fabs(sum[0] - 3.0) > 1e-6) {
+		printf("Gap interpolation failed\r\n");
+		ok = false;
+	}
+
+	memset(cnt, 0, sizeof(cnt));
+	if (foc_cogging_bin_mean(sum, cnt, TABLE_SIZE)) {
+		printf("bin_mean should fail without samples\r\n");
+		ok = false;
+	}
+
+	return ok;
+}
+
+int main(void) {
+	bool ok = test_table_functions();
+	printf("Table function tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	const double kp = 20.0;
+	const double ki = 200.0;
+	const double kd = 0.28;
+
+	sim_state s;
+	sim_init(&s, kp, ki, kd);
+
+	int8_t table[TABLE_SIZE];
+	float scale = calibrate(&s, 20.0, table);
+
+	// The ideal compensation current
+	double err_sum = 0.0;
+	for (int i = 0;i < 1000;i++) {
+		double pos = 2.0 * M_PI * (double)i / 1000.0 / POLE_PAIRS;
+		double diff = foc_cogging_lookup(table, TABLE_SIZE, scale, (float)elec_angle(pos)) -
+				cogging_torque(pos) / KT;
+		err_sum += diff * diff;
+	}
+
+	double table_rms = sqrt(err_sum / 1000.0);
+	printf("\r\nCalibration\r\n");
+	printf("Table peak:      %.3f A\r\n", (double)(scale * 127.0));
+	printf("Cogging peak:    %.3f A\r\n", 1.4 * COG_TORQUE / KT);
+	printf("Table RMS error: %.4f A\r\n", table_rms);
+
+	if (table_rms > 0.1 * COG_TORQUE / KT) {
+		printf("Calibrated table does not match the cogging torque\r\n");
+		ok = false;
+	}
+
+	double rms_off = track_rms(kp, ki, kd, 0, 0.0);
+	double rms_on = track_rms(kp, ki, kd, table, scale);
+	double rms_low_off = track_rms(kp / 4.0, ki / 4.0, kd / 2.0, 0, 0.0);
+	double rms_low_on = track_rms(kp / 4.0, ki / 4.0, kd / 2.0, table, scale);
+
+	printf("\r\nTracking RMS error at low speed\r\n");
+	printf("Without compensation:           %.4f deg\r\n", rms_off);
+	printf("With compensation:              %.4f deg\r\n", rms_on);
+	printf("Low gains without compensation: %.4f deg\r\n", rms_low_off);
+	printf("Low gains with compensation:    %.4f deg\r\n", rms_low_on);
+
+	if (rms_on > 0.3 * rms_off || rms_low_on > rms_off) {
+		printf("Compensation does not reduce the tracking error enough\r\n");
+		ok = false;
+	}
+
+	printf("\r\nResult: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
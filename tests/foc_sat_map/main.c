@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "foc_sat_map.h"
+
+#define N_ID			5
+#define N_IQ			6
+#define MAP_SIZE		(N_ID * N_IQ)
+
+// Saturating interior permanent magnet motor
+#define I_MAX			150.0
+#define R_MOTOR			0.02
+#define LD0				60e-6
+#define LQ0				150e-6
+#define LAMBDA0			0.01
+#define POLE_PAIRS		5
+#define V_DEAD			0.3
+
+// Current controller
+#define DT_CTRL			(1.0 / 20e3)
+#define SUB_STEPS		10
+#define BW				3000.0
+
+// Arctan saturation with cross saturation. The secant inductances are what
+// the map should contain.
+static double sat_atan(double i, double i_sat) {
+	return fabs(i) < 1e-9 ? 1.0 : i_sat * atan(i / i_sat) / i;
+}
+
+static double sat_ld(double id, double iq) {
+	return LD0 * sat_atan(id, I_MAX) * (1.0 - 0.05 * pow(iq / I_MAX, 2.0));
+}
+
+static double sat_lq(double id, double iq) {
+	return LQ0 * sat_atan(iq, 0.8 * I_MAX) * (1.0 - 0.1 * pow(id / I_MAX, 2.0));
+}
+
+static double sat_lambda(double iq) {
+	return LAMBDA0 * (1.0 - 0.15 * pow(iq / I_MAX, 2.0));
+}
+
+static void flux(double id, double iq, double *psi_d, double *psi_q) {
+	*psi_d = sat_lambda(iq) + sat_ld(id, iq) * id;
+	*psi_q = sat_lq(id, iq) * iq;
+}
+
+static double torque(double id, double iq) {
+	double psi_d, psi_q;
+	flux(id, iq, &psi_d, &psi_q);
+	return 1.5 * POLE_PAIRS * (psi_d * iq - psi_q * id);
+}
+
+typedef struct {
+	double id;
+	double iq;
+	double int_d;
+	double int_q;
+} motor_sim;
+
+// Run the current controller at standstill for time t. The integrals of the
+// commanded voltage and the current are added to the steps, in the same way
+// as the ADC interrupt does.
+static void run_current(motor_sim *m, double id_set, double iq_set, double t,
+		foc_sat_map_step *sd, foc_sat_map_step *sq) {
+	for (int i = 0;i < (int)(t / DT_CTRL + 0.5);i++) {
+		double err_d = id_set - m->id;
+		double err_q = iq_set - m->iq;
+		m->int_d += err_d * R_MOTOR * BW * DT_CTRL;
+		m->int_q += err_q * R_MOTOR * BW * DT_CTRL;
+		double vd = err_d * LD0 * BW + m->int_d;
+		double vq = err_q * LQ0 * BW + m->int_q;
+
+		if (sd) {
+			sd->v_int += vd * DT_CTRL;
+			sd->i_int += m->id * DT_CTRL;
+			sd->t += DT_CTRL;
+			sq->v_int += vq * DT_CTRL;
+			sq->i_int += m->iq * DT_CTRL;
+			sq->t += DT_CTRL;
+		}
+
+		for (int j = 0;j < SUB_STEPS;j++) {
+			// Dead time drops the voltage along the current
+			double i_abs = sqrt(m->id * m->id + m->iq * m->iq);
+			double ud = vd - V_DEAD * m->id / (i_abs + 0.5) - R_MOTOR * m->id;
+			double uq = vq - V_DEAD * m->iq / (i_abs + 0.5) - R_MOTOR * m->iq;
+
+			// Incremental inductance matrix
+			const double h = 1e-3;
+			double pd0, pq0, pd1, pq1, pd2, pq2;
+			flux(m->id, m->iq, &pd0, &pq0);
+			flux(m->id + h, m->iq, &pd1, &pq1);
+			flux(m->id, m->iq + h, &pd2, &pq2);
+			double a = (pd1 - pd0) / h;
+			double b = (pd2 - pd0) / h;
+			double c = (pq1 - pq0) / h;
+			double d = (pq2 - pq0) / h;
+			double det = a * d - b * c;
+
+			double dt = DT_CTRL / SUB_STEPS;
+			m->id += (d * ud - b * uq) / det * dt;
+			m->iq += (-c * ud + a * uq) / det * dt;
+		}
+	}
+}
+
+// Same sequence as mcpwm_foc_measure_sat_map
+static void measure_point(motor_sim *m, double id, double iq, float *psi_d, float *psi_q) {
+	foc_sat_map_step sd, sq, ssd, ssq;
+	memset(&sd, 0, sizeof(sd));
+	memset(&sq, 0, sizeof(sq));
+	memset(&ssd, 0, sizeof(ssd));
+	memset(&ssq, 0, sizeof(ssq));
+
+	run_current(m, 0.0, 0.0, 0.02, 0, 0);
+	run_current(m, id, iq, 0.03, &sd, &sq);
+	run_current(m, id, iq, 0.01, &ssd, &ssq);
+	run_current(m, 0.0, 0.0, 0.02, 0, 0);
+
+	sd.v_ss = ssd.v_int / ssd.t;
+	sd.i_ss = ssd.i_int / ssd.t;
+	sq.v_ss = ssq.v_int / ssq.t;
+	sq.i_ss = ssq.i_int / ssq.t;
+
+	*psi_d = foc_sat_map_step_flux(&sd, R_MOTOR * 1.1);
+	*psi_q = foc_sat_map_step_flux(&sq, R_MOTOR * 1.1);
+}
+
+static void measure_map(float *ld, float *lq, float *lambda) {
+	float psi_d[MAP_SIZE], psi_q[MAP_SIZE];
+	motor_sim m;
+	memset(&m, 0, sizeof(m));
+
+	for (int k = 0;k < N_ID;k++) {
+		for (int j = (k == 0 ? 1 : 0);j < N_IQ;j++) {
+			float id, iq;
+			foc_sat_map_meas_current(k, j, N_ID, N_IQ, I_MAX, &id, &iq);
+			measure_point(&m, id, iq, &psi_d[k * N_IQ + j], &psi_q[k * N_IQ + j]);
+		}
+	}
+
+	foc_sat_map_from_flux(psi_d, psi_q, N_ID, N_IQ, I_MAX, LAMBDA0, ld, lq, lambda);
+}
+
+// MTPA as in mcpwm_foc.c without the map
+static void mtpa_const(double i_abs, double *id, double *iq) {
+	double diff = LQ0 - LD0;
+	*id = (LAMBDA0 - sqrt(LAMBDA0 * LAMBDA0 + 8.0 * pow(diff * i_abs, 2.0))) / (4.0 * diff);
+	*iq = sqrt(i_abs * i_abs - *id * *id);
+}
+
+static bool test_lookup(void) {
+	bool ok = true;
+	float ld[MAP_SIZE], lq[MAP_SIZE], lambda[MAP_SIZE];
+
+	// A bilinear function is reproduced exactly
+	for (int k = 0;k < N_ID;k++) {
+		for (int j = 0;j < N_IQ;j++) {
+			float id = -I_MAX * k / (N_ID - 1);
+			float iq = I_MAX * j / (N_IQ - 1);
+			ld[k * N_IQ + j] = 1.0 + 0.01 * id + 0.02 * iq + 1e-4 * id * iq;
+			lq[k * N_IQ + j] = 2.0 * ld[k * N_IQ + j];
+			lambda[k * N_IQ + j] = -ld[k * N_IQ + j];
+		}
+	}
+
+	for (int i = 0;i < 1000;i++) {
+		float id = -I_MAX * (float)rand() / (float)RAND_MAX;
+		float iq = I_MAX * (2.0 * (float)rand() / (float)RAND_MAX - 1.0);
+		float l1, l2, l3;
+		foc_sat_map_lookup(ld, lq, lambda, N_ID, N_IQ, I_MAX, id, iq, &l1, &l2, &l3);
+
+		float ref = 1.0 + 0.01 * id + 0.02 * fabsf(iq) + 1e-4 * id * fabsf(iq);
+		if (fabsf(l1 - ref) > 1e-4f || fabsf(l2 - 2.0f * ref) > 2e-4f || fabsf(l3 + ref) > 1e-4f) {
+			printf("Interpolation failed at %.2f %.2f\r\n", (double)id, (double)iq);
+			ok = false;
+			break;
+		}
+	}
+
+	// Outside of the map the edge is used
+	float l1, l2, l3, e1, e2, e3;
+	foc_sat_map_lookup(ld, lq, lambda, N_ID, N_IQ, I_MAX, 20.0, -2.0 * I_MAX, &l1, &l2, &l3);
+	foc_sat_map_lookup(ld, lq, lambda, N_ID, N_IQ, I_MAX, 0.0, I_MAX, &e1, &e2, &e3);
+	if (fabsf(l1 - e1) > 1e-6 || fabsf(l2 - e2) > 1e-6 || fabsf(l3 - e3) > 1e-6) {
+		printf("Clamping failed\r\n");
+		ok = false;
+	}
+
+	return ok;
+}
+
+int main(void) {
+	bool ok = test_lookup();
+	printf("Lookup tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	float ld[MAP_SIZE], lq[MAP_SIZE], lambda[MAP_SIZE];
+	measure_map(ld, lq, lambda);
+
+	// Compare the measured map with the motor between the grid points
+	double err_ld = 0.0, err_lq = 0.0, err_lambda = 0.0;
+	for (int i = 0;i <= 20;i++) {
+		for (int j = 0;j <= 20;j++) {
+			double id = -I_MAX * i / 20.0;
+			double iq = I_MAX * j / 20.0;
+			float l1, l2, l3;
+			foc_sat_map_lookup(ld, lq, lambda, N_ID, N_IQ, I_MAX, id, iq, &l1, &l2, &l3);
+
+			err_ld = fmax(err_ld, fabs(l1 / sat_ld(id, iq) - 1.0));
+			err_lq = fmax(err_lq, fabs(l2 / sat_lq(id, iq) - 1.0));
+			err_lambda = fmax(err_lambda, fabs(l3 / sat_lambda(iq) - 1.0));
+		}
+	}
+
+	printf("\r\nMeasured map, max relative error\r\n");
+	printf("Ld:     %.2f %%\r\n", err_ld * 100.0);
+	printf("Lq:     %.2f %%\r\n", err_lq * 100.0);
+	printf("Lambda: %.2f %%\r\n", err_lambda * 100.0);
+	printf("Lq at I_MAX: %.1f uH, unsaturated %.1f uH\r\n",
+			(double)lq[MAP_SIZE - N_IQ + N_IQ - 1] * 1e6, LQ0 * 1e6);
+
+	if (err_ld > 0.04 || err_lq > 0.04 || err_lambda > 0.01) {
+		printf("Measured map does not match the motor\r\n");
+		ok = false;
+	}
+
+	// Torque per amp at peak current
+	double best = 0.0;
+	for (int i = 0;i <= 9000;i++) {
+		double ang = M_PI / 2.0 * i / 9000.0;
+		best = fmax(best, torque(-I_MAX * sin(ang), I_MAX * cos(ang)));
+	}
+
+	double id, iq;
+	double t_none = torque(0.0, I_MAX);
+	mtpa_const(I_MAX, &id, &iq);
+	double t_const = torque(id, iq);
+
+	float id_mtpa[FOC_SAT_MAP_MTPA_LEN];
+	foc_sat_map_calc_mtpa(ld, lq, lambda, N_ID, N_IQ, I_MAX, id_mtpa);
+	id = foc_sat_map_mtpa_id(id_mtpa, I_MAX, I_MAX);
+	iq = sqrt(I_MAX * I_MAX - id * id);
+	double t_map = torque(id, iq);
+
+	// The curve between the points
+	float id_half = foc_sat_map_mtpa_id(id_mtpa, I_MAX, 0.55 * I_MAX);
+	double best_half = 0.0;
+	for (int i = 0;i <= 9000;i++) {
+		double ang = M_PI / 2.0 * i / 9000.0;
+		best_half = fmax(best_half, torque(-0.55 * I_MAX * sin(ang), 0.55 * I_MAX * cos(ang)));
+	}
+	double t_half = torque(id_half, sqrt(pow(0.55 * I_MAX, 2.0) - id_half * id_half));
+
+	printf("\r\nTorque at %.0f A\r\n", I_MAX);
+	printf("Without MTPA:       %.3f Nm\r\n", t_none);
+	printf("Constant Ld and Lq: %.3f Nm\r\n", t_const);
+	printf("Saturation map:     %.3f Nm\r\n", t_map);
+	printf("Optimum:            %.3f Nm\r\n", best);
+
+	printf("At 55 %% current:    %.3f Nm, optimum %.3f Nm\r\n", t_half, best_half);
+
+	if (t_map < t_const || t_map < 0.997 * best || t_half < 0.997 * best_half) {
+		printf("The map does not improve MTPA\r\n");
+		ok = false;
+	}
+
+	printf("\r\nResult: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
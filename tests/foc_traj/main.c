@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "foc_traj.h"
+
+#define VEL_MAX			720.0
+#define ACC_MAX			8000.0
+#define JERK_MAX		200000.0
+
+// Rigid body load for the closed loop comparison, all in degrees
+#define KT_DEG			(0.105 * 180.0 / M_PI)
+#define INERTIA			5e-3
+#define CURRENT_MAX		30.0
+#define DT_SIM			1e-5
+
+
+static double angle_difference(double angle1, double angle2) {
+	double difference = fmod(angle1 - angle2, 360.0);
+	if (difference < -180.0) difference += 360.0;
+	if (difference > 180.0) difference -= 360.0;
+	return difference;
+}
+
+typedef struct {
+	double vel_max;
+	double acc_max;
+	double jerk_max;
+	double overshoot;
+	double time;
+	double pos_err;
+} move_result;
+
+// Run until the trajectory is at rest at the target. The target can be
+// changed once on the way.
+static move_result run_move(float start, float target, float dt,
+		float target2, int change_at) {
+	static foc_traj_state s;
+	foc_traj_reset(&s, start);
+
+	move_result r;
+	memset(&r, 0, sizeof(r));
+
+	double acc_last = 0.0;
+	double dir = angle_difference(target, start) >= 0.0 ? 1.0 : -1.0;
+	int i = 0;
+
+	for (i = 0;i < (int)(10.0 / dt);i++) {
+		if (i == change_at) {
+			target = target2;
+			dir = angle_difference(target, s.pos) >= 0.0 ? 1.0 : -1.0;
+		}
+
+		foc_traj_update(&s, target, VEL_MAX, ACC_MAX, JERK_MAX, dt);
+
+		double jerk = fabs(s.acc - acc_last) / dt;
+		acc_last = s.acc;
+
+		r.vel_max = fmax(r.vel_max, fabs(s.vel));
+		r.acc_max = fmax(r.acc_max, fabs(s.acc));
+		r.jerk_max = fmax(r.jerk_max, jerk);
+
+		if (i >= change_at) {
+			r.overshoot = fmax(r.overshoot, dir * angle_difference(s.pos, target));
+		}
+
+		if (i > change_at && foc_traj_at_rest(&s) &&
+				fabs(angle_difference(s.pos, target)) < 1e-3) {
+			break;
+		}
+	}
+
+	// The last sample is spent detecting rest
+	r.time = (double)i * dt;
+	r.pos_err = fabs(angle_difference(s.pos, target));
+	return r;
+}
+
+static bool check_limits(const char *name, move_result r) {
+	bool ok = true;
+
+	if (r.vel_max > VEL_MAX * 1.0001 || r.acc_max > ACC_MAX * 1.001 ||
+			r.jerk_max > JERK_MAX * 1.001) {
+		printf("%s: limits exceeded, vel %.1f acc %.1f jerk %.1f\r\n",
+				name, r.vel_max, r.acc_max, r.jerk_max);
+		ok = false;
+	}
+
+	if (r.pos_err > 1e-4) {
+		printf("%s: final position error %.6f\r\n", name, r.pos_err);
+		ok = false;
+	}
+
+	return ok;
+}
+
+// Time optimal rest to rest S-curve where all limits are reached
+static double scurve_time(double dist) {
+	return dist / VEL_MAX + VEL_MAX / ACC_MAX + ACC_MAX / JERK_MAX;
+}
+
+// Position control of a rigid body with a PD controller on the current,
+// with and without trajectory and feedforward. Returns the time until the
+// error stays below tol.
+static double settle_time(bool use_traj, double dist, double tol, double *current_peak) {
+	static foc_traj_state s;
+	foc_traj_reset(&s, 0.0);
+
+	const double dt_ctrl = 1e-3;
+	const double kp = 0.5;
+	const double kd = 0.015;
+	const double ff_acc = INERTIA / KT_DEG;
+
+	double pos = 0.0;
+	double speed = 0.0;
+	double settled = -1.0;
+	*current_peak = 0.0;
+
+	for (int i = 0;i < 3000;i++) {
+		double set = dist;
+		double vel_set = 0.0;
+		double acc_set = 0.0;
+
+		if (use_traj) {
+			foc_traj_update(&s, dist, VEL_MAX, ACC_MAX, JERK_MAX, dt_ctrl);
+			set = s.pos;
+			vel_set = s.vel;
+			acc_set = s.acc;
+		}
+
+		double current = kp * (set - pos) + kd * (vel_set - speed) + ff_acc * acc_set;
+		if (current > CURRENT_MAX) current = CURRENT_MAX;
+		if (current < -CURRENT_MAX) current = -CURRENT_MAX;
+		*current_peak = fmax(*current_peak, fabs(current));
+
+		for (int j = 0;j < (int)(dt_ctrl / DT_SIM + 0.5);j++) {
+			speed += KT_DEG * current / INERTIA * DT_SIM;
+			pos += speed * DT_SIM;
+		}
+
+		if (fabs(dist - pos) > tol) {
+			settled = -1.0;
+		} else if (settled < 0.0) {
+			settled = (double)(i + 1) * dt_ctrl;
+		}
+	}
+
+	return settled;
+}
+
+int main(void) {
+	bool ok = true;
+
+	// Long, medium, short and tiny moves
+	const float dists[] = {170.0, 90.0, 20.0, 2.0, 0.05};
+	printf("Move     Time     S-curve  Vel      Acc      Jerk\r\n");
+	for (unsigned int i = 0;i < sizeof(dists) / sizeof(dists[0]);i++) {
+		move_result r = run_move(100.0, 100.0 + dists[i], 1e-3, 0.0, -1);
+		char name[32];
+		snprintf(name, sizeof(name), "Move %.2f", (double)dists[i]);
+		ok = check_limits(name, r) && ok;
+
+		printf("%-8.2f %-8.4f %-8.4f %-8.1f %-8.1f %-8.0f\r\n",
+				(double)dists[i], r.time, scurve_time(dists[i]), r.vel_max, r.acc_max, r.jerk_max);
+
+		if (r.overshoot > 1e-3) {
+			printf("%s: overshoot %.6f\r\n", name, r.overshoot);
+			ok = false;
+		}
+
+		if (dists[i] >= 90.0 && r.time > (scurve_time(dists[i]) + 0.004)) {
+			printf("%s: slower than the S-curve time\r\n", name);
+			ok = false;
+		}
+	}
+
+	// Shortest way across 360
+	move_result r = run_move(350.0, 10.0, 1e-3, 0.0, -1);
+	ok = check_limits("Wrap", r) && ok;
+	if (r.overshoot > 1e-3 || r.time > (scurve_time(20.0) + 0.004)) {
+		printf("Wrap: did not take the shortest way\r\n");
+		ok = false;
+	}
+
+	// New target in the same direction and reversing during the move
+	r = run_move(0.0, 90.0, 1e-3, 120.0, 100);
+	ok = check_limits("Extend", r) && ok;
+	r = run_move(0.0, 90.0, 1e-3, 300.0, 100);
+	ok = check_limits("Reverse", r) && ok;
+
+	// The smoothing time must not depend on the loop rate
+	const float dts[] = {1e-4, 1e-5};
+	for (unsigned int i = 0;i < sizeof(dts) / sizeof(dts[0]);i++) {
+		r = run_move(0.0, 170.0, dts[i], 0.0, -1);
+		ok = check_limits("Fast loop", r) && ok;
+		if (r.time > (scurve_time(170.0) + 0.004)) {
+			printf("Fast loop: %.4f s at dt %g\r\n", r.time, (double)dts[i]);
+			ok = false;
+		}
+	}
+
+	printf("Trajectory tests: %s\r\n", ok ? "OK" : "FAILED");
+
+	// Closed loop move and settle
+	double peak_step, peak_traj;
+	double t_step = settle_time(false, 90.0, 0.05, &peak_step);
+	double t_traj = settle_time(true, 90.0, 0.05, &peak_traj);
+
+	printf("\r\nMove and settle 90 deg to 0.05 deg\r\n");
+	printf("Step:       %.4f s, peak current %.1f A\r\n", t_step, peak_step);
+	printf("Trajectory: %.4f s, peak current %.1f A\r\n", t_traj, peak_traj);
+
+	if (t_traj < 0.0 || (t_step > 0.0 && t_traj > t_step) || peak_traj >= CURRENT_MAX) {
+		printf("Trajectory does not improve the move\r\n");
+		ok = false;
+	}
+
+	printf("\r\nResult: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "virtual_motor_batch.h"
+
+#define TS				(1.0 / 30000.0)
+#define V_BUS			48.0
+
+// Nominal motor of the family that the gains are swept for
+#define MOTOR_R			0.024
+#define MOTOR_L			18e-6
+#define MOTOR_LAMBDA	5.5e-3
+#define MOTOR_POLES		14
+#define MOTOR_J			2e-4
+#define MOTOR_B			2.2e-3
+
+// Run with a constant q axis current from an initial speed, with the
+// observer starting off by some angle.
+#define RUN_TIME		0.3
+#define SCORE_START		0.05
+#define WE_START		2000.0
+#define IQ_SET			20.0
+#define OBS_ANGLE_ERR	0.5
+
+#define MOTOR_VARIANTS	27
+#define GAIN_SETS		60
+#define INSTANCES		(MOTOR_VARIANTS * GAIN_SETS)
+#define BATCHES			((INSTANCES + VIRTUAL_MOTOR_BATCH_SIZE - 1) / VIRTUAL_MOTOR_BATCH_SIZE)
+
+static const float cc_bw[] = {500.0, 1000.0, 2000.0, 4000.0};
+static const float obs_mult[] = {0.25, 0.5, 1.0, 2.0, 4.0};
+static const float pll_kp[] = {1000.0, 2000.0, 4000.0};
+static const float pll_ki[] = {10000.0, 30000.0, 100000.0};
+
+typedef struct {
+	float angle_err; // RMS in degrees
+	float speed_err; // RMS in percent
+	float iq_err; // RMS in percent
+} run_result;
+
+static virtual_motor_batch m_motors[BATCHES];
+static virtual_motor_batch_ctrl m_ctrl[BATCHES];
+static run_result m_res[INSTANCES];
+static run_result m_res_threaded[INSTANCES];
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double wrap_pi(double a) {
+	return a - 2.0 * M_PI * floor((a + M_PI) / (2.0 * M_PI));
+}
+
+// Straightforward model of one motor in double precision
+typedef struct {
+	double r, ld, lq, lambda, pp, J;
+	double id, iq, we, phi;
+} ref_motor;
+
+static void ref_run(ref_motor *m, double v_alpha, double v_beta) {
+	double c = cos(m->phi), s = sin(m->phi);
+	double vd = c * v_alpha + s * v_beta;
+	double vq = c * v_beta - s * v_alpha;
+	double id = m->id, iq = m->iq;
+	m->id += (vd + m->we * m->lq * iq - m->r * id) * TS / m->ld;
+	m->iq += (vq - m->we * (m->ld * id + m->lambda) - m->r * iq) * TS / m->lq;
+	double me = 1.5 * m->pp * (m->lambda + (m->ld - m->lq) * m->id) * m->iq;
+	m->we += m->pp * TS / m->J * me;
+	m->phi = wrap_pi(m->phi + m->we * TS);
+}
+
+// Motors with different parameters pulled towards alpha from different
+// angles, against the double precision model.
+static bool test_against_reference(void) {
+	static virtual_motor_batch b;
+	const int n = 100;
+	virtual_motor_batch_init(&b, n, TS);
+
+	ref_motor ref[n];
+	float va[n], vb[n];
+
+	for (int i = 0;i < n;i++) {
+		float r = MOTOR_R * (0.5 + (float)i / (float)n);
+		float l = MOTOR_L * (1.5 - (float)i / (float)n);
+		float diff = MOTOR_L * 0.3 * (float)(i % 3);
+		virtual_motor_batch_set_motor(&b, i, r, l, diff, MOTOR_LAMBDA, MOTOR_POLES, MOTOR_J);
+		b.phi[i] = -3.0 + 6.0 * (float)i / (float)n;
+		b.sin_phi[i] = sinf(b.phi[i]);
+		b.cos_phi[i] = cosf(b.phi[i]);
+
+		ref[i] = (ref_motor){r, l - diff / 2.0, l + diff / 2.0, MOTOR_LAMBDA,
+			MOTOR_POLES / 2, MOTOR_J, 0.0, 0.0, 0.0, b.phi[i]};
+		va[i] = 0.5;
+		vb[i] = 0.0;
+	}
+
+	for (int step = 0;step < 3000;step++) {
+		virtual_motor_batch_run(&b, va, vb);
+		for (int i = 0;i < n;i++) {
+			ref_run(&ref[i], va[i], vb[i]);
+		}
+	}
+
+	bool ok = true;
+	for (int i = 0;i < n;i++) {
+		if (fabs(b.id[i] - ref[i].id) > 0.05 || fabs(b.iq[i] - ref[i].iq) > 0.05 ||
+				fabs(b.we[i] - ref[i].we) > 1.0 || fabs(wrap_pi(b.phi[i] - ref[i].phi)) > 1e-3) {
+			printf("Motor %d differs: id %.3f %.3f iq %.3f %.3f we %.2f %.2f phi %.4f %.4f\r\n",
+					i, (double)b.id[i], ref[i].id, (double)b.iq[i], ref[i].iq,
+					(double)b.we[i], ref[i].we, (double)b.phi[i], ref[i].phi);
+			ok = false;
+			break;
+		}
+	}
+
+	return ok;
+}
+
+static void gain_set(int g, float *bw, float *obs, float *kp, float *ki) {
+	*bw = cc_bw[g % 4];
+	*obs = obs_mult[(g / 4) % 5];
+	*kp = pll_kp[(g / 20) % 3];
+	*ki = pll_ki[(g / 20) % 3];
+}
+
+// Set up one batch of instances. Every gain set runs on all motor variants,
+// and the controller always uses the nominal parameters.
+static void setup_batch(int batch) {
+	virtual_motor_batch *m = &m_motors[batch];
+	virtual_motor_batch_ctrl *c = &m_ctrl[batch];
+	const int start = batch * VIRTUAL_MOTOR_BATCH_SIZE;
+	int n = INSTANCES - start;
+	if (n > VIRTUAL_MOTOR_BATCH_SIZE) {
+		n = VIRTUAL_MOTOR_BATCH_SIZE;
+	}
+
+	virtual_motor_batch_init(m, n, TS);
+	virtual_motor_batch_ctrl_init(c, n, TS);
+
+	for (int i = 0;i < n;i++) {
+		const int inst = start + i;
+		const int var = inst % MOTOR_VARIANTS;
+		const float fr = 0.8 + 0.2 * (float)(var % 3);
+		const float fl = 0.8 + 0.2 * (float)((var / 3) % 3);
+		const float fx = 0.95 + 0.05 * (float)(var / 9);
+
+		virtual_motor_batch_set_motor(m, i, MOTOR_R * fr, MOTOR_L * fl, 0.0,
+				MOTOR_LAMBDA * fx, MOTOR_POLES, MOTOR_J);
+		m->b[i] = MOTOR_B;
+		m->we[i] = WE_START;
+		m->phi[i] = 0.3;
+		m->sin_phi[i] = sinf(m->phi[i]);
+		m->cos_phi[i] = cosf(m->phi[i]);
+
+		float bw, obs, kp, ki;
+		gain_set(inst / MOTOR_VARIANTS, &bw, &obs, &kp, &ki);
+
+		c->r[i] = MOTOR_R;
+		c->l[i] = MOTOR_L;
+		c->lambda[i] = MOTOR_LAMBDA;
+		c->kp[i] = MOTOR_L * bw;
+		c->ki[i] = MOTOR_R * bw;
+		c->gamma[i] = obs * 4.0 * 1e3 / (MOTOR_LAMBDA * MOTOR_LAMBDA);
+		c->pll_kp[i] = kp;
+		c->pll_ki[i] = ki;
+		c->iq_set[i] = IQ_SET;
+		c->v_max[i] = V_BUS / sqrt(3.0) * 0.95;
+
+		c->x1[i] = MOTOR_LAMBDA * cosf(m->phi[i] + OBS_ANGLE_ERR);
+		c->x2[i] = MOTOR_LAMBDA * sinf(m->phi[i] + OBS_ANGLE_ERR);
+		c->pll_phase[i] = m->phi[i] + OBS_ANGLE_ERR;
+		c->pll_speed[i] = WE_START * 0.8;
+
+		// As in mcpwm_foc, the integrator starts at the BEMF voltage
+		c->vq_int[i] = MOTOR_LAMBDA * WE_START;
+		c->v_alpha[i] = -sinf(c->pll_phase[i]) * c->vq_int[i];
+		c->v_beta[i] = cosf(c->pll_phase[i]) * c->vq_int[i];
+	}
+}
+
+static void run_batch(int batch, run_result *res) {
+	virtual_motor_batch *m = &m_motors[batch];
+	virtual_motor_batch_ctrl *c = &m_ctrl[batch];
+	const int n = m->n;
+
+	static __thread double sum_ang[VIRTUAL_MOTOR_BATCH_SIZE];
+	static __thread double sum_speed[VIRTUAL_MOTOR_BATCH_SIZE];
+	static __thread double sum_iq[VIRTUAL_MOTOR_BATCH_SIZE];
+	memset(sum_ang, 0, sizeof(sum_ang));
+	memset(sum_speed, 0, sizeof(sum_speed));
+	memset(sum_iq, 0, sizeof(sum_iq));
+
+	const int steps = (int)(RUN_TIME / TS);
+	const int score_start = (int)(SCORE_START / TS);
+
+	for (int step = 0;step < steps;step++) {
+		virtual_motor_batch_step(m, c);
+
+		if (step >= score_start && (step % 10) == 0) {
+			for (int i = 0;i < n;i++) {
+				double ang = wrap_pi(c->phase_obs[i] - m->phi[i]);
+				sum_ang[i] += ang * ang;
+				double sp = (c->pll_speed[i] - m->we[i]) / m->we[i];
+				sum_speed[i] += sp * sp;
+				double iq = (m->iq[i] - IQ_SET) / IQ_SET;
+				sum_iq[i] += iq * iq;
+			}
+		}
+	}
+
+	const double cnt = (double)((steps - score_start) / 10);
+	for (int i = 0;i < n;i++) {
+		run_result *r = &res[batch * VIRTUAL_MOTOR_BATCH_SIZE + i];
+		r->angle_err = sqrt(sum_ang[i] / cnt) * 180.0 / M_PI;
+		r->speed_err = sqrt(sum_speed[i] / cnt) * 100.0;
+		r->iq_err = sqrt(sum_iq[i] / cnt) * 100.0;
+	}
+}
+
+typedef struct {
+	int first;
+	int step;
+	run_result *res;
+} thread_arg;
+
+static void *thread_fun(void *arg) {
+	thread_arg *a = (thread_arg*)arg;
+	for (int b = a->first;b < BATCHES;b += a->step) {
+		setup_batch(b);
+		run_batch(b, a->res);
+	}
+	return 0;
+}
+
+// Diverged runs give inf or NaN. This is built with -ffast-math, where
+// isfinite cannot be trusted, so look at the exponent bits instead.
+static float score(const run_result *r) {
+	float s = r->angle_err + r->speed_err + r->iq_err;
+	uint32_t bits;
+	memcpy(&bits, &s, sizeof(bits));
+	return ((bits >> 23) & 0xFF) == 0xFF ? 1e9 : s;
+}
+
+int main(void) {
+	bool ok = test_against_reference();
+	printf("Reference model test: %s\r\n", ok ? "OK" : "FAILED");
+
+	// One thread
+	double t = time_s();
+	for (int b = 0;b < BATCHES;b++) {
+		setup_batch(b);
+		run_batch(b, m_res);
+	}
+	double t_single = time_s() - t;
+
+	// All cores
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > BATCHES) {
+		threads = BATCHES;
+	}
+
+	pthread_t th[BATCHES];
+	thread_arg args[BATCHES];
+	t = time_s();
+	for (int i = 0;i < threads;i++) {
+		args[i] = (thread_arg){i, threads, m_res_threaded};
+		pthread_create(&th[i], 0, thread_fun, &args[i]);
+	}
+	for (int i = 0;i < threads;i++) {
+		pthread_join(th[i], 0);
+	}
+	double t_threads = time_s() - t;
+
+	if (memcmp(m_res, m_res_threaded, sizeof(m_res)) != 0) {
+		printf("Threaded results differ\r\n");
+		ok = false;
+	}
+
+	const double inst_steps = (double)INSTANCES * (RUN_TIME / TS);
+	printf("\r\n%d motors for %.2f s\r\n", INSTANCES, RUN_TIME);
+	printf("1 thread:   %.3f s, %.1f ns per motor step\r\n", t_single, t_single / inst_steps * 1e9);
+	printf("%d threads: %.3f s, %.1f ns per motor step\r\n", threads, t_threads, t_threads / inst_steps * 1e9);
+
+	// Worst case over the motor variants for every gain set
+	int order[GAIN_SETS];
+	float worst[GAIN_SETS];
+	int worst_var[GAIN_SETS];
+
+	for (int g = 0;g < GAIN_SETS;g++) {
+		worst[g] = 0.0;
+		worst_var[g] = 0;
+		for (int v = 0;v < MOTOR_VARIANTS;v++) {
+			float s = score(&m_res[g * MOTOR_VARIANTS + v]);
+			if (s > worst[g]) {
+				worst[g] = s;
+				worst_var[g] = v;
+			}
+		}
+		order[g] = g;
+	}
+
+	for (int i = 0;i < GAIN_SETS;i++) {
+		for (int j = i + 1;j < GAIN_SETS;j++) {
+			if (worst[order[j]] < worst[order[i]]) {
+				int tmp = order[i];
+				order[i] = order[j];
+				order[j] = tmp;
+			}
+		}
+	}
+
+	printf("\r\nWorst case over %d motor variants\r\n", MOTOR_VARIANTS);
+	printf("CC bw   Obs   PLL kp  PLL ki   Angle   Speed   Iq      Score\r\n");
+
+	const int default_set = 1 + 4 * 2 + 20 * 1;
+	for (int i = 0;i < GAIN_SETS;i++) {
+		int g = order[i];
+		if (i >= 5 && g != default_set && i != GAIN_SETS - 1) {
+			continue;
+		}
+
+		float bw, obs, kp, ki;
+		gain_set(g, &bw, &obs, &kp, &ki);
+		const run_result *r = &m_res[g * MOTOR_VARIANTS + worst_var[g]];
+		printf("%-7.0f %-5.2f %-7.0f %-8.0f %-7.2f %-7.2f %-7.2f %-7.2f%s\r\n",
+				(double)bw, (double)obs, (double)kp, (double)ki, (double)r->angle_err,
+				(double)r->speed_err, (double)r->iq_err, (double)worst[g],
+				g == default_set ? "  (default)" : "");
+	}
+
+	if (worst[order[0]] >= 1e9 || worst[order[0]] > worst[default_set]) {
+		printf("No robust gain set found\r\n");
+		ok = false;
+	}
+
+	printf("\r\nResult: %s\r\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -22,10 +22,20 @@
 
 #include <stdint.h>
 
+/*
+ * Number of bytes the software CRCs process per table lookup round. 1 uses one
+ * 256-entry table per CRC (1.5 KB flash), 4 and 8 use 4x and 8x that but are
+ * considerably faster.
+ */
+#ifndef CRC_SLICE_BY
+#define CRC_SLICE_BY		4
+#endif
+
 /*
  * Functions
  */
 unsigned short crc16(unsigned char *buf, unsigned int len);
+unsigned short crc16_with_init(const uint8_t *buf, uint32_t len, unsigned short cksum);
 uint32_t crc32(uint32_t *buf, uint32_t len);
 void crc32_reset(void);
 uint32_t crc32_with_init(const uint8_t *buf, uint32_t len, uint32_t cksum);
@@ -0,0 +1,175 @@
+/*
+	Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "delta_patch.h"
+#include "buffer.h"
+
+#include <string.h>
+
+// Output is collected in a buffer of this size before being written, so that
+// flash writes are not done byte by byte.
+#define OUT_BUFFER_SIZE			256
+
+void delta_patch_init(delta_patch_state *s, const uint8_t *src, uint32_t src_len, uint32_t out_size) {
+	s->src = src;
+	s->src_len = src_len;
+	s->skip_start = 0;
+	s->skip_end = 0;
+	s->out_pos = 0;
+	s->out_size = out_size;
+}
+
+/**
+ * Exclude a part of the source. Copy and add operations that read any byte
+ * of it fail with DELTA_PATCH_ERR_SRC_RANGE.
+ *
+ * @param s
+ * Patch state, initialized with delta_patch_init.
+ *
+ * @param start
+ * Offset of the excluded part in the source.
+ *
+ * @param len
+ * Length of the excluded part.
+ */
+void delta_patch_exclude(delta_patch_state *s, uint32_t start, uint32_t len) {
+	s->skip_start = start;
+	s->skip_end = start + len;
+}
+
+/**
+ * Apply a number of patch operations and write the result.
+ *
+ * @param s
+ * Patch state, initialized with delta_patch_init.
+ *
+ * @param ops
+ * Complete operations, see delta_patch.h for the format.
+ *
+ * @param len
+ * Length of ops in bytes.
+ *
+ * @param write
+ * Called with consecutive pieces of output and their offset in the output
+ * image. Should return false on failure.
+ *
+ * @return
+ * DELTA_PATCH_OK on success or one of the DELTA_PATCH_ERR codes. On failure
+ * s->out_pos is left at the start of the output of this call, so that the
+ * same operations can be applied again.
+ */
+int delta_patch_apply(delta_patch_state *s, const uint8_t *ops, uint32_t len, delta_patch_write_func write) {
+	uint8_t out[OUT_BUFFER_SIZE];
+	uint32_t out_len = 0;
+	uint32_t out_start = s->out_pos;
+	uint32_t pos = s->out_pos;
+	int32_t ind = 0;
+	int res = DELTA_PATCH_OK;
+
+	while ((uint32_t)ind < len) {
+		uint8_t op = ops[ind++];
+		uint32_t src_ofs = 0;
+		uint32_t op_len = 0;
+		const uint8_t *op_data = 0;
+
+		if (op == DELTA_OP_COPY || op == DELTA_OP_ADD) {
+			if ((uint32_t)ind + 6 > len) {
+				res = DELTA_PATCH_ERR_FORMAT;
+				break;
+			}
+
+			src_ofs = buffer_get_uint32(ops, &ind);
+			op_len = buffer_get_uint16(ops, &ind);
+
+			if (src_ofs > s->src_len || op_len > (s->src_len - src_ofs)) {
+				res = DELTA_PATCH_ERR_SRC_RANGE;
+				break;
+			}
+
+			if (op_len > 0 && src_ofs < s->skip_end && (src_ofs + op_len) > s->skip_start) {
+				res = DELTA_PATCH_ERR_SRC_RANGE;
+				break;
+			}
+		} else if (op == DELTA_OP_DATA) {
+			if ((uint32_t)ind + 2 > len) {
+				res = DELTA_PATCH_ERR_FORMAT;
+				break;
+			}
+
+			op_len = buffer_get_uint16(ops, &ind);
+		} else {
+			res = DELTA_PATCH_ERR_FORMAT;
+			break;
+		}
+
+		if (op != DELTA_OP_COPY) {
+			if ((uint32_t)ind + op_len > len) {
+				res = DELTA_PATCH_ERR_FORMAT;
+				break;
+			}
+
+			op_data = ops + ind;
+			ind += op_len;
+		}
+
+		if (op_len > (s->out_size - pos - out_len)) {
+			res = DELTA_PATCH_ERR_OUT_RANGE;
+			break;
+		}
+
+		for (uint32_t i = 0;i < op_len;i++) {
+			uint8_t b;
+			if (op == DELTA_OP_COPY) {
+				b = s->src[src_ofs + i];
+			} else if (op == DELTA_OP_ADD) {
+				b = s->src[src_ofs + i] + op_data[i];
+			} else {
+				b = op_data[i];
+			}
+
+			out[out_len++] = b;
+
+			if (out_len == OUT_BUFFER_SIZE) {
+				if (!write(pos, out, out_len)) {
+					res = DELTA_PATCH_ERR_WRITE;
+					break;
+				}
+
+				pos += out_len;
+				out_len = 0;
+			}
+		}
+
+		if (res != DELTA_PATCH_OK) {
+			break;
+		}
+	}
+
+	if (res == DELTA_PATCH_OK && out_len > 0) {
+		if (write(pos, out, out_len)) {
+			pos += out_len;
+		} else {
+			res = DELTA_PATCH_ERR_WRITE;
+		}
+	}
+
+	s->out_pos = res == DELTA_PATCH_OK ? pos : out_start;
+
+	return res;
+}
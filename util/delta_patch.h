@@ -0,0 +1,67 @@
+/*
+	Copyright 2016 - 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef DELTA_PATCH_H_
+#define DELTA_PATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A patch is a sequence of operations that produce the output image from
+ * start to end. Operations never span two calls to delta_patch_apply, so
+ * every packet can be applied on its own. All values are big endian.
+ *
+ * DELTA_OP_COPY: src_ofs (u32), len (u16)
+ *   Copy len bytes from the source image.
+ * DELTA_OP_ADD:  src_ofs (u32), len (u16), len bytes
+ *   Copy len bytes from the source image and add the given bytes to them
+ *   (modulo 256). Good for code that moved and had addresses changed.
+ * DELTA_OP_DATA: len (u16), len bytes
+ *   Insert new data.
+ */
+#define DELTA_OP_COPY				0
+#define DELTA_OP_ADD				1
+#define DELTA_OP_DATA				2
+
+// Return values
+#define DELTA_PATCH_OK				0
+#define DELTA_PATCH_ERR_FORMAT		-1
+#define DELTA_PATCH_ERR_SRC_RANGE	-2
+#define DELTA_PATCH_ERR_OUT_RANGE	-3
+#define DELTA_PATCH_ERR_WRITE		-4
+
+typedef struct {
+	const uint8_t *src;
+	uint32_t src_len;
+	// Part of the source that operations may not read from
+	uint32_t skip_start;
+	uint32_t skip_end;
+	uint32_t out_pos;
+	uint32_t out_size;
+} delta_patch_state;
+
+typedef bool (*delta_patch_write_func)(uint32_t offset, uint8_t *data, uint32_t len);
+
+// Functions
+void delta_patch_init(delta_patch_state *s, const uint8_t *src, uint32_t src_len, uint32_t out_size);
+void delta_patch_exclude(delta_patch_state *s, uint32_t start, uint32_t len);
+int delta_patch_apply(delta_patch_state *s, const uint8_t *ops, uint32_t len, delta_patch_write_func write);
+
+#endif /* DELTA_PATCH_H_ */
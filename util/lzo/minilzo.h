@@ -72,8 +72,16 @@ extern "C" {
  * When the required size is 0, you can also pass a NULL pointer.
  */
 
+/* VESC: The compressor dictionary has 2^MINILZO_CFG_D_BITS entries. The
+ * upstream value of 14 needs too much RAM, 10 bits compresses packet-sized
+ * buffers almost as well. The output is standard LZO1X either way.
+ */
+#ifndef MINILZO_CFG_D_BITS
+#define MINILZO_CFG_D_BITS      10
+#endif
+
 #define LZO1X_MEM_COMPRESS      LZO1X_1_MEM_COMPRESS
-#define LZO1X_1_MEM_COMPRESS    ((lzo_uint32_t) (16384L * lzo_sizeof_dict_t))
+#define LZO1X_1_MEM_COMPRESS    ((lzo_uint32_t) ((1L << MINILZO_CFG_D_BITS) * lzo_sizeof_dict_t))
 #define LZO1X_MEM_DECOMPRESS    (0)
 
 
@@ -19,6 +19,7 @@
 
 #include "mempools.h"
 #include "packet.h"
+#include "minilzo.h"
 
 // Private types
 typedef struct {
@@ -31,9 +32,15 @@ typedef struct {
 	app_configuration conf;
 } appconf_container_t;
 
+typedef struct {
+	volatile bool is_taken;
+	mc_local_configuration conf;
+} mc_local_container_t;
+
 // Private variables
 static mcconf_container_t m_mc_confs[MEMPOOLS_MCCONF_NUM] = {{0}};
 static appconf_container_t m_app_confs[MEMPOOLS_APPCONF_NUM] = {{0}};
+static mc_local_container_t m_mc_locals[MEMPOOLS_MC_LOCAL_NUM] = {{0}};
 static int m_mcconf_highest = 0;
 static int m_appconf_highest = 0;
 
@@ -42,9 +49,16 @@ static uint8_t lbm_packet_buffer[PACKET_MAX_PL_LEN];
 static mutex_t packet_buffer_mutex;
 static mutex_t lbm_packet_buffer_mutex;
 
+// Work memory and output buffer for LZO compression. The output buffer has room
+// for the worst case expansion of a full packet plus a small header.
+static lzo_align_t lzo_work_mem[(LZO1X_1_MEM_COMPRESS + sizeof(lzo_align_t) - 1) / sizeof(lzo_align_t)];
+static uint8_t lzo_out_buffer[PACKET_MAX_PL_LEN + PACKET_MAX_PL_LEN / 16 + 64 + 3 + 8];
+static mutex_t lzo_mutex;
+
 void mempools_init(void) {
 	chMtxObjectInit(&packet_buffer_mutex);
 	chMtxObjectInit(&lbm_packet_buffer_mutex);
+	chMtxObjectInit(&lzo_mutex);
 }
 
 mc_configuration *mempools_alloc_mcconf(void) {
@@ -97,6 +111,26 @@ void mempools_free_appconf(app_configuration *conf) {
 	}
 }
 
+mc_local_configuration *mempools_alloc_mc_local(void) {
+	for (int i = 0;i < MEMPOOLS_MC_LOCAL_NUM;i++) {
+		if (!m_mc_locals[i].is_taken) {
+			m_mc_locals[i].is_taken = true;
+			return &m_mc_locals[i].conf;
+		}
+	}
+
+	return 0;
+}
+
+void mempools_free_mc_local(mc_local_configuration *conf) {
+	for (int i = 0;i < MEMPOOLS_MC_LOCAL_NUM;i++) {
+		if (&m_mc_locals[i].conf == conf) {
+			m_mc_locals[i].is_taken = false;
+			return;
+		}
+	}
+}
+
 int mempools_mcconf_highest(void) {
 	return m_mcconf_highest;
 }
@@ -142,3 +176,29 @@ void mempools_free_packet_buffer(uint8_t *buffer) {
 		chMtxUnlock(&lbm_packet_buffer_mutex);
 	}
 }
+
+/**
+ * Get the LZO compression work memory. Blocks until it is available and must be
+ * returned with mempools_free_lzo_work_mem.
+ *
+ * @param out_buffer
+ * Set to a buffer that can hold the compressed output of a full packet.
+ *
+ * @param out_buffer_len
+ * Set to the length of out_buffer.
+ *
+ * @return
+ * The work memory, LZO1X_1_MEM_COMPRESS bytes.
+ */
+void *mempools_get_lzo_work_mem(uint8_t **out_buffer, unsigned int *out_buffer_len) {
+	chMtxLock(&lzo_mutex);
+	*out_buffer = lzo_out_buffer;
+	*out_buffer_len = sizeof(lzo_out_buffer);
+	return lzo_work_mem;
+}
+
+void mempools_free_lzo_work_mem(void *wrkmem) {
+	if (wrkmem == lzo_work_mem) {
+		chMtxUnlock(&lzo_mutex);
+	}
+}
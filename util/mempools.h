@@ -25,6 +25,7 @@
 // Settings
 #define MEMPOOLS_MCCONF_NUM				10
 #define MEMPOOLS_APPCONF_NUM			3
+#define MEMPOOLS_MC_LOCAL_NUM			2
 
 // Functions
 void mempools_init(void);
@@ -35,6 +36,9 @@ void mempools_free_mcconf(mc_configuration *conf);
 app_configuration *mempools_alloc_appconf(void);
 void mempools_free_appconf(app_configuration *conf);
 
+mc_local_configuration *mempools_alloc_mc_local(void);
+void mempools_free_mc_local(mc_local_configuration *conf);
+
 int mempools_mcconf_highest(void);
 int mempools_appconf_highest(void);
 
@@ -45,4 +49,7 @@ uint8_t *mempools_get_packet_buffer(void);
 uint8_t *mempools_get_lbm_packet_buffer(void);
 void mempools_free_packet_buffer(uint8_t *buffer);
 
+void *mempools_get_lzo_work_mem(uint8_t **out_buffer, unsigned int *out_buffer_len);
+void mempools_free_lzo_work_mem(void *wrkmem);
+
 #endif /* MEMPOOLS_H_ */
@@ -1,6 +1,7 @@
 CSRC += \
 	util/buffer.c \
 	util/crc.c \
+	util/delta_patch.c \
 	util/digital_filter.c \
 	util/mempools.c \
 	util/utils_math.c \